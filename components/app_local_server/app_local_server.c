@@ -6,35 +6,227 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
+#include <stdlib.h>
 #include <stdio.h>
+#include <stdatomic.h>
+#include <ctype.h>
 #include <sys/param.h>
 #include "esp_http_server.h"
 #include "esp_event.h"
+#include "esp_netif.h"
 #include "esp_log.h"
 #include "esp_mac.h"
 #include "esp_timer.h"
 #include "lwip/inet.h"
+#include "lwip/sockets.h"
 #include "esp_ota_ops.h"
-#include <cJSON.h>
+#include "esp_system.h"
+#include "esp_random.h"
+#include "esp_heap_caps.h"
+#include "esp_rom_crc.h"
+#include "mbedtls/sha256.h"
 #include "nvs_storage.h"
 #include "spiffs_storage.h"
 #include "app_local_server.h"
 #include "dns_server.h"
 #include "rfid_manager.h"
+#include "sse_events.h"
+#include "data_keys.h"
+#include "json_scan.h"
+#include "req_body.h"
+#include "ota_pipeline.h"
+#include "multipart_parser.h"
+#include "ota_decoder.h"
+#include "metrics.h"
+#include "rate_limit.h"
+#include "captive_probe.h"
+#include "http_workers.h"
+#include "uri_template.h"
+#include "asset_pack.h"
+#include "http_range.h"
+#include "conn_budget.h"
+#if CONFIG_APP_LOCAL_SERVER_HTTPS
+#include "esp_https_server.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/ssl_cache.h"
+#include "mbedtls/platform_util.h"
+#include "session_cache.h"
+#endif
 
 #define URI_HANDLER_MARGIN (1u) // Margin for the URI Handlers
 #define URI_HANDLERS_COUNT (sizeof(uri_handlers) / sizeof(uri_handlers[0]))
 
-#define HTTP_SERVER_MAX_URI_HANDLERS (20u)
+// CONFIG_LWIP_MAX_SOCKETS split between the subsystems, see http_server_socket_reservations
+#ifdef CONFIG_LWIP_MAX_SOCKETS
+#define HTTP_SERVER_SOCKET_POOL (CONFIG_LWIP_MAX_SOCKETS)
+#else
+#define HTTP_SERVER_SOCKET_POOL (16u) // Host builds without lwIP get the device's pool
+#endif
+#if CONFIG_APP_LOCAL_SERVER_DNS_FORWARD
+#define HTTP_SERVER_DNS_SOCKETS (2u) // Client socket and the one to the upstream resolver
+#else
+#define HTTP_SERVER_DNS_SOCKETS (1u)
+#endif
+// Listen and control sockets, and the one a new connection is accepted into
+// before the server (or the admission check) closes one
+#define HTTP_SERVER_LISTENER_SOCKETS (3u)
+#if CONFIG_APP_LOCAL_SERVER_HTTPS
+#define HTTP_SERVER_HTTPS_SOCKETS (HTTP_SERVER_LISTENER_SOCKETS + CONFIG_APP_LOCAL_SERVER_HTTPS_MAX_SOCKETS)
+#define HTTP_SERVER_HTTPS_CTRL_PORT (ESP_HTTPD_DEF_CTRL_PORT + 1) // Each server needs its own
+#else
+#define HTTP_SERVER_HTTPS_SOCKETS (0u)
+#endif
+// Client connections of the plain server, managed by conn_budget.h
+#define HTTP_SERVER_CLIENT_SOCKETS \
+    (HTTP_SERVER_SOCKET_POOL - HTTP_SERVER_DNS_SOCKETS - HTTP_SERVER_LISTENER_SOCKETS - HTTP_SERVER_HTTPS_SOCKETS)
+// esp_http_server's own limit includes the admission slot, it only purges if an eviction is still pending
+#define HTTP_SERVER_MAX_OPEN_SOCKETS (HTTP_SERVER_CLIENT_SOCKETS + 1u)
+#define HTTP_SERVER_ADMIN_HOLD_US (10 * 60 * 1000000LL) // Administration session outlives its last request this long
 #define HTTP_SERVER_RECEIVE_WAIT_TIMEOUT (10u) // in seconds
 #define HTTP_SERVER_SEND_WAIT_TIMEOUT (10u)    // in seconds
 #define HTTP_SERVER_MONITOR_QUEUE_LEN (3u)
 #define HTTP_SERVER_BUFFER_SIZE (3 * 1024) // 3KB buffer size
+#define HTTP_SERVER_BODY_MAX_SIZE (2 * 1024) // Largest accepted API request body
+#define HTTP_SERVER_BODY_ARENA_SIZE (HTTP_SERVER_BODY_MAX_SIZE + 1)
+#define HTTP_SERVER_TASK_BUFFER_SIZE MAX(HTTP_SERVER_BODY_ARENA_SIZE, HTTP_SERVER_BUFFER_SIZE) // Body or card list copy
+#define HTTP_SERVER_JSON_MAX_TOKENS (16u)  // Tokens for small request bodies
+#define HTTP_SERVER_CONTENT_TYPE_MAX_LEN (128u)
+#define HTTP_SERVER_OTA_TASK_STACK_SIZE (6 * 1024)
+#define HTTP_SERVER_OTA_TASK_PRIORITY (5u)
+#define HTTP_SERVER_WORKER_STACK_SIZE (6 * 1024)
+#define HTTP_SERVER_WORKER_PRIORITY (5u) // Same as the server task
+#define HTTP_SERVER_OTA_RECV_SIZE (2 * 1024) // Receive buffer of the upload task
+#define HTTP_SERVER_SHA256_LEN (32u)
+#define HTTP_SERVER_SHA256_HEX_LEN (2 * HTTP_SERVER_SHA256_LEN)
+#define HTTP_SERVER_ETAG_LEN (24u)             // "bbbbbbbb-vvvvvvvvvv" with quotes
+#define HTTP_SERVER_IF_NONE_MATCH_LEN (128u)   // Longer lists of tags are treated as no match
+#define HTTP_SERVER_CARD_COUNT_BODY_SIZE (32u)
+#define HTTP_SERVER_WILDCARD_URI_LEN (32u)    // esp_http_server pattern of a URI template
+#define HTTP_SERVER_CARD_JSON_SIZE (128u)
+#define HTTP_SERVER_REMOVE_QUERY_LEN (64u) // ?id=4294967295 and a cache buster
+#define HTTP_SERVER_CARD_ID_LEN (11u)      // Up to 10 digits
+#define HTTP_SERVER_PORTAL_URL_LEN (24u)      // "http://255.255.255.255/"
+#define HTTP_SERVER_ASSET_CHUNK_SIZE (4 * 1024) // Sent per httpd_resp_send_chunk from mapped flash
+#define HTTP_SERVER_ASSET_ETAG_LEN (12u)        // "cccccccc" with quotes
+#define HTTP_SERVER_ACCEPT_ENCODING_LEN (64u)
+#define HTTP_SERVER_CONTENT_RANGE_LEN (40u)     // "bytes 4294967295-4294967295/4294967295"
+#define HTTP_SERVER_EMBEDDED_FILES (8u)         // EMBED_FILES of the component
+#define HTTP_SERVER_ASSET_PARTITION "assets"
+
+#define HTTP_SERVER_FIRMWARE_VERSION "V1.0.0"
 
 #define OTA_UPDATE_PENDING (0)
 #define OTA_UPDATE_SUCCESSFUL (1)
 #define OTA_UPDATE_FAILED (-1)
 
+typedef enum
+{
+    HTTP_SERVER_OTA_DIGEST_NONE = 0, // No X-OTA-SHA256 header sent
+    HTTP_SERVER_OTA_DIGEST_PENDING,  // Upload still running
+    HTTP_SERVER_OTA_DIGEST_VERIFIED,
+    HTTP_SERVER_OTA_DIGEST_MISMATCH,
+} http_server_ota_digest_e;
+
+// State of a firmware upload shared with the multipart parser callback
+typedef struct
+{
+    char *block;      // Pipeline block being filled, NULL if none
+    size_t block_len;
+    size_t filled;
+    size_t image_len; // Decoded bytes handed to the pipeline
+    ota_decoder_t *decoder;
+    esp_ota_handle_t ota_handle;
+    mbedtls_sha256_context sha256; // Of the uploaded file, updated as it arrives
+    uint8_t expected_sha256[HTTP_SERVER_SHA256_LEN];
+    bool has_expected_sha256;
+} http_server_ota_upload_t;
+
+// Card check outcomes as reported to http_server_card_check_cb
+typedef enum
+{
+    HTTP_SERVER_CARD_GRANTED = 0,
+    HTTP_SERVER_CARD_UNKNOWN,
+    HTTP_SERVER_CARD_INACTIVE,
+    HTTP_SERVER_CARD_ERROR,
+    HTTP_SERVER_CARD_OUTCOME_COUNT,
+} http_server_card_outcome_e;
+
+// How a connectivity probe was answered
+typedef enum
+{
+    HTTP_SERVER_PROBE_PORTAL = 0, // Redirected, the OS opens the sign-in window
+    HTTP_SERVER_PROBE_ONLINE,     // Expected answer, the OS reports internet access
+    HTTP_SERVER_PROBE_ANSWER_COUNT,
+} http_server_probe_answer_e;
+
+// Where a web UI file was sent from
+typedef enum
+{
+    HTTP_SERVER_ASSET_PACK = 0, // The asset partition, see asset_pack.h
+    HTTP_SERVER_ASSET_EMBEDDED, // The copy built into the firmware
+    HTTP_SERVER_ASSET_SOURCE_COUNT,
+} http_server_asset_source_e;
+
+// Who holds which part of CONFIG_LWIP_MAX_SOCKETS, exported on /metrics
+typedef struct
+{
+    const char *subsystem;
+    uint32_t sockets;
+} http_server_socket_reservation_t;
+
+// How a URI is dispatched, the user_ctx of a uri_handlers entry (NULL for the defaults)
+typedef struct
+{
+    rate_limit_t *limit; // Per client limit checked before the handler, or NULL
+    bool worker;         // Run on the worker pool instead of the server task
+} http_server_route_opts_t;
+
+// A registered URI handler and what is measured about it
+typedef struct
+{
+    esp_err_t (*handler)(httpd_req_t *req);
+    const char *uri_template; // uri_template.h pattern with parameters, NULL for plain URIs
+    rate_limit_t *limit;      // Per client limit checked before the handler, or NULL
+    bool worker;              // Handed to the worker pool, see http_workers.h
+    bool admin;               // Changes cards, firmware or web files, see APP_LOCAL_SERVER_HTTPS_ADMIN_ONLY
+    metrics_histogram_t latency; // Handler run time, on a worker without the queue wait
+    metrics_counter_t errors;    // Handler returned something else than ESP_OK
+    metrics_counter_t limited;   // Refused with 429 by the rate limit
+    metrics_counter_t busy;      // Refused with 503, the worker queue was full
+} http_server_route_t;
+
+// A response built from the RFID database, valid while rfid_manager_get_version()
+// still returns version. The shared ones are guarded by http_server_cards_lock.
+typedef struct
+{
+    uint32_t version;
+    size_t len;  // 0 while nothing is cached
+    size_t size; // Capacity of body
+    char *body;
+} http_server_cards_cache_t;
+
+// Progress of the current (or last) firmware upload. Written by the upload and
+// flash writer tasks, read by /OTAstatus on the server tasks.
+typedef struct
+{
+    atomic_bool active;
+    atomic_uint total;      // Request body length
+    atomic_uint received;   // Request body bytes received
+    atomic_uint written;    // Image bytes written to flash
+    atomic_uint start_ms;
+    atomic_uint end_ms;     // 0 while the upload is running
+    atomic_int digest;      // http_server_ota_digest_e
+} http_server_ota_progress_t;
+
+// Buffers of one server task. Its handlers run one at a time, the plain and
+// the HTTPS server run side by side and have one each.
+typedef struct
+{
+    char buffer[HTTP_SERVER_TASK_BUFFER_SIZE]; // Request body, or the card list copied out of its cache
+    char response[HTTP_SERVER_BUFFER_SIZE];    // /getData response
+    metrics_writer_t metrics;                  // /metrics output
+} http_server_task_state_t;
+
 // GLOBAL VARIABLES
 static const char *TAG = "app_local_server";
 //  Embedded Files: JQuery, index.html, app.css, app.js, and favicon.ico files
@@ -58,13 +250,68 @@ extern const char rfid_js_start[] asm("_binary_rfid_js_start");
 extern const char rfid_js_end[] asm("_binary_rfid_js_end");
 
 static httpd_handle_t http_server_handle = NULL;
+#if CONFIG_APP_LOCAL_SERVER_HTTPS
+static httpd_handle_t http_server_https_handle = NULL;
+extern const char servercert_pem_start[] asm("_binary_servercert_pem_start");
+extern const char servercert_pem_end[] asm("_binary_servercert_pem_end");
+extern const char prvtkey_pem_start[] asm("_binary_prvtkey_pem_start");
+extern const char prvtkey_pem_end[] asm("_binary_prvtkey_pem_end");
+#endif
 // Queue Handle used to manipulate the main queue of events
 static QueueHandle_t http_server_monitor_q_handle;
 // Firmware Update Status
 static int fw_update_status = OTA_UPDATE_PENDING;
+static http_server_ota_progress_t http_server_ota_progress = {0};
+static metrics_counter_t http_server_card_checks[HTTP_SERVER_CARD_OUTCOME_COUNT] = {0};
+static const char *const http_server_card_outcome_names[HTTP_SERVER_CARD_OUTCOME_COUNT] = {
+    "granted", "unknown", "inactive", "error"};
+static metrics_counter_t http_server_redirects = {0};
+static metrics_counter_t http_server_probe_answers[CAPTIVE_PROBE_OS_COUNT][HTTP_SERVER_PROBE_ANSWER_COUNT] = {0};
+static const char *const http_server_probe_answer_names[HTTP_SERVER_PROBE_ANSWER_COUNT] = {"portal", "online"};
+static metrics_counter_t http_server_assets_served[HTTP_SERVER_ASSET_SOURCE_COUNT] = {0};
+static const char *const http_server_asset_source_names[HTTP_SERVER_ASSET_SOURCE_COUNT] = {"pack", "embedded"};
+static const char *const http_server_conn_class_names[CONN_BUDGET_CLASS_COUNT] = {"portal", "admin"};
+static const char *const http_server_conn_reason_names[CONN_BUDGET_REASON_COUNT] = {"pool", "client"};
+// Time from a client getting its address to reaching each captive_probe_stage_e
+static metrics_summary_t http_server_join_to_stage[CAPTIVE_PROBE_STAGE_COUNT] = {0};
+// Every card check takes the RFID database mutex, one client must not starve the readers
+static rate_limit_t http_server_card_check_limit;
+static rate_limit_t http_server_card_write_limit;
+// rate_limit has no locking of its own, both server tasks take tokens
+static SemaphoreHandle_t http_server_limit_lock = NULL;
 // Local Time Status
 static bool g_is_local_time_set = false;
-static char http_server_buffer[HTTP_SERVER_BUFFER_SIZE] = {0};
+static http_server_task_state_t http_server_task_state;
+#if CONFIG_APP_LOCAL_SERVER_HTTPS
+static http_server_task_state_t http_server_https_task_state;
+#endif
+// Last /cards/get and /cards/count bodies, repeated polls are answered from here
+static char http_server_cards_list_body[HTTP_SERVER_BUFFER_SIZE] = {0};
+static char http_server_cards_count_body[HTTP_SERVER_CARD_COUNT_BODY_SIZE] = {0};
+static http_server_cards_cache_t http_server_cards_list_cache = {
+    .size = sizeof(http_server_cards_list_body), .body = http_server_cards_list_body};
+static http_server_cards_cache_t http_server_cards_count_cache = {
+    .size = sizeof(http_server_cards_count_body), .body = http_server_cards_count_body};
+// Part of every ETag, the database version restarts at 1 on each boot
+static uint32_t http_server_boot_id = 0;
+// Both card caches, held to check, rebuild or copy one out, never while sending
+static SemaphoreHandle_t http_server_cards_lock = NULL;
+// Memo of http_server_embedded_crc, filled by the static handlers of both servers
+static SemaphoreHandle_t http_server_crc_lock = NULL;
+// Admission control of the plain server's connections, off if conn_budget_init failed
+static bool http_server_conn_budget_ready = false;
+
+_Static_assert(HTTP_SERVER_CLIENT_SOCKETS > CONFIG_APP_LOCAL_SERVER_ADMIN_RESERVED_CONNS &&
+                   HTTP_SERVER_CLIENT_SOCKETS <= CONN_BUDGET_MAX_CONNS,
+               "CONFIG_LWIP_MAX_SOCKETS leaves no connections for the portal");
+
+static const http_server_socket_reservation_t http_server_socket_reservations[] = {
+    {"dns", HTTP_SERVER_DNS_SOCKETS},
+    {"http_listener", HTTP_SERVER_LISTENER_SOCKETS},
+    {"https", HTTP_SERVER_HTTPS_SOCKETS},
+    {"http_admin", CONFIG_APP_LOCAL_SERVER_ADMIN_RESERVED_CONNS},
+    {"http_portal", HTTP_SERVER_CLIENT_SOCKETS - CONFIG_APP_LOCAL_SERVER_ADMIN_RESERVED_CONNS},
+};
 
 // ESP32 Timer Configuration Passed to esp_timer_create
 static const esp_timer_create_args_t fw_update_reset_args =
@@ -81,6 +328,11 @@ static http_server_wifi_connect_status_e g_wifi_connect_status = HTTP_WIFI_STATU
 static BaseType_t http_server_monitor_send_msg(http_server_msg_e msg_id);
 static void http_server_monitor(void);
 static void start_webserver(void);
+#if CONFIG_APP_LOCAL_SERVER_HTTPS
+static void start_https_server(void);
+#endif
+static esp_err_t http_server_route_dispatch(httpd_req_t *req);
+static esp_err_t http_server_send_json_error(httpd_req_t *req, const char *status, const char *message);
 static void http_server_fw_update_reset_timer(void);
 static esp_err_t http_server_j_query_handler(httpd_req_t *req);
 static esp_err_t http_server_index_html_handler(httpd_req_t *req);
@@ -98,7 +350,7 @@ static esp_err_t http_server_get_sensor_data_handler(httpd_req_t *req);
 static esp_err_t http_server_get_data_handler(httpd_req_t *req);
 static int16_t get_humidity(void);
 static int16_t get_temperature(void);
-bool get_data_rsp_string(char *key, char *buffer, uint16_t len);
+static void http_server_register_data_keys(void);
 static esp_err_t http_server_wifi_connect_handler(httpd_req_t *req);
 static esp_err_t http_server_rfid_manager_list_cards_handler(httpd_req_t *req);
 static esp_err_t http_server_rfid_manager_add_card_handler(httpd_req_t *req);
@@ -110,7 +362,26 @@ static esp_err_t http_server_rfid_manager_get_default_cards_handler(httpd_req_t
 static esp_err_t http_server_rfid_html_handler(httpd_req_t *req);
 static esp_err_t http_server_rfid_css_handler(httpd_req_t *req);
 static esp_err_t http_server_rfid_js_handler(httpd_req_t *req);
-
+static void http_server_card_check_cb(uint32_t card_id, esp_err_t result);
+static esp_err_t http_server_metrics_handler(httpd_req_t *req);
+static esp_err_t http_server_captive_probe_handler(httpd_req_t *req);
+static esp_err_t http_server_captive_accept_handler(httpd_req_t *req);
+static esp_err_t http_server_card_get_handler(httpd_req_t *req);
+static esp_err_t http_server_card_delete_handler(httpd_req_t *req);
+static esp_err_t http_server_card_patch_handler(httpd_req_t *req);
+static esp_err_t http_server_asset_update_handler(httpd_req_t *req);
+static esp_err_t http_server_events_handler(httpd_req_t *req);
+static void http_server_ap_client_joined(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data);
+
+static const http_server_route_opts_t http_server_card_check_opts = {
+    .limit = &http_server_card_check_limit};
+// Card changes write SPIFFS, which takes long enough to stall every other client
+static const http_server_route_opts_t http_server_card_write_opts = {
+    .limit = &http_server_card_write_limit, .worker = true};
+static const http_server_route_opts_t http_server_worker_opts = {
+    .worker = true};
+
+// user_ctx of an entry is its http_server_route_opts_t, or NULL
 static const httpd_uri_t uri_handlers[] = {
     {"/jquery-3.3.1.min.js", HTTP_GET, http_server_j_query_handler, NULL},
     {"/", HTTP_GET, http_server_index_html_handler, NULL},
@@ -125,21 +396,47 @@ static const httpd_uri_t uri_handlers[] = {
     {"/getData", HTTP_POST, http_server_get_data_handler, NULL},
     {"/wifiConnect", HTTP_POST, http_server_wifi_connect_handler, NULL},
     // RFID Manager Handlers
-    {"/cards/get", HTTP_GET, http_server_rfid_manager_list_cards_handler, NULL},
+    {"/cards/get", HTTP_GET, http_server_rfid_manager_list_cards_handler, (void *)&http_server_worker_opts},
     {"/cards/defaults", HTTP_GET, http_server_rfid_manager_get_default_cards_handler, NULL},
-    {"/cards/add", HTTP_POST, http_server_rfid_manager_add_card_handler, NULL},
-    {"/cards/remove", HTTP_DELETE, http_server_rfid_manager_remove_card_handler, NULL},
+    {"/cards/add", HTTP_POST, http_server_rfid_manager_add_card_handler, (void *)&http_server_card_write_opts},
+    {"/cards/remove", HTTP_DELETE, http_server_rfid_manager_remove_card_handler, (void *)&http_server_card_write_opts},
     {"/cards/count", HTTP_GET, http_server_rfid_manager_get_card_count_handler, NULL},
-    {"/cards/check", HTTP_GET, http_server_rfid_manager_check_card_handler, NULL},
-    {"/cards/reset", HTTP_POST, http_server_rfid_manager_reset_cards_handler, NULL},
+    {"/cards/check", HTTP_GET, http_server_rfid_manager_check_card_handler, (void *)&http_server_card_check_opts},
+    {"/cards/reset", HTTP_POST, http_server_rfid_manager_reset_cards_handler, (void *)&http_server_card_write_opts},
+    // A single card, after the fixed /cards/... URIs so those match first
+    {"/cards/{id:u32}", HTTP_GET, http_server_card_get_handler, NULL},
+    {"/cards/{id:u32}", HTTP_DELETE, http_server_card_delete_handler, (void *)&http_server_card_write_opts},
+    {"/cards/{id:u32}", HTTP_PATCH, http_server_card_patch_handler, (void *)&http_server_card_write_opts},
     // RFID Web Interface Files
     {"/rfid.html", HTTP_GET, http_server_rfid_html_handler, NULL},
     {"/rfid", HTTP_GET, http_server_rfid_html_handler, NULL},
     {"/rfid.css", HTTP_GET, http_server_rfid_css_handler, NULL},
     {"/rfid.js", HTTP_GET, http_server_rfid_js_handler, NULL},
-
+    // HEAD of the static files and card lists: the headers of the GET, no body
+    {"/jquery-3.3.1.min.js", HTTP_HEAD, http_server_j_query_handler, NULL},
+    {"/", HTTP_HEAD, http_server_index_html_handler, NULL},
+    {"/app.css", HTTP_HEAD, http_server_app_css_handler, NULL},
+    {"/app.js", HTTP_HEAD, http_server_app_js_handler, NULL},
+    {"/favicon.ico", HTTP_HEAD, http_server_favicon_handler, NULL},
+    {"/rfid.html", HTTP_HEAD, http_server_rfid_html_handler, NULL},
+    {"/rfid", HTTP_HEAD, http_server_rfid_html_handler, NULL},
+    {"/rfid.css", HTTP_HEAD, http_server_rfid_css_handler, NULL},
+    {"/rfid.js", HTTP_HEAD, http_server_rfid_js_handler, NULL},
+    {"/cards/get", HTTP_HEAD, http_server_rfid_manager_list_cards_handler, (void *)&http_server_worker_opts},
+    {"/cards/count", HTTP_HEAD, http_server_rfid_manager_get_card_count_handler, NULL},
+    // Live Events
+    {"/events", HTTP_GET, http_server_events_handler, NULL},
+    // Monitoring
+    {"/metrics", HTTP_GET, http_server_metrics_handler, NULL},
+    // Captive Portal
+    {"/captive/accept", HTTP_POST, http_server_captive_accept_handler, NULL},
+    // Web UI files without a firmware update, rewriting flash takes a while
+    {"/assets/update", HTTP_POST, http_server_asset_update_handler, (void *)&http_server_worker_opts},
 };
 
+// Same order as uri_handlers, every request is dispatched through its entry
+static http_server_route_t http_server_routes[URI_HANDLERS_COUNT] = {0};
+
 // FUNCTIONS
 bool app_local_server_init(void)
 {
@@ -147,6 +444,55 @@ bool app_local_server_init(void)
     http_server_monitor_q_handle = xQueueCreate(HTTP_SERVER_MONITOR_QUEUE_LEN,
                                                 sizeof(http_server_q_msg_t));
 
+    // Keys served by the /getData endpoint
+    http_server_register_data_keys();
+
+    http_server_boot_id = esp_random();
+
+    const rate_limit_config_t card_check_limit = {
+        .per_minute = CONFIG_APP_LOCAL_SERVER_CARD_CHECK_PER_MINUTE,
+        .burst = CONFIG_APP_LOCAL_SERVER_CARD_CHECK_BURST};
+    const rate_limit_config_t card_write_limit = {
+        .per_minute = CONFIG_APP_LOCAL_SERVER_CARD_WRITE_PER_MINUTE,
+        .burst = CONFIG_APP_LOCAL_SERVER_CARD_WRITE_BURST};
+    rate_limit_init(&http_server_card_check_limit, &card_check_limit);
+    rate_limit_init(&http_server_card_write_limit, &card_write_limit);
+
+    // Slow routes fall back to running on the server task if the pool is missing
+    const http_workers_config_t workers = {
+        .workers = CONFIG_APP_LOCAL_SERVER_WORKERS,
+        .queue_len = CONFIG_APP_LOCAL_SERVER_WORKER_QUEUE_LEN,
+        .stack_size = HTTP_SERVER_WORKER_STACK_SIZE,
+        .priority = HTTP_SERVER_WORKER_PRIORITY,
+        .scratch_size = HTTP_SERVER_TASK_BUFFER_SIZE};
+    http_workers_init(&workers);
+    http_server_cards_lock = xSemaphoreCreateMutex();
+    http_server_crc_lock = xSemaphoreCreateMutex();
+    http_server_limit_lock = xSemaphoreCreateMutex();
+
+    // Without it the server falls back to esp_http_server purging its least recently used connection
+    const conn_budget_config_t conn_budget = {
+        .limit = HTTP_SERVER_CLIENT_SOCKETS,
+        .admin_reserved = CONFIG_APP_LOCAL_SERVER_ADMIN_RESERVED_CONNS,
+        .per_client = CONFIG_APP_LOCAL_SERVER_CONNS_PER_CLIENT,
+        .admin_hold_us = HTTP_SERVER_ADMIN_HOLD_US};
+    http_server_conn_budget_ready = conn_budget_init(&conn_budget);
+
+    // Without a valid pack every file is served from the firmware
+    asset_pack_mount(HTTP_SERVER_ASSET_PARTITION);
+
+    // Time every client from getting an address on the AP to seeing the portal
+    if (captive_probe_init())
+    {
+        esp_event_handler_register(IP_EVENT, IP_EVENT_AP_STAIPASSIGNED, http_server_ap_client_joined, NULL);
+    }
+
+    // Stream every access decision to the live view on the RFID page
+    if (sse_events_init())
+    {
+        rfid_manager_set_check_callback(http_server_card_check_cb);
+    }
+
     return true;
 }
 
@@ -154,6 +500,9 @@ bool app_local_server_start(void)
 {
     // Start the web server
     start_webserver();
+#if CONFIG_APP_LOCAL_SERVER_HTTPS
+    start_https_server();
+#endif
     start_dns_server();
 
     return true;
@@ -237,310 +586,1314 @@ static void http_server_monitor(void)
     }
 }
 
-static void start_webserver(void)
+/*
+ * One end of a connection
+ * @param sockfd socket of the connection
+ * @param local true for the server's address, false for the client's
+ * @return IPv4 address in network order (the low 32 bits for IPv6), 0 if unknown
+ */
+static uint32_t http_server_fd_addr(int sockfd, bool local)
 {
-    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
-    config.max_uri_handlers = URI_HANDLERS_COUNT + URI_HANDLER_MARGIN;
-    config.max_open_sockets = 13;
-    config.lru_purge_enable = true;
+    struct sockaddr_storage addr;
+    socklen_t addr_len = sizeof(addr);
+    uint32_t ip = 0;
 
-    ESP_LOGI(TAG, "Starting on port: '%d'", config.server_port);
-    if (httpd_start(&http_server_handle, &config) == ESP_OK)
+    if ((local ? getsockname(sockfd, (struct sockaddr *)&addr, &addr_len)
+               : getpeername(sockfd, (struct sockaddr *)&addr, &addr_len)) != 0)
     {
-        // Set URI handlers
-        for (size_t i = 0; i < URI_HANDLERS_COUNT; i++)
-        {
-            ESP_LOGI(TAG, "Registering URI handler: %s", uri_handlers[i].uri);
-            httpd_register_uri_handler(http_server_handle, &uri_handlers[i]);
-        }
-        httpd_register_err_handler(http_server_handle, HTTPD_404_NOT_FOUND, http_404_error_handler);
+        return 0;
+    }
+    if (addr.ss_family == AF_INET6)
+    {
+        // IPv4 clients show up as ::ffff:a.b.c.d on a dual stack server
+        memcpy(&ip, &((struct sockaddr_in6 *)&addr)->sin6_addr.s6_addr[12], sizeof(ip));
     }
     else
     {
-        ESP_LOGE(TAG, "Failed to start HTTP server");
+        ip = ((struct sockaddr_in *)&addr)->sin_addr.s_addr;
     }
+    return ip;
 }
 
 /*
- * Check the fw_update_status and creates the fw_update_reset time if the
- * fw_update_status is true
+ * One end of the connection a request arrived on
+ * @param req HTTP request
+ * @param local true for the server's address, false for the client's
+ * @return IPv4 address in network order (the low 32 bits for IPv6), 0 if unknown
  */
-static void http_server_fw_update_reset_timer(void)
+static uint32_t http_server_socket_addr(httpd_req_t *req, bool local)
 {
-    if (fw_update_status == OTA_UPDATE_SUCCESSFUL)
-    {
-        ESP_LOGI(TAG, "http_server_fw_update_reset_timer: FW Update successful starting FW update reset timer");
-        // Give the web page a chance to receive an acknowledge back and initialize the timer
-        ESP_ERROR_CHECK(esp_timer_create(&fw_update_reset_args, &fw_update_reset));
-        ESP_ERROR_CHECK(esp_timer_start_once(fw_update_reset, 8 * 1000 * 1000));
-    }
-    else
+    return http_server_fd_addr(httpd_req_to_sockfd(req), local);
+}
+
+/*
+ * Address of the client that sent the request, the rate limit key
+ * @param req HTTP request
+ * @return IPv4 address in network order, 0 if unknown
+ */
+static uint32_t http_server_client_addr(httpd_req_t *req)
+{
+    return http_server_socket_addr(req, false);
+}
+
+/*
+ * Answers 429 Too Many Requests without running the handler
+ * @param req HTTP request
+ * @param retry_after_s seconds until the client's next request is accepted
+ * @return result of sending the response
+ */
+static esp_err_t http_server_send_rate_limited(httpd_req_t *req, uint32_t retry_after_s)
+{
+    char retry_after[12];
+
+    snprintf(retry_after, sizeof(retry_after), "%lu", (unsigned long)retry_after_s);
+    httpd_resp_set_status(req, "429 Too Many Requests");
+    httpd_resp_set_hdr(req, "Retry-After", retry_after);
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_sendstr(req, "{\"status\":\"error\",\"message\":\"Too many requests\"}");
+}
+
+/*
+ * Answers 503 Service Unavailable because all workers are busy and their
+ * queue is full
+ * @param req HTTP request
+ * @return result of sending the response
+ */
+static esp_err_t http_server_send_busy(httpd_req_t *req)
+{
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    httpd_resp_set_hdr(req, "Retry-After", "1");
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_sendstr(req, "{\"status\":\"error\",\"message\":\"Server busy\"}");
+}
+
+/*
+ * Buffers of the server task a request is handled on
+ * @param req HTTP request
+ * @return state of the plain or the HTTPS server
+ */
+static http_server_task_state_t *http_server_task_state_of(httpd_req_t *req)
+{
+#if CONFIG_APP_LOCAL_SERVER_HTTPS
+    if (req->handle == http_server_https_handle)
     {
-        ESP_LOGI(TAG, "http_server_fw_update_reset_timer: FW Update unsuccessful");
+        return &http_server_https_task_state;
     }
+#endif
+    return &http_server_task_state;
 }
 
 /*
- * jQuery get handler requested when accessing the web page.
- * @param req HTTP request for which the uri needs to be handled
- * @return ESP_OK
+ * Whether conn_budget tracks the request's connection. Only the plain server
+ * admits its connections through it (http_server_conn_open), the HTTPS
+ * server is bounded by its own max_open_sockets and never reports closes.
+ * @param req HTTP request
+ * @return false for the HTTPS server
  */
-static esp_err_t http_server_j_query_handler(httpd_req_t *req)
+static bool http_server_conn_budgeted(httpd_req_t *req)
 {
-    esp_err_t error;
-    ESP_LOGI(TAG, "JQuery Requested");
-    httpd_resp_set_type(req, "application/javascript");
-    error = httpd_resp_send(req, (const char *)jquery_3_3_1_min_js_start, jquery_3_3_1_min_js_end - jquery_3_3_1_min_js_start);
+#if CONFIG_APP_LOCAL_SERVER_HTTPS
+    return req->handle != http_server_https_handle;
+#else
+    return true;
+#endif
+}
+
+/*
+ * Buffer of the calling task for a request body or a copy of a card list:
+ * the worker's own scratch buffer on a worker, the server's on a server task
+ * @param req HTTP request
+ * @return buffer of HTTP_SERVER_TASK_BUFFER_SIZE bytes
+ */
+static char *http_server_task_buffer(httpd_req_t *req)
+{
+    char *scratch = (char *)http_workers_scratch();
+    return (scratch != NULL) ? scratch : http_server_task_state_of(req)->buffer;
+}
+
+/*
+ * Runs the route's handler and records its latency and errors
+ * @param req HTTP request
+ * @param route route of the request
+ * @return result of the route's handler
+ */
+static esp_err_t http_server_route_run(httpd_req_t *req, http_server_route_t *route)
+{
+    int64_t start = esp_timer_get_time();
+    esp_err_t error = route->handler(req);
+
+    metrics_histogram_observe(&route->latency, (uint32_t)MIN(esp_timer_get_time() - start, (int64_t)UINT32_MAX));
     if (error != ESP_OK)
     {
-        ESP_LOGI(TAG, "http_server_j_query_handler: Error %d while sending Response", error);
-    }
-    else
-    {
-        ESP_LOGI(TAG, "http_server_j_query_handler: Response Sent Successfully");
+        metrics_counter_add(&route->errors, 1);
     }
     return error;
 }
 
 /*
- * Send the index HTML page
- * @param req HTTP request for which the uri needs to be handled
- * @return ESP_OK
+ * Worker side of a route handed to the pool
+ * @param req asynchronous copy of the request
+ * @param ctx http_server_route_t of the URI
+ * @return result of the route's handler
  */
-static esp_err_t http_server_index_html_handler(httpd_req_t *req)
+static esp_err_t http_server_route_worker(httpd_req_t *req, void *ctx)
 {
-    esp_err_t error;
-    ESP_LOGI(TAG, "Index HTML Requested");
-    httpd_resp_set_type(req, "text/html");
-    error = httpd_resp_send(req, (const char *)index_html_start, index_html_end - index_html_start);
-    if (error != ESP_OK)
-    {
-        ESP_LOGI(TAG, "http_server_index_html_handler: Error %d while sending Response", error);
-    }
-    else
+    esp_err_t error = http_server_route_run(req, (http_server_route_t *)ctx);
+
+    if (http_server_conn_budgeted(req))
     {
-        ESP_LOGI(TAG, "http_server_index_html_handler: Response Sent Successfully");
+        conn_budget_request_end(httpd_req_to_sockfd(req), esp_timer_get_time());
     }
     return error;
 }
 
 /*
- * app.css get handler is requested when accessing the web page
- * @param req HTTP request for which the uri needs to be handled
- * @return ESP_OK
+ * Applies the route's rate limit and runs the real handler, or queues it for
+ * a worker if the route is slow
+ * @param req HTTP request
+ * @param route route of the request
+ * @param queued set to true if a worker took the request
+ * @return result of the route's handler, ESP_OK once handed to a worker
  */
-static esp_err_t http_server_app_css_handler(httpd_req_t *req)
+static esp_err_t http_server_route_serve(httpd_req_t *req, http_server_route_t *route, bool *queued)
 {
-    esp_err_t error;
-    ESP_LOGI(TAG, "APP CSS Requested");
-    httpd_resp_set_type(req, "text/css");
-    error = httpd_resp_send(req, (const char *)app_css_start, app_css_end - app_css_start);
-    if (error != ESP_OK)
+    uint32_t retry_after_s = 0;
+
+    // The wildcard registered for a template also takes paths the template refuses
+    if (route->uri_template != NULL && !uri_template_match(route->uri_template, req->uri, NULL))
     {
-        ESP_LOGI(TAG, "http_server_app_css_handler: Error %d while sending Response", error);
+        httpd_resp_set_status(req, "404 Not Found");
+        httpd_resp_set_type(req, "application/json");
+        return httpd_resp_sendstr(req, "{\"status\":\"error\",\"message\":\"Not found\"}");
     }
-    else
+
+#if CONFIG_APP_LOCAL_SERVER_HTTPS_ADMIN_ONLY
+    if (route->admin && req->handle == http_server_handle)
     {
-        ESP_LOGI(TAG, "http_server_app_css_handler: Response Sent Successfully");
+        return http_server_send_json_error(req, "403 Forbidden", "Use the HTTPS port for this");
     }
-    return error;
+#endif
+    if (route->admin)
+    {
+        // The client's connections may use the reserved ones from now on, a TLS one is not among them
+        conn_budget_mark_admin(http_server_conn_budgeted(req) ? httpd_req_to_sockfd(req) : -1,
+                               http_server_client_addr(req), esp_timer_get_time());
+    }
+
+    if (route->limit != NULL)
+    {
+        xSemaphoreTake(http_server_limit_lock, portMAX_DELAY);
+        bool allowed = rate_limit_take(route->limit, http_server_client_addr(req), esp_timer_get_time(), &retry_after_s);
+        xSemaphoreGive(http_server_limit_lock);
+        if (!allowed)
+        {
+            metrics_counter_add(&route->limited, 1);
+            return http_server_send_rate_limited(req, retry_after_s);
+        }
+    }
+
+    if (route->worker)
+    {
+        esp_err_t error = http_workers_submit(req, http_server_route_worker, route);
+        if (error == ESP_OK)
+        {
+            *queued = true;
+            return ESP_OK;
+        }
+        if (error == ESP_ERR_NO_MEM)
+        {
+            metrics_counter_add(&route->busy, 1);
+            return http_server_send_busy(req);
+        }
+        // No pool or the request could not be detached, serve it here
+        ESP_LOGW(TAG, "http_server_route_dispatch: Running %s inline: %s", req->uri, esp_err_to_name(error));
+    }
+
+    return http_server_route_run(req, route);
 }
 
 /*
- * app.js get handler requested when accessing the web page.
- * @param req HTTP request for which the uri needs to be handled
- * @return ESP_OK
+ * Entry point of every registered URI. The connection is not idle, and so
+ * not evicted for a new one, until the request is answered.
+ * @param req HTTP request, user_ctx is the http_server_route_t of the URI
+ * @return result of http_server_route_serve
  */
-static esp_err_t http_server_app_js_handler(httpd_req_t *req)
+static esp_err_t http_server_route_dispatch(httpd_req_t *req)
 {
-    esp_err_t error;
-    ESP_LOGI(TAG, "APP JS Requested");
-    httpd_resp_set_type(req, "application/javascript");
-    error = httpd_resp_send(req, (const char *)app_js_start, app_js_end - app_js_start);
-    if (error != ESP_OK)
+    int sockfd = httpd_req_to_sockfd(req);
+    bool budgeted = http_server_conn_budgeted(req);
+    bool queued = false;
+
+    if (budgeted)
     {
-        ESP_LOGI(TAG, "http_server_app_js_handler: Error %d while sending Response", error);
+        conn_budget_request_begin(sockfd, esp_timer_get_time());
     }
-    else
+    esp_err_t error = http_server_route_serve(req, (http_server_route_t *)req->user_ctx, &queued);
+    if (budgeted && !queued)
     {
-        ESP_LOGI(TAG, "http_server_app_js_handler: Response Sent Successfully");
+        // A worker ends the request itself, see http_server_route_worker
+        conn_budget_request_end(sockfd, esp_timer_get_time());
     }
     return error;
 }
 
 /*
- * Sends the .ico file when accessing the web page
- * @param req HTTP request for which the uri needs to be handled
- * @return ESP_OK
+ * open_fn of the plain server: admits the connection it just accepted, closing
+ * an idle one to make room, or refuses it with 503
+ * @param hd server handle
+ * @param sockfd new connection
+ * @return ESP_OK to keep the connection, ESP_FAIL to have the server close it
  */
-static esp_err_t http_server_favicon_handler(httpd_req_t *req)
+static esp_err_t http_server_conn_open(httpd_handle_t hd, int sockfd)
 {
-    esp_err_t error;
-    ESP_LOGI(TAG, "Favicon.ico Requested");
-    httpd_resp_set_type(req, "image/x-icon");
-    error = httpd_resp_send(req, (const char *)favicon_ico_start, favicon_ico_end - favicon_ico_start);
-    if (error != ESP_OK)
-    {
-        ESP_LOGI(TAG, "http_server_favicon_handler: Error %d while sending Response", error);
-    }
-    else
+    static const char refused[] = "HTTP/1.1 503 Service Unavailable\r\nRetry-After: 1\r\n"
+                                  "Content-Length: 0\r\nConnection: close\r\n\r\n";
+    int victim = -1;
+    uint32_t client = http_server_fd_addr(sockfd, false);
+
+    switch (conn_budget_admit(sockfd, client, esp_timer_get_time(), &victim))
     {
-        ESP_LOGI(TAG, "http_server_favicon_handler: Response Sent Successfully");
+    case CONN_BUDGET_ADMIT:
+        return ESP_OK;
+    case CONN_BUDGET_ADMIT_EVICT:
+        ESP_LOGD(TAG, "http_server_conn_open: Closing idle socket %d for socket %d", victim, sockfd);
+        httpd_sess_trigger_close(hd, victim);
+        return ESP_OK;
+    case CONN_BUDGET_REJECT_CLIENT:
+    case CONN_BUDGET_REJECT_POOL:
+    default:
+        ESP_LOGW(TAG, "http_server_conn_open: No connection left for " IPSTR ", refusing socket %d",
+                 IP2STR((esp_ip4_addr_t *)&client), sockfd);
+        // Best effort, a browser retries instead of reporting a reset
+        send(sockfd, refused, sizeof(refused) - 1, MSG_DONTWAIT);
+        return ESP_FAIL;
     }
-    return error;
 }
 
-/**
- * @brief Receives the *.bin file via the web page and handles the firmware update
- * @param req HTTP request for which the uri needs to be handled
- * @return ESP_OK, other ESP_FAIL if timeout occurs and the update canot be started
+/*
+ * close_fn of the plain server, also called for refused connections
+ * @param hd server handle
+ * @param sockfd connection being closed
  */
-static esp_err_t http_server_ota_update_handler(httpd_req_t *req)
+static void http_server_conn_close(httpd_handle_t hd, int sockfd)
 {
-    esp_err_t error;
-    esp_ota_handle_t ota_handle;
-    char ota_buffer[1024];
-    int content_len = req->content_len; // total content length
-    int content_received = 0;
-    int recv_len = 0;
-    bool is_req_body_started = false;
-    bool flash_successful = false;
+    conn_budget_closed(sockfd);
+    close(sockfd);
+}
 
-    // get the next OTA app partition which should be written with a new firmware
-    const esp_partition_t *update_partition = esp_ota_get_next_update_partition(NULL);
+/*
+ * Registers uri_handlers[i] on a server through the dispatch wrapper
+ * @param handle server to register on
+ * @param i index into uri_handlers and http_server_routes, set up by start_webserver
+ * @return result of httpd_register_uri_handler
+ */
+static esp_err_t http_server_register_route(httpd_handle_t handle, size_t i)
+{
+    httpd_uri_t uri = uri_handlers[i];
+    char wildcard[HTTP_SERVER_WILDCARD_URI_LEN];
 
-    // our ota_buffer is not sufficient to receive all data in a one go
-    // hence we will read the data in chunks and write in chunks, read the below
-    // mentioned comments for more information
-    do
-    {
-        // The following is the API to read content of data from the HTTP request
-        /* This API will read HTTP content data from the HTTP request into the
-         * provided buffer. Use content_len provided in the httpd_req_t structure to
-         *  know the length of the data to be fetched.
-         *  If the content_len is to large for the buffer then the user may have to
-         *  make multiple calls to this functions (as done here), each time fetching
-         *  buf_len num of bytes (which is ota_buffer length here), while the pointer
-         *  to content data is incremented internally by the same number
-         *  This function returns
-         *  Bytes: Number of bytes read into the buffer successfully
-         *  0: Buffer length parameter is zero/connection closed by peer.
-         *  HTTPD_SOCK_ERR_INVALID: Invalid Arguments
-         *  HTTPD_SOCK_ERR_TIMEOUT: Timeout/Interrupted while calling socket recv()
-         *  HTTPD_SOCK_ERR_FAIL: Unrecoverable error while calling socket recv()
-         *  Parameters to this function are:
-         *  req: The request being responded to
-         *  ota_buffer: Pointer to a buffer that the data will be read into
-         *  length: length of the buffer which ever is minimum (as we don't want to
-         *          read more data which buffer can't handle)
-         */
-        recv_len = httpd_req_recv(req, ota_buffer, MIN(content_len, sizeof(ota_buffer)));
-        // if recv_len is less than zero, it means some problem (but if timeout error, then try again)
-        if (recv_len < 0)
+    uri.handler = http_server_route_dispatch;
+    uri.user_ctx = &http_server_routes[i];
+    if (http_server_routes[i].uri_template != NULL)
+    {
+        // Registered as its wildcard, the dispatcher matches the template
+        if (!uri_template_wildcard(uri.uri, wildcard, sizeof(wildcard)))
         {
-            // Check if timeout occur, then we will retry again
-            if (recv_len == HTTPD_SOCK_ERR_TIMEOUT)
-            {
-                ESP_LOGI(TAG, "http_server_ota_update_handler: Socket Timeout");
-                continue; // Retry Receiving if Timeout Occurred
-            }
-            // If there is some other error apart from Timeout, then exit with fail
-            ESP_LOGI(TAG, "http_server_ota_update_handler: OTA Other Error, %d", recv_len);
-            return ESP_FAIL;
+            ESP_LOGE(TAG, "URI template too long: %s", uri.uri);
+            return ESP_ERR_INVALID_SIZE;
         }
-        ESP_LOGI(TAG, "http_server_ota_update_handler: OTA RX: %d of %d", content_received, content_len);
+        uri.uri = wildcard;
+    }
 
-        // We are here which means that "recv_len" is positive, now we have to check
-        // if this is the first data we are receiving or not, If so, it will have
-        // the information in the header that we need
-        if (!is_req_body_started)
-        {
-            is_req_body_started = true;
-            // Now we have to identify from where the binary file content is starting
-            // this can be done by actually checking the escape characters i.e. \r\n\r\n
-            // Get the location of the *.bin file content (remove the web form data)
-            // the strstr will return the pointer to the \r\n\r\n in the ota_buffer
-            // and then by adding 4 we reach to the start of the binary content/start
-            char *body_start_p = strstr(ota_buffer, "\r\n\r\n") + 4u;
-            int body_part_len = recv_len - (body_start_p - ota_buffer);
-            ESP_LOGI(TAG, "http_server_ota_update_handler: OTA File Size: %d", content_len);
-            /*
-             * esp_ota_begin function commence an OTA update writing to the specified
-             * partition. The specified partition is erased to the specified image
-             * size. If the image size is not yet known, OTA_SIZE_UNKNOWN is passed
-             * which will cause the entire partition to be erased.
-             * On Success this function allocates memory that remains in use until
-             * esp_ota_end is called with the return handle.
-             */
-            error = esp_ota_begin(update_partition, OTA_SIZE_UNKNOWN, &ota_handle);
-            if (error != ESP_OK)
-            {
-                ESP_LOGI(TAG, "http_server_ota_update_handler: Error with OTA Begin, Canceling OTA");
-                return ESP_FAIL;
-            }
-            else
-            {
-                ESP_LOGI(TAG, "http_server_ota_update_handler: Writing to partition subtype %d at offset 0x%lx", update_partition->subtype, update_partition->address);
-            }
-            /*
-             * esp_ota_write function, writes the OTA update to the partition.
-             * This function can be called multiple times as data is received during
-             * the OTA operation. Data is written sequentially to the partition.
-             * Here we are writing the body start for the first time.
-             */
-            esp_ota_write(ota_handle, body_start_p, body_part_len);
-            content_received += body_part_len;
-        }
-        else
-        {
-            /* Continue to receive data above using httpd_req_recv function, and write
-             * using esp_ota_write (below), until all the content is received. */
-            esp_ota_write(ota_handle, ota_buffer, recv_len);
-            content_received += recv_len;
-        }
+    ESP_LOGI(TAG, "Registering URI handler: %s", uri.uri);
+    return httpd_register_uri_handler(handle, &uri);
+}
 
-    } while ((recv_len > 0) && (content_received < content_len));
-    // till complete data is received and written or some error is there we will
-    // remain in the above mentioned do-while loop
+/*
+ * Whether a route changes the device: card changes, firmware and web files
+ * @param uri entry of uri_handlers
+ * @return true for the administration routes
+ */
+static bool http_server_route_is_admin(const httpd_uri_t *uri)
+{
+    if (uri->method == HTTP_GET || uri->method == HTTP_HEAD)
+    {
+        return false;
+    }
+    return (strncmp(uri->uri, "/cards/", 7) == 0) || (strncmp(uri->uri, "/OTA", 4) == 0) ||
+           (strcmp(uri->uri, "/assets/update") == 0);
+}
 
-    /* Finish the OTA update and validate newly written app image.
-     * After calling esp_ota_end, the handle is no longer valid and memory associated
-     * with it is freed (regardless of the results).
-     */
-    if (esp_ota_end(ota_handle) == ESP_OK)
+static void start_webserver(void)
+{
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.max_uri_handlers = URI_HANDLERS_COUNT + CAPTIVE_PROBE_COUNT + URI_HANDLER_MARGIN;
+    config.max_open_sockets = HTTP_SERVER_MAX_OPEN_SOCKETS;
+    config.lru_purge_enable = true;
+    config.server_port = CONFIG_APP_LOCAL_SERVER_PORT;
+    if (http_server_conn_budget_ready)
     {
-        // let's update the partition i.e. configure OTA data for new boot partition
-        if (esp_ota_set_boot_partition(update_partition) == ESP_OK)
+        config.open_fn = http_server_conn_open;
+        config.close_fn = http_server_conn_close;
+    }
+    // Exact URIs still match exactly, '*' is only used for the /cards/{id} templates
+    config.uri_match_fn = httpd_uri_match_wildcard;
+
+    ESP_LOGI(TAG, "Starting on port: '%d'", config.server_port);
+    if (httpd_start(&http_server_handle, &config) == ESP_OK)
+    {
+        // Set URI handlers, each one wrapped to record its latency
+        for (size_t i = 0; i < URI_HANDLERS_COUNT; i++)
         {
-            const esp_partition_t *boot_partition = esp_ota_get_boot_partition();
-            ESP_LOGI(TAG, "http_server_ota_update_handler: Next boot partition subtype %d at offset 0x%lx", boot_partition->subtype, boot_partition->address);
-            flash_successful = true;
+            const httpd_uri_t *uri = &uri_handlers[i];
+            const http_server_route_opts_t *opts = (const http_server_route_opts_t *)uri->user_ctx;
+            http_server_routes[i].handler = uri->handler;
+            http_server_routes[i].limit = (opts != NULL) ? opts->limit : NULL;
+            http_server_routes[i].worker = (opts != NULL) && opts->worker;
+            http_server_routes[i].admin = http_server_route_is_admin(uri);
+            http_server_routes[i].uri_template = uri_template_is_template(uri->uri) ? uri->uri : NULL;
+            http_server_register_route(http_server_handle, i);
         }
-        else
+        // Probes are polled by every connected device, they skip the dispatch wrapper
+        for (size_t i = 0; i < CAPTIVE_PROBE_COUNT; i++)
         {
-            ESP_LOGI(TAG, "http_server_ota_update_handler: Flash Error");
+            const httpd_uri_t probe = {
+                .uri = captive_probes[i].path,
+                .method = HTTP_GET,
+                .handler = http_server_captive_probe_handler,
+                .user_ctx = (void *)&captive_probes[i]};
+            httpd_register_uri_handler(http_server_handle, &probe);
         }
+        httpd_register_err_handler(http_server_handle, HTTPD_404_NOT_FOUND, http_404_error_handler);
+        sse_events_set_server(http_server_handle);
     }
     else
     {
-        ESP_LOGI(TAG, "http_server_ota_update_handler: esp_ota_end Error");
+        ESP_LOGE(TAG, "Failed to start HTTP server");
     }
+}
 
-    // We won't update the global variables throughout the file, so send the message about the status
-    if (flash_successful)
+#if CONFIG_APP_LOCAL_SERVER_HTTPS
+/*
+ * mbedTLS session cache lookup, restores the session a client offered to resume
+ * @param data unused
+ * @param id session ID from the ClientHello
+ * @param id_len its length
+ * @param session receives the session
+ * @return 0 if the session can be resumed
+ */
+static int http_server_tls_cache_get(void *data, const unsigned char *id, size_t id_len, mbedtls_ssl_session *session)
+{
+    unsigned char saved[SESSION_CACHE_DATA_LEN];
+    size_t len = 0;
+    int ret = MBEDTLS_ERR_SSL_CACHE_ENTRY_NOT_FOUND;
+
+    if (session_cache_lookup(id, id_len, saved, sizeof(saved), &len, esp_timer_get_time()) == ESP_OK)
     {
-        http_server_monitor_send_msg(HTTP_MSG_WIFI_OTA_UPDATE_SUCCESSFUL);
+        ret = mbedtls_ssl_session_load(session, saved, len);
     }
-    else
+    mbedtls_platform_zeroize(saved, sizeof(saved));
+    return ret;
+}
+
+/*
+ * mbedTLS session cache store, called after every full handshake
+ * @param data unused
+ * @param id session ID sent to the client
+ * @param id_len its length
+ * @param session negotiated session
+ * @return 0 if the session was kept
+ */
+static int http_server_tls_cache_set(void *data, const unsigned char *id, size_t id_len,
+                                     const mbedtls_ssl_session *session)
+{
+    unsigned char saved[SESSION_CACHE_DATA_LEN];
+    size_t len = 0;
+    int ret = mbedtls_ssl_session_save(session, saved, sizeof(saved), &len);
+
+    if (ret == 0 && session_cache_store(id, id_len, saved, len, esp_timer_get_time()) != ESP_OK)
     {
-        http_server_monitor_send_msg(HTTP_MSG_WIFI_OTA_UPDATE_FAILED);
+        ret = MBEDTLS_ERR_SSL_CACHE_ENTRY_NOT_FOUND;
     }
-    return ESP_OK;
+    mbedtls_platform_zeroize(saved, sizeof(saved));
+    return ret;
 }
 
-static esp_err_t http_server_rfid_manager_get_default_cards_handler(httpd_req_t *req)
+/*
+ * Runs while the ClientHello is parsed, before the server looks up the
+ * session ID. esp-tls gives every connection its own mbedtls_ssl_config,
+ * so the cache is attached here rather than to a shared one.
+ * @param ssl connection being set up
+ * @return 0 to go on with the handshake
+ */
+static int http_server_tls_handshake_hook(mbedtls_ssl_context *ssl)
 {
-    ESP_LOGI(TAG, "RFID default cards requested");
+    mbedtls_ssl_conf_session_cache((mbedtls_ssl_config *)ssl->MBEDTLS_PRIVATE(conf), NULL,
+                                   http_server_tls_cache_get, http_server_tls_cache_set);
+    return 0;
+}
+
+/*
+ * Starts the HTTPS listener with the routes of the plain server, sharing
+ * their rate limits, workers and metrics. Clients resuming a cached session
+ * ID (or a ticket, CONFIG_ESP_TLS_SERVER_SESSION_TICKETS) skip the key
+ * exchange. Called after start_webserver.
+ */
+static void start_https_server(void)
+{
+    httpd_ssl_config_t config = HTTPD_SSL_CONFIG_DEFAULT();
+    config.servercert = (const uint8_t *)servercert_pem_start;
+    config.servercert_len = servercert_pem_end - servercert_pem_start;
+    config.prvtkey_pem = (const uint8_t *)prvtkey_pem_start;
+    config.prvtkey_len = prvtkey_pem_end - prvtkey_pem_start;
+    config.port_secure = CONFIG_APP_LOCAL_SERVER_HTTPS_PORT;
+    config.httpd.ctrl_port = HTTP_SERVER_HTTPS_CTRL_PORT;
+    config.httpd.max_uri_handlers = URI_HANDLERS_COUNT;
+    config.httpd.max_open_sockets = CONFIG_APP_LOCAL_SERVER_HTTPS_MAX_SOCKETS;
+    config.httpd.lru_purge_enable = true;
+    config.httpd.uri_match_fn = httpd_uri_match_wildcard;
+#if CONFIG_ESP_TLS_SERVER_SESSION_TICKETS
+    config.session_tickets = true;
+#endif
+    const session_cache_config_t session_cache = {
+        .entries = CONFIG_APP_LOCAL_SERVER_HTTPS_SESSION_CACHE_ENTRIES,
+        .lifetime_s = CONFIG_APP_LOCAL_SERVER_HTTPS_SESSION_LIFETIME};
+    if (session_cache_init(&session_cache))
+    {
+        config.cert_select_cb = http_server_tls_handshake_hook;
+    }
+
+    ESP_LOGI(TAG, "Starting HTTPS on port: '%d'", config.port_secure);
+    if (httpd_ssl_start(&http_server_https_handle, &config) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to start HTTPS server");
+        return;
+    }
+    for (size_t i = 0; i < URI_HANDLERS_COUNT; i++)
+    {
+        // Live events are sent through the plain server, the captive portal only runs there
+        if ((strcmp(uri_handlers[i].uri, "/events") != 0) && (strncmp(uri_handlers[i].uri, "/captive/", 9) != 0))
+        {
+            http_server_register_route(http_server_https_handle, i);
+        }
+    }
+}
+#endif
+
+/*
+ * Check the fw_update_status and creates the fw_update_reset time if the
+ * fw_update_status is true
+ */
+static void http_server_fw_update_reset_timer(void)
+{
+    if (fw_update_status == OTA_UPDATE_SUCCESSFUL)
+    {
+        ESP_LOGI(TAG, "http_server_fw_update_reset_timer: FW Update successful starting FW update reset timer");
+        // Give the web page a chance to receive an acknowledge back and initialize the timer
+        ESP_ERROR_CHECK(esp_timer_create(&fw_update_reset_args, &fw_update_reset));
+        ESP_ERROR_CHECK(esp_timer_start_once(fw_update_reset, 8 * 1000 * 1000));
+    }
+    else
+    {
+        ESP_LOGI(TAG, "http_server_fw_update_reset_timer: FW Update unsuccessful");
+    }
+}
+
+/*
+ * Whether the client accepts gzip, browsers always do but scripts may not
+ * @param req HTTP request
+ * @return true if Accept-Encoding lists gzip
+ */
+static bool http_server_accepts_gzip(httpd_req_t *req)
+{
+    char accept_encoding[HTTP_SERVER_ACCEPT_ENCODING_LEN];
+
+    return (httpd_req_get_hdr_value_str(req, "Accept-Encoding", accept_encoding, sizeof(accept_encoding)) == ESP_OK) &&
+           (strstr(accept_encoding, "gzip") != NULL);
+}
+
+/*
+ * Sends a static body of known length: 304 when the client has it, the
+ * headers only for HEAD, a single byte range with 206, or the whole body.
+ * The whole body is streamed in HTTP_SERVER_ASSET_CHUNK_SIZE chunks when
+ * chunked is set, which keeps every send on mapped flash short.
+ * @param req HTTP request, its Content-Type already set
+ * @param data body, sent without a copy
+ * @param len body length
+ * @param etag quoted ETag of the body, also the If-Range validator
+ * @param chunked true to send the whole body with chunked encoding
+ * @return result of sending the response
+ */
+static esp_err_t http_server_send_static(httpd_req_t *req, const char *data, size_t len, const char *etag, bool chunked)
+{
+    char header[HTTP_SERVER_IF_NONE_MATCH_LEN];
+    char content_range[HTTP_SERVER_CONTENT_RANGE_LEN];
+    http_range_t range;
+    esp_err_t error = ESP_OK;
+
+    httpd_resp_set_hdr(req, "ETag", etag);
+    // Browsers keep the body but ask again each time, which costs a 304 at most
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    httpd_resp_set_hdr(req, "Accept-Ranges", "bytes");
+
+    if ((httpd_req_get_hdr_value_str(req, "If-None-Match", header, sizeof(header)) == ESP_OK) &&
+        ((strstr(header, etag) != NULL) || (strcmp(header, "*") == 0)))
+    {
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, NULL, 0);
+    }
+    if (req->method == HTTP_HEAD)
+    {
+        // Content-Length of the body without sending it
+        return httpd_resp_send(req, NULL, len);
+    }
+
+    // A range of another version of the file would corrupt the client's copy
+    bool range_valid = (httpd_req_get_hdr_value_str(req, "If-Range", header, sizeof(header)) != ESP_OK) ||
+                       (strcmp(header, etag) == 0);
+    if (range_valid && (httpd_req_get_hdr_value_str(req, "Range", header, sizeof(header)) == ESP_OK))
+    {
+        switch (http_range_parse(header, len, &range))
+        {
+        case HTTP_RANGE_PARTIAL:
+            snprintf(content_range, sizeof(content_range), "bytes %u-%u/%u",
+                     (unsigned)range.start, (unsigned)range.end, (unsigned)len);
+            httpd_resp_set_status(req, "206 Partial Content");
+            httpd_resp_set_hdr(req, "Content-Range", content_range);
+            return httpd_resp_send(req, data + range.start, range.end - range.start + 1);
+        case HTTP_RANGE_UNSATISFIABLE:
+            snprintf(content_range, sizeof(content_range), "bytes */%u", (unsigned)len);
+            httpd_resp_set_status(req, "416 Range Not Satisfiable");
+            httpd_resp_set_hdr(req, "Content-Range", content_range);
+            return httpd_resp_send(req, NULL, 0);
+        default:
+            break;
+        }
+    }
+
+    if (!chunked)
+    {
+        return httpd_resp_send(req, data, len);
+    }
+    for (size_t sent = 0; (sent < len) && (error == ESP_OK); sent += HTTP_SERVER_ASSET_CHUNK_SIZE)
+    {
+        error = httpd_resp_send_chunk(req, data + sent, MIN(len - sent, HTTP_SERVER_ASSET_CHUNK_SIZE));
+    }
+    if (error == ESP_OK)
+    {
+        error = httpd_resp_send_chunk(req, NULL, 0);
+    }
+    return error;
+}
+
+/*
+ * CRC-32 of an embedded file, computed on its first request. The static
+ * handlers of both servers share the memo under http_server_crc_lock.
+ * @param start start of the embedded file
+ * @param end end of the embedded file
+ * @return CRC-32 of the file
+ */
+static uint32_t http_server_embedded_crc(const char *start, const char *end)
+{
+    static struct
+    {
+        const char *start;
+        uint32_t crc;
+    } crcs[HTTP_SERVER_EMBEDDED_FILES];
+    size_t i = 0;
+    uint32_t crc = 0;
+
+    xSemaphoreTake(http_server_crc_lock, portMAX_DELAY);
+    for (; (i < HTTP_SERVER_EMBEDDED_FILES) && (crcs[i].start != NULL); i++)
+    {
+        if (crcs[i].start == start)
+        {
+            crc = crcs[i].crc;
+            xSemaphoreGive(http_server_crc_lock);
+            return crc;
+        }
+    }
+
+    // Once per file, the other server task waits for it instead of computing it too
+    crc = esp_rom_crc32_le(0, (const uint8_t *)start, end - start);
+    if (i < HTTP_SERVER_EMBEDDED_FILES)
+    {
+        crcs[i].start = start;
+        crcs[i].crc = crc;
+    }
+    xSemaphoreGive(http_server_crc_lock);
+    return crc;
+}
+
+/*
+ * Sends a piece of a decompressed asset as a chunk
+ * @param ctx HTTP request
+ * @param data decompressed content
+ * @param len content length
+ * @return result of sending the chunk
+ */
+static esp_err_t http_server_send_inflated_chunk(void *ctx, const uint8_t *data, size_t len)
+{
+    return httpd_resp_send_chunk((httpd_req_t *)ctx, (const char *)data, len);
+}
+
+/*
+ * Sends a gzip file of the asset pack decompressed, to a client that does
+ * not accept gzip. Its ETag is the CRC of the content, ranges are not offered.
+ * @param req HTTP request
+ * @param file acquired pack file stored with ASSET_PACK_FLAG_GZIP
+ * @return result of sending the response
+ */
+static esp_err_t http_server_send_inflated(httpd_req_t *req, const asset_pack_file_t *file)
+{
+    char etag[HTTP_SERVER_ASSET_ETAG_LEN];
+    char header[HTTP_SERVER_IF_NONE_MATCH_LEN];
+    asset_pack_gzip_t gzip;
+
+    if (asset_pack_gzip_parse(file->data, file->len, &gzip) != ESP_OK)
+    {
+        // No body, the request may be a HEAD
+        ESP_LOGE(TAG, "http_server_send_inflated: Invalid gzip file in the asset pack");
+        httpd_resp_set_status(req, "500 Internal Server Error");
+        return httpd_resp_send(req, NULL, 0);
+    }
+
+    httpd_resp_set_type(req, file->content_type);
+    snprintf(etag, sizeof(etag), "\"%08lx\"", (unsigned long)gzip.crc);
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    if ((httpd_req_get_hdr_value_str(req, "If-None-Match", header, sizeof(header)) == ESP_OK) &&
+        ((strstr(header, etag) != NULL) || (strcmp(header, "*") == 0)))
+    {
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, NULL, 0);
+    }
+    if (req->method == HTTP_HEAD)
+    {
+        return httpd_resp_send(req, NULL, gzip.len);
+    }
+
+    esp_err_t error = asset_pack_inflate(&gzip, http_server_send_inflated_chunk, req);
+    switch (error)
+    {
+    case ESP_OK:
+        return httpd_resp_send_chunk(req, NULL, 0);
+    case ESP_ERR_INVALID_STATE:
+    case ESP_ERR_NO_MEM:
+        // Another client's file is being decompressed or the heap is short, both pass
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        return httpd_resp_send(req, NULL, 0);
+    case ESP_ERR_NOT_SUPPORTED:
+        httpd_resp_set_status(req, "406 Not Acceptable");
+        return httpd_resp_send(req, NULL, 0);
+    default:
+        // Part of the body is sent, failing closes the connection
+        ESP_LOGE(TAG, "http_server_send_inflated: %s", esp_err_to_name(error));
+        return error;
+    }
+}
+
+/*
+ * Sends a web UI file, from the asset pack when one is mounted and has the
+ * file, else the copy embedded in the firmware. GET and HEAD, with ranges
+ * except for a pack file decompressed for a client without gzip.
+ * @param req HTTP request
+ * @param path path of the file in the pack
+ * @param content_type type of the embedded copy
+ * @param start start of the embedded copy
+ * @param end end of the embedded copy
+ * @return result of sending the response
+ */
+static esp_err_t http_server_send_asset(httpd_req_t *req, const char *path, const char *content_type,
+                                        const char *start, const char *end)
+{
+    char etag[HTTP_SERVER_ASSET_ETAG_LEN];
+    asset_pack_file_t file;
+
+    if (asset_pack_acquire(path, &file))
+    {
+        bool gzip = (file.flags & ASSET_PACK_FLAG_GZIP) != 0;
+        esp_err_t error;
+        if (gzip)
+        {
+            httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+        }
+        // The embedded copy may be older than the pack, so it is decompressed instead
+        if (gzip && !http_server_accepts_gzip(req))
+        {
+            error = http_server_send_inflated(req, &file);
+        }
+        else
+        {
+            if (gzip)
+            {
+                httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+            }
+            httpd_resp_set_type(req, file.content_type);
+            snprintf(etag, sizeof(etag), "\"%08lx\"", (unsigned long)file.crc);
+            error = http_server_send_static(req, (const char *)file.data, file.len, etag, true);
+        }
+        asset_pack_release();
+        metrics_counter_add(&http_server_assets_served[HTTP_SERVER_ASSET_PACK], 1);
+        return error;
+    }
+
+    metrics_counter_add(&http_server_assets_served[HTTP_SERVER_ASSET_EMBEDDED], 1);
+    httpd_resp_set_type(req, content_type);
+    snprintf(etag, sizeof(etag), "\"%08lx\"", (unsigned long)http_server_embedded_crc(start, end));
+    return http_server_send_static(req, start, end - start, etag, false);
+}
+
+/*
+ * jQuery get handler requested when accessing the web page.
+ * @param req HTTP request for which the uri needs to be handled
+ * @return ESP_OK
+ */
+static esp_err_t http_server_j_query_handler(httpd_req_t *req)
+{
+    esp_err_t error;
+    ESP_LOGI(TAG, "JQuery Requested");
+    error = http_server_send_asset(req, "/jquery-3.3.1.min.js", "application/javascript", jquery_3_3_1_min_js_start, jquery_3_3_1_min_js_end);
+    if (error != ESP_OK)
+    {
+        ESP_LOGI(TAG, "http_server_j_query_handler: Error %d while sending Response", error);
+    }
+    else
+    {
+        ESP_LOGI(TAG, "http_server_j_query_handler: Response Sent Successfully");
+    }
+    return error;
+}
+
+/*
+ * Send the index HTML page
+ * @param req HTTP request for which the uri needs to be handled
+ * @return ESP_OK
+ */
+static esp_err_t http_server_index_html_handler(httpd_req_t *req)
+{
+    esp_err_t error;
+    ESP_LOGI(TAG, "Index HTML Requested");
+    // A HEAD does not show the page to anyone
+    int64_t join_us = (req->method == HTTP_GET)
+                          ? captive_probe_client_reached(http_server_client_addr(req), CAPTIVE_PROBE_STAGE_PORTAL,
+                                                         esp_timer_get_time())
+                          : -1;
+    if (join_us >= 0)
+    {
+        metrics_summary_observe(&http_server_join_to_stage[CAPTIVE_PROBE_STAGE_PORTAL], (uint64_t)join_us);
+        ESP_LOGI(TAG, "Portal opened %lld ms after the client joined", join_us / 1000);
+    }
+    error = http_server_send_asset(req, "/index.html", "text/html", index_html_start, index_html_end);
+    if (error != ESP_OK)
+    {
+        ESP_LOGI(TAG, "http_server_index_html_handler: Error %d while sending Response", error);
+    }
+    else
+    {
+        ESP_LOGI(TAG, "http_server_index_html_handler: Response Sent Successfully");
+    }
+    return error;
+}
+
+/*
+ * app.css get handler is requested when accessing the web page
+ * @param req HTTP request for which the uri needs to be handled
+ * @return ESP_OK
+ */
+static esp_err_t http_server_app_css_handler(httpd_req_t *req)
+{
+    esp_err_t error;
+    ESP_LOGI(TAG, "APP CSS Requested");
+    error = http_server_send_asset(req, "/app.css", "text/css", app_css_start, app_css_end);
+    if (error != ESP_OK)
+    {
+        ESP_LOGI(TAG, "http_server_app_css_handler: Error %d while sending Response", error);
+    }
+    else
+    {
+        ESP_LOGI(TAG, "http_server_app_css_handler: Response Sent Successfully");
+    }
+    return error;
+}
+
+/*
+ * app.js get handler requested when accessing the web page.
+ * @param req HTTP request for which the uri needs to be handled
+ * @return ESP_OK
+ */
+static esp_err_t http_server_app_js_handler(httpd_req_t *req)
+{
+    esp_err_t error;
+    ESP_LOGI(TAG, "APP JS Requested");
+    error = http_server_send_asset(req, "/app.js", "application/javascript", app_js_start, app_js_end);
+    if (error != ESP_OK)
+    {
+        ESP_LOGI(TAG, "http_server_app_js_handler: Error %d while sending Response", error);
+    }
+    else
+    {
+        ESP_LOGI(TAG, "http_server_app_js_handler: Response Sent Successfully");
+    }
+    return error;
+}
+
+/*
+ * Sends the .ico file when accessing the web page
+ * @param req HTTP request for which the uri needs to be handled
+ * @return ESP_OK
+ */
+static esp_err_t http_server_favicon_handler(httpd_req_t *req)
+{
+    esp_err_t error;
+    ESP_LOGI(TAG, "Favicon.ico Requested");
+    error = http_server_send_asset(req, "/favicon.ico", "image/x-icon", favicon_ico_start, favicon_ico_end);
+    if (error != ESP_OK)
+    {
+        ESP_LOGI(TAG, "http_server_favicon_handler: Error %d while sending Response", error);
+    }
+    else
+    {
+        ESP_LOGI(TAG, "http_server_favicon_handler: Response Sent Successfully");
+    }
+    return error;
+}
+
+/*
+ * OTA pipeline sink, runs on the flash writer task
+ * @param data block to write
+ * @param len length of the block
+ * @param ctx http_server_ota_upload_t of the running update
+ * @return result of esp_ota_write
+ */
+static esp_err_t http_server_ota_write_sink(const void *data, size_t len, void *ctx)
+{
+    esp_err_t error = esp_ota_write(((http_server_ota_upload_t *)ctx)->ota_handle, data, len);
+    if (error == ESP_OK)
+    {
+        atomic_fetch_add(&http_server_ota_progress.written, len);
+    }
+    return error;
+}
+
+/*
+ * Multipart parser callback, copies file content into pipeline blocks and
+ * submits every block as soon as it is full
+ * @param data file content, points into the receive buffer
+ * @param len length of data
+ * @param ctx http_server_ota_upload_t of the running update
+ * @return ESP_OK, or the first write error reported by the pipeline
+ */
+static esp_err_t http_server_ota_data_cb(const char *data, size_t len, void *ctx)
+{
+    http_server_ota_upload_t *upload = (http_server_ota_upload_t *)ctx;
+
+    while (len > 0)
+    {
+        if (upload->block == NULL)
+        {
+            upload->block = ota_pipeline_acquire(&upload->block_len);
+            upload->filled = 0;
+            if (upload->block == NULL)
+            {
+                return ESP_ERR_TIMEOUT;
+            }
+        }
+
+        size_t n = MIN(len, upload->block_len - upload->filled);
+        memcpy(upload->block + upload->filled, data, n);
+        upload->filled += n;
+        upload->image_len += n;
+        data += n;
+        len -= n;
+
+        if (upload->filled == upload->block_len)
+        {
+            esp_err_t error = ota_pipeline_submit(upload->block, upload->filled);
+            upload->block = NULL;
+            if (error != ESP_OK)
+            {
+                return error;
+            }
+        }
+    }
+    return ESP_OK;
+}
+
+/*
+ * Multipart parser callback, the file content may be a plain, compressed or
+ * delta image and goes through the decoder first
+ * @param data file content
+ * @param len length of data
+ * @param ctx http_server_ota_upload_t of the running update
+ * @return result of ota_decoder_feed
+ */
+static esp_err_t http_server_ota_file_cb(const char *data, size_t len, void *ctx)
+{
+    http_server_ota_upload_t *upload = (http_server_ota_upload_t *)ctx;
+
+    // The digest covers the file as uploaded, so the client can compute it
+    // from the file it sends whether that is packed or not
+    mbedtls_sha256_update(&upload->sha256, (const unsigned char *)data, len);
+    return ota_decoder_feed(upload->decoder, data, len);
+}
+
+/*
+ * Decoder callback for delta images, reads from the running app partition
+ * @param ctx unused
+ * @return result of esp_partition_read
+ */
+static esp_err_t http_server_ota_read_base(size_t offset, void *dest, size_t len, void *ctx)
+{
+    return esp_partition_read(esp_ota_get_running_partition(), offset, dest, len);
+}
+
+/*
+ * Returns the SHA-256 of the running image, computed once per boot since it
+ * only changes with a reboot into a new image
+ * @return digest, NULL if it could not be computed
+ */
+static const uint8_t *http_server_running_image_digest(void)
+{
+    static uint8_t digest[OTA_DECODER_DIGEST_LEN];
+    static bool is_digest_valid = false;
+
+    if (!is_digest_valid)
+    {
+        is_digest_valid = (esp_partition_get_sha256(esp_ota_get_running_partition(), digest) == ESP_OK);
+    }
+    return is_digest_valid ? digest : NULL;
+}
+
+/*
+ * Reads the digest the client expects for the uploaded file
+ * @param req HTTP request of the upload
+ * @param digest receives the 32 byte SHA-256
+ * @return ESP_OK, ESP_ERR_NOT_FOUND without an X-OTA-SHA256 header,
+ * ESP_ERR_INVALID_ARG if it is not 64 hex digits
+ */
+static esp_err_t http_server_ota_expected_digest(httpd_req_t *req, uint8_t *digest)
+{
+    char hex[HTTP_SERVER_SHA256_HEX_LEN + 1];
+    size_t hex_len = httpd_req_get_hdr_value_len(req, "X-OTA-SHA256");
+
+    if (hex_len == 0)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if ((hex_len != HTTP_SERVER_SHA256_HEX_LEN) ||
+        (httpd_req_get_hdr_value_str(req, "X-OTA-SHA256", hex, sizeof(hex)) != ESP_OK))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    for (size_t i = 0; i < HTTP_SERVER_SHA256_LEN; i++)
+    {
+        unsigned int byte;
+        if (!isxdigit((unsigned char)hex[2 * i]) || !isxdigit((unsigned char)hex[2 * i + 1]) ||
+            (sscanf(&hex[2 * i], "%2x", &byte) != 1))
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+        digest[i] = (uint8_t)byte;
+    }
+    return ESP_OK;
+}
+
+static uint32_t http_server_now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+/*
+ * Receives the firmware file and writes it to the next OTA partition, then
+ * answers the request. Runs on the upload task.
+ * @param req asynchronous copy of the /OTAupdate request
+ * @return ESP_OK if the new image was set as boot partition
+ */
+static esp_err_t http_server_ota_upload(httpd_req_t *req)
+{
+    esp_err_t error;
+    size_t content_len = req->content_len; // total content length
+    size_t content_received = 0;
+    http_server_ota_upload_t upload = {0};
+    multipart_parser_t parser;
+    char content_type[HTTP_SERVER_CONTENT_TYPE_MAX_LEN];
+    bool flash_successful = false;
+    int64_t start_time = esp_timer_get_time();
+
+    // The web page posts the image as multipart/form-data, the boundary is
+    // needed to separate the file content from the form framing
+    if ((content_len == 0) ||
+        (httpd_req_get_hdr_value_str(req, "Content-Type", content_type, sizeof(content_type)) != ESP_OK) ||
+        (multipart_parser_init(&parser, content_type, http_server_ota_file_cb, &upload) != ESP_OK))
+    {
+        ESP_LOGE(TAG, "http_server_ota_upload: Expected a multipart/form-data upload");
+        http_server_monitor_send_msg(HTTP_MSG_WIFI_OTA_UPDATE_FAILED);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Expected multipart/form-data");
+        return ESP_FAIL;
+    }
+
+    // The digest is optional, the web page can only compute it in a secure context
+    error = http_server_ota_expected_digest(req, upload.expected_sha256);
+    if (error == ESP_ERR_INVALID_ARG)
+    {
+        ESP_LOGE(TAG, "http_server_ota_upload: Malformed X-OTA-SHA256 header");
+        http_server_monitor_send_msg(HTTP_MSG_WIFI_OTA_UPDATE_FAILED);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "X-OTA-SHA256 must be 64 hex digits");
+        return ESP_FAIL;
+    }
+    upload.has_expected_sha256 = (error == ESP_OK);
+
+    fw_update_status = OTA_UPDATE_PENDING;
+    atomic_store(&http_server_ota_progress.total, content_len);
+    atomic_store(&http_server_ota_progress.received, 0);
+    atomic_store(&http_server_ota_progress.written, 0);
+    atomic_store(&http_server_ota_progress.start_ms, http_server_now_ms());
+    atomic_store(&http_server_ota_progress.end_ms, 0);
+    atomic_store(&http_server_ota_progress.digest,
+                 upload.has_expected_sha256 ? HTTP_SERVER_OTA_DIGEST_PENDING : HTTP_SERVER_OTA_DIGEST_NONE);
+
+    // get the next OTA app partition which should be written with a new firmware
+    const esp_partition_t *update_partition = esp_ota_get_next_update_partition(NULL);
+    if (update_partition == NULL)
+    {
+        ESP_LOGE(TAG, "http_server_ota_upload: No OTA partition available");
+        http_server_monitor_send_msg(HTTP_MSG_WIFI_OTA_UPDATE_FAILED);
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    /*
+     * With OTA_WITH_SEQUENTIAL_WRITES the partition is erased sector by sector
+     * inside esp_ota_write instead of all at once here, so the erase time is
+     * spread over the writer task and overlaps with the network receive.
+     */
+    error = esp_ota_begin(update_partition, OTA_WITH_SEQUENTIAL_WRITES, &upload.ota_handle);
+    if (error != ESP_OK)
+    {
+        ESP_LOGE(TAG, "http_server_ota_upload: Error with OTA Begin, Canceling OTA");
+        http_server_monitor_send_msg(HTTP_MSG_WIFI_OTA_UPDATE_FAILED);
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "http_server_ota_upload: Receiving %u bytes for partition subtype %d at offset 0x%lx",
+             (unsigned)content_len, update_partition->subtype, update_partition->address);
+
+    mbedtls_sha256_init(&upload.sha256);
+    mbedtls_sha256_starts(&upload.sha256, 0);
+
+    // Packed images are expanded on the fly, the decoder only needs its 4 KB window
+    const ota_decoder_config_t decoder_config = {
+        .write = http_server_ota_data_cb,
+        .read_base = http_server_ota_read_base,
+        .base_digest = http_server_running_image_digest(),
+        .base_size = esp_ota_get_running_partition()->size,
+        .ctx = &upload};
+    upload.decoder = malloc(sizeof(ota_decoder_t));
+    // Not a server task's buffer: this task runs alongside the server tasks
+    char *recv_buffer = malloc(HTTP_SERVER_OTA_RECV_SIZE);
+    error = ((upload.decoder != NULL) && (recv_buffer != NULL)) ? ota_decoder_init(upload.decoder, &decoder_config) : ESP_ERR_NO_MEM;
+
+    // Decoded content is written by a separate task while the next chunk is received
+    const ota_pipeline_sink_t sink = {.write = http_server_ota_write_sink, .ctx = &upload};
+    if (error == ESP_OK)
+    {
+        error = ota_pipeline_start(&sink);
+    }
+
+    // The parser hands only the file bytes on
+    while ((error == ESP_OK) && (content_received < content_len))
+    {
+        size_t recv_len = 0;
+        error = req_body_recv(req, recv_buffer, MIN(HTTP_SERVER_OTA_RECV_SIZE, content_len - content_received), &recv_len);
+        if (error != ESP_OK)
+        {
+            // Also covers a client that disconnects before content_len bytes arrived
+            ESP_LOGE(TAG, "http_server_ota_upload: Receive failed after %u of %u bytes: %s",
+                     (unsigned)content_received, (unsigned)content_len, esp_err_to_name(error));
+            break;
+        }
+        content_received += recv_len;
+        atomic_store(&http_server_ota_progress.received, content_received);
+        error = multipart_parser_feed(&parser, recv_buffer, recv_len);
+    }
+
+    // The body must end with the closing boundary and a packed image must
+    // decode to its full size, anything else is a short upload
+    if (error == ESP_OK)
+    {
+        error = multipart_parser_finish(&parser);
+    }
+    if (error == ESP_OK)
+    {
+        error = ota_decoder_finish(upload.decoder);
+    }
+
+    // Hand over the last, partially filled block
+    if (upload.block != NULL)
+    {
+        esp_err_t write_error = ota_pipeline_submit(upload.block, (error == ESP_OK) ? upload.filled : 0);
+        if (error == ESP_OK)
+        {
+            error = write_error;
+        }
+    }
+
+    // Wait for the writer task, it reports the first esp_ota_write failure
+    esp_err_t write_error = ota_pipeline_finish();
+    if (error == ESP_OK)
+    {
+        error = write_error;
+    }
+
+    // The digest was computed while receiving, so checking it costs no extra
+    // pass over the flash and happens before the image can become bootable
+    if ((error == ESP_OK) && upload.has_expected_sha256)
+    {
+        uint8_t digest[HTTP_SERVER_SHA256_LEN];
+        mbedtls_sha256_finish(&upload.sha256, digest);
+        if (memcmp(digest, upload.expected_sha256, sizeof(digest)) != 0)
+        {
+            ESP_LOGE(TAG, "http_server_ota_upload: SHA-256 of the upload does not match X-OTA-SHA256");
+            atomic_store(&http_server_ota_progress.digest, HTTP_SERVER_OTA_DIGEST_MISMATCH);
+            error = ESP_ERR_INVALID_CRC;
+        }
+        else
+        {
+            atomic_store(&http_server_ota_progress.digest, HTTP_SERVER_OTA_DIGEST_VERIFIED);
+        }
+    }
+    mbedtls_sha256_free(&upload.sha256);
+
+    if (error != ESP_OK)
+    {
+        ESP_LOGE(TAG, "http_server_ota_upload: Update failed: %s", esp_err_to_name(error));
+        esp_ota_abort(upload.ota_handle);
+    }
+    /* Finish the OTA update and validate newly written app image.
+     * After calling esp_ota_end, the handle is no longer valid and memory associated
+     * with it is freed (regardless of the results).
+     */
+    else if (esp_ota_end(upload.ota_handle) == ESP_OK)
+    {
+        // let's update the partition i.e. configure OTA data for new boot partition
+        if (esp_ota_set_boot_partition(update_partition) == ESP_OK)
+        {
+            const esp_partition_t *boot_partition = esp_ota_get_boot_partition();
+            ESP_LOGI(TAG, "http_server_ota_upload: Next boot partition subtype %d at offset 0x%lx", boot_partition->subtype, boot_partition->address);
+            flash_successful = true;
+        }
+        else
+        {
+            ESP_LOGI(TAG, "http_server_ota_upload: Flash Error");
+        }
+    }
+    else
+    {
+        ESP_LOGI(TAG, "http_server_ota_upload: esp_ota_end Error");
+    }
+
+    ESP_LOGI(TAG, "http_server_ota_upload: %u bytes received, %u bytes written in %lld ms",
+             (unsigned)content_received, (unsigned)upload.image_len,
+             (long long)((esp_timer_get_time() - start_time) / 1000));
+    atomic_store(&http_server_ota_progress.end_ms, MAX(http_server_now_ms(), 1u));
+    free(recv_buffer);
+    free(upload.decoder);
+
+    // We won't update the global variables throughout the file, so send the message about the status
+    if (flash_successful)
+    {
+        http_server_monitor_send_msg(HTTP_MSG_WIFI_OTA_UPDATE_SUCCESSFUL);
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_sendstr(req, "{\"ota_update_status\":1}");
+        return ESP_OK;
+    }
+
+    http_server_monitor_send_msg(HTTP_MSG_WIFI_OTA_UPDATE_FAILED);
+    if (error == ESP_ERR_INVALID_CRC)
+    {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "SHA-256 mismatch");
+    }
+    else
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Firmware update failed");
+    }
+    return ESP_FAIL;
+}
+
+/*
+ * Upload task, one per firmware update so the HTTP server keeps serving
+ * /OTAstatus and the other pages while the image is received
+ * @param arg asynchronous copy of the /OTAupdate request
+ */
+static void http_server_ota_upload_task(void *arg)
+{
+    httpd_req_t *req = (httpd_req_t *)arg;
+
+    http_server_ota_upload(req);
+    if (http_server_conn_budgeted(req))
+    {
+        conn_budget_request_end(httpd_req_to_sockfd(req), esp_timer_get_time());
+    }
+    httpd_req_async_handler_complete(req);
+    atomic_store(&http_server_ota_progress.active, false);
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief Receives the *.bin file via the web page and handles the firmware update
+ * on a dedicated task
+ * @param req HTTP request for which the uri needs to be handled
+ * @return ESP_OK, other ESP_FAIL if the upload task canot be started
+ */
+static esp_err_t http_server_ota_update_handler(httpd_req_t *req)
+{
+    httpd_req_t *async_req = NULL;
+
+    // A second upload would write the same partition, refuse it
+    if (atomic_exchange(&http_server_ota_progress.active, true))
+    {
+        ESP_LOGW(TAG, "http_server_ota_update_handler: Update already in progress");
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "30");
+        httpd_resp_sendstr(req, "Firmware update already in progress");
+        return ESP_FAIL;
+    }
+
+    if (httpd_req_async_handler_begin(req, &async_req) != ESP_OK)
+    {
+        atomic_store(&http_server_ota_progress.active, false);
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    // The upload outlives the handler, its connection stays busy until the task ends it
+    bool budgeted = http_server_conn_budgeted(async_req);
+    if (budgeted)
+    {
+        conn_budget_request_begin(httpd_req_to_sockfd(async_req), esp_timer_get_time());
+    }
+    if (xTaskCreate(http_server_ota_upload_task, "ota_upload", HTTP_SERVER_OTA_TASK_STACK_SIZE, async_req,
+                    HTTP_SERVER_OTA_TASK_PRIORITY, NULL) != pdPASS)
+    {
+        ESP_LOGE(TAG, "http_server_ota_update_handler: Failed to create the upload task");
+        if (budgeted)
+        {
+            conn_budget_request_end(httpd_req_to_sockfd(async_req), esp_timer_get_time());
+        }
+        httpd_resp_send_500(async_req);
+        httpd_req_async_handler_complete(async_req);
+        atomic_store(&http_server_ota_progress.active, false);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t http_server_rfid_manager_get_default_cards_handler(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "RFID default cards requested");
 
     // Set content type
     httpd_resp_set_type(req, "application/json");
@@ -580,8 +1933,7 @@ static esp_err_t http_server_rfid_html_handler(httpd_req_t *req)
 {
     esp_err_t error;
     ESP_LOGI(TAG, "RFID HTML Requested");
-    httpd_resp_set_type(req, "text/html");
-    error = httpd_resp_send(req, (const char *)rfid_html_start, rfid_html_end - rfid_html_start);
+    error = http_server_send_asset(req, "/rfid.html", "text/html", rfid_html_start, rfid_html_end);
     if (error != ESP_OK)
     {
         ESP_LOGI(TAG, "http_server_rfid_html_handler: Error %d while sending Response", error);
@@ -602,8 +1954,7 @@ static esp_err_t http_server_rfid_css_handler(httpd_req_t *req)
 {
     esp_err_t error;
     ESP_LOGI(TAG, "RFID CSS Requested");
-    httpd_resp_set_type(req, "text/css");
-    error = httpd_resp_send(req, (const char *)rfid_css_start, rfid_css_end - rfid_css_start);
+    error = http_server_send_asset(req, "/rfid.css", "text/css", rfid_css_start, rfid_css_end);
     if (error != ESP_OK)
     {
         ESP_LOGI(TAG, "http_server_rfid_css_handler: Error %d while sending Response", error);
@@ -624,50 +1975,427 @@ static esp_err_t http_server_rfid_js_handler(httpd_req_t *req)
 {
     esp_err_t error;
     ESP_LOGI(TAG, "RFID JS Requested");
-    httpd_resp_set_type(req, "application/javascript");
-    error = httpd_resp_send(req, (const char *)rfid_js_start, rfid_js_end - rfid_js_start);
+    error = http_server_send_asset(req, "/rfid.js", "application/javascript", rfid_js_start, rfid_js_end);
     if (error != ESP_OK)
     {
         ESP_LOGI(TAG, "http_server_rfid_js_handler: Error %d while sending Response", error);
     }
     else
     {
-        ESP_LOGI(TAG, "http_server_rfid_js_handler: Response Sent Successfully");
+        ESP_LOGI(TAG, "http_server_rfid_js_handler: Response Sent Successfully");
+    }
+    return error;
+}
+
+/*
+ * OTA status handler responds with the firmware update status after the OTA
+ * update is started and responds with the compile time & date when the page is
+ * first requested. While an upload runs it also reports its progress.
+ * @param req HTTP request for which the URI needs to be handled
+ * @return ESP_OK
+ */
+static esp_err_t http_server_ota_status_handler(httpd_req_t *req)
+{
+    static const char *const digest_names[] = {"none", "pending", "verified", "mismatch"};
+    char ota_JSON[320];
+
+    bool active = atomic_load(&http_server_ota_progress.active);
+    uint32_t total = atomic_load(&http_server_ota_progress.total);
+    uint32_t received = atomic_load(&http_server_ota_progress.received);
+    uint32_t written = atomic_load(&http_server_ota_progress.written);
+    uint32_t end_ms = atomic_load(&http_server_ota_progress.end_ms);
+    int digest = atomic_load(&http_server_ota_progress.digest);
+
+    // Throughput over the whole upload so far, the ETA assumes it holds
+    uint32_t elapsed_ms = ((end_ms != 0) ? end_ms : http_server_now_ms()) - atomic_load(&http_server_ota_progress.start_ms);
+    uint32_t rate = (elapsed_ms > 0) ? (uint32_t)((uint64_t)received * 1000u / elapsed_ms) : 0;
+    uint32_t eta = (active && rate > 0 && total > received) ? (total - received + rate - 1) / rate : 0;
+
+    ESP_LOGI(TAG, "OTA Status Requested");
+    snprintf(ota_JSON, sizeof(ota_JSON),
+             "{\"ota_update_status\":%d,\"compile_time\":\"%s\",\"compile_date\":\"%s\","
+             "\"ota_active\":%s,\"ota_total\":%lu,\"ota_received\":%lu,\"ota_written\":%lu,"
+             "\"ota_rate\":%lu,\"ota_eta\":%lu,\"ota_sha256\":\"%s\"}",
+             fw_update_status, __TIME__, __DATE__, active ? "true" : "false",
+             (unsigned long)total, (unsigned long)received, (unsigned long)written,
+             (unsigned long)rate, (unsigned long)eta, digest_names[digest]);
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, ota_JSON, strlen(ota_JSON));
+
+    return ESP_OK;
+}
+
+/*
+ * Metrics writer output, sent as one chunk of the /metrics response
+ * @param ctx HTTP request being answered
+ * @return result of httpd_resp_send_chunk
+ */
+static esp_err_t http_server_metrics_flush(const char *data, size_t len, void *ctx)
+{
+    return httpd_resp_send_chunk((httpd_req_t *)ctx, data, len);
+}
+
+/*
+ * Renders all metrics in the Prometheus text format. Nothing is aggregated
+ * between scrapes, so the cost is only paid when the endpoint is requested.
+ * @param req HTTP request for which the URI needs to be handled
+ * @return ESP_OK, or the send error
+ */
+static esp_err_t http_server_metrics_handler(httpd_req_t *req)
+{
+    // Too large for the server task's stack, each server has its own
+    metrics_writer_t *writer = &http_server_task_state_of(req)->metrics;
+    char labels[96];
+    dns_server_stats_t dns_stats;
+    conn_budget_stats_t conn_stats;
+#if CONFIG_APP_LOCAL_SERVER_HTTPS
+    session_cache_stats_t tls_stats;
+#endif
+    int client_fds[HTTP_SERVER_MAX_OPEN_SOCKETS];
+    size_t client_count = HTTP_SERVER_MAX_OPEN_SOCKETS;
+
+    httpd_resp_set_type(req, "text/plain; version=0.0.4; charset=utf-8");
+    metrics_writer_init(writer, http_server_metrics_flush, req);
+
+    metrics_write_family(writer, "portal_http_request_duration_seconds", "histogram", "Time spent in the URI handler");
+    for (size_t i = 0; i < URI_HANDLERS_COUNT; i++)
+    {
+        snprintf(labels, sizeof(labels), "route=\"%s\",method=\"%s\"",
+                 uri_handlers[i].uri, http_method_str(uri_handlers[i].method));
+        metrics_write_histogram(writer, "portal_http_request_duration_seconds", labels, &http_server_routes[i].latency);
+    }
+
+    metrics_write_family(writer, "portal_http_request_errors_total", "counter", "Requests whose handler returned an error");
+    for (size_t i = 0; i < URI_HANDLERS_COUNT; i++)
+    {
+        snprintf(labels, sizeof(labels), "route=\"%s\",method=\"%s\"",
+                 uri_handlers[i].uri, http_method_str(uri_handlers[i].method));
+        metrics_write_sample(writer, "portal_http_request_errors_total", labels, metrics_counter_get(&http_server_routes[i].errors));
+    }
+
+    metrics_write_family(writer, "portal_http_rate_limited_total", "counter", "Requests refused with 429 by the per client limit");
+    for (size_t i = 0; i < URI_HANDLERS_COUNT; i++)
+    {
+        if (http_server_routes[i].limit != NULL)
+        {
+            snprintf(labels, sizeof(labels), "route=\"%s\",method=\"%s\"",
+                     uri_handlers[i].uri, http_method_str(uri_handlers[i].method));
+            metrics_write_sample(writer, "portal_http_rate_limited_total", labels, metrics_counter_get(&http_server_routes[i].limited));
+        }
+    }
+    metrics_write_family(writer, "portal_http_busy_total", "counter", "Requests refused with 503, the worker queue was full");
+    for (size_t i = 0; i < URI_HANDLERS_COUNT; i++)
+    {
+        if (http_server_routes[i].worker)
+        {
+            snprintf(labels, sizeof(labels), "route=\"%s\",method=\"%s\"",
+                     uri_handlers[i].uri, http_method_str(uri_handlers[i].method));
+            metrics_write_sample(writer, "portal_http_busy_total", labels, metrics_counter_get(&http_server_routes[i].busy));
+        }
+    }
+    http_workers_stats_t *worker_stats = http_workers_get_stats();
+    metrics_write_family(writer, "portal_http_worker_queue_wait_seconds", "histogram", "Time a slow request waited for a worker");
+    metrics_write_histogram(writer, "portal_http_worker_queue_wait_seconds", NULL, &worker_stats->queue_wait);
+    metrics_write_family(writer, "portal_http_worker_queued", "gauge", "Requests waiting for a worker");
+    metrics_write_sample(writer, "portal_http_worker_queued", NULL, atomic_load(&worker_stats->queued));
+    metrics_write_family(writer, "portal_http_worker_busy", "gauge", "Workers running a request");
+    metrics_write_sample(writer, "portal_http_worker_busy", NULL, atomic_load(&worker_stats->busy));
+
+    metrics_write_family(writer, "portal_rate_limit_evictions_total", "counter", "Clients dropped from a full rate limit table");
+    metrics_write_sample(writer, "portal_rate_limit_evictions_total", "limit=\"card_check\"", http_server_card_check_limit.evictions);
+    metrics_write_sample(writer, "portal_rate_limit_evictions_total", "limit=\"card_write\"", http_server_card_write_limit.evictions);
+
+    metrics_write_family(writer, "portal_http_redirects_total", "counter", "Unknown URIs redirected to the portal");
+    metrics_write_sample(writer, "portal_http_redirects_total", NULL, metrics_counter_get(&http_server_redirects));
+
+    metrics_write_family(writer, "portal_captive_probes_total", "counter", "OS connectivity probes by answer");
+    for (size_t os = 0; os < CAPTIVE_PROBE_OS_COUNT; os++)
+    {
+        for (size_t answer = 0; answer < HTTP_SERVER_PROBE_ANSWER_COUNT; answer++)
+        {
+            snprintf(labels, sizeof(labels), "os=\"%s\",answer=\"%s\"",
+                     captive_probe_os_names[os], http_server_probe_answer_names[answer]);
+            metrics_write_sample(writer, "portal_captive_probes_total", labels,
+                                 metrics_counter_get(&http_server_probe_answers[os][answer]));
+        }
+    }
+    metrics_write_family(writer, "portal_captive_join_to_probe_seconds", "summary", "Client joined the AP to its first probe");
+    metrics_write_summary(writer, "portal_captive_join_to_probe_seconds", NULL,
+                          &http_server_join_to_stage[CAPTIVE_PROBE_STAGE_PROBE]);
+    metrics_write_family(writer, "portal_captive_join_to_portal_seconds", "summary", "Client joined the AP to opening the portal page");
+    metrics_write_summary(writer, "portal_captive_join_to_portal_seconds", NULL,
+                          &http_server_join_to_stage[CAPTIVE_PROBE_STAGE_PORTAL]);
+
+    metrics_write_family(writer, "portal_assets_served_total", "counter", "Web UI files by where they were sent from");
+    for (size_t i = 0; i < HTTP_SERVER_ASSET_SOURCE_COUNT; i++)
+    {
+        snprintf(labels, sizeof(labels), "source=\"%s\"", http_server_asset_source_names[i]);
+        metrics_write_sample(writer, "portal_assets_served_total", labels, metrics_counter_get(&http_server_assets_served[i]));
+    }
+
+    if (httpd_get_client_list(http_server_handle, &client_count, client_fds) != ESP_OK)
+    {
+        client_count = 0;
+    }
+    metrics_write_family(writer, "portal_http_open_sockets", "gauge", "Open HTTP client sockets");
+    metrics_write_sample(writer, "portal_http_open_sockets", NULL, client_count);
+    metrics_write_family(writer, "portal_http_max_sockets", "gauge", "HTTP client socket limit");
+    metrics_write_sample(writer, "portal_http_max_sockets", NULL, HTTP_SERVER_CLIENT_SOCKETS);
+
+    metrics_write_family(writer, "portal_socket_reserved", "gauge", "Sockets of CONFIG_LWIP_MAX_SOCKETS set aside per subsystem");
+    for (size_t i = 0; i < sizeof(http_server_socket_reservations) / sizeof(http_server_socket_reservations[0]); i++)
+    {
+        snprintf(labels, sizeof(labels), "subsystem=\"%s\"", http_server_socket_reservations[i].subsystem);
+        metrics_write_sample(writer, "portal_socket_reserved", labels, http_server_socket_reservations[i].sockets);
+    }
+    conn_budget_get_stats(&conn_stats);
+    metrics_write_family(writer, "portal_http_connections_open", "gauge", "Admitted HTTP connections by session");
+    for (size_t i = 0; i < CONN_BUDGET_CLASS_COUNT; i++)
+    {
+        snprintf(labels, sizeof(labels), "session=\"%s\"", http_server_conn_class_names[i]);
+        metrics_write_sample(writer, "portal_http_connections_open", labels, conn_stats.open[i]);
+    }
+    metrics_write_family(writer, "portal_http_connections_admitted_total", "counter", "HTTP connections admitted by session");
+    for (size_t i = 0; i < CONN_BUDGET_CLASS_COUNT; i++)
+    {
+        snprintf(labels, sizeof(labels), "session=\"%s\"", http_server_conn_class_names[i]);
+        metrics_write_sample(writer, "portal_http_connections_admitted_total", labels, conn_stats.admitted[i]);
+    }
+    metrics_write_family(writer, "portal_http_connections_evicted_total", "counter", "Idle HTTP connections closed to admit a new one");
+    for (size_t i = 0; i < CONN_BUDGET_REASON_COUNT; i++)
+    {
+        snprintf(labels, sizeof(labels), "reason=\"%s\"", http_server_conn_reason_names[i]);
+        metrics_write_sample(writer, "portal_http_connections_evicted_total", labels, conn_stats.evicted[i]);
+    }
+    metrics_write_family(writer, "portal_http_connections_rejected_total", "counter", "New HTTP connections refused with 503");
+    for (size_t i = 0; i < CONN_BUDGET_REASON_COUNT; i++)
+    {
+        snprintf(labels, sizeof(labels), "reason=\"%s\"", http_server_conn_reason_names[i]);
+        metrics_write_sample(writer, "portal_http_connections_rejected_total", labels, conn_stats.rejected[i]);
+    }
+    metrics_write_family(writer, "portal_http_connections_peak", "gauge", "Most HTTP connections open at once");
+    metrics_write_sample(writer, "portal_http_connections_peak", NULL, conn_stats.peak);
+#if CONFIG_APP_LOCAL_SERVER_HTTPS
+    session_cache_get_stats(&tls_stats);
+    metrics_write_family(writer, "portal_tls_sessions_stored_total", "counter", "TLS sessions of full handshakes cached");
+    metrics_write_sample(writer, "portal_tls_sessions_stored_total", NULL, tls_stats.stored);
+    metrics_write_family(writer, "portal_tls_sessions_resumed_total", "counter", "TLS handshakes resumed from the session cache");
+    metrics_write_sample(writer, "portal_tls_sessions_resumed_total", NULL, tls_stats.hits);
+    metrics_write_family(writer, "portal_tls_sessions_missed_total", "counter", "Offered TLS session IDs that were unknown or expired");
+    metrics_write_sample(writer, "portal_tls_sessions_missed_total", NULL, tls_stats.misses);
+    metrics_write_family(writer, "portal_tls_sessions_evicted_total", "counter", "Live TLS sessions replaced because the cache was full");
+    metrics_write_sample(writer, "portal_tls_sessions_evicted_total", NULL, tls_stats.evicted);
+    metrics_write_family(writer, "portal_tls_sessions_cached", "gauge", "TLS sessions held in the cache");
+    metrics_write_sample(writer, "portal_tls_sessions_cached", NULL, tls_stats.entries);
+#endif
+
+    metrics_write_family(writer, "portal_card_checks_total", "counter", "RFID card checks by decision");
+    for (size_t i = 0; i < HTTP_SERVER_CARD_OUTCOME_COUNT; i++)
+    {
+        snprintf(labels, sizeof(labels), "outcome=\"%s\"", http_server_card_outcome_names[i]);
+        metrics_write_sample(writer, "portal_card_checks_total", labels, metrics_counter_get(&http_server_card_checks[i]));
+    }
+
+    dns_server_get_stats(&dns_stats);
+    metrics_write_family(writer, "portal_dns_queries_total", "counter", "DNS queries received");
+    metrics_write_sample(writer, "portal_dns_queries_total", NULL, dns_stats.queries);
+    metrics_write_family(writer, "portal_dns_answers_total", "counter", "DNS replies sent");
+    metrics_write_sample(writer, "portal_dns_answers_total", NULL, dns_stats.answered);
+    metrics_write_family(writer, "portal_dns_malformed_total", "counter", "DNS queries that could not be answered");
+    metrics_write_sample(writer, "portal_dns_malformed_total", NULL, dns_stats.malformed);
+    metrics_write_family(writer, "portal_dns_ignored_total", "counter", "DNS messages with another opcode than a query");
+    metrics_write_sample(writer, "portal_dns_ignored_total", NULL, dns_stats.ignored);
+    metrics_write_family(writer, "portal_dns_send_errors_total", "counter", "DNS replies the stack could not send");
+    metrics_write_sample(writer, "portal_dns_send_errors_total", NULL, dns_stats.send_errors);
+    metrics_write_family(writer, "portal_dns_wakeups_total", "counter", "Times the DNS task woke up to drain its socket");
+    metrics_write_sample(writer, "portal_dns_wakeups_total", NULL, dns_stats.wakeups);
+    metrics_write_family(writer, "portal_dns_batch_max", "gauge", "Most DNS queries answered in one wakeup");
+    metrics_write_sample(writer, "portal_dns_batch_max", NULL, dns_stats.batch_max);
+    metrics_write_family(writer, "portal_dns_forwarded_total", "counter", "DNS queries sent to the upstream resolver");
+    metrics_write_sample(writer, "portal_dns_forwarded_total", NULL, dns_stats.forwarded);
+    metrics_write_family(writer, "portal_dns_cache_hits_total", "counter", "DNS queries answered from the cache");
+    metrics_write_sample(writer, "portal_dns_cache_hits_total", NULL, dns_stats.cache_hits);
+    metrics_write_family(writer, "portal_dns_upstream_timeouts_total", "counter",
+                         "Forwarded DNS queries the upstream resolver did not answer in time");
+    metrics_write_sample(writer, "portal_dns_upstream_timeouts_total", NULL, dns_stats.upstream_timeouts);
+    metrics_write_family(writer, "portal_dns_upstream_failures_total", "counter",
+                         "DNS queries answered SERVFAIL because no upstream resolver was usable");
+    metrics_write_sample(writer, "portal_dns_upstream_failures_total", NULL, dns_stats.upstream_failures);
+    metrics_write_family(writer, "portal_dns_refused_total", "counter", "DNS queries dropped by the per client limit");
+    metrics_write_sample(writer, "portal_dns_refused_total", NULL, dns_stats.refused);
+    metrics_write_family(writer, "portal_dns_clients_evicted_total", "counter", "Sources dropped from the full DNS client table");
+    metrics_write_sample(writer, "portal_dns_clients_evicted_total", NULL, dns_stats.clients_evicted);
+
+    // Top talkers, the entries change as sources come and go so these are gauges
+    dns_server_client_t dns_clients[DNS_SERVER_TOP_CLIENTS];
+    size_t dns_client_count = dns_server_get_top_clients(dns_clients, DNS_SERVER_TOP_CLIENTS);
+    static const struct
+    {
+        const char *name;
+        const char *help;
+    } dns_client_families[] = {
+        {"portal_dns_top_client_queries", "DNS queries of the busiest sources since they got a table entry"},
+        {"portal_dns_top_client_refused", "DNS queries of the busiest sources dropped by the limit"},
+        {"portal_dns_top_client_names", "Different names the busiest sources asked for in the last 10 to 20 s"},
+    };
+    for (size_t f = 0; f < sizeof(dns_client_families) / sizeof(dns_client_families[0]); f++)
+    {
+        metrics_write_family(writer, dns_client_families[f].name, "gauge", dns_client_families[f].help);
+        for (size_t i = 0; i < dns_client_count; i++)
+        {
+            const dns_server_client_t *client = &dns_clients[i];
+            if (client->addr == 0)
+            {
+                snprintf(labels, sizeof(labels), "client=\"shared\"");
+            }
+            else
+            {
+                snprintf(labels, sizeof(labels), "client=\"" IPSTR "\"", IP2STR((esp_ip4_addr_t *)&client->addr));
+            }
+            uint32_t values[] = {client->queries, client->refused, client->names};
+            metrics_write_sample(writer, dns_client_families[f].name, labels, values[f]);
+        }
+    }
+
+    metrics_write_family(writer, "portal_heap_free_bytes", "gauge", "Free heap");
+    metrics_write_sample(writer, "portal_heap_free_bytes", NULL, esp_get_free_heap_size());
+    metrics_write_family(writer, "portal_heap_min_free_bytes", "gauge", "Lowest free heap since boot");
+    metrics_write_sample(writer, "portal_heap_min_free_bytes", NULL, esp_get_minimum_free_heap_size());
+    metrics_write_family(writer, "portal_heap_largest_free_block_bytes", "gauge", "Largest allocatable 8-bit block");
+    metrics_write_sample(writer, "portal_heap_largest_free_block_bytes", NULL, heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+
+    esp_err_t error = metrics_writer_finish(writer);
+    if (error != ESP_OK)
+    {
+        ESP_LOGE(TAG, "http_server_metrics_handler: Error %d while sending metrics", error);
+        return error;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+/*
+ * Redirects the request to the portal page. The Location is absolute because
+ * the request was usually made for another host name.
+ * @param req HTTP request
+ * @return result of sending the response
+ */
+static esp_err_t http_server_send_portal_redirect(httpd_req_t *req)
+{
+    // Only the plain server redirects to the portal (404 handler, probes and
+    // /captive/), its handlers run one at a time on its task
+    static char location[HTTP_SERVER_PORTAL_URL_LEN];
+    uint32_t ip = http_server_socket_addr(req, true);
+    const uint8_t *octets = (const uint8_t *)&ip;
+
+    if (ip != 0)
+    {
+        snprintf(location, sizeof(location), "http://%u.%u.%u.%u/", octets[0], octets[1], octets[2], octets[3]);
+    }
+    else
+    {
+        strcpy(location, "/");
+    }
+    httpd_resp_set_status(req, "302 Temporary Redirect");
+    httpd_resp_set_hdr(req, "Location", location);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    // iOS requires content in the response to detect a captive portal, simply redirecting is not sufficient.
+    return httpd_resp_send(req, "Redirect to the captive portal", HTTPD_RESP_USE_STRLEN);
+}
+
+/*
+ * Answers an OS connectivity probe: a redirect to the portal while the client
+ * has not been through it, the exact response the OS expects afterwards.
+ * Probes repeat every few seconds per device, so nothing is logged above debug.
+ * @param req HTTP request, user_ctx is the captive_probe_t of the URI
+ * @return result of sending the response
+ */
+static esp_err_t http_server_captive_probe_handler(httpd_req_t *req)
+{
+    const captive_probe_t *probe = (const captive_probe_t *)req->user_ctx;
+    uint32_t client = http_server_client_addr(req);
+
+    int64_t join_us = captive_probe_client_reached(client, CAPTIVE_PROBE_STAGE_PROBE, esp_timer_get_time());
+    if (join_us >= 0)
+    {
+        metrics_summary_observe(&http_server_join_to_stage[CAPTIVE_PROBE_STAGE_PROBE], (uint64_t)join_us);
+    }
+
+    if (!captive_probe_is_authorized(client))
+    {
+        ESP_LOGD(TAG, "Probe %s: portal", probe->path);
+        metrics_counter_add(&http_server_probe_answers[probe->os][HTTP_SERVER_PROBE_PORTAL], 1);
+        return http_server_send_portal_redirect(req);
+    }
+
+    ESP_LOGD(TAG, "Probe %s: online", probe->path);
+    metrics_counter_add(&http_server_probe_answers[probe->os][HTTP_SERVER_PROBE_ONLINE], 1);
+    httpd_resp_set_status(req, probe->status);
+    if (probe->content_type != NULL)
+    {
+        httpd_resp_set_type(req, probe->content_type);
+    }
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    return httpd_resp_send(req, probe->body, HTTPD_RESP_USE_STRLEN);
+}
+
+/*
+ * Marks the requesting client as done with the portal, its next probes get
+ * the online answer and the OS closes the sign-in window
+ * @param req HTTP request for which the URI needs to be handled
+ * @return result of sending the response
+ */
+static esp_err_t http_server_captive_accept_handler(httpd_req_t *req)
+{
+    uint32_t client = http_server_client_addr(req);
+
+    if (client == 0)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Client address unknown");
+        return ESP_FAIL;
+    }
+    captive_probe_authorize(client);
+    ESP_LOGI(TAG, "http_server_captive_accept_handler: Client authorized");
+
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_sendstr(req, "{\"status\":\"success\"}");
+}
+
+/*
+ * Subscribes the connection to the live events. A subscribed connection
+ * streams until the client leaves, it is never idle.
+ * @param req HTTP request for which the URI needs to be handled
+ * @return result of sse_events_subscribe_handler
+ */
+static esp_err_t http_server_events_handler(httpd_req_t *req)
+{
+    void *sess_ctx = req->sess_ctx;
+    esp_err_t error = sse_events_subscribe_handler(req);
+
+    // Only a subscription binds a context to the session, a refused one is an ordinary response
+    if (error == ESP_OK && req->sess_ctx != sess_ctx)
+    {
+        conn_budget_request_begin(httpd_req_to_sockfd(req), esp_timer_get_time());
     }
     return error;
 }
 
 /*
- * OTA status handler responds with the firmware update status after the OTA
- * update is started and responds with the compile time & date when the page is
- * first requested
- * @param req HTTP request for which the URI needs to be handled
- * @return ESP_OK
+ * IP_EVENT_AP_STAIPASSIGNED handler, starts timing the client's way to the portal
  */
-static esp_err_t http_server_ota_status_handler(httpd_req_t *req)
+static void http_server_ap_client_joined(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
 {
-    char ota_JSON[100];
-    ESP_LOGI(TAG, "OTA Status Requested");
-    sprintf(ota_JSON, "{\"ota_update_status\":%d,\"compile_time\":\"%s\",\"compile_date\":\"%s\"}", fw_update_status, __TIME__, __DATE__);
-
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, ota_JSON, strlen(ota_JSON));
+    const ip_event_ap_staipassigned_t *event = (const ip_event_ap_staipassigned_t *)event_data;
 
-    return ESP_OK;
+    captive_probe_client_joined(event->ip.addr, event->mac, esp_timer_get_time());
 }
 
 // HTTP Error (404) Handler - Redirects all requests to the root page
 static esp_err_t http_404_error_handler(httpd_req_t *req, httpd_err_code_t err)
 {
-    // Set status
-    httpd_resp_set_status(req, "302 Temporary Redirect");
-    // Redirect to the "/" root directory
-    httpd_resp_set_hdr(req, "Location", "/");
-    // iOS requires content in the response to detect a captive portal, simply redirecting is not sufficient.
-    httpd_resp_send(req, "Redirect to the captive portal", HTTPD_RESP_USE_STRLEN);
-
-    ESP_LOGI(TAG, "Redirecting to root");
-    return ESP_OK;
+    metrics_counter_add(&http_server_redirects, 1);
+    ESP_LOGD(TAG, "Redirecting to root");
+    return http_server_send_portal_redirect(req);
 }
 
 static esp_err_t http_server_get_ssid_handler(httpd_req_t *req)
@@ -740,91 +2468,111 @@ static esp_err_t http_server_get_data_handler(httpd_req_t *req)
     bool isComma = false;
     int32_t length = 0;
     uint16_t rsp_len = 0;
-    char temp_buff[256] = {0};
+    char *output = http_server_task_state_of(req)->response;
     ESP_LOGI(TAG, "Parameters Request Received");
 
-    // Read request content
-    char buf[256];
-    int ret = httpd_req_recv(req, buf, sizeof(buf) - 1);
-    if (ret <= 0)
+    // Read the complete request body into the arena of this task
+    char *buf = http_server_task_buffer(req);
+    size_t body_len = 0;
+    esp_err_t body_error = req_body_read(req, buf, HTTP_SERVER_BODY_ARENA_SIZE, &body_len);
+    if (body_error != ESP_OK)
     {
-        ESP_LOGE(TAG, "Failed to receive request data");
-        httpd_resp_send_500(req);
-        return ESP_FAIL;
+        ESP_LOGE(TAG, "Failed to receive request data: %s", esp_err_to_name(body_error));
+        return req_body_send_error(req, body_error);
     }
-    buf[ret] = '\0';
 
     // Process parameters (this is a placeholder for actual processing logic)
     ESP_LOGI(TAG, "Received parameters: %s", buf);
 
-    // Parse JSON
-    cJSON *json = cJSON_Parse(buf);
-    if (json == NULL)
+    // Tokenize the JSON in place
+    json_scan_token_t tokens[HTTP_SERVER_JSON_MAX_TOKENS];
+    json_scan_t scan;
+    if (json_scan_parse(&scan, buf, body_len, tokens, HTTP_SERVER_JSON_MAX_TOKENS) < 0)
     {
         ESP_LOGE(TAG, "Failed to parse JSON");
         httpd_resp_send_500(req);
         return ESP_FAIL;
     }
 
-    // Extract the "kay" value
+    // Extract the "key" value
     //
     // { "key": "SSID" } -> { "SSID": "NetworkA" }
-    cJSON *key_obj = cJSON_GetObjectItemCaseSensitive(json, "key");
-    if (cJSON_IsString(key_obj) && (key_obj->valuestring != NULL))
-    {
-        // ESP_LOGI(TAG, "Key value: %s", key_obj->valuestring);
-        // I am sending comma separated values in key_obj->valuestring like "SSID,Temp,Humidity"
-        // extract them based on the comma token, give me code to extract them
-        // ',' ASCII value of comma
-        // "," const string
+    size_t keys_len = 0;
+    const char *keys = json_scan_get_raw(&scan, 0, "key", &keys_len);
+    if (keys != NULL)
+    {
+        // Comma separated keys like "SSID,Temp,Humidity" are resolved one by one
+        // straight from the receive buffer
         // {"SSID":"NetworkA", "Temp":"25", "Humidity":"60"}
-        char *token;
+        const char *key = keys;
+        const char *keys_end = keys + keys_len;
 
-        token = strtok(key_obj->valuestring, ",");
+        output[length++] = '{';
 
-        memset(http_server_buffer, 0, HTTP_SERVER_BUFFER_SIZE);
+        while (key < keys_end)
+        {
+            const char *key_end = memchr(key, ',', keys_end - key);
+            if (key_end == NULL)
+            {
+                key_end = keys_end;
+            }
 
-        length = snprintf(http_server_buffer,
-                          HTTP_SERVER_BUFFER_SIZE,
-                          "{");
+            // Ignore blanks around the key
+            const char *key_start = key;
+            while (key_start < key_end && *key_start == ' ')
+            {
+                key_start++;
+            }
+            size_t key_len = key_end - key_start;
+            while (key_len > 0 && key_start[key_len - 1] == ' ')
+            {
+                key_len--;
+            }
 
-        while (token != NULL)
-        {
-            ESP_LOGI(TAG, "Key value: %s", token);
-            memset(temp_buff, 0, sizeof(temp_buff));
-            get_data_rsp_string(token, temp_buff, sizeof(temp_buff));
-            length += snprintf(http_server_buffer + length,
-                               HTTP_SERVER_BUFFER_SIZE - length,
-                               "%s%s",
-                               isComma ? "," : "",
-                               temp_buff);
-            token = strtok(NULL, ",");
-            isComma = true;
+            if (key_len > 0)
+            {
+                // Leave room for the separator and the closing brace
+                size_t separator = isComma ? 1 : 0;
+                int written = data_keys_write(key_start, key_len,
+                                              output + length + separator,
+                                              HTTP_SERVER_BUFFER_SIZE - length - separator - 1);
+                if (written < 0)
+                {
+                    ESP_LOGW(TAG, "Response buffer full, remaining keys skipped");
+                    break;
+                }
+                if (written > 0)
+                {
+                    if (isComma)
+                    {
+                        output[length] = ',';
+                    }
+                    length += separator + written;
+                    isComma = true;
+                }
+            }
+
+            key = key_end + 1;
         }
 
-        length += snprintf(http_server_buffer + length,
-                           HTTP_SERVER_BUFFER_SIZE - length,
-                           "}");
+        output[length++] = '}';
+        output[length] = '\0';
 
-        ESP_LOGI(TAG, "%s [%ld]: %s", key_obj->valuestring, length, http_server_buffer);
+        ESP_LOGI(TAG, "%.*s [%ld]: %s", (int)keys_len, keys, (long)length, output);
     }
     else
     {
-        ESP_LOGE(TAG, "Invalid or missing 'name' key in JSON");
-        cJSON_Delete(json);
+        ESP_LOGE(TAG, "Invalid or missing 'key' key in JSON");
         httpd_resp_send_500(req);
         return ESP_FAIL;
     }
 
-    // Clean up JSON object
-    cJSON_Delete(json);
-
     // Send success response
     const char *response = NULL;
 
     if (length > 0)
     {
-        response = http_server_buffer;
+        response = output;
         rsp_len = length;
     }
     else
@@ -847,60 +2595,49 @@ static esp_err_t http_server_get_data_handler(httpd_req_t *req)
     return error;
 }
 
-bool get_data_rsp_string(char *key, char *buffer, uint16_t len)
+static int http_server_write_temperature(char *buffer, size_t len, void *ctx)
 {
-    if (!key || !buffer || len == 0)
-    {
-        ESP_LOGE(TAG, "Buffer is NULL or length is zero");
-        return false;
-    }
+    return snprintf(buffer, len, "%d", get_temperature()); // Placeholder for temperature
+}
 
-    if (strstr(key, "SSID") != NULL)
-    {
-        snprintf(buffer, len, "\"SSID\":\"%s\"", CONFIG_ESP_WIFI_SSID);
-    }
-    else if (strstr(key, "Temp") != NULL)
-    {
-        snprintf(buffer, len, "\"Temp\":\"%d\"", get_temperature()); // Placeholder for temperature
-    }
-    else if (strstr(key, "Humidity") != NULL)
-    {
-        snprintf(buffer, len, "\"Humidity\":\"%d\"", get_humidity()); // Placeholder for humidity
-    }
-    else if (strstr(key, "UTC") != NULL)
-    {
-        char time_str[20];
-        get_local_time_string_utc(time_str, sizeof(time_str));
-        snprintf(buffer, len, "\"UTC\":\"%s\"", time_str);
-    }
-    else if (strstr(key, "Local") != NULL)
-    {
-        char time_str[20];
-        get_local_time_string(time_str, sizeof(time_str));
-        snprintf(buffer, len, "\"Local\":\"%s\"", time_str);
-    }
-    else if (strstr(key, "CompileTime") != NULL)
-    {
-        snprintf(buffer, len, "\"CompileTime\":\"%s\"", __TIME__);
-    }
-    else if (strstr(key, "CompileDate") != NULL)
-    {
-        snprintf(buffer, len, "\"CompileDate\":\"%s\"", __DATE__);
-    }
-    else if (strstr(key, "FirmwareVersion") != NULL)
-    {
-        snprintf(buffer, len, "\"FirmwareVersion\":\"%s\"", "V1.0.0");
-    }
-    else if (strstr(key, "WiFiStatus") != NULL)
-    {
-        snprintf(buffer, len, "\"WiFiStatus\":\"%d\"", g_wifi_connect_status);
-    }
-    else
-    {
-        snprintf(buffer, len, "\"%s\":\"\"", key); // Default case
-    }
+static int http_server_write_humidity(char *buffer, size_t len, void *ctx)
+{
+    return snprintf(buffer, len, "%d", get_humidity()); // Placeholder for humidity
+}
 
-    return true;
+static int http_server_write_utc_time(char *buffer, size_t len, void *ctx)
+{
+    get_local_time_string_utc(buffer, len);
+    return strlen(buffer);
+}
+
+static int http_server_write_local_time(char *buffer, size_t len, void *ctx)
+{
+    get_local_time_string(buffer, len);
+    return strlen(buffer);
+}
+
+static int http_server_write_wifi_status(char *buffer, size_t len, void *ctx)
+{
+    return snprintf(buffer, len, "%d", g_wifi_connect_status);
+}
+
+/*
+ * Registers the keys answered by /getData. Values that are fixed at build time
+ * are formatted once here, the rest are produced by a writer per request.
+ */
+static void http_server_register_data_keys(void)
+{
+    data_keys_register_static("SSID", CONFIG_ESP_WIFI_SSID);
+    data_keys_register_static("CompileTime", __TIME__);
+    data_keys_register_static("CompileDate", __DATE__);
+    data_keys_register_static("FirmwareVersion", HTTP_SERVER_FIRMWARE_VERSION);
+
+    data_keys_register("Temp", http_server_write_temperature, NULL);
+    data_keys_register("Humidity", http_server_write_humidity, NULL);
+    data_keys_register("UTC", http_server_write_utc_time, NULL);
+    data_keys_register("Local", http_server_write_local_time, NULL);
+    data_keys_register("WiFiStatus", http_server_write_wifi_status, NULL);
 }
 
 static int16_t get_temperature(void)
@@ -917,24 +2654,18 @@ static int16_t get_humidity(void)
 
 static esp_err_t http_server_wifi_connect_handler(httpd_req_t *req)
 {
-    bool isComma = false;
-    int32_t length = 0;
     uint16_t rsp_len = 0;
     char response[100] = {0};
-    char temp_buff[256] = {0};
     ESP_LOGI(TAG, "Parameters Request Received");
-    // Read request content
-    char buf[256];
-
-    int ret = httpd_req_recv(req, buf, sizeof(buf) - 1);
-
-    if (ret <= 0)
+    // Read the complete request body into the arena of this task
+    char *buf = http_server_task_buffer(req);
+    size_t body_len = 0;
+    esp_err_t body_error = req_body_read(req, buf, HTTP_SERVER_BODY_ARENA_SIZE, &body_len);
+    if (body_error != ESP_OK)
     {
-        ESP_LOGE(TAG, "Failed to receive request data");
-        httpd_resp_send_500(req);
-        return ESP_FAIL;
+        ESP_LOGE(TAG, "Failed to receive request data: %s", esp_err_to_name(body_error));
+        return req_body_send_error(req, body_error);
     }
-    buf[ret] = '\0';
 
     // Process parameters (this is a placeholder for actual processing logic)
     ESP_LOGI(TAG, "Received parameters: %s", buf);
@@ -943,8 +2674,25 @@ static esp_err_t http_server_wifi_connect_handler(httpd_req_t *req)
     char ssid[64] = {0};
     char password[64] = {0};
 
-    httpd_req_get_hdr_value_str(req, "my-connect-ssid", ssid, sizeof(ssid));
-    httpd_req_get_hdr_value_str(req, "my-connect-pswd", password, sizeof(password));
+    if (httpd_req_get_hdr_value_str(req, "my-connect-ssid", ssid, sizeof(ssid)) != ESP_OK)
+    {
+        // No credential headers, accept {"ssid":"...","password":"..."} in the body
+        json_scan_token_t tokens[HTTP_SERVER_JSON_MAX_TOKENS];
+        json_scan_t scan;
+        if (json_scan_parse(&scan, buf, body_len, tokens, HTTP_SERVER_JSON_MAX_TOKENS) < 0 ||
+            json_scan_get_string(&scan, 0, "ssid", ssid, sizeof(ssid)) < 0)
+        {
+            ESP_LOGE(TAG, "Missing SSID in request");
+            httpd_resp_set_status(req, "400 Bad Request");
+            httpd_resp_send(req, "{\"status\":\"error\",\"message\":\"Missing ssid\"}", HTTPD_RESP_USE_STRLEN);
+            return ESP_FAIL;
+        }
+        json_scan_get_string(&scan, 0, "password", password, sizeof(password));
+    }
+    else
+    {
+        httpd_req_get_hdr_value_str(req, "my-connect-pswd", password, sizeof(password));
+    }
 
     rsp_len = snprintf(response, sizeof(response), "{\"ssid\":\"%s\",\"password\":\"%s\"}", ssid, password);
     ESP_LOGI(TAG, "SSID: %s, Password: %s", ssid, password);
@@ -965,32 +2713,103 @@ static esp_err_t http_server_wifi_connect_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
-static esp_err_t http_server_rfid_manager_list_cards_handler(httpd_req_t *req)
+/*
+ * Sends a cached card response with its ETag, or 304 Not Modified when the
+ * client already has this version (If-None-Match). HEAD and ranges as for
+ * static files.
+ * @param req HTTP request
+ * @param cache valid cache entry
+ * @return result of sending the response
+ */
+static esp_err_t http_server_send_cards_cache(httpd_req_t *req, const http_server_cards_cache_t *cache)
 {
-    ESP_LOGI(TAG, "RFID card list requested");
+    char etag[HTTP_SERVER_ETAG_LEN];
 
-    // Default empty response
-    const char *response = "{\"status\":\"error\",\"message\":\"Failed to get RFID cards\",\"cards\":[]}";
+    snprintf(etag, sizeof(etag), "\"%08lx-%lu\"", (unsigned long)http_server_boot_id, (unsigned long)cache->version);
+    httpd_resp_set_type(req, "application/json");
+    return http_server_send_static(req, cache->body, cache->len, etag, false);
+}
 
+/*
+ * Sends a card response that is not cached, so it has no ETag. Like
+ * http_server_send_static, HEAD gets the headers without the body.
+ * @param req HTTP request
+ * @param body JSON body
+ * @param len body length
+ * @return result of sending the response
+ */
+static esp_err_t http_server_send_cards_uncached(httpd_req_t *req, const char *body, size_t len)
+{
     httpd_resp_set_type(req, "application/json");
+    if (req->method == HTTP_HEAD)
+    {
+        return httpd_resp_send(req, NULL, len);
+    }
+    return httpd_resp_send(req, body, len);
+}
+
+/*
+ * Rebuilds the card list cache if the database changed and copies it out.
+ * The caller holds http_server_cards_lock.
+ * @param copy receives the cached response, body of HTTP_SERVER_TASK_BUFFER_SIZE bytes
+ * @return ESP_OK, ESP_ERR_INVALID_STATE if the database is not valid, or the
+ * error of rfid_manager_get_card_list_json
+ */
+static esp_err_t http_server_cards_list_copy_locked(http_server_cards_cache_t *copy)
+{
+    http_server_cards_cache_t *cache = &http_server_cards_list_cache;
+    // Read first: a change while the list is built only makes the next request rebuild it
+    uint32_t version = rfid_manager_get_version();
 
-    // Check if RFID manager is initialized
-    if (!rfid_manager_is_database_valid())
+    if (cache->len == 0 || cache->version != version)
     {
-        ESP_LOGE(TAG, "RFID database is not valid");
-        response = "{\"status\":\"error\",\"message\":\"RFID database is not valid\",\"cards\":[]}";
-        httpd_resp_send(req, response, strlen(response));
-        return ESP_OK;
+        cache->len = 0;
+        if (!rfid_manager_is_database_valid())
+        {
+            return ESP_ERR_INVALID_STATE;
+        }
+        esp_err_t result = rfid_manager_get_card_list_json(cache->body, cache->size);
+        if (result != ESP_OK)
+        {
+            return result;
+        }
+        ESP_LOGI(TAG, "RFID card list generated successfully");
+        cache->version = version;
+        cache->len = strlen(cache->body);
     }
+    memcpy(copy->body, cache->body, cache->len);
+    copy->len = cache->len;
+    copy->version = cache->version;
+    return ESP_OK;
+}
+
+/*
+ * /cards/get handler, runs on the workers. The list is rebuilt in the cache
+ * and copied into the task's buffer under http_server_cards_lock, the copy is
+ * sent after the lock is released so a slow client holds up no one.
+ * @param req HTTP request for which the URI needs to be handled
+ * @return ESP_OK, or the send error
+ */
+static esp_err_t http_server_rfid_manager_list_cards_handler(httpd_req_t *req)
+{
+    http_server_cards_cache_t copy = {.size = HTTP_SERVER_TASK_BUFFER_SIZE, .body = http_server_task_buffer(req)};
+    const char *response = NULL;
+
+    ESP_LOGI(TAG, "RFID card list requested");
 
-    // Try to get the card list as JSON
-    esp_err_t result = rfid_manager_get_card_list_json(http_server_buffer, HTTP_SERVER_BUFFER_SIZE);
+    xSemaphoreTake(http_server_cards_lock, portMAX_DELAY);
+    esp_err_t result = http_server_cards_list_copy_locked(&copy);
+    xSemaphoreGive(http_server_cards_lock);
 
     if (result == ESP_OK)
     {
-        // Success - use the generated JSON
-        response = http_server_buffer;
-        ESP_LOGI(TAG, "RFID card list generated successfully");
+        return http_server_send_cards_cache(req, &copy);
+    }
+
+    if (result == ESP_ERR_INVALID_STATE)
+    {
+        ESP_LOGE(TAG, "RFID database is not valid");
+        response = "{\"status\":\"error\",\"message\":\"RFID database is not valid\",\"cards\":[]}";
     }
     else if (result == ESP_ERR_NO_MEM)
     {
@@ -1000,85 +2819,69 @@ static esp_err_t http_server_rfid_manager_list_cards_handler(httpd_req_t *req)
     }
     else
     {
-        // Other error
+        // Other error, the copy buffer is free
         ESP_LOGE(TAG, "Failed to get RFID card list: %s", esp_err_to_name(result));
-        char error_msg[100];
-        snprintf(error_msg, sizeof(error_msg),
+        snprintf(copy.body, copy.size,
                  "{\"status\":\"error\",\"message\":\"Failed to get RFID card list: %s\",\"cards\":[]}",
                  esp_err_to_name(result));
-        response = error_msg;
+        response = copy.body;
     }
 
-    // Send the response
-    esp_err_t error = httpd_resp_send(req, response, strlen(response));
-
+    esp_err_t error = http_server_send_cards_uncached(req, response, strlen(response));
     if (error != ESP_OK)
     {
         ESP_LOGE(TAG, "Error %d while sending RFID cards response", error);
-        return error;
     }
-
-    ESP_LOGI(TAG, "RFID cards response sent successfully");
-    return ESP_OK;
+    return error;
 }
 
 static esp_err_t http_server_rfid_manager_add_card_handler(httpd_req_t *req)
 {
     ESP_LOGI(TAG, "RFID card add requested");
 
-    // Read the request body
-    char buf[256];
-    int ret = httpd_req_recv(req, buf, sizeof(buf) - 1);
-    if (ret <= 0)
+    // Read the complete request body into the arena of this task
+    char *buf = http_server_task_buffer(req);
+    size_t body_len = 0;
+    esp_err_t body_error = req_body_read(req, buf, HTTP_SERVER_BODY_ARENA_SIZE, &body_len);
+    if (body_error != ESP_OK)
     {
-        ESP_LOGE(TAG, "Failed to receive request data");
-        httpd_resp_send_500(req);
-        return ESP_FAIL;
+        ESP_LOGE(TAG, "Failed to receive request data: %s", esp_err_to_name(body_error));
+        return req_body_send_error(req, body_error);
     }
-    buf[ret] = '\0';
 
-    // Parse the JSON request
-    cJSON *json = cJSON_Parse(buf);
-    if (json == NULL)
+    // Tokenize the JSON request in place
+    json_scan_token_t tokens[HTTP_SERVER_JSON_MAX_TOKENS];
+    json_scan_t scan;
+    if (json_scan_parse(&scan, buf, body_len, tokens, HTTP_SERVER_JSON_MAX_TOKENS) < 0)
     {
         ESP_LOGE(TAG, "Failed to parse JSON");
         httpd_resp_send_500(req);
         return ESP_FAIL;
     }
 
-    // Extract the card ID
-    cJSON *card_id_obj = cJSON_GetObjectItemCaseSensitive(json, "id");
-    cJSON *card_name_obj = cJSON_GetObjectItemCaseSensitive(json, "nm");
+    // Extract the card ID and name
+    uint32_t card_id = 0;
+    char card_name[sizeof(((rfid_card_t *)0)->name)];
 
-    if (!cJSON_IsNumber(card_id_obj) || !(cJSON_IsString(card_name_obj)))
+    if (!json_scan_get_u32(&scan, 0, "id", &card_id) ||
+        json_scan_get_string(&scan, 0, "nm", card_name, sizeof(card_name)) < 0)
     {
         ESP_LOGE(TAG, "Invalid or missing 'card_id' key in JSON");
-        cJSON_Delete(json);
         httpd_resp_set_status(req, "400 Bad Request");
         httpd_resp_send(req, "{\"status\":\"error\",\"message\":\"Invalid or missing card_id\"}", HTTPD_RESP_USE_STRLEN);
         return ESP_FAIL;
     }
 
-    const char *card_id_str = card_id_obj->valuestring;
-
-    // Convert string to uint32_t
-    //    uint32_t card_id = (uint32_t)strtoul(card_id_str, NULL, 10);
-    uint32_t card_id = (uint32_t)card_id_obj->valueint;
     if (card_id == 0)
     {
         ESP_LOGE(TAG, "Invalid card ID: %lu", card_id);
-        cJSON_Delete(json);
         httpd_resp_set_status(req, "400 Bad Request");
         httpd_resp_send(req, "{\"status\":\"error\",\"message\":\"Invalid card_id\"}", HTTPD_RESP_USE_STRLEN);
         return ESP_FAIL;
     }
 
     // Add the card to the RFID manager
-    esp_err_t result = rfid_manager_add_card(card_id,
-                                             card_name_obj->valuestring);
-
-    // Clean up JSON object
-    cJSON_Delete(json);
+    esp_err_t result = rfid_manager_add_card(card_id, card_name);
 
     if (result == ESP_OK)
     {
@@ -1095,80 +2898,234 @@ static esp_err_t http_server_rfid_manager_add_card_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
-static esp_err_t http_server_rfid_manager_remove_card_handler(httpd_req_t *req)
+/*
+ * Reads a numeric path parameter of the request's URI template
+ * @param req HTTP request, user_ctx is its http_server_route_t
+ * @param name parameter name
+ * @param value receives the number
+ * @return true if the route has the parameter and it is in range
+ */
+static bool http_server_path_u32(httpd_req_t *req, const char *name, uint32_t *value)
 {
-    char urlBuffer[256];
-    uint16_t lengthOfURI = 0;
-    char idStrBuffer[48];
-    uint32_t cardId = 0;
+    const http_server_route_t *route = (const http_server_route_t *)req->user_ctx;
+    uri_template_match_t match;
+
+    return route->uri_template != NULL && uri_template_match(route->uri_template, req->uri, &match) &&
+           uri_template_get_u32(&match, name, value);
+}
 
-    ESP_LOGI(TAG, "/api/rfid/cards/{id} (DELETE) requested: %s", req->uri);
+/*
+ * Sends a JSON error response
+ * @param req HTTP request
+ * @param status HTTP status line, e.g. "404 Not Found"
+ * @param message text of the message field
+ * @return result of sending the response
+ */
+static esp_err_t http_server_send_json_error(httpd_req_t *req, const char *status, const char *message)
+{
+    char body[96];
 
-    memset(idStrBuffer, 0, sizeof(idStrBuffer));
+    snprintf(body, sizeof(body), "{\"status\":\"error\",\"message\":\"%s\"}", message);
+    httpd_resp_set_status(req, status);
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_sendstr(req, body);
+}
 
-    lengthOfURI = httpd_req_get_url_query_len(req) + 1; // +1 for null terminator
+/*
+ * GET /cards/{id}: one card in the format of the /cards/get list entries
+ * @param req HTTP request for which the URI needs to be handled
+ * @return ESP_OK, or the send error
+ */
+static esp_err_t http_server_card_get_handler(httpd_req_t *req)
+{
+    char body[HTTP_SERVER_CARD_JSON_SIZE];
+    rfid_card_t card;
+    uint32_t card_id = 0;
 
-    if (lengthOfURI > 1)
+    if (!http_server_path_u32(req, "id", &card_id))
     {
-        if (httpd_req_get_url_query_str(req, urlBuffer, lengthOfURI) == ESP_OK)
-        {
-            ESP_LOGI(TAG, "urlBuffer:%s", urlBuffer);
+        return http_server_send_json_error(req, "400 Bad Request", "Invalid card id");
+    }
 
-            if (httpd_query_key_value(urlBuffer, "id", idStrBuffer, sizeof(idStrBuffer)) == ESP_OK)
-            {
-                ESP_LOGI(TAG, "idStrBuffer:%s", idStrBuffer);
+    esp_err_t result = rfid_manager_get_card(card_id, &card);
+    if (result == ESP_ERR_NOT_FOUND)
+    {
+        return http_server_send_json_error(req, "404 Not Found", "Card not found");
+    }
+    if (result != ESP_OK)
+    {
+        ESP_LOGE(TAG, "http_server_card_get_handler: %s", esp_err_to_name(result));
+        return http_server_send_json_error(req, "500 Internal Server Error", "Failed to read card");
+    }
 
-                cardId = strtoul(idStrBuffer, NULL, 10);
+    snprintf(body, sizeof(body), "{\"status\":\"ok\",\"card\":{\"id\":%lu,\"name\":\"%s\",\"active\":%d,\"timestamp\":%lu}}",
+             (unsigned long)card.card_id, card.name, card.active, (unsigned long)card.timestamp);
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_sendstr(req, body);
+}
 
-                if (cardId == 0)
-                {
-                    ESP_LOGE(TAG, "Card ID missing in URI");
-                    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Card ID missing in URI");
-                    return ESP_FAIL;
-                }
-            }
-        }
+/*
+ * Removes a card and answers, for DELETE /cards/{id} and /cards/remove
+ * @param req HTTP request
+ * @param card_id card to remove, not 0
+ * @return ESP_OK, or the send error
+ */
+static esp_err_t http_server_card_remove(httpd_req_t *req, uint32_t card_id)
+{
+    esp_err_t result = rfid_manager_remove_card(card_id);
+    switch (result)
+    {
+    case ESP_OK:
+        ESP_LOGI(TAG, "Card %lu removed", (unsigned long)card_id);
+        httpd_resp_set_type(req, "application/json");
+        return httpd_resp_sendstr(req, "{\"status\":\"success\",\"message\":\"Card removed successfully\"}");
+    case ESP_ERR_NOT_FOUND:
+        return http_server_send_json_error(req, "404 Not Found", "Card not found");
+    case ESP_ERR_NOT_SUPPORTED:
+        return http_server_send_json_error(req, "403 Forbidden", "The admin card cannot be removed");
+    default:
+        ESP_LOGE(TAG, "http_server_card_remove: %s", esp_err_to_name(result));
+        return http_server_send_json_error(req, "500 Internal Server Error", "Failed to remove card");
+    }
+}
+
+/*
+ * DELETE /cards/{id}
+ * @param req HTTP request for which the URI needs to be handled
+ * @return ESP_OK, or the send error
+ */
+static esp_err_t http_server_card_delete_handler(httpd_req_t *req)
+{
+    uint32_t card_id = 0;
+
+    if (!http_server_path_u32(req, "id", &card_id) || card_id == 0)
+    {
+        return http_server_send_json_error(req, "400 Bad Request", "Invalid card id");
     }
+    return http_server_card_remove(req, card_id);
+}
 
-    esp_err_t ret = rfid_manager_remove_card(cardId);
+/*
+ * PATCH /cards/{id} with {"nm":"...","active":true}, either field optional
+ * @param req HTTP request for which the URI needs to be handled
+ * @return ESP_OK, ESP_FAIL on unreadable bodies
+ */
+static esp_err_t http_server_card_patch_handler(httpd_req_t *req)
+{
+    uint32_t card_id = 0;
+    char card_name[sizeof(((rfid_card_t *)0)->name)];
+    bool active = false;
 
-    if (ret == ESP_OK)
+    if (!http_server_path_u32(req, "id", &card_id) || card_id == 0)
     {
-        httpd_resp_send(req, "{\"status\":\"success\", \"message\":\"Card removed\"}", HTTPD_RESP_USE_STRLEN);
+        return http_server_send_json_error(req, "400 Bad Request", "Invalid card id");
     }
-    else if (ret == ESP_ERR_NOT_FOUND)
+
+    // Read the complete request body into the arena of this task
+    char *buf = http_server_task_buffer(req);
+    size_t body_len = 0;
+    esp_err_t body_error = req_body_read(req, buf, HTTP_SERVER_BODY_ARENA_SIZE, &body_len);
+    if (body_error != ESP_OK)
     {
-        char err_msg[100];
-        sprintf(err_msg, "Card ID %ld not found", cardId);
-        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, err_msg);
+        ESP_LOGE(TAG, "Failed to receive request data: %s", esp_err_to_name(body_error));
+        return req_body_send_error(req, body_error);
     }
-    else if (ret == ESP_ERR_NOT_SUPPORTED)
+
+    json_scan_token_t tokens[HTTP_SERVER_JSON_MAX_TOKENS];
+    json_scan_t scan;
+    if (json_scan_parse(&scan, buf, body_len, tokens, HTTP_SERVER_JSON_MAX_TOKENS) < 0 ||
+        tokens[0].type != JSON_SCAN_OBJECT)
     {
-        ESP_LOGW(TAG, "Attempted to remove protected admin card: %ld", cardId);
-        httpd_resp_set_status(req, "403 Forbidden");
-        httpd_resp_send(req, "{\"status\":\"error\", \"message\":\"Cannot remove admin card - this card is protected\"}", HTTPD_RESP_USE_STRLEN);
+        http_server_send_json_error(req, "400 Bad Request", "Invalid JSON");
+        return ESP_FAIL;
     }
-    else
+
+    bool has_name = json_scan_find(&scan, 0, "nm") >= 0;
+    bool has_active = json_scan_find(&scan, 0, "active") >= 0;
+    if ((has_name && json_scan_get_string(&scan, 0, "nm", card_name, sizeof(card_name)) < 0) ||
+        (has_active && !json_scan_get_bool(&scan, 0, "active", &active)) ||
+        (!has_name && !has_active))
     {
-        ESP_LOGE(TAG, "Failed to remove RFID card: %s (Error: %s)", esp_err_to_name(ret), ret == ESP_FAIL ? "Generic Fail" : "Other");
-        httpd_resp_send_500(req);
+        return http_server_send_json_error(req, "400 Bad Request", "Expected nm and/or active");
     }
-    return ESP_OK;
+
+    esp_err_t result = rfid_manager_update_card(card_id, has_name ? card_name : NULL, has_active ? active : -1);
+    switch (result)
+    {
+    case ESP_OK:
+        ESP_LOGI(TAG, "Card %lu updated", (unsigned long)card_id);
+        httpd_resp_set_type(req, "application/json");
+        return httpd_resp_sendstr(req, "{\"status\":\"success\",\"message\":\"Card updated successfully\"}");
+    case ESP_ERR_NOT_FOUND:
+        return http_server_send_json_error(req, "404 Not Found", "Card not found");
+    case ESP_ERR_NOT_SUPPORTED:
+        return http_server_send_json_error(req, "403 Forbidden", "The admin card cannot be deactivated");
+    default:
+        ESP_LOGE(TAG, "http_server_card_patch_handler: %s", esp_err_to_name(result));
+        return http_server_send_json_error(req, "500 Internal Server Error", "Failed to update card");
+    }
+}
+
+/*
+ * DELETE /cards/remove?id=123, kept for older clients, answers as DELETE /cards/{id}
+ * @param req HTTP request for which the URI needs to be handled
+ * @return ESP_OK, or the send error
+ */
+static esp_err_t http_server_rfid_manager_remove_card_handler(httpd_req_t *req)
+{
+    char query[HTTP_SERVER_REMOVE_QUERY_LEN];
+    char id[HTTP_SERVER_CARD_ID_LEN];
+    uint32_t card_id = 0;
+
+    // Longer queries and ids come back truncated with an error, they are refused too
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK ||
+        httpd_query_key_value(query, "id", id, sizeof(id)) != ESP_OK ||
+        !uri_template_parse_u32(id, strlen(id), &card_id) || card_id == 0)
+    {
+        return http_server_send_json_error(req, "400 Bad Request", "Invalid card id");
+    }
+    return http_server_card_remove(req, card_id);
 }
 
 static esp_err_t http_server_rfid_manager_get_card_count_handler(httpd_req_t *req)
 {
+    char body[HTTP_SERVER_CARD_COUNT_BODY_SIZE];
+    http_server_cards_cache_t copy = {.size = sizeof(body), .body = body};
+    bool cached = true;
+
     ESP_LOGI(TAG, "RFID card count requested");
 
-    // Get the card count from the RFID manager
-    int card_count = rfid_manager_get_card_count();
+    xSemaphoreTake(http_server_cards_lock, portMAX_DELAY);
+    http_server_cards_cache_t *cache = &http_server_cards_count_cache;
+    uint32_t version = rfid_manager_get_version();
+    if (cache->len == 0 || cache->version != version)
+    {
+        // Get the card count from the RFID manager
+        int card_count = rfid_manager_get_card_count();
 
-    // Prepare the JSON response
-    char response[50];
-    snprintf(response, sizeof(response), "{\"card_count\":%d}", card_count);
+        // Prepare the JSON response, 0 is also what a failed read returns so it is not kept
+        cache->len = snprintf(cache->body, cache->size, "{\"card_count\":%d}", card_count);
+        cache->version = version;
+        cached = (card_count != 0);
+    }
+    memcpy(copy.body, cache->body, cache->len);
+    copy.len = cache->len;
+    copy.version = cache->version;
+    if (!cached)
+    {
+        cache->len = 0;
+    }
+    xSemaphoreGive(http_server_cards_lock);
 
-    httpd_resp_set_type(req, "application/json");
-    esp_err_t error = httpd_resp_send(req, response, strlen(response));
+    esp_err_t error = ESP_OK;
+    if (!cached)
+    {
+        error = http_server_send_cards_uncached(req, copy.body, copy.len);
+    }
+    else
+    {
+        error = http_server_send_cards_cache(req, &copy);
+    }
 
     if (error != ESP_OK)
     {
@@ -1184,49 +3141,40 @@ static esp_err_t http_server_rfid_manager_check_card_handler(httpd_req_t *req)
 {
     ESP_LOGI(TAG, "RFID card check requested");
 
-    // Read the request body
-    char buf[256];
-    int ret = httpd_req_recv(req, buf, sizeof(buf) - 1);
-    if (ret <= 0)
+    // Read the complete request body into the arena of this task
+    char *buf = http_server_task_buffer(req);
+    size_t body_len = 0;
+    esp_err_t body_error = req_body_read(req, buf, HTTP_SERVER_BODY_ARENA_SIZE, &body_len);
+    if (body_error != ESP_OK)
     {
-        ESP_LOGE(TAG, "Failed to receive request data");
-        httpd_resp_send_500(req);
-        return ESP_FAIL;
+        ESP_LOGE(TAG, "Failed to receive request data: %s", esp_err_to_name(body_error));
+        return req_body_send_error(req, body_error);
     }
-    buf[ret] = '\0';
 
-    // Parse the JSON request
-    cJSON *json = cJSON_Parse(buf);
-    if (json == NULL)
+    // Tokenize the JSON request in place
+    json_scan_token_t tokens[HTTP_SERVER_JSON_MAX_TOKENS];
+    json_scan_t scan;
+    if (json_scan_parse(&scan, buf, body_len, tokens, HTTP_SERVER_JSON_MAX_TOKENS) < 0)
     {
         ESP_LOGE(TAG, "Failed to parse JSON");
         httpd_resp_send_500(req);
         return ESP_FAIL;
     }
 
-    // Extract the card ID
-    cJSON *card_id_obj = cJSON_GetObjectItemCaseSensitive(json, "card_id");
-    if (!cJSON_IsString(card_id_obj) || (card_id_obj->valuestring == NULL))
+    // Extract the card ID, sent as a decimal string
+    uint32_t card_id = 0;
+    if (!json_scan_get_u32(&scan, 0, "card_id", &card_id))
     {
         ESP_LOGE(TAG, "Invalid or missing 'card_id' key in JSON");
-        cJSON_Delete(json);
         httpd_resp_set_status(req, "400 Bad Request");
         httpd_resp_send(req, "{\"status\":\"error\",\"message\":\"Invalid or missing card_id\"}", HTTPD_RESP_USE_STRLEN);
         return ESP_FAIL;
     }
 
-    const char *card_id_str = card_id_obj->valuestring;
-
-    // Convert string to uint32_t
-    uint32_t card_id = (uint32_t)strtoul(card_id_str, NULL, 10);
-
     // Check if the card exists in the RFID manager
     esp_err_t check_result = rfid_manager_check_card(card_id);
     bool exists = (check_result == ESP_OK);
 
-    // Clean up JSON object
-    cJSON_Delete(json);
-
     // Prepare the response
     char response[50];
     snprintf(response, sizeof(response), "{\"exists\":%s}", exists ? "true" : "false");
@@ -1244,6 +3192,42 @@ static esp_err_t http_server_rfid_manager_check_card_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
+/*
+ * Access decision hook registered with the RFID manager, publishes a "badge"
+ * event to every live event stream subscriber
+ * @param card_id card that was presented
+ * @param result decision returned by rfid_manager_check_card
+ */
+static void http_server_card_check_cb(uint32_t card_id, esp_err_t result)
+{
+    char event_json[96];
+    const char *decision;
+
+    http_server_card_outcome_e outcome;
+
+    switch (result)
+    {
+    case ESP_OK:
+        outcome = HTTP_SERVER_CARD_GRANTED;
+        break;
+    case ESP_ERR_NOT_FOUND:
+        outcome = HTTP_SERVER_CARD_UNKNOWN;
+        break;
+    case ESP_ERR_INVALID_STATE:
+        outcome = HTTP_SERVER_CARD_INACTIVE;
+        break;
+    default:
+        outcome = HTTP_SERVER_CARD_ERROR;
+        break;
+    }
+    metrics_counter_add(&http_server_card_checks[outcome], 1);
+    decision = http_server_card_outcome_names[outcome];
+
+    snprintf(event_json, sizeof(event_json), "{\"id\":%lu,\"decision\":\"%s\",\"timestamp\":%lu}",
+             (unsigned long)card_id, decision, (unsigned long)time(NULL));
+    sse_events_publish("badge", event_json);
+}
+
 static esp_err_t http_server_rfid_manager_reset_cards_handler(httpd_req_t *req)
 {
     ESP_LOGI(TAG, "RFID card reset to defaults requested");
@@ -1306,3 +3290,62 @@ static esp_err_t http_server_rfid_manager_reset_cards_handler(httpd_req_t *req)
 
     return ESP_OK;
 }
+
+/*
+ * req_body_stream consumer of /assets/update, writes each piece to the partition
+ * @param data received piece of the pack
+ * @param len length of the piece
+ * @param ctx unused
+ * @return result of asset_pack_update_write
+ */
+static esp_err_t http_server_asset_update_write(const char *data, size_t len, void *ctx)
+{
+    return asset_pack_update_write(data, len);
+}
+
+/*
+ * POST /assets/update: replaces the asset pack with the request body, an
+ * image made by tools/mkassets.py. The embedded files are served while the
+ * partition is rewritten and stay in use if the new pack is invalid.
+ * @param req HTTP request for which the URI needs to be handled
+ * @return ESP_OK, or ESP_FAIL to close the socket after a failed upload
+ */
+static esp_err_t http_server_asset_update_handler(httpd_req_t *req)
+{
+    esp_err_t error = asset_pack_update_begin(req->content_len);
+
+    if (error == ESP_ERR_INVALID_SIZE)
+    {
+        return req_body_send_error(req, error);
+    }
+    if (error == ESP_ERR_TIMEOUT)
+    {
+        // A client is still downloading from the old pack
+        httpd_resp_set_hdr(req, "Retry-After", "10");
+        return http_server_send_json_error(req, "503 Service Unavailable", "Asset files in use, try again");
+    }
+    if (error != ESP_OK)
+    {
+        ESP_LOGW(TAG, "http_server_asset_update_handler: Not started: %s", esp_err_to_name(error));
+        return http_server_send_json_error(req, "409 Conflict", "No asset partition or an update is running");
+    }
+
+    ESP_LOGI(TAG, "http_server_asset_update_handler: Writing %d bytes", req->content_len);
+    error = req_body_stream(req, http_server_task_buffer(req), HTTP_SERVER_BODY_ARENA_SIZE,
+                            http_server_asset_update_write, NULL);
+    if (error != ESP_OK)
+    {
+        asset_pack_update_end(false);
+        return req_body_send_error(req, error);
+    }
+
+    error = asset_pack_update_end(true);
+    if (error != ESP_OK)
+    {
+        ESP_LOGW(TAG, "http_server_asset_update_handler: Invalid pack: %s", esp_err_to_name(error));
+        return http_server_send_json_error(req, "422 Unprocessable Entity", "Invalid asset pack");
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_sendstr(req, "{\"status\":\"success\"}");
+}
@@ -0,0 +1,449 @@
+/**
+ * @file asset_pack.c
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "rom/miniz.h"
+#endif
+#include "asset_pack.h"
+
+#define ASSET_PACK_MAGIC "WPAK"
+#define ASSET_PACK_VERSION (1u)
+#define ASSET_PACK_DRAIN_TIMEOUT_MS (10 * 1000) // Longest an update waits for downloads from the old pack
+#define ASSET_PACK_GZIP_HEADER_LEN (10u)
+#define ASSET_PACK_GZIP_TRAILER_LEN (8u)
+#define ASSET_PACK_GZIP_FHCRC (0x02u)
+#define ASSET_PACK_GZIP_FEXTRA (0x04u)
+#define ASSET_PACK_GZIP_FNAME (0x08u)
+#define ASSET_PACK_GZIP_FCOMMENT (0x10u)
+#define ASSET_PACK_GZIP_RESERVED (0xE0u)
+
+static const char *TAG = "asset_pack";
+
+static SemaphoreHandle_t asset_pack_mutex = NULL; // Held for lookups and around (un)mapping, never while sending
+static SemaphoreHandle_t asset_pack_idle = NULL;  // Given by the last release while an update waits
+static uint32_t asset_pack_users = 0;             // Files acquired and not released yet
+static bool asset_pack_draining = false;          // An update waits for asset_pack_users to reach 0
+#if !CONFIG_IDF_TARGET_LINUX
+static atomic_bool asset_pack_inflating = false; // One asset_pack_inflate at a time, it needs 43KB of heap
+#endif
+static const esp_partition_t *asset_pack_partition = NULL;
+static esp_partition_mmap_handle_t asset_pack_mmap_handle;
+static bool asset_pack_mapped = false;
+static asset_pack_t asset_pack = {0};
+static bool asset_pack_mounted = false;
+static bool asset_pack_updating = false;
+static size_t asset_pack_update_len = 0;
+static size_t asset_pack_update_written = 0;
+
+static uint16_t asset_pack_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t asset_pack_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+esp_err_t asset_pack_open(asset_pack_t *pack, const uint8_t *image, size_t image_len)
+{
+    if (image_len < ASSET_PACK_HEADER_LEN || memcmp(image, ASSET_PACK_MAGIC, 4) != 0)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (asset_pack_u16(image + 4) != ASSET_PACK_VERSION)
+    {
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    uint16_t count = asset_pack_u16(image + 6);
+    uint32_t len = asset_pack_u32(image + 8);
+    if (len > image_len || len < ASSET_PACK_HEADER_LEN + (size_t)count * ASSET_PACK_ENTRY_LEN)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    // One pass over the whole image at mount time, lookups trust it afterwards
+    if (esp_rom_crc32_le(0, image + ASSET_PACK_HEADER_LEN, len - ASSET_PACK_HEADER_LEN) != asset_pack_u32(image + 12))
+    {
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    for (uint16_t i = 0; i < count; i++)
+    {
+        const uint8_t *entry = image + ASSET_PACK_HEADER_LEN + i * ASSET_PACK_ENTRY_LEN;
+        uint32_t offset = asset_pack_u32(entry + ASSET_PACK_PATH_LEN + ASSET_PACK_TYPE_LEN);
+        uint32_t size = asset_pack_u32(entry + ASSET_PACK_PATH_LEN + ASSET_PACK_TYPE_LEN + 4);
+
+        // Strings must be terminated inside their fields, data inside the image
+        if (entry[ASSET_PACK_PATH_LEN - 1] != '\0' || entry[ASSET_PACK_PATH_LEN + ASSET_PACK_TYPE_LEN - 1] != '\0' ||
+            offset > len || size > len - offset)
+        {
+            return ESP_ERR_INVALID_SIZE;
+        }
+    }
+
+    pack->image = image;
+    pack->len = len;
+    pack->count = count;
+    return ESP_OK;
+}
+
+bool asset_pack_find(const asset_pack_t *pack, const char *path, asset_pack_file_t *file)
+{
+    for (uint16_t i = 0; i < pack->count; i++)
+    {
+        const uint8_t *entry = pack->image + ASSET_PACK_HEADER_LEN + i * ASSET_PACK_ENTRY_LEN;
+        const uint8_t *fields = entry + ASSET_PACK_PATH_LEN + ASSET_PACK_TYPE_LEN;
+
+        if (strcmp((const char *)entry, path) == 0)
+        {
+            file->content_type = (const char *)entry + ASSET_PACK_PATH_LEN;
+            file->data = pack->image + asset_pack_u32(fields);
+            file->len = asset_pack_u32(fields + 4);
+            file->crc = asset_pack_u32(fields + 8);
+            file->flags = asset_pack_u16(fields + 12);
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Skips a zero terminated field of a gzip header
+ * @param data file data
+ * @param len file length
+ * @param pos position of the field
+ * @return position after the terminator, len if there is none
+ */
+static size_t asset_pack_gzip_skip_string(const uint8_t *data, size_t len, size_t pos)
+{
+    const uint8_t *end = memchr(data + pos, '\0', len - pos);
+    return (end == NULL) ? len : (size_t)(end - data) + 1;
+}
+
+esp_err_t asset_pack_gzip_parse(const uint8_t *data, size_t len, asset_pack_gzip_t *gzip)
+{
+    if (len < ASSET_PACK_GZIP_HEADER_LEN + ASSET_PACK_GZIP_TRAILER_LEN || data[0] != 0x1F || data[1] != 0x8B ||
+        data[2] != 8 || (data[3] & ASSET_PACK_GZIP_RESERVED) != 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Optional fields, mkassets.py writes none of them but gzip(1) names the file
+    uint8_t flags = data[3];
+    size_t pos = ASSET_PACK_GZIP_HEADER_LEN;
+    size_t end = len - ASSET_PACK_GZIP_TRAILER_LEN;
+    if ((flags & ASSET_PACK_GZIP_FEXTRA) != 0)
+    {
+        pos = (end - pos < 2) ? len : pos + 2 + asset_pack_u16(data + pos);
+    }
+    if ((flags & ASSET_PACK_GZIP_FNAME) != 0 && pos < end)
+    {
+        pos = asset_pack_gzip_skip_string(data, end, pos);
+    }
+    if ((flags & ASSET_PACK_GZIP_FCOMMENT) != 0 && pos < end)
+    {
+        pos = asset_pack_gzip_skip_string(data, end, pos);
+    }
+    if ((flags & ASSET_PACK_GZIP_FHCRC) != 0)
+    {
+        pos += 2;
+    }
+    // Deflate data is never empty, a final block takes at least 2 bytes
+    if (pos >= end)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    gzip->deflate = data + pos;
+    gzip->deflate_len = end - pos;
+    gzip->crc = asset_pack_u32(data + end);
+    gzip->len = asset_pack_u32(data + end + 4);
+    return ESP_OK;
+}
+
+esp_err_t asset_pack_inflate(const asset_pack_gzip_t *gzip, asset_pack_sink_t sink, void *ctx)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    return ESP_ERR_NOT_SUPPORTED;
+#else
+    // Refused rather than queued, the caller's client may retry
+    if (atomic_exchange(&asset_pack_inflating, true))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    tinfl_decompressor *inflator = malloc(sizeof(tinfl_decompressor));
+    uint8_t *window = malloc(TINFL_LZ_DICT_SIZE);
+    if (inflator == NULL || window == NULL)
+    {
+        free(inflator);
+        free(window);
+        atomic_store(&asset_pack_inflating, false);
+        return ESP_ERR_NO_MEM;
+    }
+    tinfl_init(inflator);
+
+    const uint8_t *in = gzip->deflate;
+    size_t in_left = gzip->deflate_len;
+    size_t window_pos = 0;
+    size_t total = 0;
+    uint32_t crc = 0;
+    tinfl_status status;
+    esp_err_t error = ESP_OK;
+
+    // All the input is mapped, the window wraps and is handed to sink each time it fills
+    do
+    {
+        size_t in_len = in_left;
+        size_t out_len = TINFL_LZ_DICT_SIZE - window_pos;
+        status = tinfl_decompress(inflator, in, &in_len, window, window + window_pos, &out_len, 0);
+        in += in_len;
+        in_left -= in_len;
+        if (out_len > 0)
+        {
+            crc = esp_rom_crc32_le(crc, window + window_pos, out_len);
+            total += out_len;
+            error = sink(ctx, window + window_pos, out_len);
+        }
+        window_pos = (window_pos + out_len) & (TINFL_LZ_DICT_SIZE - 1);
+    } while (error == ESP_OK && status == TINFL_STATUS_HAS_MORE_OUTPUT);
+
+    free(inflator);
+    free(window);
+    atomic_store(&asset_pack_inflating, false);
+    if (error != ESP_OK)
+    {
+        return error;
+    }
+    if (status != TINFL_STATUS_DONE)
+    {
+        return ESP_FAIL;
+    }
+    if (total != gzip->len)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return (crc == gzip->crc) ? ESP_OK : ESP_ERR_INVALID_CRC;
+#endif
+}
+
+/*
+ * Drops the mapping, the caller holds asset_pack_mutex
+ */
+static void asset_pack_unmap(void)
+{
+    asset_pack_mounted = false;
+    if (asset_pack_mapped)
+    {
+        esp_partition_munmap(asset_pack_mmap_handle);
+        asset_pack_mapped = false;
+    }
+}
+
+/*
+ * Maps the partition and opens the pack in it, the caller holds asset_pack_mutex
+ * @return result of asset_pack_open, or the mapping error
+ */
+static esp_err_t asset_pack_map(void)
+{
+    const void *image = NULL;
+
+    esp_err_t error = esp_partition_mmap(asset_pack_partition, 0, asset_pack_partition->size, ESP_PARTITION_MMAP_DATA,
+                                         &image, &asset_pack_mmap_handle);
+    if (error != ESP_OK)
+    {
+        return error;
+    }
+    asset_pack_mapped = true;
+
+    error = asset_pack_open(&asset_pack, (const uint8_t *)image, asset_pack_partition->size);
+    if (error != ESP_OK)
+    {
+        asset_pack_unmap();
+        return error;
+    }
+    asset_pack_mounted = true;
+    return ESP_OK;
+}
+
+esp_err_t asset_pack_mount(const char *label)
+{
+    if (asset_pack_mutex == NULL)
+    {
+        asset_pack_mutex = xSemaphoreCreateMutex();
+        if (asset_pack_mutex == NULL)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    if (asset_pack_idle == NULL)
+    {
+        asset_pack_idle = xSemaphoreCreateBinary();
+        if (asset_pack_idle == NULL)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    asset_pack_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    if (asset_pack_partition == NULL)
+    {
+        ESP_LOGW(TAG, "No '%s' partition, serving the embedded files", label);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    xSemaphoreTake(asset_pack_mutex, portMAX_DELAY);
+    asset_pack_unmap();
+    esp_err_t error = asset_pack_map();
+    xSemaphoreGive(asset_pack_mutex);
+
+    if (error != ESP_OK)
+    {
+        ESP_LOGW(TAG, "No usable pack in '%s' (%s), serving the embedded files", label, esp_err_to_name(error));
+        return error;
+    }
+    ESP_LOGI(TAG, "%u files, %u bytes in '%s'", asset_pack.count, (unsigned)asset_pack.len, label);
+    return ESP_OK;
+}
+
+bool asset_pack_acquire(const char *path, asset_pack_file_t *file)
+{
+    bool found = false;
+
+    if (asset_pack_mutex == NULL)
+    {
+        return false;
+    }
+    xSemaphoreTake(asset_pack_mutex, portMAX_DELAY);
+    if (asset_pack_mounted && asset_pack_find(&asset_pack, path, file))
+    {
+        // Keeps the mapping, not the mutex, while the file is sent
+        asset_pack_users++;
+        found = true;
+    }
+    xSemaphoreGive(asset_pack_mutex);
+    return found;
+}
+
+void asset_pack_release(void)
+{
+    xSemaphoreTake(asset_pack_mutex, portMAX_DELAY);
+    asset_pack_users--;
+    if (asset_pack_users == 0 && asset_pack_draining)
+    {
+        asset_pack_draining = false;
+        xSemaphoreGive(asset_pack_idle);
+    }
+    xSemaphoreGive(asset_pack_mutex);
+}
+
+esp_err_t asset_pack_update_begin(size_t len)
+{
+    if (asset_pack_partition == NULL || asset_pack_mutex == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (len < ASSET_PACK_HEADER_LEN || len > asset_pack_partition->size)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // New requests get the embedded copies from here on
+    xSemaphoreTake(asset_pack_mutex, portMAX_DELAY);
+    if (asset_pack_updating)
+    {
+        xSemaphoreGive(asset_pack_mutex);
+        return ESP_ERR_INVALID_STATE;
+    }
+    asset_pack_updating = true;
+    asset_pack_mounted = false;
+    asset_pack_draining = (asset_pack_users > 0);
+    bool draining = asset_pack_draining;
+    xSemaphoreGive(asset_pack_mutex);
+
+    // Files being sent keep the mapping until their last release
+    if (draining && xSemaphoreTake(asset_pack_idle, pdMS_TO_TICKS(ASSET_PACK_DRAIN_TIMEOUT_MS)) != pdTRUE)
+    {
+        // A stalled download, the old pack stays mounted
+        xSemaphoreTake(asset_pack_mutex, portMAX_DELAY);
+        asset_pack_draining = false;
+        xSemaphoreTake(asset_pack_idle, 0); // Given by a release after the timeout
+        asset_pack_mounted = true;
+        asset_pack_updating = false;
+        xSemaphoreGive(asset_pack_mutex);
+        ESP_LOGW(TAG, "asset_pack_update_begin: Files of the old pack still in use");
+        return ESP_ERR_TIMEOUT;
+    }
+    xSemaphoreTake(asset_pack_mutex, portMAX_DELAY);
+    asset_pack_unmap();
+    xSemaphoreGive(asset_pack_mutex);
+
+    size_t erase_len = (len + asset_pack_partition->erase_size - 1) / asset_pack_partition->erase_size *
+                       asset_pack_partition->erase_size;
+    esp_err_t error = esp_partition_erase_range(asset_pack_partition, 0, erase_len);
+    if (error != ESP_OK)
+    {
+        ESP_LOGE(TAG, "asset_pack_update_begin: Erase failed: %s", esp_err_to_name(error));
+        asset_pack_updating = false;
+        return error;
+    }
+    asset_pack_update_len = len;
+    asset_pack_update_written = 0;
+    return ESP_OK;
+}
+
+esp_err_t asset_pack_update_write(const void *data, size_t len)
+{
+    if (!asset_pack_updating)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (len > asset_pack_update_len - asset_pack_update_written)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    esp_err_t error = esp_partition_write(asset_pack_partition, asset_pack_update_written, data, len);
+    if (error == ESP_OK)
+    {
+        asset_pack_update_written += len;
+    }
+    return error;
+}
+
+esp_err_t asset_pack_update_end(bool commit)
+{
+    esp_err_t error = ESP_OK;
+
+    if (!asset_pack_updating)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (commit && asset_pack_update_written != asset_pack_update_len)
+    {
+        error = ESP_ERR_INVALID_SIZE;
+    }
+
+    xSemaphoreTake(asset_pack_mutex, portMAX_DELAY);
+    if (commit && error == ESP_OK)
+    {
+        error = asset_pack_map();
+    }
+    asset_pack_updating = false;
+    xSemaphoreGive(asset_pack_mutex);
+
+    if (commit && error == ESP_OK)
+    {
+        ESP_LOGI(TAG, "New pack mounted, %u files, %u bytes", asset_pack.count, (unsigned)asset_pack.len);
+    }
+    return commit ? error : ESP_OK;
+}
@@ -0,0 +1,179 @@
+/**
+ * @file captive_probe.c
+ *
+ * Connectivity probes of the common operating systems. A probe that gets the
+ * expected "online" answer makes the OS believe it has internet access, any
+ * other answer makes it open the captive portal sign-in window. Clients are
+ * answered with a redirect to the portal until they are authorized, and with
+ * the exact online response afterwards so the sign-in window goes away.
+ */
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "captive_probe.h"
+
+#define CAPTIVE_PROBE_MAX_CLIENTS (16u) // Clients remembered, the AP allows far fewer at a time
+
+typedef struct
+{
+    uint32_t addr;
+    uint8_t mac[CAPTIVE_PROBE_MAC_LEN]; // All zero if the join was not seen
+    int64_t joined_us; // 0 when the join was not seen (e.g. before a reboot)
+    bool reached[CAPTIVE_PROBE_STAGE_COUNT];
+    bool authorized;
+    bool used;
+} captive_probe_client_t;
+
+static const char *TAG = "captive_probe";
+
+static const char captive_probe_apple_success[] =
+    "<HTML><HEAD><TITLE>Success</TITLE></HEAD><BODY>Success</BODY></HTML>";
+
+const char *const captive_probe_os_names[CAPTIVE_PROBE_OS_COUNT] = {
+    "android", "apple", "windows", "firefox", "kindle"};
+
+const captive_probe_t captive_probes[CAPTIVE_PROBE_COUNT] = {
+    {"/generate_204", CAPTIVE_PROBE_ANDROID, "204 No Content", NULL, ""},
+    {"/gen_204", CAPTIVE_PROBE_ANDROID, "204 No Content", NULL, ""},
+    {"/hotspot-detect.html", CAPTIVE_PROBE_APPLE, "200 OK", "text/html", captive_probe_apple_success},
+    {"/library/test/success.html", CAPTIVE_PROBE_APPLE, "200 OK", "text/html", captive_probe_apple_success},
+    {"/connecttest.txt", CAPTIVE_PROBE_WINDOWS, "200 OK", "text/plain", "Microsoft Connect Test"},
+    {"/ncsi.txt", CAPTIVE_PROBE_WINDOWS, "200 OK", "text/plain", "Microsoft NCSI"},
+    {"/success.txt", CAPTIVE_PROBE_FIREFOX, "200 OK", "text/plain", "success\n"},
+    {"/canonical.html", CAPTIVE_PROBE_FIREFOX, "200 OK", "text/html",
+     "<meta http-equiv=\"refresh\" content=\"0;url=https://support.mozilla.org/kb/captive-portal\"/>"},
+    {"/kindle-wifi/wifistub.html", CAPTIVE_PROBE_KINDLE, "200 OK", "text/html", "81ce4465-7167-4dcb-835b-dcc9e44c112a"},
+};
+
+static captive_probe_client_t captive_probe_clients[CAPTIVE_PROBE_MAX_CLIENTS];
+static uint32_t captive_probe_next_slot = 0;
+static SemaphoreHandle_t captive_probe_mutex = NULL;
+
+bool captive_probe_init(void)
+{
+    if (captive_probe_mutex == NULL)
+    {
+        captive_probe_mutex = xSemaphoreCreateMutex();
+    }
+    if (captive_probe_mutex == NULL)
+    {
+        ESP_LOGE(TAG, "captive_probe_init: Failed to create mutex");
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Looks a client up, the caller holds captive_probe_mutex
+ * @param addr IPv4 address in network order
+ * @param create take a slot for an unknown client, replacing the oldest one
+ * if the table is full
+ * @return the client entry, NULL if unknown and create is false
+ */
+static captive_probe_client_t *captive_probe_find(uint32_t addr, bool create)
+{
+    for (size_t i = 0; i < CAPTIVE_PROBE_MAX_CLIENTS; i++)
+    {
+        if (captive_probe_clients[i].used && captive_probe_clients[i].addr == addr)
+        {
+            return &captive_probe_clients[i];
+        }
+    }
+    if (!create)
+    {
+        return NULL;
+    }
+
+    // Slots are handed out round robin, so the one reused is the oldest
+    captive_probe_client_t *client = &captive_probe_clients[captive_probe_next_slot];
+    captive_probe_next_slot = (captive_probe_next_slot + 1) % CAPTIVE_PROBE_MAX_CLIENTS;
+    memset(client, 0, sizeof(*client));
+    client->addr = addr;
+    client->used = true;
+    return client;
+}
+
+void captive_probe_client_joined(uint32_t addr, const uint8_t mac[CAPTIVE_PROBE_MAC_LEN], int64_t now_us)
+{
+    captive_probe_client_t *client = NULL;
+
+    if (captive_probe_mutex == NULL)
+    {
+        return;
+    }
+    xSemaphoreTake(captive_probe_mutex, portMAX_DELAY);
+    for (size_t i = 0; i < CAPTIVE_PROBE_MAX_CLIENTS; i++)
+    {
+        captive_probe_client_t *entry = &captive_probe_clients[i];
+        if (!entry->used)
+        {
+            continue;
+        }
+        if (memcmp(entry->mac, mac, CAPTIVE_PROBE_MAC_LEN) == 0)
+        {
+            // The same device back, possibly with another lease
+            client = entry;
+        }
+        else if (entry->addr == addr)
+        {
+            // The lease went to another device, which has not been through the portal
+            entry->used = false;
+        }
+    }
+    if (client == NULL)
+    {
+        client = captive_probe_find(addr, true);
+        memcpy(client->mac, mac, CAPTIVE_PROBE_MAC_LEN);
+    }
+    client->addr = addr;
+    client->joined_us = now_us;
+    memset(client->reached, 0, sizeof(client->reached));
+    xSemaphoreGive(captive_probe_mutex);
+}
+
+void captive_probe_authorize(uint32_t addr)
+{
+    if (captive_probe_mutex == NULL)
+    {
+        return;
+    }
+    xSemaphoreTake(captive_probe_mutex, portMAX_DELAY);
+    captive_probe_find(addr, true)->authorized = true;
+    xSemaphoreGive(captive_probe_mutex);
+}
+
+bool captive_probe_is_authorized(uint32_t addr)
+{
+    bool authorized = false;
+
+    if (captive_probe_mutex == NULL)
+    {
+        return false;
+    }
+    xSemaphoreTake(captive_probe_mutex, portMAX_DELAY);
+    captive_probe_client_t *client = captive_probe_find(addr, false);
+    authorized = (client != NULL) && client->authorized;
+    xSemaphoreGive(captive_probe_mutex);
+    return authorized;
+}
+
+int64_t captive_probe_client_reached(uint32_t addr, captive_probe_stage_e stage, int64_t now_us)
+{
+    int64_t elapsed_us = -1;
+
+    if (captive_probe_mutex == NULL || stage >= CAPTIVE_PROBE_STAGE_COUNT)
+    {
+        return -1;
+    }
+    xSemaphoreTake(captive_probe_mutex, portMAX_DELAY);
+    captive_probe_client_t *client = captive_probe_find(addr, false);
+    if (client != NULL && client->joined_us != 0 && !client->reached[stage])
+    {
+        client->reached[stage] = true;
+        elapsed_us = now_us - client->joined_us;
+    }
+    xSemaphoreGive(captive_probe_mutex);
+    return elapsed_us;
+}
@@ -0,0 +1,310 @@
+/**
+ * @file conn_budget.c
+ *
+ * The server's client connections are a fixed table; every decision scans
+ * it, there are never more than a few dozen entries. Connections are keyed
+ * by socket: lwIP hands out the number of a closed socket again, so an
+ * unknown or stale entry with the same number is simply replaced.
+ */
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "conn_budget.h"
+
+typedef struct
+{
+    int fd;
+    uint32_t client;
+    conn_budget_class_e class;
+    int64_t used_us;   // Admission or last request, the LRU order
+    uint16_t requests; // In progress, the connection is idle at 0
+    bool closing;      // Evicted, waiting for the server to close it
+    bool used;
+} conn_budget_entry_t;
+
+typedef struct
+{
+    uint32_t addr;
+    int64_t seen_us;
+    bool used;
+} conn_budget_admin_client_t;
+
+static const char *TAG = "conn_budget";
+
+static conn_budget_config_t conn_budget_config;
+static conn_budget_entry_t conn_budget_entries[CONN_BUDGET_MAX_CONNS];
+static conn_budget_admin_client_t conn_budget_admin_clients[CONN_BUDGET_MAX_ADMIN_CLIENTS];
+static conn_budget_stats_t conn_budget_stats;
+static SemaphoreHandle_t conn_budget_mutex = NULL;
+
+bool conn_budget_init(const conn_budget_config_t *config)
+{
+    if (config->limit == 0 || config->limit > CONN_BUDGET_MAX_CONNS || config->admin_reserved >= config->limit)
+    {
+        ESP_LOGE(TAG, "conn_budget_init: %lu connections with %lu reserved do not fit",
+                 (unsigned long)config->limit, (unsigned long)config->admin_reserved);
+        return false;
+    }
+    if (conn_budget_mutex == NULL)
+    {
+        conn_budget_mutex = xSemaphoreCreateMutex();
+    }
+    if (conn_budget_mutex == NULL)
+    {
+        ESP_LOGE(TAG, "conn_budget_init: Failed to create mutex");
+        return false;
+    }
+
+    xSemaphoreTake(conn_budget_mutex, portMAX_DELAY);
+    conn_budget_config = *config;
+    memset(conn_budget_entries, 0, sizeof(conn_budget_entries));
+    memset(conn_budget_admin_clients, 0, sizeof(conn_budget_admin_clients));
+    memset(&conn_budget_stats, 0, sizeof(conn_budget_stats));
+    xSemaphoreGive(conn_budget_mutex);
+    return true;
+}
+
+/*
+ * Looks a connection up, the caller holds conn_budget_mutex
+ * @param fd socket
+ * @return the entry, NULL if the socket is not tracked
+ */
+static conn_budget_entry_t *conn_budget_find(int fd)
+{
+    for (size_t i = 0; i < CONN_BUDGET_MAX_CONNS; i++)
+    {
+        if (conn_budget_entries[i].used && conn_budget_entries[i].fd == fd)
+        {
+            return &conn_budget_entries[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Whether a client is in the administration session, the caller holds conn_budget_mutex
+ * @param addr IPv4 address in network order
+ * @param now_us current time
+ * @return the client's entry, NULL if it is not an administration client or its session expired
+ */
+static conn_budget_admin_client_t *conn_budget_find_admin(uint32_t addr, int64_t now_us)
+{
+    for (size_t i = 0; i < CONN_BUDGET_MAX_ADMIN_CLIENTS; i++)
+    {
+        conn_budget_admin_client_t *admin = &conn_budget_admin_clients[i];
+        if (admin->used && admin->addr == addr && now_us - admin->seen_us <= conn_budget_config.admin_hold_us)
+        {
+            return admin;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Least recently used idle connection of a class, the caller holds conn_budget_mutex
+ * @param class class of the connections to consider
+ * @param client only this client's connections, or any client if all is true
+ * @param all consider every client
+ * @return the connection, NULL if every one of them has a request in progress
+ */
+static conn_budget_entry_t *conn_budget_lru_idle(conn_budget_class_e class, uint32_t client, bool all)
+{
+    conn_budget_entry_t *lru = NULL;
+
+    for (size_t i = 0; i < CONN_BUDGET_MAX_CONNS; i++)
+    {
+        conn_budget_entry_t *entry = &conn_budget_entries[i];
+        if (entry->used && !entry->closing && entry->requests == 0 && entry->class == class &&
+            (all || entry->client == client) && (lru == NULL || entry->used_us < lru->used_us))
+        {
+            lru = entry;
+        }
+    }
+    return lru;
+}
+
+conn_budget_result_e conn_budget_admit(int fd, uint32_t client, int64_t now_us, int *victim)
+{
+    conn_budget_entry_t *slot = NULL;
+    conn_budget_entry_t *evict = NULL;
+    conn_budget_reason_e reason = CONN_BUDGET_REASON_POOL;
+    bool full = false;
+    uint32_t open = 0, portal = 0, client_portal = 0;
+
+    *victim = -1;
+    xSemaphoreTake(conn_budget_mutex, portMAX_DELAY);
+
+    conn_budget_class_e class = (conn_budget_find_admin(client, now_us) != NULL) ? CONN_BUDGET_ADMIN : CONN_BUDGET_PORTAL;
+    for (size_t i = 0; i < CONN_BUDGET_MAX_CONNS; i++)
+    {
+        conn_budget_entry_t *entry = &conn_budget_entries[i];
+        if (entry->used && entry->fd == fd)
+        {
+            // The socket number was closed without us hearing of it
+            entry->used = false;
+        }
+        if (!entry->used)
+        {
+            slot = (slot == NULL) ? entry : slot;
+            continue;
+        }
+        if (entry->closing)
+        {
+            continue;
+        }
+        open++;
+        if (entry->class == CONN_BUDGET_PORTAL)
+        {
+            portal++;
+            client_portal += (entry->client == client);
+        }
+    }
+
+    if (class == CONN_BUDGET_PORTAL && conn_budget_config.per_client != 0 && client_portal >= conn_budget_config.per_client)
+    {
+        // The client's own oldest idle connection makes room, nobody else's
+        evict = conn_budget_lru_idle(CONN_BUDGET_PORTAL, client, false);
+        reason = CONN_BUDGET_REASON_CLIENT;
+        full = true;
+    }
+    else if (open >= conn_budget_config.limit ||
+             (class == CONN_BUDGET_PORTAL && portal >= conn_budget_config.limit - conn_budget_config.admin_reserved))
+    {
+        // Captive connections go first, administration ones only make room for their own session
+        evict = conn_budget_lru_idle(CONN_BUDGET_PORTAL, 0, true);
+        if (evict == NULL && class == CONN_BUDGET_ADMIN)
+        {
+            evict = conn_budget_lru_idle(CONN_BUDGET_ADMIN, 0, true);
+        }
+        full = true;
+    }
+
+    conn_budget_result_e result = CONN_BUDGET_ADMIT;
+    if (slot == NULL || (full && evict == NULL))
+    {
+        result = (reason == CONN_BUDGET_REASON_CLIENT) ? CONN_BUDGET_REJECT_CLIENT : CONN_BUDGET_REJECT_POOL;
+        conn_budget_stats.rejected[reason]++;
+    }
+    else
+    {
+        if (evict != NULL)
+        {
+            evict->closing = true;
+            *victim = evict->fd;
+            conn_budget_stats.evicted[reason]++;
+            result = CONN_BUDGET_ADMIT_EVICT;
+            open--;
+        }
+        slot->fd = fd;
+        slot->client = client;
+        slot->class = class;
+        slot->used_us = now_us;
+        slot->requests = 0;
+        slot->closing = false;
+        slot->used = true;
+        conn_budget_stats.admitted[class]++;
+        if (open + 1 > conn_budget_stats.peak)
+        {
+            conn_budget_stats.peak = open + 1;
+        }
+    }
+
+    xSemaphoreGive(conn_budget_mutex);
+    return result;
+}
+
+void conn_budget_closed(int fd)
+{
+    xSemaphoreTake(conn_budget_mutex, portMAX_DELAY);
+    conn_budget_entry_t *entry = conn_budget_find(fd);
+    if (entry != NULL)
+    {
+        entry->used = false;
+    }
+    xSemaphoreGive(conn_budget_mutex);
+}
+
+void conn_budget_request_begin(int fd, int64_t now_us)
+{
+    xSemaphoreTake(conn_budget_mutex, portMAX_DELAY);
+    conn_budget_entry_t *entry = conn_budget_find(fd);
+    if (entry != NULL)
+    {
+        entry->requests++;
+        entry->used_us = now_us;
+        if (entry->class == CONN_BUDGET_ADMIN)
+        {
+            // Every request of the session keeps it going
+            conn_budget_admin_client_t *admin = conn_budget_find_admin(entry->client, now_us);
+            if (admin != NULL)
+            {
+                admin->seen_us = now_us;
+            }
+        }
+    }
+    xSemaphoreGive(conn_budget_mutex);
+}
+
+void conn_budget_request_end(int fd, int64_t now_us)
+{
+    xSemaphoreTake(conn_budget_mutex, portMAX_DELAY);
+    conn_budget_entry_t *entry = conn_budget_find(fd);
+    if (entry != NULL && entry->requests > 0)
+    {
+        entry->requests--;
+        entry->used_us = now_us;
+    }
+    xSemaphoreGive(conn_budget_mutex);
+}
+
+void conn_budget_mark_admin(int fd, uint32_t client, int64_t now_us)
+{
+    conn_budget_admin_client_t *admin = NULL;
+
+    xSemaphoreTake(conn_budget_mutex, portMAX_DELAY);
+    for (size_t i = 0; i < CONN_BUDGET_MAX_ADMIN_CLIENTS; i++)
+    {
+        conn_budget_admin_client_t *candidate = &conn_budget_admin_clients[i];
+        if (candidate->used && candidate->addr == client)
+        {
+            admin = candidate;
+            break;
+        }
+        // Otherwise a free slot, or the client seen longest ago
+        if (admin == NULL || (admin->used && (!candidate->used || candidate->seen_us < admin->seen_us)))
+        {
+            admin = candidate;
+        }
+    }
+    admin->addr = client;
+    admin->seen_us = now_us;
+    admin->used = true;
+
+    // Connections the client already holds join the session too
+    for (size_t i = 0; i < CONN_BUDGET_MAX_CONNS; i++)
+    {
+        conn_budget_entry_t *entry = &conn_budget_entries[i];
+        if (entry->used && (entry->fd == fd || entry->client == client))
+        {
+            entry->class = CONN_BUDGET_ADMIN;
+        }
+    }
+    xSemaphoreGive(conn_budget_mutex);
+}
+
+void conn_budget_get_stats(conn_budget_stats_t *stats)
+{
+    xSemaphoreTake(conn_budget_mutex, portMAX_DELAY);
+    *stats = conn_budget_stats;
+    memset(stats->open, 0, sizeof(stats->open));
+    for (size_t i = 0; i < CONN_BUDGET_MAX_CONNS; i++)
+    {
+        if (conn_budget_entries[i].used && !conn_budget_entries[i].closing)
+        {
+            stats->open[conn_budget_entries[i].class]++;
+        }
+    }
+    xSemaphoreGive(conn_budget_mutex);
+}
@@ -0,0 +1,209 @@
+/**
+ * @file data_keys.c
+ *
+ * Registry behind the /getData multi-key endpoint. Keys live in a table kept
+ * sorted by name so each requested key costs one binary search instead of a
+ * chain of substring tests.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+#include "data_keys.h"
+
+#define DATA_KEYS_MAX (16u)             // Registered keys
+#define DATA_KEYS_NAME_MAX_LEN (24u)    // Longest key name incl. NUL
+#define DATA_KEYS_STATIC_POOL_SIZE (256u) // Preformatted static fragments
+
+typedef struct
+{
+    char name[DATA_KEYS_NAME_MAX_LEN];
+    uint8_t name_len;
+    data_key_writer_t writer; // NULL for static keys
+    void *ctx;
+    const char *fragment; // Preformatted "name":"value" for static keys
+    uint16_t fragment_len;
+} data_key_entry_t;
+
+static const char *TAG = "data_keys";
+
+static data_key_entry_t data_keys[DATA_KEYS_MAX];
+static size_t data_keys_count = 0;
+static char data_keys_static_pool[DATA_KEYS_STATIC_POOL_SIZE];
+static size_t data_keys_static_used = 0;
+
+/*
+ * Compares a counted key with a registered entry, same ordering as strcmp
+ */
+static int data_keys_compare(const char *key, size_t key_len, const data_key_entry_t *entry)
+{
+    size_t n = key_len < entry->name_len ? key_len : entry->name_len;
+    int cmp = memcmp(key, entry->name, n);
+    if (cmp != 0)
+    {
+        return cmp;
+    }
+    return (key_len < entry->name_len) ? -1 : (key_len > entry->name_len) ? 1 : 0;
+}
+
+static const data_key_entry_t *data_keys_find(const char *key, size_t key_len)
+{
+    size_t low = 0;
+    size_t high = data_keys_count;
+
+    while (low < high)
+    {
+        size_t mid = (low + high) / 2;
+        int cmp = data_keys_compare(key, key_len, &data_keys[mid]);
+        if (cmp == 0)
+        {
+            return &data_keys[mid];
+        }
+        if (cmp < 0)
+        {
+            high = mid;
+        }
+        else
+        {
+            low = mid + 1;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Inserts a new entry keeping the table sorted
+ * @return pointer to the new entry, NULL if full or duplicate
+ */
+static data_key_entry_t *data_keys_insert(const char *name)
+{
+    size_t name_len = strlen(name);
+
+    if (name_len == 0 || name_len >= DATA_KEYS_NAME_MAX_LEN)
+    {
+        ESP_LOGE(TAG, "Invalid key name length: %u", (unsigned)name_len);
+        return NULL;
+    }
+    if (data_keys_count >= DATA_KEYS_MAX)
+    {
+        ESP_LOGE(TAG, "Key table full, cannot register %s", name);
+        return NULL;
+    }
+
+    size_t pos = 0;
+    while (pos < data_keys_count)
+    {
+        int cmp = data_keys_compare(name, name_len, &data_keys[pos]);
+        if (cmp == 0)
+        {
+            ESP_LOGE(TAG, "Key %s already registered", name);
+            return NULL;
+        }
+        if (cmp < 0)
+        {
+            break;
+        }
+        pos++;
+    }
+
+    memmove(&data_keys[pos + 1], &data_keys[pos], (data_keys_count - pos) * sizeof(data_keys[0]));
+    data_keys_count++;
+
+    data_key_entry_t *entry = &data_keys[pos];
+    memset(entry, 0, sizeof(*entry));
+    memcpy(entry->name, name, name_len + 1);
+    entry->name_len = (uint8_t)name_len;
+    return entry;
+}
+
+bool data_keys_register(const char *name, data_key_writer_t writer, void *ctx)
+{
+    if (name == NULL || writer == NULL)
+    {
+        return false;
+    }
+
+    data_key_entry_t *entry = data_keys_insert(name);
+    if (entry == NULL)
+    {
+        return false;
+    }
+    entry->writer = writer;
+    entry->ctx = ctx;
+    return true;
+}
+
+bool data_keys_register_static(const char *name, const char *value)
+{
+    if (name == NULL || value == NULL)
+    {
+        return false;
+    }
+
+    char *fragment = data_keys_static_pool + data_keys_static_used;
+    size_t space = DATA_KEYS_STATIC_POOL_SIZE - data_keys_static_used;
+    int len = snprintf(fragment, space, "\"%s\":\"%s\"", name, value);
+    if (len < 0 || (size_t)len >= space)
+    {
+        ESP_LOGE(TAG, "Static pool full, cannot register %s", name);
+        return false;
+    }
+
+    data_key_entry_t *entry = data_keys_insert(name);
+    if (entry == NULL)
+    {
+        return false;
+    }
+    entry->fragment = fragment;
+    entry->fragment_len = (uint16_t)len;
+    data_keys_static_used += len + 1;
+    return true;
+}
+
+int data_keys_write(const char *key, size_t key_len, char *buffer, size_t len)
+{
+    const data_key_entry_t *entry = data_keys_find(key, key_len);
+
+    if (entry == NULL)
+    {
+        // Echo unknown keys with an empty value, skipping anything that would break the JSON
+        for (size_t i = 0; i < key_len; i++)
+        {
+            if (key[i] == '"' || key[i] == '\\' || (unsigned char)key[i] < 0x20)
+            {
+                return 0;
+            }
+        }
+        int written = snprintf(buffer, len, "\"%.*s\":\"\"", (int)key_len, key);
+        return (written < 0 || (size_t)written >= len) ? -1 : written;
+    }
+
+    if (entry->fragment != NULL)
+    {
+        if (entry->fragment_len >= len)
+        {
+            return -1;
+        }
+        memcpy(buffer, entry->fragment, entry->fragment_len + 1);
+        return entry->fragment_len;
+    }
+
+    // "name":" + value + "
+    size_t prefix_len = entry->name_len + 4;
+    if (prefix_len + 2 > len)
+    {
+        return -1;
+    }
+    buffer[0] = '"';
+    memcpy(buffer + 1, entry->name, entry->name_len);
+    memcpy(buffer + 1 + entry->name_len, "\":\"", 3);
+
+    int value_len = entry->writer(buffer + prefix_len, len - prefix_len - 1, entry->ctx);
+    if (value_len < 0 || prefix_len + value_len + 2 > len)
+    {
+        return -1;
+    }
+    buffer[prefix_len + value_len] = '"';
+    buffer[prefix_len + value_len + 1] = '\0';
+    return (int)(prefix_len + value_len + 1);
+}
@@ -9,154 +9,475 @@
 
 #include <sys/param.h>
 #include <inttypes.h>
+#include <stdatomic.h>
+#include <string.h>
 
 #include "esp_log.h"
 #include "esp_system.h"
 #include "esp_netif.h"
+#include "esp_event.h"
+#include "esp_timer.h"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_wifi.h"
+#endif
+#include "esp_random.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
 
 #include "lwip/err.h"
 #include "lwip/sockets.h"
 #include "lwip/sys.h"
 #include "lwip/netdb.h"
 
-#define DNS_PORT (53)
-#define DNS_MAX_LEN (256)
+#include "metrics.h"
+#include "dns_codec.h"
+#include "dns_cache.h"
+#include "dns_guard.h"
+#include "captive_probe.h"
+#include "dns_server.h"
+
+#define DNS_PORT (CONFIG_APP_LOCAL_SERVER_DNS_PORT)
+#define DNS_MAX_LEN (DNS_CODEC_EDNS_UDP_SIZE) // Queries are received into and answered from one buffer
 
-#define OPCODE_MASK (0x7800)
-#define QR_FLAG (1 << 7)
-#define QD_TYPE_A (0x0001)
 #define ANS_TTL_SEC (300)
 
+#define DNS_UPSTREAM_PORT (53)
+#define DNS_UPSTREAM_MAX_LEN (1232)   // EDNS0 payload asked of the upstream resolver, fits in one frame
+#define DNS_FORWARD_MAX_PENDING (16)  // Forwarded queries waiting for the upstream resolver
+#define DNS_FORWARD_POLL_MS (100)     // How often pending queries are checked for a timeout
+
+#define DNS_SERVER_STACK_SIZE (4096)
+#define DNS_CLIENTS_PUBLISH_US (1000000) // How often the DNS task copies out its top talkers
+
 static const char *TAG = "example_dns_redirect_server";
 
-// DNS Header Packet
-typedef struct __attribute__((__packed__))
-{
-    uint16_t id;
-    uint16_t flags;
-    uint16_t qd_count;
-    uint16_t an_count;
-    uint16_t ns_count;
-    uint16_t ar_count;
-} dns_header_t;
-
-// DNS Question Packet
+static metrics_counter_t dns_queries = {0};
+static metrics_counter_t dns_answered = {0};
+static metrics_counter_t dns_malformed = {0};
+static metrics_counter_t dns_ignored = {0};
+static metrics_counter_t dns_send_errors = {0};
+static metrics_counter_t dns_wakeups = {0};
+static _Atomic uint32_t dns_batch_max = 0; // Only written by the DNS task
+static metrics_counter_t dns_refused = {0};
+
+// Per-source throttling, owned by the DNS task
+static dns_guard_t dns_guard;
+static int64_t dns_clients_published_us = 0;
+
+// Copy of the guard's busiest sources for dns_server_get_top_clients
+static SemaphoreHandle_t dns_clients_mutex = NULL;
+static dns_server_client_t dns_clients_top[DNS_SERVER_TOP_CLIENTS];
+static size_t dns_clients_top_count = 0;
+static uint32_t dns_clients_evicted = 0;
+
+// Soft AP address the answers carry, network order. Read at start, when the
+// soft AP starts and from dns_server_update_ap_addr, so that no query waits
+// for the netif lookup.
+static _Atomic uint32_t dns_ap_addr = 0;
+
+#if CONFIG_APP_LOCAL_SERVER_DNS_FORWARD
+// A query sent upstream on behalf of a client
 typedef struct {
-    uint16_t type;
-    uint16_t class;
-} dns_question_t;
+    struct sockaddr_in client;
+    int64_t sent_us;
+    uint16_t client_id;
+    uint16_t upstream_id; // Random, a spoofed response has to guess it
+    uint16_t udp_limit;   // Largest response the client takes, dns_codec_udp_limit of its query
+    bool used;
+} dns_forward_pending_t;
+
+// Always answered with the AP's address, whether the client went through the
+// portal or not: the hosts of the connectivity probes in captive_probe.c
+static const char *const dns_forward_local_names[] = {
+    "connectivitycheck.gstatic.com",
+    "connectivitycheck.android.com",
+    "clients1.google.com",
+    "clients3.google.com",
+    "www.google.com",
+    "captive.apple.com",
+    "www.apple.com",
+    "www.appleiphonecell.com",
+    "www.msftconnecttest.com",
+    "www.msftncsi.com",
+    "dns.msftncsi.com",
+    "detectportal.firefox.com",
+    "spectrum.s3.amazonaws.com",
+};
+
+static metrics_counter_t dns_forwarded = {0};
+static metrics_counter_t dns_cache_hits = {0};
+static metrics_counter_t dns_upstream_timeouts = {0};
+static metrics_counter_t dns_upstream_failures = {0};
+
+// The station's DNS server, 0 while it has no address
+static _Atomic uint32_t dns_upstream_addr = 0;
+
+// Owned by the DNS task
+static int dns_upstream_sock = -1;
+static uint32_t dns_upstream_seen = 0; // Upstream the cache and pending queries belong to
+static dns_forward_pending_t dns_forward_pending[DNS_FORWARD_MAX_PENDING];
+static uint8_t dns_upstream_buffer[DNS_UPSTREAM_MAX_LEN + 1]; // One more to tell a cut off response
+static dns_cache_entry_t dns_cache_entries[CONFIG_APP_LOCAL_SERVER_DNS_CACHE_ENTRIES];
+static dns_cache_t dns_cache;
+#endif
+
+void dns_server_update_ap_addr(void)
+{
+    esp_netif_ip_info_t ip_info;
+    esp_netif_t *netif = esp_netif_get_handle_from_ifkey("WIFI_AP_DEF");
+
+    if (netif != NULL && esp_netif_get_ip_info(netif, &ip_info) == ESP_OK) {
+        atomic_store(&dns_ap_addr, ip_info.ip.addr);
+        ESP_LOGD(TAG, "Answering with " IPSTR, IP2STR(&ip_info.ip));
+    }
+}
 
-// DNS Answer Packet
-typedef struct __attribute__((__packed__))
+#if !CONFIG_IDF_TARGET_LINUX
+/*
+    WIFI_EVENT_AP_START handler, picks up an address given to the AP netif
+    with esp_netif_set_ip_info while the soft AP was stopped
+*/
+static void dns_server_ap_started(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+    dns_server_update_ap_addr();
+}
+#endif
+
+#if CONFIG_APP_LOCAL_SERVER_DNS_FORWARD
+/*
+    IP_EVENT_STA_GOT_IP and IP_EVENT_STA_LOST_IP handler, follows the station's
+    DNS server. The DNS task drops its cache when it changes.
+*/
+static void dns_forward_sta_event(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
 {
-    uint16_t ptr_offset;
-    uint16_t type;
-    uint16_t class;
-    uint32_t ttl;
-    uint16_t addr_len;
-    uint32_t ip_addr;
-} dns_answer_t;
+    uint32_t upstream = 0;
+
+    if (event_id == IP_EVENT_STA_GOT_IP) {
+        const ip_event_got_ip_t *event = (const ip_event_got_ip_t *)event_data;
+        esp_netif_dns_info_t dns;
+        if (esp_netif_get_dns_info(event->esp_netif, ESP_NETIF_DNS_MAIN, &dns) == ESP_OK &&
+            dns.ip.type == ESP_IPADDR_TYPE_V4) {
+            upstream = dns.ip.u_addr.ip4.addr;
+        }
+    }
+    atomic_store(&dns_upstream_addr, upstream);
+    ESP_LOGI(TAG, "Upstream resolver " IPSTR, IP2STR((esp_ip4_addr_t *)&upstream));
+}
 
 /*
-    Parse the name from the packet from the DNS name format to a regular .-seperated name
-    returns the pointer to the next part of the packet
+    Decides whether a query goes upstream: a standard query with one question
+    from an IPv4 client that went through the portal, for a name that is not
+    one of dns_forward_local_names, while the station has a DNS server
 */
-static char *parse_dns_name(char *raw_name, char *parsed_name, size_t parsed_name_max_len)
+static bool dns_forward_wanted(const uint8_t *query, int len, const struct sockaddr *source_addr)
 {
+    uint32_t upstream = atomic_load(&dns_upstream_addr);
+    dns_codec_question_t question;
+
+    if (upstream != dns_upstream_seen) {
+        // Answers and pending queries of another network
+        dns_cache_flush(&dns_cache);
+        memset(dns_forward_pending, 0, sizeof(dns_forward_pending));
+        dns_upstream_seen = upstream;
+    }
+    if (upstream == 0 || dns_upstream_sock < 0 || source_addr->sa_family != AF_INET ||
+        !dns_codec_parse_question(query, len, &question) || (query[2] & 0xF8) != 0 ||
+        dns_codec_get16(&query[4]) != 1 ||
+        !captive_probe_is_authorized(((const struct sockaddr_in *)source_addr)->sin_addr.s_addr)) {
+        return false;
+    }
+    for (size_t i = 0; i < sizeof(dns_forward_local_names) / sizeof(dns_forward_local_names[0]); i++) {
+        if (dns_codec_name_equals(query, len, question.name_offset, dns_forward_local_names[i])) {
+            return false;
+        }
+    }
+    return true;
+}
 
-    char *label = raw_name;
-    char *name_itr = parsed_name;
-    int name_len = 0;
+/*
+    Sends a reply without answers, built in place, for queries the upstream
+    resolver cannot be asked
+*/
+static void dns_forward_fail(int sock, uint8_t *query, int len, const struct sockaddr *source_addr,
+                             socklen_t socklen)
+{
+    int reply_len = dns_codec_build_error(query, len, query, DNS_MAX_LEN, DNS_CODEC_RCODE_SERVFAIL);
 
-    do {
-        int sub_name_len = *label;
-        // (len + 1) since we are adding  a '.'
-        name_len += (sub_name_len + 1);
-        if (name_len > parsed_name_max_len) {
-            return NULL;
-        }
-
-        // Copy the sub name that follows the the label
-        memcpy(name_itr, label + 1, sub_name_len);
-        name_itr[sub_name_len] = '.';
-        name_itr += (sub_name_len + 1);
-        label += sub_name_len + 1;
-    } while (*label != 0);
-
-    // Terminate the final string, replacing the last '.'
-    parsed_name[name_len - 1] = '\0';
-    // Return pointer to first char after the name
-    return label + 1;
+    metrics_counter_add(&dns_upstream_failures, 1);
+    if (reply_len > 0) {
+        sendto(sock, query, reply_len, 0, source_addr, socklen);
+    }
 }
 
-// Parses the DNS request and prepares a DNS response with the IP of the softAP
-static int parse_dns_request(char *req, size_t req_len, char *dns_reply, size_t dns_reply_max_len)
+/*
+    Sends a query upstream under a new id and remembers where the answer goes.
+    The id, and the payload size of an OPT record, are changed in place.
+*/
+static void dns_forward_query(int sock, uint8_t *query, int len, const struct sockaddr *source_addr,
+                              socklen_t socklen, int64_t now_us)
 {
-    if (req_len > dns_reply_max_len) {
-        return -1;
+    dns_forward_pending_t *slot = NULL;
+    dns_codec_question_t question;
+    dns_codec_edns_t edns;
+    uint16_t upstream_id;
+    bool unique;
+
+    // The question was checked by dns_forward_wanted
+    dns_codec_parse_question(query, len, &question);
+    if (!dns_codec_parse_edns(query, len, question.end, &edns)) {
+        metrics_counter_add(&dns_malformed, 1);
+        return;
+    }
+    for (size_t i = 0; i < DNS_FORWARD_MAX_PENDING && slot == NULL; i++) {
+        slot = dns_forward_pending[i].used ? NULL : &dns_forward_pending[i];
+    }
+    if (slot == NULL) {
+        dns_forward_fail(sock, query, len, source_addr, socklen);
+        return;
+    }
+    do {
+        upstream_id = (uint16_t)esp_random();
+        unique = true;
+        for (size_t i = 0; i < DNS_FORWARD_MAX_PENDING; i++) {
+            unique = unique && !(dns_forward_pending[i].used && dns_forward_pending[i].upstream_id == upstream_id);
+        }
+    } while (!unique);
+
+    uint16_t client_id = dns_codec_get16(query);
+    dns_codec_put16(query, upstream_id);
+    if (edns.present && edns.udp_size > DNS_UPSTREAM_MAX_LEN) {
+        // Anything larger would be cut off in dns_upstream_buffer
+        dns_codec_put16(&query[edns.offset + 2], DNS_UPSTREAM_MAX_LEN);
     }
 
-    // Prepare the reply
-    memset(dns_reply, 0, dns_reply_max_len);
-    memcpy(dns_reply, req, req_len);
+    struct sockaddr_in upstream_addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(DNS_UPSTREAM_PORT),
+        .sin_addr.s_addr = dns_upstream_seen,
+    };
+    if (sendto(dns_upstream_sock, query, len, 0, (struct sockaddr *)&upstream_addr, sizeof(upstream_addr)) < 0) {
+        dns_codec_put16(query, client_id);
+        dns_forward_fail(sock, query, len, source_addr, socklen);
+        return;
+    }
 
-    // Endianess of NW packet different from chip
-    dns_header_t *header = (dns_header_t *)dns_reply;
-    ESP_LOGD(TAG, "DNS query with header id: 0x%X, flags: 0x%X, qd_count: %d",
-             ntohs(header->id), ntohs(header->flags), ntohs(header->qd_count));
+    slot->client = *(const struct sockaddr_in *)source_addr;
+    slot->client_id = client_id;
+    slot->upstream_id = upstream_id;
+    slot->udp_limit = (uint16_t)MIN(dns_codec_udp_limit(&edns), DNS_UPSTREAM_MAX_LEN);
+    slot->sent_us = now_us;
+    slot->used = true;
+    metrics_counter_add(&dns_forwarded, 1);
+}
 
-    // Not a standard query
-    if ((header->flags & OPCODE_MASK) != 0) {
-        return 0;
+/*
+    Passes every response queued on the upstream socket on to its client and
+    into the cache, then gives up on queries past the timeout
+*/
+static void dns_forward_drain(int sock, int64_t now_us)
+{
+    uint8_t *response = dns_upstream_buffer;
+    struct sockaddr_in source_addr;
+
+    while (1) {
+        socklen_t socklen = sizeof(source_addr);
+        int len = recvfrom(dns_upstream_sock, response, sizeof(dns_upstream_buffer), MSG_DONTWAIT,
+                           (struct sockaddr *)&source_addr, &socklen);
+        if (len < 0) {
+            break;
+        }
+        if (len < (int)DNS_CODEC_HEADER_LEN || source_addr.sin_addr.s_addr != dns_upstream_seen ||
+            source_addr.sin_port != htons(DNS_UPSTREAM_PORT)) {
+            continue;
+        }
+
+        uint16_t upstream_id = dns_codec_get16(response);
+        for (size_t i = 0; i < DNS_FORWARD_MAX_PENDING; i++) {
+            dns_forward_pending_t *pending = &dns_forward_pending[i];
+            if (!pending->used || pending->upstream_id != upstream_id) {
+                continue;
+            }
+            pending->used = false;
+            if (len > pending->udp_limit) {
+                // Cut off, or more than the client takes: the question with TC set
+                // makes it retry over TCP
+                len = dns_codec_build_error(response, len, response, DNS_UPSTREAM_MAX_LEN, DNS_CODEC_RCODE_NOERROR);
+                if (len < 0) {
+                    break;
+                }
+                response[2] |= 0x02;
+            } else {
+                dns_cache_store(&dns_cache, response, len, now_us);
+            }
+            dns_codec_put16(response, pending->client_id);
+            if (sendto(sock, response, len, 0, (struct sockaddr *)&pending->client, sizeof(pending->client)) < 0) {
+                metrics_counter_add(&dns_send_errors, 1);
+            } else {
+                metrics_counter_add(&dns_answered, 1);
+            }
+            break;
+        }
     }
 
-    // Set question response flag
-    header->flags |= QR_FLAG;
+    // The client asks again on its own, nothing is sent back
+    for (size_t i = 0; i < DNS_FORWARD_MAX_PENDING; i++) {
+        if (dns_forward_pending[i].used &&
+            now_us - dns_forward_pending[i].sent_us > CONFIG_APP_LOCAL_SERVER_DNS_FORWARD_TIMEOUT_MS * 1000LL) {
+            dns_forward_pending[i].used = false;
+            metrics_counter_add(&dns_upstream_timeouts, 1);
+        }
+    }
+}
 
-    uint16_t qd_count = ntohs(header->qd_count);
-    header->an_count = htons(qd_count);
+/*
+    Waits for a query or an upstream response, whichever comes first
+    @return 1 if the client socket is readable, 0 if not (yet), -1 on error
+*/
+static int dns_forward_wait(int sock)
+{
+    fd_set fds;
+    bool pending = false;
+    int max_fd = MAX(sock, dns_upstream_sock);
+    struct timeval timeout = {.tv_sec = 0, .tv_usec = DNS_FORWARD_POLL_MS * 1000};
 
-    int reply_len = qd_count * sizeof(dns_answer_t) + req_len;
-    if (reply_len > dns_reply_max_len) {
+    for (size_t i = 0; i < DNS_FORWARD_MAX_PENDING; i++) {
+        pending = pending || dns_forward_pending[i].used;
+    }
+    FD_ZERO(&fds);
+    FD_SET(sock, &fds);
+    if (dns_upstream_sock >= 0) {
+        FD_SET(dns_upstream_sock, &fds);
+    }
+    if (select(max_fd + 1, &fds, NULL, NULL, pending ? &timeout : NULL) < 0) {
         return -1;
     }
+    if (dns_upstream_sock >= 0) {
+        dns_forward_drain(sock, esp_timer_get_time());
+    }
+    return FD_ISSET(sock, &fds) ? 1 : 0;
+}
+#endif
 
-    // Pointer to current answer and question
-    char *cur_ans_ptr = dns_reply + req_len;
-    char *cur_qd_ptr = dns_reply + sizeof(dns_header_t);
-    char name[128];
+/*
+    Answers one datagram, the reply is built over the query in its buffer of
+    DNS_MAX_LEN bytes. Nothing is logged or formatted here: a phone joining
+    the AP sends dozens of probes at once, the counters tell what happened.
+*/
+static void dns_server_answer(int sock, uint8_t *query, int len, const struct sockaddr *source_addr,
+                              socklen_t socklen, const dns_codec_answer_template_t *answer_template)
+{
+    uint8_t *reply = query;
+    int reply_len = 0;
+
+    if (len > (int)DNS_MAX_LEN) {
+        // Larger than any query this server takes, and cut off by recvfrom
+        metrics_counter_add(&dns_malformed, 1);
+        return;
+    }
 
-    // Respond to all questions with the ESP32's IP address
-    for (int i = 0; i < qd_count; i++) {
-        char *name_end_ptr = parse_dns_name(cur_qd_ptr, name, sizeof(name));
-        if (name_end_ptr == NULL) {
-            ESP_LOGE(TAG, "Failed to parse DNS question: %s", cur_qd_ptr);
-            return -1;
+#if CONFIG_APP_LOCAL_SERVER_DNS_FORWARD
+    if (dns_forward_wanted(query, len, source_addr)) {
+        int64_t now_us = esp_timer_get_time();
+        reply_len = dns_cache_lookup(&dns_cache, query, len, reply, DNS_MAX_LEN, now_us);
+        if (reply_len == 0) {
+            dns_forward_query(sock, query, len, source_addr, socklen, now_us);
+            return;
         }
+        metrics_counter_add(&dns_cache_hits, 1);
+    }
+#endif
+    if (reply_len == 0) {
+        reply_len = dns_codec_build_reply(query, len, reply, DNS_MAX_LEN, answer_template);
+    }
 
-        dns_question_t *question = (dns_question_t *)(name_end_ptr);
-        uint16_t qd_type = ntohs(question->type);
-        uint16_t qd_class = ntohs(question->class);
+    if (reply_len < 0) {
+        metrics_counter_add(&dns_malformed, 1);
+    } else if (reply_len == 0) {
+        metrics_counter_add(&dns_ignored, 1);
+    } else if (sendto(sock, reply, reply_len, 0, source_addr, socklen) < 0) {
+        // Out of buffers during a burst, the client asks again
+        metrics_counter_add(&dns_send_errors, 1);
+    } else {
+        metrics_counter_add(&dns_answered, 1);
+    }
+}
 
-        ESP_LOGD(TAG, "Received type: %d | Class: %d | Question for: %s", qd_type, qd_class, name);
+/*
+    Copies the busiest sources out of the guard for other tasks, at most once
+    per DNS_CLIENTS_PUBLISH_US so that a flood does not take the mutex per wakeup
+*/
+static void dns_server_publish_clients(int64_t now_us)
+{
+    dns_guard_client_t top[DNS_SERVER_TOP_CLIENTS];
 
-        if (qd_type == QD_TYPE_A) {
-            dns_answer_t *answer = (dns_answer_t *)cur_ans_ptr;
+    if (now_us - dns_clients_published_us < DNS_CLIENTS_PUBLISH_US || dns_clients_mutex == NULL) {
+        return;
+    }
+    dns_clients_published_us = now_us;
+    size_t count = dns_guard_top(&dns_guard, top, DNS_SERVER_TOP_CLIENTS);
+
+    xSemaphoreTake(dns_clients_mutex, portMAX_DELAY);
+    for (size_t i = 0; i < count; i++) {
+        dns_clients_top[i].addr = top[i].addr;
+        dns_clients_top[i].queries = top[i].queries;
+        dns_clients_top[i].refused = top[i].refused;
+        dns_clients_top[i].names = dns_guard_distinct_names(&top[i]);
+    }
+    dns_clients_top_count = count;
+    dns_clients_evicted = dns_guard.evicted;
+    xSemaphoreGive(dns_clients_mutex);
+}
 
-            answer->ptr_offset = htons(0xC000 | (cur_qd_ptr - dns_reply));
-            answer->type = htons(qd_type);
-            answer->class = htons(qd_class);
-            answer->ttl = htonl(ANS_TTL_SEC);
+/*
+    Answers every datagram queued on the socket, the first recvfrom blocks
+    unless flags has MSG_DONTWAIT
+    @return datagrams handled, -1 if the socket failed
+*/
+static int dns_server_drain(int sock, dns_codec_answer_template_t *answer_template, int flags)
+{
+    uint8_t rx_buffer[DNS_MAX_LEN + 1]; // One more to tell a cut off query
+    struct sockaddr_in6 source_addr; // Large enough for both IPv4 or IPv6
+    int batch = 0;
 
-            esp_netif_ip_info_t ip_info;
-            esp_netif_get_ip_info(esp_netif_get_handle_from_ifkey("WIFI_AP_DEF"), &ip_info);
-            ESP_LOGD(TAG, "Answer with PTR offset: 0x%" PRIX16 " and IP 0x%" PRIX32, ntohs(answer->ptr_offset), ip_info.ip.addr);
+    while (1) {
+        socklen_t socklen = sizeof(source_addr);
+        int len = recvfrom(sock, rx_buffer, sizeof(rx_buffer), flags, (struct sockaddr *)&source_addr, &socklen);
+        if (len < 0) {
+            break;
+        }
+        if (batch == 0) {
+            // The record is only rebuilt when the AP's address changed
+            uint32_t ap_addr = atomic_load(&dns_ap_addr);
+            if (ap_addr != answer_template->addr) {
+                dns_codec_template_init(answer_template, ap_addr, ANS_TTL_SEC);
+            }
+        }
+        // The socket is IPv4, a refused query costs no reply and no parsing
+        uint32_t source = ((struct sockaddr_in *)&source_addr)->sin_addr.s_addr;
+        if (dns_guard_admit(&dns_guard, source, rx_buffer, len, esp_timer_get_time())) {
+            dns_server_answer(sock, rx_buffer, len, (struct sockaddr *)&source_addr, socklen, answer_template);
+        } else {
+            metrics_counter_add(&dns_refused, 1);
+        }
+        flags = MSG_DONTWAIT;
+        batch++;
+    }
 
-            answer->addr_len = htons(sizeof(ip_info.ip.addr));
-            answer->ip_addr = ip_info.ip.addr;
+    int recv_errno = errno;
+    if (batch > 0) {
+        dns_server_publish_clients(esp_timer_get_time());
+        metrics_counter_add(&dns_queries, batch);
+        metrics_counter_add(&dns_wakeups, 1);
+        if ((uint32_t)batch > atomic_load(&dns_batch_max)) {
+            atomic_store(&dns_batch_max, batch);
         }
     }
-    return reply_len;
+    if (recv_errno != EAGAIN && recv_errno != EWOULDBLOCK) {
+        errno = recv_errno;
+        return -1;
+    }
+    return batch;
 }
 
 /*
@@ -165,10 +486,22 @@ static int parse_dns_request(char *req, size_t req_len, char *dns_reply, size_t
 */
 void dns_server_task(void *pvParameters)
 {
-    char rx_buffer[128];
-    char addr_str[128];
-    int addr_family;
-    int ip_protocol;
+    dns_codec_answer_template_t answer_template;
+
+    const dns_guard_config_t guard_config = {
+        .per_second = CONFIG_APP_LOCAL_SERVER_DNS_QUERIES_PER_SECOND,
+        .burst = CONFIG_APP_LOCAL_SERVER_DNS_BURST,
+    };
+
+    dns_codec_template_init(&answer_template, atomic_load(&dns_ap_addr), ANS_TTL_SEC);
+    dns_guard_init(&dns_guard, &guard_config);
+#if CONFIG_APP_LOCAL_SERVER_DNS_FORWARD
+    dns_cache_init(&dns_cache, dns_cache_entries, CONFIG_APP_LOCAL_SERVER_DNS_CACHE_ENTRIES);
+    dns_upstream_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (dns_upstream_sock < 0) {
+        ESP_LOGE(TAG, "Unable to create upstream socket: errno %d, not forwarding", errno);
+    }
+#endif
 
     while (1) {
 
@@ -176,16 +509,12 @@ void dns_server_task(void *pvParameters)
         dest_addr.sin_addr.s_addr = htonl(INADDR_ANY);
         dest_addr.sin_family = AF_INET;
         dest_addr.sin_port = htons(DNS_PORT);
-        addr_family = AF_INET;
-        ip_protocol = IPPROTO_IP;
-        inet_ntoa_r(dest_addr.sin_addr, addr_str, sizeof(addr_str) - 1);
 
-        int sock = socket(addr_family, SOCK_DGRAM, ip_protocol);
+        int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
         if (sock < 0) {
             ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
             break;
         }
-        ESP_LOGI(TAG, "Socket created");
 
         int err = bind(sock, (struct sockaddr *)&dest_addr, sizeof(dest_addr));
         if (err < 0) {
@@ -193,56 +522,81 @@ void dns_server_task(void *pvParameters)
         }
         ESP_LOGI(TAG, "Socket bound, port %d", DNS_PORT);
 
-        while (1) {
-            ESP_LOGI(TAG, "Waiting for data");
-            struct sockaddr_in6 source_addr; // Large enough for both IPv4 or IPv6
-            socklen_t socklen = sizeof(source_addr);
-            int len = recvfrom(sock, rx_buffer, sizeof(rx_buffer) - 1, 0, (struct sockaddr *)&source_addr, &socklen);
-
-            // Error occurred during receiving
-            if (len < 0) {
-                ESP_LOGE(TAG, "recvfrom failed: errno %d", errno);
-                close(sock);
-                break;
-            }
-            // Data received
-            else {
-                // Get the sender's ip address as string
-                if (source_addr.sin6_family == PF_INET) {
-                    inet_ntoa_r(((struct sockaddr_in *)&source_addr)->sin_addr.s_addr, addr_str, sizeof(addr_str) - 1);
-                } else if (source_addr.sin6_family == PF_INET6) {
-                    inet6_ntoa_r(source_addr.sin6_addr, addr_str, sizeof(addr_str) - 1);
-                }
-
-                // Null-terminate whatever we received and treat like a string...
-                rx_buffer[len] = 0;
-
-                char reply[DNS_MAX_LEN];
-                int reply_len = parse_dns_request(rx_buffer, len, reply, DNS_MAX_LEN);
-
-                ESP_LOGI(TAG, "Received %d bytes from %s | DNS reply with len: %d", len, addr_str, reply_len);
-                if (reply_len <= 0) {
-                    ESP_LOGE(TAG, "Failed to prepare a DNS reply");
-                } else {
-                    int err = sendto(sock, reply, reply_len, 0, (struct sockaddr *)&source_addr, sizeof(source_addr));
-                    if (err < 0) {
-                        ESP_LOGE(TAG, "Error occurred during sending: errno %d", errno);
-                        break;
-                    }
-                }
-            }
+        // Runs until the socket fails, then it is opened again
+#if CONFIG_APP_LOCAL_SERVER_DNS_FORWARD
+        int ready;
+        while ((ready = dns_forward_wait(sock)) >= 0 &&
+               (ready == 0 || dns_server_drain(sock, &answer_template, MSG_DONTWAIT) >= 0)) {
         }
-
-        if (sock != -1) {
-            ESP_LOGE(TAG, "Shutting down socket");
-            shutdown(sock, 0);
-            close(sock);
+#else
+        while (dns_server_drain(sock, &answer_template, 0) >= 0) {
         }
+#endif
+        ESP_LOGE(TAG, "recvfrom failed: errno %d", errno);
+
+        ESP_LOGE(TAG, "Shutting down socket");
+        shutdown(sock, 0);
+        close(sock);
     }
     vTaskDelete(NULL);
 }
 
 void start_dns_server(void)
 {
-    xTaskCreate(dns_server_task, "dns_server", 4096, NULL, 5, NULL);
+    if (dns_clients_mutex == NULL) {
+        dns_clients_mutex = xSemaphoreCreateMutex();
+    }
+    // The AP netif is created before the server starts
+    dns_server_update_ap_addr();
+#if !CONFIG_IDF_TARGET_LINUX
+    esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_AP_START, dns_server_ap_started, NULL);
+#endif
+#if CONFIG_APP_LOCAL_SERVER_DNS_FORWARD
+    esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, dns_forward_sta_event, NULL);
+    esp_event_handler_register(IP_EVENT, IP_EVENT_STA_LOST_IP, dns_forward_sta_event, NULL);
+#endif
+    xTaskCreate(dns_server_task, "dns_server", DNS_SERVER_STACK_SIZE, NULL, 5, NULL);
+}
+
+void dns_server_get_stats(dns_server_stats_t *stats)
+{
+    stats->queries = metrics_counter_get(&dns_queries);
+    stats->answered = metrics_counter_get(&dns_answered);
+    stats->malformed = metrics_counter_get(&dns_malformed);
+    stats->ignored = metrics_counter_get(&dns_ignored);
+    stats->send_errors = metrics_counter_get(&dns_send_errors);
+    stats->wakeups = metrics_counter_get(&dns_wakeups);
+    stats->batch_max = atomic_load(&dns_batch_max);
+    stats->refused = metrics_counter_get(&dns_refused);
+    stats->clients_evicted = 0;
+    if (dns_clients_mutex != NULL) {
+        xSemaphoreTake(dns_clients_mutex, portMAX_DELAY);
+        stats->clients_evicted = dns_clients_evicted;
+        xSemaphoreGive(dns_clients_mutex);
+    }
+#if CONFIG_APP_LOCAL_SERVER_DNS_FORWARD
+    stats->forwarded = metrics_counter_get(&dns_forwarded);
+    stats->cache_hits = metrics_counter_get(&dns_cache_hits);
+    stats->upstream_timeouts = metrics_counter_get(&dns_upstream_timeouts);
+    stats->upstream_failures = metrics_counter_get(&dns_upstream_failures);
+#else
+    stats->forwarded = 0;
+    stats->cache_hits = 0;
+    stats->upstream_timeouts = 0;
+    stats->upstream_failures = 0;
+#endif
+}
+
+size_t dns_server_get_top_clients(dns_server_client_t *clients, size_t max)
+{
+    size_t count = 0;
+
+    if (dns_clients_mutex == NULL) {
+        return 0;
+    }
+    xSemaphoreTake(dns_clients_mutex, portMAX_DELAY);
+    count = MIN(max, dns_clients_top_count);
+    memcpy(clients, dns_clients_top, count * sizeof(clients[0]));
+    xSemaphoreGive(dns_clients_mutex);
+    return count;
 }
@@ -0,0 +1,105 @@
+/**
+ * @file http_range.c
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <strings.h>
+#include "http_range.h"
+
+/*
+ * Parses the digits at *text, saturating at SIZE_MAX: a position that large
+ * is past the end of any body anyway
+ * @param text advanced past the digits
+ * @param value receives the number
+ * @return false if there are no digits
+ */
+static bool http_range_parse_pos(const char **text, size_t *value)
+{
+    const char *p = *text;
+    size_t result = 0;
+
+    while (*p >= '0' && *p <= '9')
+    {
+        size_t digit = (size_t)(*p - '0');
+        result = (result > (SIZE_MAX - digit) / 10u) ? SIZE_MAX : result * 10u + digit;
+        p++;
+    }
+    if (p == *text)
+    {
+        return false;
+    }
+    *text = p;
+    *value = result;
+    return true;
+}
+
+static const char *http_range_skip_spaces(const char *p)
+{
+    while (*p == ' ' || *p == '\t')
+    {
+        p++;
+    }
+    return p;
+}
+
+http_range_result_e http_range_parse(const char *value, size_t len, http_range_t *range)
+{
+    const char *p = http_range_skip_spaces(value);
+    size_t first = 0;
+    size_t last = SIZE_MAX;
+
+    if (strncasecmp(p, "bytes", 5) != 0)
+    {
+        return HTTP_RANGE_NONE;
+    }
+    p = http_range_skip_spaces(p + 5);
+    if (*p++ != '=')
+    {
+        return HTTP_RANGE_NONE;
+    }
+    p = http_range_skip_spaces(p);
+
+    if (*p == '-')
+    {
+        // Suffix: the last N bytes
+        size_t suffix = 0;
+        p++;
+        if (!http_range_parse_pos(&p, &suffix) || *http_range_skip_spaces(p) != '\0')
+        {
+            return HTTP_RANGE_NONE;
+        }
+        if (suffix == 0 || len == 0)
+        {
+            return HTTP_RANGE_UNSATISFIABLE;
+        }
+        range->start = (suffix >= len) ? 0 : len - suffix;
+        range->end = len - 1;
+        return HTTP_RANGE_PARTIAL;
+    }
+
+    if (!http_range_parse_pos(&p, &first) || *p++ != '-')
+    {
+        return HTTP_RANGE_NONE;
+    }
+    if (*p >= '0' && *p <= '9')
+    {
+        http_range_parse_pos(&p, &last);
+        if (last < first)
+        {
+            return HTTP_RANGE_NONE;
+        }
+    }
+    // Anything else left, e.g. a second range after a comma, falls back to the whole body
+    if (*http_range_skip_spaces(p) != '\0')
+    {
+        return HTTP_RANGE_NONE;
+    }
+    if (first >= len)
+    {
+        return HTTP_RANGE_UNSATISFIABLE;
+    }
+    range->start = first;
+    range->end = (last >= len) ? len - 1 : last;
+    return HTTP_RANGE_PARTIAL;
+}
@@ -0,0 +1,182 @@
+/**
+ * @file http_workers.c
+ *
+ * Worker pool for slow URI handlers. esp_http_server runs every handler on
+ * its single server task, so one request writing flash stalls all clients.
+ * A slow request is detached with httpd_req_async_handler_begin and queued;
+ * the server task returns to polling right away and the workers finish the
+ * request. The queue is bounded and submitting never waits, a full queue is
+ * reported to the caller who answers 503 instead of piling up sockets.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "http_workers.h"
+
+#define HTTP_WORKERS_MAX_WORKERS (4u)
+
+typedef struct
+{
+    httpd_req_t *req; // Asynchronous copy, owned by the job
+    http_workers_fn_t fn;
+    void *ctx;
+    int64_t submitted_us;
+} http_workers_job_t;
+
+typedef struct
+{
+    TaskHandle_t task;
+    void *scratch;
+} http_workers_worker_t;
+
+static const char *TAG = "http_workers";
+
+static QueueHandle_t http_workers_queue = NULL;
+static http_workers_worker_t http_workers[HTTP_WORKERS_MAX_WORKERS];
+static uint32_t http_workers_count = 0;
+static http_workers_stats_t http_workers_stats = {0};
+
+/*
+ * Worker task, runs queued requests until the device restarts
+ * @param arg unused
+ */
+static void http_workers_task(void *arg)
+{
+    http_workers_job_t job;
+
+    for (;;)
+    {
+        if (xQueueReceive(http_workers_queue, &job, portMAX_DELAY) != pdTRUE)
+        {
+            continue;
+        }
+        atomic_fetch_sub(&http_workers_stats.queued, 1);
+        atomic_fetch_add(&http_workers_stats.busy, 1);
+        metrics_histogram_observe(&http_workers_stats.queue_wait,
+                                  (uint32_t)(esp_timer_get_time() - job.submitted_us));
+
+        esp_err_t error = job.fn(job.req, job.ctx);
+
+        // Same as a failed synchronous handler: the connection is not reused
+        httpd_handle_t server = job.req->handle;
+        int sockfd = httpd_req_to_sockfd(job.req);
+        httpd_req_async_handler_complete(job.req);
+        if (error != ESP_OK)
+        {
+            httpd_sess_trigger_close(server, sockfd);
+        }
+        atomic_fetch_sub(&http_workers_stats.busy, 1);
+    }
+}
+
+bool http_workers_init(const http_workers_config_t *config)
+{
+    char name[configMAX_TASK_NAME_LEN];
+
+    if (http_workers_queue != NULL)
+    {
+        return true;
+    }
+    if (config->workers == 0 || config->workers > HTTP_WORKERS_MAX_WORKERS || config->queue_len == 0)
+    {
+        ESP_LOGE(TAG, "http_workers_init: Invalid pool size %lu/%lu",
+                 (unsigned long)config->workers, (unsigned long)config->queue_len);
+        return false;
+    }
+
+    http_workers_queue = xQueueCreate(config->queue_len, sizeof(http_workers_job_t));
+    if (http_workers_queue == NULL)
+    {
+        ESP_LOGE(TAG, "http_workers_init: Failed to create the queue");
+        return false;
+    }
+
+    for (uint32_t i = 0; i < config->workers; i++)
+    {
+        if (config->scratch_size > 0)
+        {
+            http_workers[i].scratch = malloc(config->scratch_size);
+            if (http_workers[i].scratch == NULL)
+            {
+                ESP_LOGE(TAG, "http_workers_init: No memory for worker %lu", (unsigned long)i);
+                break;
+            }
+        }
+        snprintf(name, sizeof(name), "http_worker%lu", (unsigned long)i);
+        // Count before starting the task, http_workers_scratch looks the task up by index
+        http_workers_count = i + 1;
+        if (xTaskCreate(http_workers_task, name, config->stack_size, NULL, config->priority,
+                        &http_workers[i].task) != pdPASS)
+        {
+            ESP_LOGE(TAG, "http_workers_init: Failed to create worker %lu", (unsigned long)i);
+            free(http_workers[i].scratch);
+            http_workers[i].scratch = NULL;
+            http_workers_count = i;
+            break;
+        }
+    }
+
+    // Fewer workers than configured still serve, only none at all is fatal
+    if (http_workers_count == 0)
+    {
+        vQueueDelete(http_workers_queue);
+        http_workers_queue = NULL;
+        return false;
+    }
+    ESP_LOGI(TAG, "%lu workers, queue of %lu", (unsigned long)http_workers_count, (unsigned long)config->queue_len);
+    return true;
+}
+
+esp_err_t http_workers_submit(httpd_req_t *req, http_workers_fn_t fn, void *ctx)
+{
+    http_workers_job_t job = {.fn = fn, .ctx = ctx, .submitted_us = esp_timer_get_time()};
+
+    if (http_workers_queue == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    // Cheap early out, the send below is what actually decides
+    if (uxQueueSpacesAvailable(http_workers_queue) == 0)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t error = httpd_req_async_handler_begin(req, &job.req);
+    if (error != ESP_OK)
+    {
+        return error;
+    }
+    atomic_fetch_add(&http_workers_stats.queued, 1);
+    if (xQueueSend(http_workers_queue, &job, 0) != pdTRUE)
+    {
+        atomic_fetch_sub(&http_workers_stats.queued, 1);
+        httpd_req_async_handler_complete(job.req);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void *http_workers_scratch(void)
+{
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+
+    for (uint32_t i = 0; i < http_workers_count; i++)
+    {
+        if (http_workers[i].task == self)
+        {
+            return http_workers[i].scratch;
+        }
+    }
+    return NULL;
+}
+
+http_workers_stats_t *http_workers_get_stats(void)
+{
+    return &http_workers_stats;
+}
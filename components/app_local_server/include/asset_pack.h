@@ -0,0 +1,151 @@
+/**
+ * @file asset_pack.h
+ *
+ * Web UI files packed into one image (see tools/mkassets.py) and kept in the
+ * "assets" data partition. The partition is memory mapped, so files are sent
+ * straight from flash without a copy in RAM, and the pack can be replaced
+ * without reflashing the firmware. Callers fall back to the copies embedded
+ * in the firmware when the partition is empty, invalid or being rewritten.
+ *
+ * Layout, little endian:
+ *   header  magic "WPAK", u16 version, u16 count, u32 image length,
+ *           u32 CRC-32 of everything after the header
+ *   entries count x { char path[32], char content_type[32], u32 offset,
+ *           u32 length, u32 CRC-32 of the stored data, u16 flags, u16 0 }
+ *   data    files at their offsets
+ */
+#ifndef ASSET_PACK_H
+#define ASSET_PACK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#define ASSET_PACK_HEADER_LEN (16u)
+#define ASSET_PACK_ENTRY_LEN (80u)
+#define ASSET_PACK_PATH_LEN (32u)
+#define ASSET_PACK_TYPE_LEN (32u)
+#define ASSET_PACK_FLAG_GZIP (0x0001u) // Stored gzip compressed, see asset_pack_inflate for clients without gzip
+
+// A validated pack image
+typedef struct
+{
+    const uint8_t *image;
+    size_t len;
+    uint16_t count;
+} asset_pack_t;
+
+// One file of a pack, the pointers stay valid while the pack is mounted
+typedef struct
+{
+    const char *content_type;
+    const uint8_t *data;
+    uint32_t len;
+    uint32_t crc; // Of data, usable as an ETag
+    uint16_t flags;
+} asset_pack_file_t;
+
+// The deflate data of a gzip file (RFC 1952) and what its trailer says about the content
+typedef struct
+{
+    const uint8_t *deflate;
+    size_t deflate_len;
+    uint32_t crc; // Of the content, the ETag of the file sent decompressed
+    uint32_t len; // Of the content
+} asset_pack_gzip_t;
+
+// Receives a piece of decompressed content, anything but ESP_OK stops asset_pack_inflate
+typedef esp_err_t (*asset_pack_sink_t)(void *ctx, const uint8_t *data, size_t len);
+
+/**
+ * @brief Checks a pack image: header, entry bounds and CRC
+ * @param pack receives the pack on success
+ * @param image pack image, e.g. a mapped partition
+ * @param image_len bytes available at image, may be more than the pack
+ * @return ESP_OK, ESP_ERR_NOT_FOUND if there is no pack (erased flash),
+ * ESP_ERR_INVALID_VERSION, ESP_ERR_INVALID_SIZE or ESP_ERR_INVALID_CRC
+ */
+esp_err_t asset_pack_open(asset_pack_t *pack, const uint8_t *image, size_t image_len);
+
+/**
+ * @brief Looks a file up by path
+ * @param pack opened pack
+ * @param path e.g. "/app.css"
+ * @param file receives the file
+ * @return true if found
+ */
+bool asset_pack_find(const asset_pack_t *pack, const char *path, asset_pack_file_t *file);
+
+/**
+ * @brief Skips the gzip header of a file stored with ASSET_PACK_FLAG_GZIP
+ * @param data file data
+ * @param len file length
+ * @param gzip receives the deflate data and the trailer
+ * @return ESP_OK, ESP_ERR_INVALID_ARG if data is not a gzip file of deflate data
+ */
+esp_err_t asset_pack_gzip_parse(const uint8_t *data, size_t len, asset_pack_gzip_t *gzip);
+
+/**
+ * @brief Decompresses a gzip file, for clients that do not accept gzip. The
+ * decompressor and its 32KB window are allocated for the duration of the call,
+ * calls on other tasks meanwhile are refused so the heap holds one at most.
+ * @param gzip from asset_pack_gzip_parse
+ * @param sink called with each piece of the content, in order
+ * @param ctx passed to sink
+ * @return ESP_OK, before sink is called ESP_ERR_INVALID_STATE while another
+ * inflate runs (one at a time), ESP_ERR_NO_MEM or ESP_ERR_NOT_SUPPORTED (linux
+ * target, no decompressor in ROM), then ESP_FAIL for corrupt deflate data,
+ * ESP_ERR_INVALID_SIZE or ESP_ERR_INVALID_CRC if the content does not match the
+ * trailer, or the error of sink
+ */
+esp_err_t asset_pack_inflate(const asset_pack_gzip_t *gzip, asset_pack_sink_t sink, void *ctx);
+
+/**
+ * @brief Maps the partition and opens the pack in it
+ * @param label partition label, e.g. "assets"
+ * @return ESP_OK, or why the pack is not used (callers fall back to embedded files)
+ */
+esp_err_t asset_pack_mount(const char *label);
+
+/**
+ * @brief Finds a file of the mounted pack and keeps its mapping until
+ * asset_pack_release. Every successful call must be followed by a release.
+ * No lock is held in between, asset_pack_update_begin waits for the release.
+ * @param path e.g. "/app.css"
+ * @param file receives the file
+ * @return true if found, false if not or no pack is mounted
+ */
+bool asset_pack_acquire(const char *path, asset_pack_file_t *file);
+
+/**
+ * @brief Ends the use of a file returned by asset_pack_acquire
+ */
+void asset_pack_release(void);
+
+/**
+ * @brief Unmounts the pack, waits until the files acquired from it are
+ * released and erases the partition for a new one. Files are served from
+ * the firmware until asset_pack_update_end.
+ * @param len size of the new pack
+ * @return ESP_OK, ESP_ERR_INVALID_STATE if asset_pack_mount found no partition or
+ * another update runs, ESP_ERR_INVALID_SIZE if len does not fit, ESP_ERR_TIMEOUT
+ * if a file of the old pack was not released within 10 s (the old pack stays)
+ */
+esp_err_t asset_pack_update_begin(size_t len);
+
+/**
+ * @brief Writes the next piece of the new pack
+ * @return ESP_OK, ESP_ERR_INVALID_SIZE past the announced length, or the flash error
+ */
+esp_err_t asset_pack_update_write(const void *data, size_t len);
+
+/**
+ * @brief Finishes an update and mounts the new pack
+ * @param commit false to give up (the partition stays erased)
+ * @return result of mounting the new pack, ESP_ERR_INVALID_SIZE if fewer
+ * bytes than announced were written
+ */
+esp_err_t asset_pack_update_end(bool commit);
+
+#endif // ASSET_PACK_H
@@ -0,0 +1,86 @@
+/**
+ * @file captive_probe.h
+ */
+#ifndef CAPTIVE_PROBE_H
+#define CAPTIVE_PROBE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CAPTIVE_PROBE_COUNT (9u) // Entries of captive_probes
+#define CAPTIVE_PROBE_MAC_LEN (6u)
+
+// Operating system family sending a connectivity probe
+typedef enum
+{
+    CAPTIVE_PROBE_ANDROID = 0,
+    CAPTIVE_PROBE_APPLE,
+    CAPTIVE_PROBE_WINDOWS,
+    CAPTIVE_PROBE_FIREFOX,
+    CAPTIVE_PROBE_KINDLE,
+    CAPTIVE_PROBE_OS_COUNT,
+} captive_probe_os_e;
+
+// Points between a client joining the AP and using the portal, timed once per join
+typedef enum
+{
+    CAPTIVE_PROBE_STAGE_PROBE = 0, // First connectivity probe received
+    CAPTIVE_PROBE_STAGE_PORTAL,    // Portal page requested
+    CAPTIVE_PROBE_STAGE_COUNT,
+} captive_probe_stage_e;
+
+// A connectivity check URL and the exact answer its OS expects when online
+typedef struct
+{
+    const char *path;
+    captive_probe_os_e os;
+    const char *status;       // e.g. "204 No Content"
+    const char *content_type; // NULL for an empty body
+    const char *body;
+} captive_probe_t;
+
+extern const captive_probe_t captive_probes[CAPTIVE_PROBE_COUNT];
+extern const char *const captive_probe_os_names[CAPTIVE_PROBE_OS_COUNT];
+
+/**
+ * @brief Creates the client table lock
+ * @return true on success, false if the mutex could not be created
+ */
+bool captive_probe_init(void);
+
+/**
+ * @brief Starts timing a client that was just given an address by the AP.
+ * Clients are told apart by MAC: a device that joins again keeps its
+ * authorization, also with a new address, while a device given an address
+ * that belonged to another one starts unauthorized.
+ * @param addr IPv4 address in network order
+ * @param mac station MAC address
+ * @param now_us esp_timer_get_time() of the join
+ */
+void captive_probe_client_joined(uint32_t addr, const uint8_t mac[CAPTIVE_PROBE_MAC_LEN], int64_t now_us);
+
+/**
+ * @brief Marks a client as done with the portal, its probes are answered
+ * as online from now on
+ * @param addr IPv4 address in network order
+ */
+void captive_probe_authorize(uint32_t addr);
+
+/**
+ * @brief Tells whether a client went through the portal
+ * @param addr IPv4 address in network order
+ * @return true if captive_probe_authorize was called for addr
+ */
+bool captive_probe_is_authorized(uint32_t addr);
+
+/**
+ * @brief Records that a client reached a stage
+ * @param addr IPv4 address in network order
+ * @param stage stage reached
+ * @param now_us current esp_timer_get_time()
+ * @return microseconds since the client joined the first time the stage is
+ * reached after a join, -1 otherwise
+ */
+int64_t captive_probe_client_reached(uint32_t addr, captive_probe_stage_e stage, int64_t now_us);
+
+#endif // CAPTIVE_PROBE_H
@@ -0,0 +1,117 @@
+/**
+ * @file conn_budget.h
+ *
+ * Admission control for the HTTP client connections. The server's share of
+ * the socket pool is split into connections any client may use and a few
+ * only the administration session may use. A new connection that does not
+ * fit takes the place of the least recently used idle keep-alive connection
+ * of the captive clients, or is refused; connections with a request in
+ * progress are never closed for it. Each client address is also held to a
+ * number of connections of its own.
+ */
+#ifndef CONN_BUDGET_H
+#define CONN_BUDGET_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CONN_BUDGET_MAX_CONNS (16u)       // Connections tracked, above any client limit of CONFIG_LWIP_MAX_SOCKETS
+#define CONN_BUDGET_MAX_ADMIN_CLIENTS (4u) // Administration clients remembered
+
+// Whose session a connection belongs to
+typedef enum
+{
+    CONN_BUDGET_PORTAL = 0, // Captive clients, the web UI before any administration
+    CONN_BUDGET_ADMIN,      // A client that recently used an administration route
+    CONN_BUDGET_CLASS_COUNT,
+} conn_budget_class_e;
+
+// Outcome of conn_budget_admit
+typedef enum
+{
+    CONN_BUDGET_ADMIT = 0,     // Take the connection
+    CONN_BUDGET_ADMIT_EVICT,   // Take it and close the idle connection returned in victim
+    CONN_BUDGET_REJECT_CLIENT, // The client holds its limit of connections, none of them idle
+    CONN_BUDGET_REJECT_POOL,   // No connection left for its class and none idle to take over
+} conn_budget_result_e;
+
+// Why a connection was evicted or rejected
+typedef enum
+{
+    CONN_BUDGET_REASON_POOL = 0, // Server's connections used up
+    CONN_BUDGET_REASON_CLIENT,   // Client's own limit reached
+    CONN_BUDGET_REASON_COUNT,
+} conn_budget_reason_e;
+
+typedef struct conn_budget_config
+{
+    uint32_t limit;          // Client connections of the server, at most CONN_BUDGET_MAX_CONNS
+    uint32_t admin_reserved; // Part of limit captive clients cannot take, below limit
+    uint32_t per_client;     // Captive connections per client address, 0 for no limit
+    uint32_t admin_hold_us;  // How long a client stays in the administration session after its last request
+} conn_budget_config_t;
+
+typedef struct conn_budget_stats
+{
+    uint32_t open[CONN_BUDGET_CLASS_COUNT];
+    uint32_t admitted[CONN_BUDGET_CLASS_COUNT];
+    uint32_t evicted[CONN_BUDGET_REASON_COUNT];  // Idle connections closed for a new one
+    uint32_t rejected[CONN_BUDGET_REASON_COUNT]; // New connections refused
+    uint32_t peak;                               // Most connections open at once
+} conn_budget_stats_t;
+
+/**
+ * @brief Creates the lock on the first call, sets the limits and forgets all
+ * connections, administration clients and counters
+ * @param config limits, see conn_budget_config_t
+ * @return false if the mutex could not be created or the limits do not fit
+ */
+bool conn_budget_init(const conn_budget_config_t *config);
+
+/**
+ * @brief Decides about a connection the server just accepted
+ * @param fd socket of the new connection
+ * @param client peer IPv4 address in network order
+ * @param now_us current time in microseconds
+ * @param victim receives the connection to close for CONN_BUDGET_ADMIT_EVICT, -1 otherwise
+ * @return how to handle the connection, it is only tracked when admitted
+ */
+conn_budget_result_e conn_budget_admit(int fd, uint32_t client, int64_t now_us, int *victim);
+
+/**
+ * @brief Forgets a closed connection, unknown sockets are ignored
+ * @param fd socket being closed
+ */
+void conn_budget_closed(int fd);
+
+/**
+ * @brief Marks a request in progress on a connection, it is not idle until the
+ * matching conn_budget_request_end. Calls nest.
+ * @param fd socket of the request
+ * @param now_us current time in microseconds
+ */
+void conn_budget_request_begin(int fd, int64_t now_us);
+
+/**
+ * @brief Ends a request started with conn_budget_request_begin
+ * @param fd socket of the request
+ * @param now_us current time in microseconds, the connection's last use
+ */
+void conn_budget_request_end(int fd, int64_t now_us);
+
+/**
+ * @brief Puts a client in the administration session: the connection (if
+ * tracked) and the client's next ones may use the reserved connections
+ * @param fd socket of the administration request, -1 for one of another server
+ * @param client peer IPv4 address in network order
+ * @param now_us current time in microseconds
+ */
+void conn_budget_mark_admin(int fd, uint32_t client, int64_t now_us);
+
+/**
+ * @brief Copies the current counts
+ * @param stats destination
+ */
+void conn_budget_get_stats(conn_budget_stats_t *stats);
+
+#endif // CONN_BUDGET_H
@@ -0,0 +1,47 @@
+/**
+ * @file data_keys.h
+ */
+#ifndef DATA_KEYS_H
+#define DATA_KEYS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Writes the value of a key (without quotes) into buffer.
+ * @return number of characters written, or a negative value on error
+ */
+typedef int (*data_key_writer_t)(char *buffer, size_t len, void *ctx);
+
+/**
+ * @brief Registers a key whose value is produced on every request.
+ * Keys must be registered during init, before the HTTP server is started.
+ * @param name key name as sent by the web page, e.g. "Temp"
+ * @param writer callback which formats the current value
+ * @param ctx opaque pointer handed back to the writer
+ * @return true on success, false if the table is full or the name is taken
+ */
+bool data_keys_register(const char *name, data_key_writer_t writer, void *ctx);
+
+/**
+ * @brief Registers a key whose value never changes, the "name":"value"
+ * fragment is formatted once here and copied as-is on every request.
+ * @param name key name
+ * @param value constant value
+ * @return true on success, false if the table or the fragment pool is full
+ */
+bool data_keys_register_static(const char *name, const char *value);
+
+/**
+ * @brief Writes the "name":"value" fragment for one requested key.
+ * Unknown keys produce "name":"" like before.
+ * @param key requested key, not NUL terminated
+ * @param key_len length of key
+ * @param buffer destination
+ * @param len size of buffer
+ * @return number of characters written, or -1 if the fragment does not fit
+ */
+int data_keys_write(const char *key, size_t key_len, char *buffer, size_t len);
+
+#endif // DATA_KEYS_H
@@ -9,10 +9,38 @@
 
 #pragma once
 
+#include <stdint.h>
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+typedef struct {
+    uint32_t queries;     // Datagrams received
+    uint32_t answered;    // Replies sent
+    uint32_t malformed;   // Queries no reply could be built for
+    uint32_t ignored;     // Other opcodes than a standard query, not answered
+    uint32_t send_errors; // Replies the stack could not send
+    uint32_t wakeups;     // Times the task woke up, queries / wakeups is the average batch
+    uint32_t batch_max;   // Most datagrams answered in one wakeup
+    uint32_t forwarded;         // Queries sent to the upstream resolver (APP_LOCAL_SERVER_DNS_FORWARD)
+    uint32_t cache_hits;        // Queries of authorized clients answered from the cache
+    uint32_t upstream_timeouts; // Forwarded queries the upstream resolver did not answer in time
+    uint32_t upstream_failures; // Queries answered SERVFAIL because they could not be forwarded
+    uint32_t refused;           // Queries dropped by the per-source limit
+    uint32_t clients_evicted;   // Sources dropped from the full per-source table, updated once a second
+} dns_server_stats_t;
+
+#define DNS_SERVER_TOP_CLIENTS (4)
+
+typedef struct {
+    uint32_t addr;    // IPv4 address in network order, 0 for the sources sharing the overflow bucket
+    uint32_t queries; // Since the source got its table entry
+    uint32_t refused; // Of those, dropped by the limit
+    uint32_t names;   // Different names asked for in the last 10 to 20 seconds, estimated
+} dns_server_client_t;
+
 /**
  * @brief Set ups and starts a simple DNS server that will respond to all queries
  * with the soft AP's IP address
@@ -20,6 +48,29 @@ extern "C" {
  */
 void start_dns_server(void);
 
+/**
+ * @brief Reads the soft AP's address again for the answers, call after
+ * changing it with esp_netif_set_ip_info while the soft AP runs. The server
+ * reads it by itself at start and whenever the soft AP starts.
+ */
+void dns_server_update_ap_addr(void);
+
+/**
+ * @brief Copies the query counters, safe to call from any task
+ *
+ * @param stats receives the counters since boot
+ */
+void dns_server_get_stats(dns_server_stats_t *stats);
+
+/**
+ * @brief Copies the sources that sent the most queries, as of the last second
+ *
+ * @param clients destination, the busiest first
+ * @param max capacity of clients, at most DNS_SERVER_TOP_CLIENTS are returned
+ * @return number of clients copied
+ */
+size_t dns_server_get_top_clients(dns_server_client_t *clients, size_t max);
+
 
 #ifdef __cplusplus
 }
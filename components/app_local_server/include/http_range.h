@@ -0,0 +1,38 @@
+/**
+ * @file http_range.h
+ *
+ * Parses the Range request header of a byte range request (RFC 9110 14.1.2).
+ * Only a single range is supported. A request for several ranges gets the
+ * whole body, which the RFC allows.
+ */
+#ifndef HTTP_RANGE_H
+#define HTTP_RANGE_H
+
+#include <stddef.h>
+
+typedef enum
+{
+    HTTP_RANGE_NONE = 0,         // No usable range, send the whole body with 200
+    HTTP_RANGE_PARTIAL,          // Send the range with 206 Partial Content
+    HTTP_RANGE_UNSATISFIABLE,    // Send 416 with "Content-Range: bytes */<len>"
+} http_range_result_e;
+
+// Bytes start to end of the body, both included
+typedef struct
+{
+    size_t start;
+    size_t end;
+} http_range_t;
+
+/**
+ * @brief Resolves a Range header against a body
+ * @param value header value, e.g. "bytes=500-999", "bytes=500-" or "bytes=-500"
+ * @param len body length
+ * @param range receives the range, clipped to the body, for HTTP_RANGE_PARTIAL
+ * @return HTTP_RANGE_PARTIAL, HTTP_RANGE_UNSATISFIABLE if the range starts
+ * past the end, HTTP_RANGE_NONE for anything else (malformed, other units,
+ * several ranges)
+ */
+http_range_result_e http_range_parse(const char *value, size_t len, http_range_t *range);
+
+#endif // HTTP_RANGE_H
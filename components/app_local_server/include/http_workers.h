@@ -0,0 +1,71 @@
+/**
+ * @file http_workers.h
+ */
+#ifndef HTTP_WORKERS_H
+#define HTTP_WORKERS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "metrics.h"
+
+/*
+ * Runs a request on a worker task.
+ * @return ESP_OK, anything else closes the connection like a failed URI handler
+ */
+typedef esp_err_t (*http_workers_fn_t)(httpd_req_t *req, void *ctx);
+
+typedef struct
+{
+    uint32_t workers;      // Worker tasks
+    uint32_t queue_len;    // Requests waiting for a worker before new ones are refused
+    uint32_t stack_size;   // Per worker task
+    uint32_t priority;     // Of the worker tasks
+    size_t scratch_size;   // Per worker buffer returned by http_workers_scratch, 0 for none
+} http_workers_config_t;
+
+// Pool counters, readable at any time
+typedef struct
+{
+    metrics_histogram_t queue_wait; // Time from submit until a worker picked the request up
+    atomic_uint queued;             // Requests waiting for a worker
+    atomic_uint busy;               // Workers running a request
+} http_workers_stats_t;
+
+/**
+ * @brief Creates the request queue and starts the worker tasks
+ * @param config pool size and task parameters
+ * @return true on success, false if a queue, task or scratch buffer could not be created
+ */
+bool http_workers_init(const http_workers_config_t *config);
+
+/**
+ * @brief Detaches req from the HTTP server task and queues it for a worker.
+ * Never blocks: a full queue is reported right away so the caller can answer
+ * 503 while the server task keeps serving other clients.
+ * @param req request being handled on the server task
+ * @param fn runs the request on a worker
+ * @param ctx opaque pointer handed to fn
+ * @return ESP_OK once queued (req must not be used anymore), ESP_ERR_NO_MEM
+ * if the queue is full, ESP_ERR_INVALID_STATE if the pool is not running, or
+ * the error of httpd_req_async_handler_begin. req is still owned by the caller
+ * on any error.
+ */
+esp_err_t http_workers_submit(httpd_req_t *req, http_workers_fn_t fn, void *ctx);
+
+/**
+ * @brief Scratch buffer of the calling worker task
+ * @return the buffer (config.scratch_size bytes), NULL when not called from a worker
+ */
+void *http_workers_scratch(void);
+
+/**
+ * @brief Pool counters
+ * @return statistics shared by all workers
+ */
+http_workers_stats_t *http_workers_get_stats(void);
+
+#endif // HTTP_WORKERS_H
@@ -0,0 +1,95 @@
+/**
+ * @file json_scan.h
+ *
+ * Zero-allocation JSON tokenizer for small request bodies. The tokens only
+ * store offsets into the caller's buffer, nothing is copied or allocated.
+ */
+#ifndef JSON_SCAN_H
+#define JSON_SCAN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define JSON_SCAN_MAX_DEPTH (8u) // Deepest nesting of objects/arrays
+
+#define JSON_SCAN_ERR_NOMEM (-1)   // Not enough tokens provided
+#define JSON_SCAN_ERR_INVALID (-2) // Malformed JSON
+#define JSON_SCAN_ERR_PARTIAL (-3) // Input ended inside a value
+
+typedef enum json_scan_type
+{
+    JSON_SCAN_UNDEFINED = 0,
+    JSON_SCAN_OBJECT,
+    JSON_SCAN_ARRAY,
+    JSON_SCAN_STRING,    // start/end exclude the quotes, escapes are left as-is
+    JSON_SCAN_PRIMITIVE, // number, true, false or null
+} json_scan_type_e;
+
+typedef struct json_scan_token
+{
+    json_scan_type_e type;
+    uint32_t start; // Offset of the first character
+    uint32_t end;   // Offset one past the last character
+    uint16_t size;  // Direct children (keys and values for objects)
+} json_scan_token_t;
+
+typedef struct json_scan
+{
+    const char *json;
+    json_scan_token_t *tokens;
+    uint16_t max_tokens;
+    uint16_t count;
+} json_scan_t;
+
+/**
+ * @brief Tokenizes a JSON document in place
+ * @param scan scanner state, filled in by this call
+ * @param json document, does not need to be NUL terminated
+ * @param len length of json
+ * @param tokens caller provided token storage
+ * @param max_tokens number of entries in tokens
+ * @return number of tokens, or one of the JSON_SCAN_ERR_* codes
+ */
+int json_scan_parse(json_scan_t *scan, const char *json, size_t len,
+                    json_scan_token_t *tokens, uint16_t max_tokens);
+
+/**
+ * @brief Returns the index of the token following the subtree at index
+ */
+int json_scan_skip(const json_scan_t *scan, int index);
+
+/**
+ * @brief Finds the value of key in the object at index object
+ * @return token index of the value, or -1 if absent
+ */
+int json_scan_find(const json_scan_t *scan, int object, const char *key);
+
+/**
+ * @brief Returns a pointer into the source buffer for a string or primitive
+ * value, escapes are not decoded
+ * @param len receives the length of the value
+ * @return pointer to the value, NULL if absent or not a scalar
+ */
+const char *json_scan_get_raw(const json_scan_t *scan, int object, const char *key, size_t *len);
+
+/**
+ * @brief Reads an unsigned 32-bit number, given either as a JSON number or
+ * as a string of decimal digits
+ * @return true if present and in range
+ */
+bool json_scan_get_u32(const json_scan_t *scan, int object, const char *key, uint32_t *value);
+
+/**
+ * @brief Reads a boolean value
+ * @return true if present and a JSON boolean
+ */
+bool json_scan_get_bool(const json_scan_t *scan, int object, const char *key, bool *value);
+
+/**
+ * @brief Copies a string value into dest, decoding escapes
+ * @return length of the decoded string, or -1 if absent, not a string or too long
+ */
+int json_scan_get_string(const json_scan_t *scan, int object, const char *key, char *dest, size_t dest_len);
+
+#endif // JSON_SCAN_H
@@ -0,0 +1,64 @@
+/**
+ * @file req_body.h
+ */
+#ifndef REQ_BODY_H
+#define REQ_BODY_H
+
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+/*
+ * Receives one chunk of the request body.
+ * @return ESP_OK to continue, anything else aborts the read with that error
+ */
+typedef esp_err_t (*req_body_chunk_cb_t)(const char *data, size_t len, void *ctx);
+
+/**
+ * @brief Receives the next piece of the request body, retrying on socket timeouts
+ * @param req HTTP request whose body is read
+ * @param buffer destination
+ * @param len maximum number of bytes to receive
+ * @param received receives the number of bytes read
+ * @return ESP_OK, ESP_ERR_TIMEOUT if the client stalled, ESP_FAIL on socket
+ * errors or if the peer closed the connection
+ */
+esp_err_t req_body_recv(httpd_req_t *req, char *buffer, size_t len, size_t *received);
+
+/**
+ * @brief Reads the complete request body (content_len bytes) into buffer and
+ * NUL terminates it. Short reads from fragmented segments are looped over and
+ * socket timeouts are retried a bounded number of times.
+ * @param req HTTP request whose body is read
+ * @param buffer destination, must hold content_len + 1 bytes
+ * @param buffer_len size of buffer
+ * @param body_len receives the number of body bytes read
+ * @return ESP_OK, ESP_ERR_INVALID_SIZE if the body is empty or does not fit,
+ * ESP_ERR_TIMEOUT if the client stalled, ESP_FAIL on socket errors
+ */
+esp_err_t req_body_read(httpd_req_t *req, char *buffer, size_t buffer_len, size_t *body_len);
+
+/**
+ * @brief Streams the request body through chunk, handing every piece to cb.
+ * Suited for bodies larger than any buffer, e.g. batch imports.
+ * @param req HTTP request whose body is read
+ * @param chunk scratch buffer used for each recv
+ * @param chunk_len size of chunk
+ * @param cb consumer called for every received piece
+ * @param ctx opaque pointer handed back to cb
+ * @return ESP_OK once content_len bytes were consumed, the error from cb, or
+ * the same errors as req_body_read
+ */
+esp_err_t req_body_stream(httpd_req_t *req, char *chunk, size_t chunk_len,
+                          req_body_chunk_cb_t cb, void *ctx);
+
+/**
+ * @brief Sends the error response matching a req_body_read/req_body_stream failure
+ * (400 empty body, 413 too large, 408 timeout, 500 otherwise)
+ * @param req HTTP request to respond to
+ * @param error value returned by the reader
+ * @return ESP_FAIL so handlers can return it directly and have the socket closed
+ */
+esp_err_t req_body_send_error(httpd_req_t *req, esp_err_t error);
+
+#endif // REQ_BODY_H
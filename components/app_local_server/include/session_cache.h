@@ -0,0 +1,77 @@
+/**
+ * @file session_cache.h
+ *
+ * Bounded cache of TLS sessions by session ID, so a client that reconnects
+ * resumes its session without a new key exchange. Entries hold the session
+ * as serialised by the TLS library (mbedtls_ssl_session_save), which this
+ * module does not look into. A full cache replaces an expired entry, else
+ * the one stored longest ago; expired entries are never returned.
+ */
+#ifndef SESSION_CACHE_H
+#define SESSION_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#define SESSION_CACHE_MAX_ENTRIES (8u) // Above any CONFIG_APP_LOCAL_SERVER_HTTPS_SESSION_CACHE_ENTRIES
+#define SESSION_CACHE_ID_LEN (32u)     // Longest TLS session ID
+#define SESSION_CACHE_DATA_LEN (160u)  // A saved TLS 1.2 session without a client certificate is about 110 bytes
+
+typedef struct session_cache_config
+{
+    uint32_t entries;    // Sessions kept, at most SESSION_CACHE_MAX_ENTRIES
+    uint32_t lifetime_s; // How long a session may be resumed after its full handshake
+} session_cache_config_t;
+
+typedef struct session_cache_stats
+{
+    uint32_t stored;  // Sessions of full handshakes added
+    uint32_t hits;    // Lookups that found a live session
+    uint32_t misses;  // Lookups for unknown or expired IDs
+    uint32_t evicted; // Live sessions replaced because the cache was full
+    uint32_t entries; // Sessions held now, expired ones included until replaced
+} session_cache_stats_t;
+
+/**
+ * @brief Creates the lock on the first call, sets the limits and forgets all
+ * sessions and counters
+ * @param config limits, see session_cache_config_t
+ * @return false if the mutex could not be created or the limits do not fit
+ */
+bool session_cache_init(const session_cache_config_t *config);
+
+/**
+ * @brief Keeps the session of a full handshake, replacing one of the same ID
+ * @param id session ID the server sent
+ * @param id_len 1 to SESSION_CACHE_ID_LEN bytes
+ * @param data serialised session
+ * @param len up to SESSION_CACHE_DATA_LEN bytes
+ * @param now_us current time in microseconds
+ * @return ESP_OK, ESP_ERR_INVALID_STATE before session_cache_init,
+ * ESP_ERR_INVALID_ARG for an empty or too long ID, ESP_ERR_INVALID_SIZE if data does not fit
+ */
+esp_err_t session_cache_store(const uint8_t *id, size_t id_len, const uint8_t *data, size_t len, int64_t now_us);
+
+/**
+ * @brief Copies out the session a client offered to resume
+ * @param id session ID from the ClientHello
+ * @param id_len its length
+ * @param data receives the serialised session
+ * @param data_len size of data, SESSION_CACHE_DATA_LEN always suffices
+ * @param len receives the length of the session
+ * @param now_us current time in microseconds
+ * @return ESP_OK, ESP_ERR_NOT_FOUND for an unknown or expired ID (an expired
+ * session is dropped), ESP_ERR_INVALID_SIZE if data_len is too small
+ */
+esp_err_t session_cache_lookup(const uint8_t *id, size_t id_len, uint8_t *data, size_t data_len, size_t *len,
+                               int64_t now_us);
+
+/**
+ * @brief Copies the counters
+ * @param stats receives the counters
+ */
+void session_cache_get_stats(session_cache_stats_t *stats);
+
+#endif // SESSION_CACHE_H
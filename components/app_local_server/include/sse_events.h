@@ -0,0 +1,39 @@
+/**
+ * @file sse_events.h
+ */
+#ifndef SSE_EVENTS_H
+#define SSE_EVENTS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+/**
+ * @brief Creates the subscriber table and its per-subscriber event queues
+ * @return true on success, false if the RTOS objects could not be created
+ */
+bool sse_events_init(void);
+
+/**
+ * @brief Attaches the running HTTP server, used to schedule socket writes
+ * @param server handle returned by httpd_start
+ */
+void sse_events_set_server(httpd_handle_t server);
+
+/**
+ * @brief GET handler which turns the connection into a text/event-stream
+ * @param req HTTP request for which the uri needs to be handled
+ * @return ESP_OK, or ESP_FAIL if the stream headers could not be sent
+ */
+esp_err_t sse_events_subscribe_handler(httpd_req_t *req);
+
+/**
+ * @brief Queues one event for every subscriber, never blocks the caller.
+ * Slow subscribers lose their oldest pending event when their queue is full.
+ * @param event SSE event name
+ * @param data single line event payload
+ */
+void sse_events_publish(const char *event, const char *data);
+
+#endif // SSE_EVENTS_H
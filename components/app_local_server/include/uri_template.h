@@ -0,0 +1,79 @@
+/**
+ * @file uri_template.h
+ *
+ * Matches request paths against templates such as "/cards/{id:u32}". The
+ * parameters point into the request URI, nothing is copied. A parameter
+ * covers one non-empty path segment; "{name}" accepts any segment and
+ * "{name:u32}" only a decimal number that fits 32 bits.
+ */
+#ifndef URI_TEMPLATE_H
+#define URI_TEMPLATE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define URI_TEMPLATE_MAX_PARAMS (4u)
+
+typedef struct
+{
+    const char *name; // Points into the template
+    size_t name_len;
+    const char *value; // Points into the URI
+    size_t value_len;
+} uri_template_param_t;
+
+typedef struct
+{
+    size_t count;
+    uri_template_param_t params[URI_TEMPLATE_MAX_PARAMS];
+} uri_template_match_t;
+
+/**
+ * @brief Matches a URI path against a template. The query string of uri,
+ * if any, is ignored.
+ * @param tpl template, e.g. "/cards/{id:u32}"
+ * @param uri request URI
+ * @param match receives the parameters, may be NULL
+ * @return true if the whole path matches and every typed parameter parses
+ */
+bool uri_template_match(const char *tpl, const char *uri, uri_template_match_t *match);
+
+/**
+ * @brief Tells whether a URI string is a template
+ * @return true if tpl contains a parameter
+ */
+bool uri_template_is_template(const char *tpl);
+
+/**
+ * @brief Writes the esp_http_server wildcard pattern that covers a template,
+ * the literal prefix up to the first parameter followed by '*'
+ * @param tpl template
+ * @param dest output buffer
+ * @param dest_len size of dest
+ * @return true on success, false if dest is too small
+ */
+bool uri_template_wildcard(const char *tpl, char *dest, size_t dest_len);
+
+/**
+ * @brief Finds a parameter by name
+ * @return the parameter, NULL if the template has none of that name
+ */
+const uri_template_param_t *uri_template_get(const uri_template_match_t *match, const char *name);
+
+/**
+ * @brief Reads a parameter as an unsigned 32-bit decimal number
+ * @return true if present and in range
+ */
+bool uri_template_get_u32(const uri_template_match_t *match, const char *name, uint32_t *value);
+
+/**
+ * @brief Parses a decimal number without copying it, e.g. a query parameter
+ * @param text digits, not necessarily terminated
+ * @param len number of characters
+ * @param value receives the number
+ * @return true if text is all digits and fits 32 bits
+ */
+bool uri_template_parse_u32(const char *text, size_t len, uint32_t *value);
+
+#endif // URI_TEMPLATE_H
@@ -0,0 +1,495 @@
+/**
+ * @file json_scan.c
+ *
+ * Single pass tokenizer in the spirit of jsmn: every value becomes a token
+ * holding offsets into the request buffer, so parsing a request body costs a
+ * small stack array instead of a heap allocated cJSON tree.
+ */
+
+#include <string.h>
+#include "json_scan.h"
+
+typedef enum json_scan_expect
+{
+    EXPECT_VALUE = 0,
+    EXPECT_VALUE_OR_CLOSE,
+    EXPECT_KEY,
+    EXPECT_KEY_OR_CLOSE,
+    EXPECT_COLON,
+    EXPECT_COMMA_OR_CLOSE,
+    EXPECT_END,
+} json_scan_expect_e;
+
+static json_scan_token_t *json_scan_alloc(json_scan_t *scan, json_scan_type_e type, uint32_t start, uint32_t end)
+{
+    if (scan->count >= scan->max_tokens)
+    {
+        return NULL;
+    }
+    json_scan_token_t *token = &scan->tokens[scan->count++];
+    token->type = type;
+    token->start = start;
+    token->end = end;
+    token->size = 0;
+    return token;
+}
+
+static bool json_scan_is_hex(char c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+/*
+ * Scans a string starting at the opening quote
+ * @return offset of the closing quote, or a JSON_SCAN_ERR_* code
+ */
+static long json_scan_string(const char *json, size_t len, size_t pos)
+{
+    for (pos++; pos < len; pos++)
+    {
+        char c = json[pos];
+        if (c == '"')
+        {
+            return (long)pos;
+        }
+        if ((unsigned char)c < 0x20)
+        {
+            return JSON_SCAN_ERR_INVALID;
+        }
+        if (c == '\\')
+        {
+            if (++pos >= len)
+            {
+                return JSON_SCAN_ERR_PARTIAL;
+            }
+            switch (json[pos])
+            {
+            case '"':
+            case '\\':
+            case '/':
+            case 'b':
+            case 'f':
+            case 'n':
+            case 'r':
+            case 't':
+                break;
+            case 'u':
+                for (int i = 0; i < 4; i++)
+                {
+                    if (++pos >= len)
+                    {
+                        return JSON_SCAN_ERR_PARTIAL;
+                    }
+                    if (!json_scan_is_hex(json[pos]))
+                    {
+                        return JSON_SCAN_ERR_INVALID;
+                    }
+                }
+                break;
+            default:
+                return JSON_SCAN_ERR_INVALID;
+            }
+        }
+    }
+    return JSON_SCAN_ERR_PARTIAL;
+}
+
+/*
+ * Scans a number or literal
+ * @return offset one past the primitive, or a JSON_SCAN_ERR_* code
+ */
+static long json_scan_primitive(const char *json, size_t len, size_t pos)
+{
+    size_t start = pos;
+
+    for (; pos < len; pos++)
+    {
+        char c = json[pos];
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == ',' || c == ']' || c == '}')
+        {
+            break;
+        }
+        if ((unsigned char)c < 0x20 || c == '"' || c == ':' || c == '[' || c == '{')
+        {
+            return JSON_SCAN_ERR_INVALID;
+        }
+    }
+
+    size_t n = pos - start;
+    const char *p = json + start;
+    if ((n == 4 && memcmp(p, "true", 4) == 0) || (n == 5 && memcmp(p, "false", 5) == 0) ||
+        (n == 4 && memcmp(p, "null", 4) == 0))
+    {
+        return (long)pos;
+    }
+    size_t digits = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        // strchr would find the terminator of its own string for a NUL
+        if (p[i] == '\0' || strchr("0123456789+-.eE", p[i]) == NULL)
+        {
+            return (pos == len) ? JSON_SCAN_ERR_PARTIAL : JSON_SCAN_ERR_INVALID;
+        }
+        digits += (p[i] >= '0' && p[i] <= '9');
+    }
+    if (digits == 0 && pos < len)
+    {
+        // A sign, point or exponent with no digits, e.g. a bare "-"
+        return JSON_SCAN_ERR_INVALID;
+    }
+    if (pos == len)
+    {
+        // A number running into the end of input may have been cut short
+        return JSON_SCAN_ERR_PARTIAL;
+    }
+    return (long)pos;
+}
+
+int json_scan_parse(json_scan_t *scan, const char *json, size_t len,
+                    json_scan_token_t *tokens, uint16_t max_tokens)
+{
+    int stack[JSON_SCAN_MAX_DEPTH];
+    size_t depth = 0;
+    json_scan_expect_e expect = EXPECT_VALUE;
+
+    scan->json = json;
+    scan->tokens = tokens;
+    scan->max_tokens = max_tokens;
+    scan->count = 0;
+
+    for (size_t pos = 0; pos < len; pos++)
+    {
+        char c = json[pos];
+        json_scan_token_t *token = NULL;
+
+        switch (c)
+        {
+        case ' ':
+        case '\t':
+        case '\r':
+        case '\n':
+            continue;
+
+        case '{':
+        case '[':
+            if ((expect != EXPECT_VALUE && expect != EXPECT_VALUE_OR_CLOSE) || depth >= JSON_SCAN_MAX_DEPTH)
+            {
+                return JSON_SCAN_ERR_INVALID;
+            }
+            if (depth > 0)
+            {
+                tokens[stack[depth - 1]].size++;
+            }
+            token = json_scan_alloc(scan, (c == '{') ? JSON_SCAN_OBJECT : JSON_SCAN_ARRAY, pos, 0);
+            if (token == NULL)
+            {
+                return JSON_SCAN_ERR_NOMEM;
+            }
+            stack[depth++] = scan->count - 1;
+            expect = (c == '{') ? EXPECT_KEY_OR_CLOSE : EXPECT_VALUE_OR_CLOSE;
+            continue;
+
+        case '}':
+        case ']':
+        {
+            json_scan_type_e type = (c == '}') ? JSON_SCAN_OBJECT : JSON_SCAN_ARRAY;
+            bool can_close = (expect == EXPECT_COMMA_OR_CLOSE) ||
+                             (type == JSON_SCAN_OBJECT && expect == EXPECT_KEY_OR_CLOSE) ||
+                             (type == JSON_SCAN_ARRAY && expect == EXPECT_VALUE_OR_CLOSE);
+            if (depth == 0 || !can_close || tokens[stack[depth - 1]].type != type)
+            {
+                return JSON_SCAN_ERR_INVALID;
+            }
+            tokens[stack[--depth]].end = pos + 1;
+            break;
+        }
+
+        case '"':
+        {
+            long end = json_scan_string(json, len, pos);
+            if (end < 0)
+            {
+                return (int)end;
+            }
+            bool is_key = (expect == EXPECT_KEY || expect == EXPECT_KEY_OR_CLOSE);
+            if (!is_key && expect != EXPECT_VALUE && expect != EXPECT_VALUE_OR_CLOSE)
+            {
+                return JSON_SCAN_ERR_INVALID;
+            }
+            if (depth > 0)
+            {
+                tokens[stack[depth - 1]].size++;
+            }
+            if (json_scan_alloc(scan, JSON_SCAN_STRING, pos + 1, end) == NULL)
+            {
+                return JSON_SCAN_ERR_NOMEM;
+            }
+            pos = end;
+            if (is_key)
+            {
+                expect = EXPECT_COLON;
+                continue;
+            }
+            break;
+        }
+
+        case ':':
+            if (expect != EXPECT_COLON)
+            {
+                return JSON_SCAN_ERR_INVALID;
+            }
+            expect = EXPECT_VALUE;
+            continue;
+
+        case ',':
+            if (expect != EXPECT_COMMA_OR_CLOSE)
+            {
+                return JSON_SCAN_ERR_INVALID;
+            }
+            expect = (tokens[stack[depth - 1]].type == JSON_SCAN_OBJECT) ? EXPECT_KEY : EXPECT_VALUE;
+            continue;
+
+        default:
+        {
+            if (expect != EXPECT_VALUE && expect != EXPECT_VALUE_OR_CLOSE)
+            {
+                return JSON_SCAN_ERR_INVALID;
+            }
+            if (c != '-' && (c < '0' || c > '9') && c != 't' && c != 'f' && c != 'n')
+            {
+                return JSON_SCAN_ERR_INVALID;
+            }
+            long end = json_scan_primitive(json, len, pos);
+            if (end < 0)
+            {
+                return (int)end;
+            }
+            if (depth > 0)
+            {
+                tokens[stack[depth - 1]].size++;
+            }
+            if (json_scan_alloc(scan, JSON_SCAN_PRIMITIVE, pos, end) == NULL)
+            {
+                return JSON_SCAN_ERR_NOMEM;
+            }
+            pos = end - 1;
+            break;
+        }
+        }
+
+        // A value or container just completed
+        expect = (depth == 0) ? EXPECT_END : EXPECT_COMMA_OR_CLOSE;
+        if (depth == 0)
+        {
+            // Only whitespace may follow the top-level value
+            for (pos++; pos < len; pos++)
+            {
+                c = json[pos];
+                if (c != ' ' && c != '\t' && c != '\r' && c != '\n' && c != '\0')
+                {
+                    return JSON_SCAN_ERR_INVALID;
+                }
+            }
+            break;
+        }
+    }
+
+    if (expect != EXPECT_END)
+    {
+        return JSON_SCAN_ERR_PARTIAL;
+    }
+    return scan->count;
+}
+
+int json_scan_skip(const json_scan_t *scan, int index)
+{
+    uint32_t end = scan->tokens[index].end;
+    int next = index + 1;
+
+    while (next < scan->count && scan->tokens[next].start < end)
+    {
+        next++;
+    }
+    return next;
+}
+
+int json_scan_find(const json_scan_t *scan, int object, const char *key)
+{
+    if (object < 0 || object >= scan->count || scan->tokens[object].type != JSON_SCAN_OBJECT)
+    {
+        return -1;
+    }
+
+    size_t key_len = strlen(key);
+    int index = object + 1;
+
+    for (uint16_t i = 0; i < scan->tokens[object].size / 2; i++)
+    {
+        const json_scan_token_t *name = &scan->tokens[index];
+        if (name->end - name->start == key_len &&
+            memcmp(scan->json + name->start, key, key_len) == 0)
+        {
+            return index + 1;
+        }
+        index = json_scan_skip(scan, index + 1);
+    }
+    return -1;
+}
+
+const char *json_scan_get_raw(const json_scan_t *scan, int object, const char *key, size_t *len)
+{
+    int index = json_scan_find(scan, object, key);
+    if (index < 0)
+    {
+        return NULL;
+    }
+
+    const json_scan_token_t *token = &scan->tokens[index];
+    if (token->type != JSON_SCAN_STRING && token->type != JSON_SCAN_PRIMITIVE)
+    {
+        return NULL;
+    }
+    *len = token->end - token->start;
+    return scan->json + token->start;
+}
+
+bool json_scan_get_u32(const json_scan_t *scan, int object, const char *key, uint32_t *value)
+{
+    size_t len = 0;
+    const char *raw = json_scan_get_raw(scan, object, key, &len);
+    uint64_t result = 0;
+
+    if (raw == NULL || len == 0 || len > 10)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++)
+    {
+        if (raw[i] < '0' || raw[i] > '9')
+        {
+            return false;
+        }
+        result = result * 10 + (raw[i] - '0');
+    }
+    if (result > UINT32_MAX)
+    {
+        return false;
+    }
+    *value = (uint32_t)result;
+    return true;
+}
+
+bool json_scan_get_bool(const json_scan_t *scan, int object, const char *key, bool *value)
+{
+    int index = json_scan_find(scan, object, key);
+    if (index < 0 || scan->tokens[index].type != JSON_SCAN_PRIMITIVE)
+    {
+        return false;
+    }
+
+    const char *raw = scan->json + scan->tokens[index].start;
+    if (raw[0] == 't')
+    {
+        *value = true;
+        return true;
+    }
+    if (raw[0] == 'f')
+    {
+        *value = false;
+        return true;
+    }
+    return false;
+}
+
+int json_scan_get_string(const json_scan_t *scan, int object, const char *key, char *dest, size_t dest_len)
+{
+    int index = json_scan_find(scan, object, key);
+    if (index < 0 || scan->tokens[index].type != JSON_SCAN_STRING || dest_len == 0)
+    {
+        return -1;
+    }
+
+    const char *src = scan->json + scan->tokens[index].start;
+    const char *src_end = scan->json + scan->tokens[index].end;
+    size_t out = 0;
+
+    while (src < src_end)
+    {
+        char decoded[3];
+        size_t decoded_len = 1;
+
+        if (*src != '\\')
+        {
+            decoded[0] = *src++;
+        }
+        else
+        {
+            src++;
+            switch (*src)
+            {
+            case 'b':
+                decoded[0] = '\b';
+                break;
+            case 'f':
+                decoded[0] = '\f';
+                break;
+            case 'n':
+                decoded[0] = '\n';
+                break;
+            case 'r':
+                decoded[0] = '\r';
+                break;
+            case 't':
+                decoded[0] = '\t';
+                break;
+            case 'u':
+            {
+                uint16_t cp = 0;
+                for (int i = 1; i <= 4; i++)
+                {
+                    char h = src[i];
+                    cp = (cp << 4) | (uint16_t)((h <= '9') ? h - '0' : (h | 0x20) - 'a' + 10);
+                }
+                src += 4;
+                if (cp < 0x80)
+                {
+                    decoded[0] = (char)cp;
+                }
+                else if (cp < 0x800)
+                {
+                    decoded[0] = (char)(0xC0 | (cp >> 6));
+                    decoded[1] = (char)(0x80 | (cp & 0x3F));
+                    decoded_len = 2;
+                }
+                else if (cp >= 0xD800 && cp <= 0xDFFF)
+                {
+                    // Surrogate pairs are not needed for card names
+                    decoded[0] = '?';
+                }
+                else
+                {
+                    decoded[0] = (char)(0xE0 | (cp >> 12));
+                    decoded[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+                    decoded[2] = (char)(0x80 | (cp & 0x3F));
+                    decoded_len = 3;
+                }
+                break;
+            }
+            default: // '"', '\\' and '/'
+                decoded[0] = *src;
+                break;
+            }
+            src++;
+        }
+
+        if (out + decoded_len >= dest_len)
+        {
+            return -1;
+        }
+        memcpy(dest + out, decoded, decoded_len);
+        out += decoded_len;
+    }
+
+    dest[out] = '\0';
+    return (int)out;
+}
@@ -0,0 +1,133 @@
+/**
+ * @file req_body.c
+ *
+ * Request body reader. httpd_req_recv returns whatever the socket currently
+ * holds, so a single call truncates bodies that are larger than the buffer or
+ * that arrive over several TCP segments. These helpers keep receiving until
+ * content_len bytes have been consumed.
+ */
+
+#include "esp_log.h"
+#include "req_body.h"
+
+#define REQ_BODY_MAX_TIMEOUTS (3u) // Consecutive recv timeouts before giving up
+
+static const char *TAG = "req_body";
+
+esp_err_t req_body_recv(httpd_req_t *req, char *buffer, size_t len, size_t *received)
+{
+    uint8_t timeouts = 0;
+
+    while (true)
+    {
+        int ret = httpd_req_recv(req, buffer, len);
+        if (ret > 0)
+        {
+            *received = (size_t)ret;
+            return ESP_OK;
+        }
+        if (ret == HTTPD_SOCK_ERR_TIMEOUT)
+        {
+            if (++timeouts < REQ_BODY_MAX_TIMEOUTS)
+            {
+                continue;
+            }
+            ESP_LOGW(TAG, "Client stalled, %u timeouts", (unsigned)timeouts);
+            return ESP_ERR_TIMEOUT;
+        }
+        // 0 means the peer closed the connection before sending the whole body
+        ESP_LOGE(TAG, "Receive failed: %d", ret);
+        return ESP_FAIL;
+    }
+}
+
+esp_err_t req_body_read(httpd_req_t *req, char *buffer, size_t buffer_len, size_t *body_len)
+{
+    size_t content_len = req->content_len;
+    size_t received = 0;
+
+    *body_len = 0;
+    if (content_len == 0)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (content_len >= buffer_len)
+    {
+        ESP_LOGW(TAG, "Body of %u bytes exceeds %u byte buffer", (unsigned)content_len, (unsigned)buffer_len);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    while (received < content_len)
+    {
+        size_t piece = 0;
+        esp_err_t error = req_body_recv(req, buffer + received, content_len - received, &piece);
+        if (error != ESP_OK)
+        {
+            return error;
+        }
+        received += piece;
+    }
+
+    buffer[received] = '\0';
+    *body_len = received;
+    return ESP_OK;
+}
+
+esp_err_t req_body_stream(httpd_req_t *req, char *chunk, size_t chunk_len,
+                          req_body_chunk_cb_t cb, void *ctx)
+{
+    size_t remaining = req->content_len;
+
+    if (remaining == 0)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    while (remaining > 0)
+    {
+        size_t piece = 0;
+        esp_err_t error = req_body_recv(req, chunk, remaining < chunk_len ? remaining : chunk_len, &piece);
+        if (error != ESP_OK)
+        {
+            return error;
+        }
+        remaining -= piece;
+
+        error = cb(chunk, piece, ctx);
+        if (error != ESP_OK)
+        {
+            return error;
+        }
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t req_body_send_error(httpd_req_t *req, esp_err_t error)
+{
+    httpd_resp_set_type(req, "application/json");
+
+    switch (error)
+    {
+    case ESP_ERR_INVALID_SIZE:
+        if (req->content_len == 0)
+        {
+            httpd_resp_set_status(req, "400 Bad Request");
+            httpd_resp_send(req, "{\"status\":\"error\",\"message\":\"Empty request body\"}", HTTPD_RESP_USE_STRLEN);
+        }
+        else
+        {
+            httpd_resp_set_status(req, "413 Content Too Large");
+            httpd_resp_send(req, "{\"status\":\"error\",\"message\":\"Request body too large\"}", HTTPD_RESP_USE_STRLEN);
+        }
+        break;
+    case ESP_ERR_TIMEOUT:
+        httpd_resp_send_408(req);
+        break;
+    default:
+        httpd_resp_send_500(req);
+        break;
+    }
+
+    return ESP_FAIL;
+}
@@ -0,0 +1,200 @@
+/**
+ * @file session_cache.c
+ *
+ * A fixed table scanned on every handshake, it holds a handful of entries.
+ * Freed and replaced entries are wiped, they contain master secrets.
+ */
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "session_cache.h"
+
+typedef struct
+{
+    uint8_t id[SESSION_CACHE_ID_LEN];
+    uint8_t id_len;
+    uint16_t len;
+    int64_t stored_us;
+    uint8_t data[SESSION_CACHE_DATA_LEN];
+    bool used;
+} session_cache_entry_t;
+
+static const char *TAG = "session_cache";
+
+static session_cache_config_t session_cache_config;
+static session_cache_entry_t session_cache_entries[SESSION_CACHE_MAX_ENTRIES];
+static session_cache_stats_t session_cache_stats;
+static SemaphoreHandle_t session_cache_mutex = NULL;
+
+bool session_cache_init(const session_cache_config_t *config)
+{
+    if (config->entries == 0 || config->entries > SESSION_CACHE_MAX_ENTRIES)
+    {
+        ESP_LOGE(TAG, "session_cache_init: %lu entries do not fit", (unsigned long)config->entries);
+        return false;
+    }
+    if (session_cache_mutex == NULL)
+    {
+        session_cache_mutex = xSemaphoreCreateMutex();
+    }
+    if (session_cache_mutex == NULL)
+    {
+        ESP_LOGE(TAG, "session_cache_init: Failed to create mutex");
+        return false;
+    }
+
+    xSemaphoreTake(session_cache_mutex, portMAX_DELAY);
+    session_cache_config = *config;
+    memset(session_cache_entries, 0, sizeof(session_cache_entries));
+    memset(&session_cache_stats, 0, sizeof(session_cache_stats));
+    xSemaphoreGive(session_cache_mutex);
+    return true;
+}
+
+/*
+ * Whether an entry's session may no longer be resumed
+ * @param entry used entry
+ * @param now_us current time in microseconds
+ * @return true once the lifetime has passed
+ */
+static bool session_cache_expired(const session_cache_entry_t *entry, int64_t now_us)
+{
+    return now_us - entry->stored_us >= (int64_t)session_cache_config.lifetime_s * 1000000;
+}
+
+/*
+ * Wipes an entry, the caller holds session_cache_mutex
+ * @param entry entry to free
+ */
+static void session_cache_free(session_cache_entry_t *entry)
+{
+    memset(entry, 0, sizeof(*entry));
+    session_cache_stats.entries--;
+}
+
+/*
+ * Looks a session up by ID, the caller holds session_cache_mutex
+ * @return the entry, NULL if there is none
+ */
+static session_cache_entry_t *session_cache_find(const uint8_t *id, size_t id_len)
+{
+    for (size_t i = 0; i < session_cache_config.entries; i++)
+    {
+        session_cache_entry_t *entry = &session_cache_entries[i];
+        if (entry->used && entry->id_len == id_len && memcmp(entry->id, id, id_len) == 0)
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+esp_err_t session_cache_store(const uint8_t *id, size_t id_len, const uint8_t *data, size_t len, int64_t now_us)
+{
+    if (session_cache_mutex == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (id_len == 0 || id_len > SESSION_CACHE_ID_LEN)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (len > SESSION_CACHE_DATA_LEN)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    xSemaphoreTake(session_cache_mutex, portMAX_DELAY);
+    session_cache_entry_t *slot = session_cache_find(id, id_len);
+    if (slot != NULL)
+    {
+        session_cache_free(slot);
+    }
+    else
+    {
+        // A free entry, else an expired one, else the one stored longest ago
+        for (size_t i = 0; i < session_cache_config.entries; i++)
+        {
+            session_cache_entry_t *entry = &session_cache_entries[i];
+            if (!entry->used)
+            {
+                slot = entry;
+                break;
+            }
+            if (slot == NULL || (!session_cache_expired(slot, now_us) &&
+                                 (session_cache_expired(entry, now_us) || entry->stored_us < slot->stored_us)))
+            {
+                slot = entry;
+            }
+        }
+        if (slot->used)
+        {
+            if (!session_cache_expired(slot, now_us))
+            {
+                session_cache_stats.evicted++;
+            }
+            session_cache_free(slot);
+        }
+    }
+
+    memcpy(slot->id, id, id_len);
+    slot->id_len = (uint8_t)id_len;
+    memcpy(slot->data, data, len);
+    slot->len = (uint16_t)len;
+    slot->stored_us = now_us;
+    slot->used = true;
+    session_cache_stats.entries++;
+    session_cache_stats.stored++;
+    xSemaphoreGive(session_cache_mutex);
+    return ESP_OK;
+}
+
+esp_err_t session_cache_lookup(const uint8_t *id, size_t id_len, uint8_t *data, size_t data_len, size_t *len,
+                               int64_t now_us)
+{
+    esp_err_t error = ESP_ERR_NOT_FOUND;
+
+    if (session_cache_mutex == NULL)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    xSemaphoreTake(session_cache_mutex, portMAX_DELAY);
+    session_cache_entry_t *entry = session_cache_find(id, id_len);
+    if (entry != NULL && session_cache_expired(entry, now_us))
+    {
+        session_cache_free(entry);
+        entry = NULL;
+    }
+    if (entry == NULL)
+    {
+        session_cache_stats.misses++;
+    }
+    else if (entry->len > data_len)
+    {
+        error = ESP_ERR_INVALID_SIZE;
+    }
+    else
+    {
+        memcpy(data, entry->data, entry->len);
+        *len = entry->len;
+        session_cache_stats.hits++;
+        error = ESP_OK;
+    }
+    xSemaphoreGive(session_cache_mutex);
+    return error;
+}
+
+void session_cache_get_stats(session_cache_stats_t *stats)
+{
+    if (session_cache_mutex == NULL)
+    {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    xSemaphoreTake(session_cache_mutex, portMAX_DELAY);
+    *stats = session_cache_stats;
+    xSemaphoreGive(session_cache_mutex);
+}
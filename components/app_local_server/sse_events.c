@@ -0,0 +1,321 @@
+/**
+ * @file sse_events.c
+ *
+ * Server-Sent Events fan-out. Publishers (the card check path) only copy the
+ * event into a bounded per-subscriber queue; the actual socket writes happen
+ * later on the HTTP server task through httpd_queue_work with non-blocking
+ * sends, so a slow browser can never stall the code that raised the event.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include "sse_events.h"
+
+#define SSE_EVENTS_MAX_SUBSCRIBERS (3u)                // Concurrent event streams
+#define SSE_EVENTS_QUEUE_LEN (8u)                      // Pending events per subscriber
+#define SSE_EVENTS_MAX_EVENT_LEN (128u)                // Formatted event incl. framing
+#define SSE_EVENTS_HEARTBEAT_PERIOD_US (15 * 1000 * 1000) // Keep idle streams alive
+
+typedef struct
+{
+    uint16_t len;
+    char data[SSE_EVENTS_MAX_EVENT_LEN];
+} sse_event_t;
+
+typedef struct
+{
+    bool in_use;
+    bool closing;
+    int sockfd;
+    uint32_t dropped;      // Events discarded because the client fell behind
+    QueueHandle_t queue;   // Events not yet handed to the socket
+    sse_event_t in_flight; // Event currently being written (may be partial)
+    uint16_t in_flight_sent;
+} sse_subscriber_t;
+
+static const char *TAG = "sse_events";
+
+static const char sse_stream_header[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: text/event-stream\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n"
+    "retry: 3000\n\n";
+
+static const char sse_heartbeat[] = ": ping\n\n";
+
+static sse_subscriber_t sse_subscribers[SSE_EVENTS_MAX_SUBSCRIBERS];
+static SemaphoreHandle_t sse_mutex = NULL; // Slot state against publishers, never held across a send
+static httpd_handle_t sse_server = NULL;
+static esp_timer_handle_t sse_heartbeat_timer = NULL;
+static atomic_bool sse_flush_pending = false;
+static atomic_bool sse_heartbeat_due = false;
+
+static void sse_events_schedule_flush(void);
+
+static void sse_events_release(sse_subscriber_t *sub)
+{
+    sub->in_use = false;
+    sub->closing = false;
+    sub->sockfd = -1;
+    sub->in_flight.len = 0;
+    sub->in_flight_sent = 0;
+    xQueueReset(sub->queue);
+}
+
+/*
+ * Session free hook, called by the HTTP server when an event stream socket closes
+ * @param ctx subscriber slot bound to the session
+ */
+static void sse_events_session_closed(void *ctx)
+{
+    sse_subscriber_t *sub = (sse_subscriber_t *)ctx;
+
+    xSemaphoreTake(sse_mutex, portMAX_DELAY);
+    ESP_LOGI(TAG, "Subscriber on socket %d closed, %lu events dropped", sub->sockfd, (unsigned long)sub->dropped);
+    sse_events_release(sub);
+    xSemaphoreGive(sse_mutex);
+}
+
+/*
+ * Writes as much of the subscriber backlog as the socket accepts without blocking
+ * @param sub subscriber to drain, on the HTTP server task (see sse_events_flush_work)
+ * @param heartbeat true to emit a keep-alive comment when nothing else is pending
+ * @return false if the socket failed and the session must be closed
+ */
+static bool sse_events_flush_subscriber(sse_subscriber_t *sub, bool heartbeat)
+{
+    while (true)
+    {
+        if (sub->in_flight_sent >= sub->in_flight.len)
+        {
+            if (xQueueReceive(sub->queue, &sub->in_flight, 0) != pdTRUE)
+            {
+                if (!heartbeat)
+                {
+                    return true;
+                }
+                sub->in_flight.len = sizeof(sse_heartbeat) - 1;
+                memcpy(sub->in_flight.data, sse_heartbeat, sub->in_flight.len);
+                heartbeat = false;
+            }
+            sub->in_flight_sent = 0;
+        }
+        heartbeat = false;
+
+        int ret = httpd_socket_send(sse_server, sub->sockfd,
+                                    sub->in_flight.data + sub->in_flight_sent,
+                                    sub->in_flight.len - sub->in_flight_sent,
+                                    MSG_DONTWAIT);
+        if (ret == HTTPD_SOCK_ERR_TIMEOUT)
+        {
+            // Socket buffer is full, the remainder goes out on the next flush
+            return true;
+        }
+        if (ret < 0)
+        {
+            return false;
+        }
+        sub->in_flight_sent += ret;
+    }
+}
+
+/*
+ * Work item executed on the HTTP server task, drains every subscriber queue
+ * @param arg unused
+ */
+static void sse_events_flush_work(void *arg)
+{
+    atomic_store(&sse_flush_pending, false);
+    bool heartbeat = atomic_exchange(&sse_heartbeat_due, false);
+
+    // Slots are only taken, released and closed on the server task, which runs
+    // this work too, so the sends need no lock and a publisher never waits for a socket.
+    // Publishers and this loop share the queues, which do their own locking.
+    for (size_t i = 0; i < SSE_EVENTS_MAX_SUBSCRIBERS; i++)
+    {
+        sse_subscriber_t *sub = &sse_subscribers[i];
+        if (!sub->in_use || sub->closing)
+        {
+            continue;
+        }
+        if (!sse_events_flush_subscriber(sub, heartbeat))
+        {
+            ESP_LOGW(TAG, "Send failed on socket %d, closing stream", sub->sockfd);
+            xSemaphoreTake(sse_mutex, portMAX_DELAY);
+            sub->closing = true;
+            xSemaphoreGive(sse_mutex);
+            httpd_sess_trigger_close(sse_server, sub->sockfd);
+        }
+    }
+}
+
+static void sse_events_schedule_flush(void)
+{
+    if (sse_server == NULL)
+    {
+        return;
+    }
+    // Coalesce bursts of events into a single work item
+    if (!atomic_exchange(&sse_flush_pending, true))
+    {
+        if (httpd_queue_work(sse_server, sse_events_flush_work, NULL) != ESP_OK)
+        {
+            atomic_store(&sse_flush_pending, false);
+        }
+    }
+}
+
+static void sse_events_heartbeat_cb(void *arg)
+{
+    atomic_store(&sse_heartbeat_due, true);
+    sse_events_schedule_flush();
+}
+
+bool sse_events_init(void)
+{
+    if (sse_mutex != NULL)
+    {
+        return true;
+    }
+
+    sse_mutex = xSemaphoreCreateMutex();
+    if (sse_mutex == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to create sse_mutex");
+        return false;
+    }
+
+    for (size_t i = 0; i < SSE_EVENTS_MAX_SUBSCRIBERS; i++)
+    {
+        sse_subscribers[i].queue = xQueueCreate(SSE_EVENTS_QUEUE_LEN, sizeof(sse_event_t));
+        if (sse_subscribers[i].queue == NULL)
+        {
+            ESP_LOGE(TAG, "Failed to create subscriber queue %u", (unsigned)i);
+            return false;
+        }
+        sse_events_release(&sse_subscribers[i]);
+    }
+
+    const esp_timer_create_args_t heartbeat_args = {
+        .callback = &sse_events_heartbeat_cb,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "sse_heartbeat"};
+    if (esp_timer_create(&heartbeat_args, &sse_heartbeat_timer) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to create heartbeat timer");
+        return false;
+    }
+
+    return true;
+}
+
+void sse_events_set_server(httpd_handle_t server)
+{
+    sse_server = server;
+    if (sse_heartbeat_timer != NULL && server != NULL)
+    {
+        esp_timer_start_periodic(sse_heartbeat_timer, SSE_EVENTS_HEARTBEAT_PERIOD_US);
+    }
+}
+
+esp_err_t sse_events_subscribe_handler(httpd_req_t *req)
+{
+    sse_subscriber_t *sub = NULL;
+
+    xSemaphoreTake(sse_mutex, portMAX_DELAY);
+    for (size_t i = 0; i < SSE_EVENTS_MAX_SUBSCRIBERS; i++)
+    {
+        if (!sse_subscribers[i].in_use)
+        {
+            sub = &sse_subscribers[i];
+            sse_events_release(sub);
+            sub->in_use = true;
+            sub->dropped = 0;
+            sub->sockfd = httpd_req_to_sockfd(req);
+            break;
+        }
+    }
+    xSemaphoreGive(sse_mutex);
+
+    if (sub == NULL)
+    {
+        ESP_LOGW(TAG, "Subscriber limit (%u) reached", SSE_EVENTS_MAX_SUBSCRIBERS);
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_set_hdr(req, "Retry-After", "10");
+        httpd_resp_send(req, "{\"status\":\"error\",\"message\":\"Too many event subscribers\"}", HTTPD_RESP_USE_STRLEN);
+        return ESP_OK;
+    }
+
+    // The stream never ends, so the headers are written raw instead of through
+    // httpd_resp_send which would add a Content-Length
+    if (httpd_send(req, sse_stream_header, sizeof(sse_stream_header) - 1) < 0)
+    {
+        xSemaphoreTake(sse_mutex, portMAX_DELAY);
+        sse_events_release(sub);
+        xSemaphoreGive(sse_mutex);
+        return ESP_FAIL;
+    }
+
+    // Bind the slot to the socket so it is released when the client goes away
+    req->sess_ctx = sub;
+    req->free_ctx = sse_events_session_closed;
+
+    ESP_LOGI(TAG, "Subscriber added on socket %d", sub->sockfd);
+    return ESP_OK;
+}
+
+void sse_events_publish(const char *event, const char *data)
+{
+    sse_event_t ev;
+    bool has_subscribers = false;
+
+    if (sse_mutex == NULL || event == NULL || data == NULL)
+    {
+        return;
+    }
+
+    int len = snprintf(ev.data, sizeof(ev.data), "event: %s\ndata: %s\n\n", event, data);
+    if (len <= 0 || len >= (int)sizeof(ev.data))
+    {
+        ESP_LOGW(TAG, "Event '%s' too long, not published", event);
+        return;
+    }
+    ev.len = (uint16_t)len;
+
+    xSemaphoreTake(sse_mutex, portMAX_DELAY);
+    for (size_t i = 0; i < SSE_EVENTS_MAX_SUBSCRIBERS; i++)
+    {
+        sse_subscriber_t *sub = &sse_subscribers[i];
+        if (!sub->in_use || sub->closing)
+        {
+            continue;
+        }
+        has_subscribers = true;
+
+        if (xQueueSend(sub->queue, &ev, 0) != pdTRUE)
+        {
+            // Client is behind: drop its oldest pending event to make room
+            sse_event_t oldest;
+            xQueueReceive(sub->queue, &oldest, 0);
+            xQueueSend(sub->queue, &ev, 0);
+            sub->dropped++;
+        }
+    }
+    xSemaphoreGive(sse_mutex);
+
+    if (has_subscribers)
+    {
+        sse_events_schedule_flush();
+    }
+}
@@ -0,0 +1,188 @@
+#include "unity.h"
+#include "esp_rom_crc.h"
+#include "asset_pack.h"
+#include <string.h>
+
+static uint8_t test_image[512];
+
+static void test_put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+static void test_put_u32(uint8_t *p, uint32_t v)
+{
+    test_put_u16(p, v & 0xFFFF);
+    test_put_u16(p + 2, v >> 16);
+}
+
+/*
+ * Builds a pack of two files into test_image, the way tools/mkassets.py does
+ * @return pack length
+ */
+static size_t test_pack(void)
+{
+    static const char css[] = "body{margin:0}";
+    static const uint8_t gz[] = {0x1F, 0x8B, 0x08, 0x00, 0x01, 0x02};
+    size_t len = ASSET_PACK_HEADER_LEN + 2 * ASSET_PACK_ENTRY_LEN;
+    uint8_t *entry = test_image + ASSET_PACK_HEADER_LEN;
+
+    memset(test_image, 0xFF, sizeof(test_image)); // Erased flash after the pack
+    memset(test_image, 0, len);
+
+    strcpy((char *)entry, "/app.css");
+    strcpy((char *)entry + ASSET_PACK_PATH_LEN, "text/css");
+    test_put_u32(entry + 64, len);
+    test_put_u32(entry + 68, sizeof(css) - 1);
+    test_put_u32(entry + 72, esp_rom_crc32_le(0, (const uint8_t *)css, sizeof(css) - 1));
+    memcpy(test_image + len, css, sizeof(css) - 1);
+    len += sizeof(css) - 1;
+
+    entry += ASSET_PACK_ENTRY_LEN;
+    strcpy((char *)entry, "/app.js");
+    strcpy((char *)entry + ASSET_PACK_PATH_LEN, "application/javascript");
+    test_put_u32(entry + 64, len);
+    test_put_u32(entry + 68, sizeof(gz));
+    test_put_u32(entry + 72, esp_rom_crc32_le(0, gz, sizeof(gz)));
+    test_put_u16(entry + 76, ASSET_PACK_FLAG_GZIP);
+    memcpy(test_image + len, gz, sizeof(gz));
+    len += sizeof(gz);
+
+    memcpy(test_image, "WPAK", 4);
+    test_put_u16(test_image + 4, 1);
+    test_put_u16(test_image + 6, 2);
+    test_put_u32(test_image + 8, len);
+    test_put_u32(test_image + 12, esp_rom_crc32_le(0, test_image + ASSET_PACK_HEADER_LEN, len - ASSET_PACK_HEADER_LEN));
+    return len;
+}
+
+/*
+ * Rewrites the header CRC after a deliberate change to the image
+ */
+static void test_reseal(size_t len)
+{
+    test_put_u32(test_image + 12, esp_rom_crc32_le(0, test_image + ASSET_PACK_HEADER_LEN, len - ASSET_PACK_HEADER_LEN));
+}
+
+TEST_CASE("Asset Pack: Files are found in place", "[asset_pack]")
+{
+    asset_pack_t pack;
+    asset_pack_file_t file;
+    size_t len = test_pack();
+
+    TEST_ASSERT_EQUAL(ESP_OK, asset_pack_open(&pack, test_image, sizeof(test_image)));
+    TEST_ASSERT_EQUAL(len, pack.len);
+    TEST_ASSERT_EQUAL(2, pack.count);
+
+    TEST_ASSERT_TRUE(asset_pack_find(&pack, "/app.css", &file));
+    TEST_ASSERT_EQUAL_STRING("text/css", file.content_type);
+    TEST_ASSERT_EQUAL(14, file.len);
+    TEST_ASSERT_EQUAL_MEMORY("body{margin:0}", file.data, file.len);
+    TEST_ASSERT_EQUAL_UINT32(esp_rom_crc32_le(0, file.data, file.len), file.crc);
+    TEST_ASSERT_EQUAL(0, file.flags);
+
+    // Data points into the image, nothing is copied
+    TEST_ASSERT_TRUE(asset_pack_find(&pack, "/app.js", &file));
+    TEST_ASSERT_TRUE(file.data > test_image && file.data < test_image + len);
+    TEST_ASSERT_EQUAL(ASSET_PACK_FLAG_GZIP, file.flags);
+
+    TEST_ASSERT_FALSE(asset_pack_find(&pack, "/app", &file));
+    TEST_ASSERT_FALSE(asset_pack_find(&pack, "/index.html", &file));
+}
+
+TEST_CASE("Asset Pack: Damaged images are refused", "[asset_pack]")
+{
+    asset_pack_t pack;
+    size_t len = test_pack();
+
+    // Erased partition
+    memset(test_image, 0xFF, ASSET_PACK_HEADER_LEN);
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, asset_pack_open(&pack, test_image, sizeof(test_image)));
+
+    test_pack();
+    test_image[4] = 2;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_VERSION, asset_pack_open(&pack, test_image, sizeof(test_image)));
+
+    // Longer than the partition
+    test_pack();
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, asset_pack_open(&pack, test_image, len - 1));
+
+    // A flipped data bit
+    test_pack();
+    test_image[len - 1] ^= 0x01;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_CRC, asset_pack_open(&pack, test_image, sizeof(test_image)));
+
+    // Entries must stay inside the pack even with a valid CRC
+    test_pack();
+    test_put_u32(test_image + ASSET_PACK_HEADER_LEN + 68, len);
+    test_reseal(len);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, asset_pack_open(&pack, test_image, sizeof(test_image)));
+
+    // And so must their strings
+    test_pack();
+    memset(test_image + ASSET_PACK_HEADER_LEN, 'a', ASSET_PACK_PATH_LEN);
+    test_reseal(len);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, asset_pack_open(&pack, test_image, sizeof(test_image)));
+}
+
+// gzip -9 of "body{margin:0} body{margin:0}", as mkassets.py writes it
+static const uint8_t test_gz[] = {0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x4B, 0xCA, 0x4F,
+                                  0xA9, 0xAC, 0xCE, 0x4D, 0x2C, 0x4A, 0xCF, 0xCC, 0xB3, 0x32, 0xA8, 0x55, 0x48,
+                                  0x42, 0xE1, 0x02, 0x00, 0xCE, 0x2F, 0x12, 0x6A, 0x1D, 0x00, 0x00, 0x00};
+
+static char test_content[64];
+static size_t test_content_len;
+
+/*
+ * Collects decompressed content into test_content
+ */
+static esp_err_t test_sink(void *ctx, const uint8_t *data, size_t len)
+{
+    TEST_ASSERT_EQUAL_PTR(test_content, ctx);
+    TEST_ASSERT_LESS_OR_EQUAL(sizeof(test_content) - test_content_len, len);
+    memcpy(test_content + test_content_len, data, len);
+    test_content_len += len;
+    return ESP_OK;
+}
+
+TEST_CASE("Asset Pack: Gzip files are decompressed", "[asset_pack]")
+{
+    static const char content[] = "body{margin:0} body{margin:0}";
+    uint8_t named[sizeof(test_gz) + 8];
+    asset_pack_gzip_t gzip;
+
+    TEST_ASSERT_EQUAL(ESP_OK, asset_pack_gzip_parse(test_gz, sizeof(test_gz), &gzip));
+    TEST_ASSERT_EQUAL_PTR(test_gz + 10, gzip.deflate);
+    TEST_ASSERT_EQUAL(sizeof(test_gz) - 18, gzip.deflate_len);
+    TEST_ASSERT_EQUAL(sizeof(content) - 1, gzip.len);
+    TEST_ASSERT_EQUAL_UINT32(esp_rom_crc32_le(0, (const uint8_t *)content, sizeof(content) - 1), gzip.crc);
+
+    test_content_len = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, asset_pack_inflate(&gzip, test_sink, test_content));
+    TEST_ASSERT_EQUAL(sizeof(content) - 1, test_content_len);
+    TEST_ASSERT_EQUAL_MEMORY(content, test_content, test_content_len);
+
+    // gzip(1) stores the file name
+    memcpy(named, test_gz, 10);
+    named[3] = 0x08;
+    memcpy(named + 10, "app.css", 8);
+    memcpy(named + 18, test_gz + 10, sizeof(test_gz) - 10);
+    TEST_ASSERT_EQUAL(ESP_OK, asset_pack_gzip_parse(named, sizeof(named), &gzip));
+    TEST_ASSERT_EQUAL_PTR(named + 18, gzip.deflate);
+
+    // A name running into the trailer, another method, too short
+    memset(named + 10, 'a', sizeof(named) - 10);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, asset_pack_gzip_parse(named, sizeof(named), &gzip));
+    memcpy(named, test_gz, sizeof(test_gz));
+    named[2] = 0;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, asset_pack_gzip_parse(named, sizeof(test_gz), &gzip));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, asset_pack_gzip_parse(test_gz, 18, &gzip));
+
+    // Content that does not match the trailer
+    memcpy(named, test_gz, sizeof(test_gz));
+    named[sizeof(test_gz) - 8] ^= 0x01;
+    TEST_ASSERT_EQUAL(ESP_OK, asset_pack_gzip_parse(named, sizeof(test_gz), &gzip));
+    test_content_len = 0;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_CRC, asset_pack_inflate(&gzip, test_sink, test_content));
+}
@@ -0,0 +1,80 @@
+#include "unity.h"
+#include "captive_probe.h"
+#include <string.h>
+
+TEST_CASE("Captive Probe: Join to portal timing", "[captive_probe]")
+{
+    const uint8_t mac[CAPTIVE_PROBE_MAC_LEN] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x02};
+    const uint32_t client = 0x0204A8C0; // 192.168.4.2
+
+    TEST_ASSERT_TRUE(captive_probe_init());
+
+    // Unknown clients are not timed
+    TEST_ASSERT_EQUAL(-1, captive_probe_client_reached(0x0304A8C0, CAPTIVE_PROBE_STAGE_PROBE, 1000));
+
+    captive_probe_client_joined(client, mac, 1000000);
+    TEST_ASSERT_EQUAL(250000, captive_probe_client_reached(client, CAPTIVE_PROBE_STAGE_PROBE, 1250000));
+    TEST_ASSERT_EQUAL(-1, captive_probe_client_reached(client, CAPTIVE_PROBE_STAGE_PROBE, 1300000));
+    TEST_ASSERT_EQUAL(900000, captive_probe_client_reached(client, CAPTIVE_PROBE_STAGE_PORTAL, 1900000));
+
+    // Joining again starts over
+    captive_probe_client_joined(client, mac, 5000000);
+    TEST_ASSERT_EQUAL(100, captive_probe_client_reached(client, CAPTIVE_PROBE_STAGE_PROBE, 5000100));
+}
+
+TEST_CASE("Captive Probe: Authorization survives a rejoin", "[captive_probe]")
+{
+    const uint8_t mac[CAPTIVE_PROBE_MAC_LEN] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x05};
+    const uint32_t client = 0x0504A8C0;
+
+    TEST_ASSERT_TRUE(captive_probe_init());
+    captive_probe_client_joined(client, mac, 1000);
+    TEST_ASSERT_FALSE(captive_probe_is_authorized(client));
+
+    captive_probe_authorize(client);
+    TEST_ASSERT_TRUE(captive_probe_is_authorized(client));
+    captive_probe_client_joined(client, mac, 2000);
+    TEST_ASSERT_TRUE(captive_probe_is_authorized(client));
+
+    // A new lease for the same device keeps the authorization
+    captive_probe_client_joined(client + 0x01000000, mac, 2500);
+    TEST_ASSERT_TRUE(captive_probe_is_authorized(client + 0x01000000));
+    TEST_ASSERT_FALSE(captive_probe_is_authorized(client));
+
+    // Enough new clients push the oldest entries out
+    for (uint32_t i = 0; i < 32; i++)
+    {
+        const uint8_t other[CAPTIVE_PROBE_MAC_LEN] = {0x02, 0x00, 0x00, 0x01, 0x00, (uint8_t)i};
+        captive_probe_client_joined(0x0A000000 + i, other, 3000);
+    }
+    TEST_ASSERT_FALSE(captive_probe_is_authorized(client + 0x01000000));
+}
+
+TEST_CASE("Captive Probe: A reused lease is not authorized", "[captive_probe]")
+{
+    const uint8_t mac[CAPTIVE_PROBE_MAC_LEN] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x07};
+    const uint8_t other[CAPTIVE_PROBE_MAC_LEN] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x08};
+    const uint32_t client = 0x0704A8C0;
+
+    TEST_ASSERT_TRUE(captive_probe_init());
+    captive_probe_client_joined(client, mac, 1000);
+    captive_probe_authorize(client);
+    TEST_ASSERT_TRUE(captive_probe_is_authorized(client));
+
+    // Another device is given the address after the first one left
+    captive_probe_client_joined(client, other, 2000);
+    TEST_ASSERT_FALSE(captive_probe_is_authorized(client));
+    TEST_ASSERT_EQUAL(100, captive_probe_client_reached(client, CAPTIVE_PROBE_STAGE_PROBE, 2100));
+}
+
+TEST_CASE("Captive Probe: Probe table", "[captive_probe]")
+{
+    for (size_t i = 0; i < CAPTIVE_PROBE_COUNT; i++)
+    {
+        TEST_ASSERT_EQUAL('/', captive_probes[i].path[0]);
+        TEST_ASSERT_LESS_THAN(CAPTIVE_PROBE_OS_COUNT, captive_probes[i].os);
+        TEST_ASSERT_NOT_NULL(captive_probes[i].body);
+        // Only the 204 answers go without a body
+        TEST_ASSERT_EQUAL(captive_probes[i].content_type == NULL, strncmp(captive_probes[i].status, "204", 3) == 0);
+    }
+}
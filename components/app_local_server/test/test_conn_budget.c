@@ -0,0 +1,113 @@
+#include "unity.h"
+#include "conn_budget.h"
+
+#define TEST_CLIENT_A (0x0204A8C0u) // 192.168.4.2
+#define TEST_CLIENT_B (0x0304A8C0u)
+#define TEST_ADMIN (0x0404A8C0u)
+
+static const conn_budget_config_t test_config = {
+    .limit = 4,
+    .admin_reserved = 1,
+    .per_client = 2,
+    .admin_hold_us = 1000000};
+
+TEST_CASE("Connection Budget: Idle connections make room, busy ones are kept", "[conn_budget]")
+{
+    conn_budget_stats_t stats;
+    int victim = 0;
+
+    TEST_ASSERT_TRUE(conn_budget_init(&test_config));
+
+    // Three captive connections fill everything but the reserved one
+    TEST_ASSERT_EQUAL(CONN_BUDGET_ADMIT, conn_budget_admit(10, TEST_CLIENT_A, 100, &victim));
+    TEST_ASSERT_EQUAL(-1, victim);
+    TEST_ASSERT_EQUAL(CONN_BUDGET_ADMIT, conn_budget_admit(11, TEST_CLIENT_A, 200, &victim));
+    TEST_ASSERT_EQUAL(CONN_BUDGET_ADMIT, conn_budget_admit(12, TEST_CLIENT_B, 300, &victim));
+
+    // A fourth takes the place of the least recently used idle one
+    conn_budget_request_begin(10, 400);
+    conn_budget_request_end(10, 500);
+    TEST_ASSERT_EQUAL(CONN_BUDGET_ADMIT_EVICT, conn_budget_admit(13, 0x0504A8C0, 600, &victim));
+    TEST_ASSERT_EQUAL(11, victim);
+    conn_budget_closed(11);
+
+    // With a request on every connection nothing is closed
+    conn_budget_request_begin(10, 700);
+    conn_budget_request_begin(12, 700);
+    conn_budget_request_begin(13, 700);
+    TEST_ASSERT_EQUAL(CONN_BUDGET_REJECT_POOL, conn_budget_admit(14, 0x0604A8C0, 800, &victim));
+    TEST_ASSERT_EQUAL(-1, victim);
+
+    conn_budget_get_stats(&stats);
+    TEST_ASSERT_EQUAL(3, stats.open[CONN_BUDGET_PORTAL]);
+    TEST_ASSERT_EQUAL(4, stats.admitted[CONN_BUDGET_PORTAL]);
+    TEST_ASSERT_EQUAL(1, stats.evicted[CONN_BUDGET_REASON_POOL]);
+    TEST_ASSERT_EQUAL(1, stats.rejected[CONN_BUDGET_REASON_POOL]);
+    TEST_ASSERT_EQUAL(3, stats.peak);
+}
+
+TEST_CASE("Connection Budget: Per client limit", "[conn_budget]")
+{
+    conn_budget_stats_t stats;
+    int victim = 0;
+
+    TEST_ASSERT_TRUE(conn_budget_init(&test_config));
+    TEST_ASSERT_EQUAL(CONN_BUDGET_ADMIT, conn_budget_admit(20, TEST_CLIENT_A, 100, &victim));
+    TEST_ASSERT_EQUAL(CONN_BUDGET_ADMIT, conn_budget_admit(21, TEST_CLIENT_A, 200, &victim));
+    TEST_ASSERT_EQUAL(CONN_BUDGET_ADMIT, conn_budget_admit(22, TEST_CLIENT_B, 300, &victim));
+
+    // The client's third connection replaces its own idle one, not client B's older one
+    conn_budget_request_begin(20, 400);
+    TEST_ASSERT_EQUAL(CONN_BUDGET_ADMIT_EVICT, conn_budget_admit(23, TEST_CLIENT_A, 500, &victim));
+    TEST_ASSERT_EQUAL(21, victim);
+    conn_budget_closed(21);
+
+    conn_budget_request_begin(23, 600);
+    TEST_ASSERT_EQUAL(CONN_BUDGET_REJECT_CLIENT, conn_budget_admit(24, TEST_CLIENT_A, 700, &victim));
+
+    conn_budget_get_stats(&stats);
+    TEST_ASSERT_EQUAL(1, stats.evicted[CONN_BUDGET_REASON_CLIENT]);
+    TEST_ASSERT_EQUAL(1, stats.rejected[CONN_BUDGET_REASON_CLIENT]);
+    TEST_ASSERT_EQUAL(0, stats.rejected[CONN_BUDGET_REASON_POOL]);
+}
+
+TEST_CASE("Connection Budget: Captive clients cannot take the administration session", "[conn_budget]")
+{
+    conn_budget_stats_t stats;
+    int victim = 0;
+
+    TEST_ASSERT_TRUE(conn_budget_init(&test_config));
+
+    // The administrator's connection joins the session with its first admin request
+    TEST_ASSERT_EQUAL(CONN_BUDGET_ADMIT, conn_budget_admit(30, TEST_ADMIN, 100, &victim));
+    conn_budget_mark_admin(30, TEST_ADMIN, 150);
+    for (int fd = 31; fd < 34; fd++)
+    {
+        TEST_ASSERT_EQUAL(CONN_BUDGET_ADMIT, conn_budget_admit(fd, 0x0A000000 + fd, 200 + fd, &victim));
+    }
+
+    // A captive burst only cycles through the captive connections, the idle admin one stays
+    for (int fd = 34; fd < 40; fd++)
+    {
+        TEST_ASSERT_EQUAL(CONN_BUDGET_ADMIT_EVICT, conn_budget_admit(fd, 0x0A000000 + fd, 300 + fd, &victim));
+        TEST_ASSERT_NOT_EQUAL(30, victim);
+        conn_budget_closed(victim);
+    }
+
+    // A new connection of the administrator uses the reserve while captive ones are busy
+    conn_budget_closed(30);
+    for (int fd = 37; fd < 40; fd++)
+    {
+        conn_budget_request_begin(fd, 400);
+    }
+    TEST_ASSERT_EQUAL(CONN_BUDGET_REJECT_POOL, conn_budget_admit(40, 0x0B000001, 500, &victim));
+    TEST_ASSERT_EQUAL(CONN_BUDGET_ADMIT, conn_budget_admit(41, TEST_ADMIN, 600, &victim));
+
+    conn_budget_get_stats(&stats);
+    TEST_ASSERT_EQUAL(1, stats.open[CONN_BUDGET_ADMIN]);
+    TEST_ASSERT_EQUAL(1, stats.admitted[CONN_BUDGET_ADMIN]);
+
+    // Once the session expired the administrator is a captive client again
+    conn_budget_closed(41);
+    TEST_ASSERT_EQUAL(CONN_BUDGET_REJECT_POOL, conn_budget_admit(42, TEST_ADMIN, 2000000, &victim));
+}
@@ -0,0 +1,48 @@
+#include "unity.h"
+#include "esp_log.h"
+#include "data_keys.h"
+#include <stdio.h>
+#include <string.h>
+
+static int test_data_keys_write_counter(char *buffer, size_t len, void *ctx)
+{
+    int *counter = (int *)ctx;
+    return snprintf(buffer, len, "%d", ++(*counter));
+}
+
+TEST_CASE("Data Keys: Static and dynamic keys", "[data_keys]")
+{
+    static int counter = 0;
+    char buffer[64];
+
+    TEST_ASSERT_TRUE(data_keys_register_static("TestStatic", "V1"));
+    TEST_ASSERT_TRUE(data_keys_register("TestCounter", test_data_keys_write_counter, &counter));
+    TEST_ASSERT_FALSE(data_keys_register_static("TestStatic", "V2"));
+
+    TEST_ASSERT_EQUAL(strlen("\"TestStatic\":\"V1\""), data_keys_write("TestStatic", 10, buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_STRING("\"TestStatic\":\"V1\"", buffer);
+
+    TEST_ASSERT_GREATER_THAN(0, data_keys_write("TestCounter", 11, buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_STRING("\"TestCounter\":\"1\"", buffer);
+}
+
+TEST_CASE("Data Keys: Exact match only", "[data_keys]")
+{
+    char buffer[64];
+
+    data_keys_register_static("TestExact", "yes");
+
+    // A longer key that merely contains a registered name must not match it
+    TEST_ASSERT_GREATER_THAN(0, data_keys_write("TestExactx", 10, buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_STRING("\"TestExactx\":\"\"", buffer);
+
+    // Counted keys do not need to be NUL terminated
+    TEST_ASSERT_GREATER_THAN(0, data_keys_write("TestExact,Other", 9, buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_STRING("\"TestExact\":\"yes\"", buffer);
+
+    // Unknown keys that would break the JSON are dropped
+    TEST_ASSERT_EQUAL(0, data_keys_write("bad\"key", 7, buffer, sizeof(buffer)));
+
+    // Fragments that do not fit are reported
+    TEST_ASSERT_EQUAL(-1, data_keys_write("TestExact", 9, buffer, 8));
+}
@@ -0,0 +1,54 @@
+#include "unity.h"
+#include "http_range.h"
+
+TEST_CASE("HTTP Range: Ranges are clipped to the body", "[http_range]")
+{
+    http_range_t range;
+
+    TEST_ASSERT_EQUAL(HTTP_RANGE_PARTIAL, http_range_parse("bytes=0-99", 1000, &range));
+    TEST_ASSERT_EQUAL(0, range.start);
+    TEST_ASSERT_EQUAL(99, range.end);
+
+    // Open end, resuming an interrupted download
+    TEST_ASSERT_EQUAL(HTTP_RANGE_PARTIAL, http_range_parse("bytes=600-", 1000, &range));
+    TEST_ASSERT_EQUAL(600, range.start);
+    TEST_ASSERT_EQUAL(999, range.end);
+
+    // Past the end and overflowing positions are clipped
+    TEST_ASSERT_EQUAL(HTTP_RANGE_PARTIAL, http_range_parse("bytes=990-5000", 1000, &range));
+    TEST_ASSERT_EQUAL(999, range.end);
+    TEST_ASSERT_EQUAL(HTTP_RANGE_PARTIAL, http_range_parse("bytes=1-99999999999999999999999", 1000, &range));
+    TEST_ASSERT_EQUAL(999, range.end);
+
+    // Suffix
+    TEST_ASSERT_EQUAL(HTTP_RANGE_PARTIAL, http_range_parse("bytes=-100", 1000, &range));
+    TEST_ASSERT_EQUAL(900, range.start);
+    TEST_ASSERT_EQUAL(999, range.end);
+    TEST_ASSERT_EQUAL(HTTP_RANGE_PARTIAL, http_range_parse("bytes=-5000", 1000, &range));
+    TEST_ASSERT_EQUAL(0, range.start);
+
+    // Case and spaces
+    TEST_ASSERT_EQUAL(HTTP_RANGE_PARTIAL, http_range_parse(" Bytes = 10-19 ", 1000, &range));
+    TEST_ASSERT_EQUAL(10, range.start);
+    TEST_ASSERT_EQUAL(19, range.end);
+}
+
+TEST_CASE("HTTP Range: Unsatisfiable and ignored ranges", "[http_range]")
+{
+    http_range_t range;
+
+    TEST_ASSERT_EQUAL(HTTP_RANGE_UNSATISFIABLE, http_range_parse("bytes=1000-", 1000, &range));
+    TEST_ASSERT_EQUAL(HTTP_RANGE_UNSATISFIABLE, http_range_parse("bytes=99999999999999999999999-", 1000, &range));
+    TEST_ASSERT_EQUAL(HTTP_RANGE_UNSATISFIABLE, http_range_parse("bytes=-0", 1000, &range));
+    TEST_ASSERT_EQUAL(HTTP_RANGE_UNSATISFIABLE, http_range_parse("bytes=0-", 0, &range));
+
+    // Malformed, other units and several ranges get the whole body
+    TEST_ASSERT_EQUAL(HTTP_RANGE_NONE, http_range_parse("bytes=20-10", 1000, &range));
+    TEST_ASSERT_EQUAL(HTTP_RANGE_NONE, http_range_parse("bytes=a-10", 1000, &range));
+    TEST_ASSERT_EQUAL(HTTP_RANGE_NONE, http_range_parse("bytes=-", 1000, &range));
+    TEST_ASSERT_EQUAL(HTTP_RANGE_NONE, http_range_parse("bytes=10", 1000, &range));
+    TEST_ASSERT_EQUAL(HTTP_RANGE_NONE, http_range_parse("bytes 0-10", 1000, &range));
+    TEST_ASSERT_EQUAL(HTTP_RANGE_NONE, http_range_parse("items=0-10", 1000, &range));
+    TEST_ASSERT_EQUAL(HTTP_RANGE_NONE, http_range_parse("bytes=0-10,20-30", 1000, &range));
+    TEST_ASSERT_EQUAL(HTTP_RANGE_NONE, http_range_parse("", 1000, &range));
+}
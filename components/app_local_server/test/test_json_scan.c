@@ -0,0 +1,67 @@
+#include "unity.h"
+#include "json_scan.h"
+#include <string.h>
+
+#define TEST_JSON_SCAN_TOKENS (16)
+
+TEST_CASE("JSON Scan: Typed fields", "[json_scan]")
+{
+    const char *body = "{\"id\":4294967295,\"nm\":\"Jane \\\"J\\\" Doe\",\"card_id\":\"305419896\",\"active\":true}";
+    json_scan_token_t tokens[TEST_JSON_SCAN_TOKENS];
+    json_scan_t scan;
+
+    TEST_ASSERT_EQUAL(9, json_scan_parse(&scan, body, strlen(body), tokens, TEST_JSON_SCAN_TOKENS));
+
+    uint32_t id = 0;
+    TEST_ASSERT_TRUE(json_scan_get_u32(&scan, 0, "id", &id));
+    TEST_ASSERT_EQUAL_UINT32(4294967295u, id);
+
+    // Numeric strings are accepted as well
+    TEST_ASSERT_TRUE(json_scan_get_u32(&scan, 0, "card_id", &id));
+    TEST_ASSERT_EQUAL_UINT32(0x12345678, id);
+
+    char name[32];
+    TEST_ASSERT_EQUAL(12, json_scan_get_string(&scan, 0, "nm", name, sizeof(name)));
+    TEST_ASSERT_EQUAL_STRING("Jane \"J\" Doe", name);
+    TEST_ASSERT_EQUAL(-1, json_scan_get_string(&scan, 0, "nm", name, 8));
+
+    bool active = false;
+    TEST_ASSERT_TRUE(json_scan_get_bool(&scan, 0, "active", &active));
+    TEST_ASSERT_TRUE(active);
+
+    TEST_ASSERT_FALSE(json_scan_get_u32(&scan, 0, "nm", &id));
+    TEST_ASSERT_EQUAL(-1, json_scan_find(&scan, 0, "missing"));
+}
+
+TEST_CASE("JSON Scan: Nested values are skipped", "[json_scan]")
+{
+    const char *body = "{\"a\":{\"key\":1,\"b\":[1,2,{\"key\":2}]},\"key\":\"SSID,Temp\"}";
+    json_scan_token_t tokens[TEST_JSON_SCAN_TOKENS];
+    json_scan_t scan;
+
+    TEST_ASSERT_GREATER_THAN(0, json_scan_parse(&scan, body, strlen(body), tokens, TEST_JSON_SCAN_TOKENS));
+
+    size_t len = 0;
+    const char *raw = json_scan_get_raw(&scan, 0, "key", &len);
+    TEST_ASSERT_NOT_NULL(raw);
+    TEST_ASSERT_EQUAL(9, len);
+    TEST_ASSERT_EQUAL_STRING_LEN("SSID,Temp", raw, len);
+}
+
+TEST_CASE("JSON Scan: Malformed input", "[json_scan]")
+{
+    json_scan_token_t tokens[4];
+    json_scan_t scan;
+
+    TEST_ASSERT_EQUAL(JSON_SCAN_ERR_PARTIAL, json_scan_parse(&scan, "{\"id\":12", 8, tokens, 4));
+    TEST_ASSERT_EQUAL(JSON_SCAN_ERR_INVALID, json_scan_parse(&scan, "{\"id\" 12}", 9, tokens, 4));
+    TEST_ASSERT_EQUAL(JSON_SCAN_ERR_INVALID, json_scan_parse(&scan, "{\"id\":12,}", 10, tokens, 4));
+    TEST_ASSERT_EQUAL(JSON_SCAN_ERR_INVALID, json_scan_parse(&scan, "{\"id\":1} x", 10, tokens, 4));
+    TEST_ASSERT_EQUAL(JSON_SCAN_ERR_NOMEM, json_scan_parse(&scan, "{\"a\":1,\"b\":2}", 13, tokens, 4));
+
+    // A sign without digits is no number, a NUL inside a number is no character of one
+    TEST_ASSERT_EQUAL(JSON_SCAN_ERR_INVALID, json_scan_parse(&scan, "{\"id\":-}", 8, tokens, 4));
+    TEST_ASSERT_EQUAL(JSON_SCAN_ERR_INVALID, json_scan_parse(&scan, "[-, 1]", 6, tokens, 4));
+    TEST_ASSERT_EQUAL(JSON_SCAN_ERR_INVALID, json_scan_parse(&scan, "[1\0 2]", 6, tokens, 4));
+    TEST_ASSERT_EQUAL(JSON_SCAN_ERR_INVALID, json_scan_parse(&scan, "{\"id\":1\0}", 9, tokens, 4));
+}
@@ -0,0 +1,115 @@
+#include "unity.h"
+#include "session_cache.h"
+#include <string.h>
+
+#define TEST_S (1000000LL) // One second in microseconds
+
+static const session_cache_config_t test_config = {
+    .entries = 2,
+    .lifetime_s = 60};
+
+/*
+ * Stores a session whose ID and data are the given byte repeated
+ */
+static esp_err_t test_store(uint8_t tag, int64_t now_us)
+{
+    uint8_t id[SESSION_CACHE_ID_LEN];
+    uint8_t data[100];
+
+    memset(id, tag, sizeof(id));
+    memset(data, tag, sizeof(data));
+    return session_cache_store(id, sizeof(id), data, sizeof(data), now_us);
+}
+
+/*
+ * Looks up the session stored by test_store and checks its data
+ */
+static esp_err_t test_lookup(uint8_t tag, int64_t now_us)
+{
+    uint8_t id[SESSION_CACHE_ID_LEN];
+    uint8_t data[SESSION_CACHE_DATA_LEN];
+    size_t len = 0;
+
+    memset(id, tag, sizeof(id));
+    esp_err_t error = session_cache_lookup(id, sizeof(id), data, sizeof(data), &len, now_us);
+    if (error == ESP_OK)
+    {
+        TEST_ASSERT_EQUAL(100, len);
+        TEST_ASSERT_EACH_EQUAL_UINT8(tag, data, len);
+    }
+    return error;
+}
+
+TEST_CASE("Session Cache: Sessions are resumed until they expire", "[session_cache]")
+{
+    session_cache_stats_t stats;
+
+    TEST_ASSERT_TRUE(session_cache_init(&test_config));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, test_lookup(1, 0));
+    TEST_ASSERT_EQUAL(ESP_OK, test_store(1, 0));
+    TEST_ASSERT_EQUAL(ESP_OK, test_lookup(1, 59 * TEST_S));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, test_lookup(2, 59 * TEST_S));
+
+    // Past the lifetime the session is dropped
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, test_lookup(1, 60 * TEST_S));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, test_lookup(1, 0));
+
+    session_cache_get_stats(&stats);
+    TEST_ASSERT_EQUAL(1, stats.stored);
+    TEST_ASSERT_EQUAL(1, stats.hits);
+    TEST_ASSERT_EQUAL(4, stats.misses);
+    TEST_ASSERT_EQUAL(0, stats.entries);
+}
+
+TEST_CASE("Session Cache: A full cache replaces expired, then oldest sessions", "[session_cache]")
+{
+    session_cache_stats_t stats;
+
+    TEST_ASSERT_TRUE(session_cache_init(&test_config));
+    TEST_ASSERT_EQUAL(ESP_OK, test_store(1, 0));
+    TEST_ASSERT_EQUAL(ESP_OK, test_store(2, 30 * TEST_S));
+
+    // Session 1 has expired and makes room, session 2 stays
+    TEST_ASSERT_EQUAL(ESP_OK, test_store(3, 61 * TEST_S));
+    TEST_ASSERT_EQUAL(ESP_OK, test_lookup(2, 61 * TEST_S));
+    TEST_ASSERT_EQUAL(ESP_OK, test_lookup(3, 61 * TEST_S));
+
+    // With both alive the older one goes
+    TEST_ASSERT_EQUAL(ESP_OK, test_store(4, 62 * TEST_S));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, test_lookup(2, 62 * TEST_S));
+    TEST_ASSERT_EQUAL(ESP_OK, test_lookup(3, 62 * TEST_S));
+    TEST_ASSERT_EQUAL(ESP_OK, test_lookup(4, 62 * TEST_S));
+
+    // The same ID again replaces its entry instead of taking another
+    TEST_ASSERT_EQUAL(ESP_OK, test_store(4, 63 * TEST_S));
+    TEST_ASSERT_EQUAL(ESP_OK, test_lookup(3, 63 * TEST_S));
+
+    session_cache_get_stats(&stats);
+    TEST_ASSERT_EQUAL(5, stats.stored);
+    TEST_ASSERT_EQUAL(1, stats.evicted);
+    TEST_ASSERT_EQUAL(2, stats.entries);
+}
+
+TEST_CASE("Session Cache: Bounds", "[session_cache]")
+{
+    static const uint8_t id[SESSION_CACHE_ID_LEN + 1] = {0};
+    static const uint8_t data[SESSION_CACHE_DATA_LEN + 1] = {0};
+    uint8_t small[8];
+    size_t len = 0;
+    session_cache_config_t config = test_config;
+
+    config.entries = SESSION_CACHE_MAX_ENTRIES + 1;
+    TEST_ASSERT_FALSE(session_cache_init(&config));
+    config.entries = 0;
+    TEST_ASSERT_FALSE(session_cache_init(&config));
+
+    TEST_ASSERT_TRUE(session_cache_init(&test_config));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, session_cache_store(id, 0, data, 1, 0));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, session_cache_store(id, sizeof(id), data, 1, 0));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, session_cache_store(id, 1, data, sizeof(data), 0));
+
+    // A buffer too small for the session leaves it cached
+    TEST_ASSERT_EQUAL(ESP_OK, session_cache_store(id, 1, data, SESSION_CACHE_DATA_LEN, 0));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, session_cache_lookup(id, 1, small, sizeof(small), &len, 0));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, session_cache_lookup(id, 1, small, sizeof(small), &len, 0));
+}
@@ -0,0 +1,68 @@
+#include "unity.h"
+#include "uri_template.h"
+#include <string.h>
+
+TEST_CASE("URI Template: Typed parameters", "[uri_template]")
+{
+    uri_template_match_t match;
+    uint32_t id = 0;
+
+    TEST_ASSERT_TRUE(uri_template_match("/cards/{id:u32}", "/cards/305419896", &match));
+    TEST_ASSERT_EQUAL(1, match.count);
+    TEST_ASSERT_TRUE(uri_template_get_u32(&match, "id", &id));
+    TEST_ASSERT_EQUAL_UINT32(305419896, id);
+
+    // The value points into the URI
+    const char *uri = "/cards/4294967295?fields=name";
+    TEST_ASSERT_TRUE(uri_template_match("/cards/{id:u32}", uri, &match));
+    TEST_ASSERT_EQUAL_PTR(uri + 7, match.params[0].value);
+    TEST_ASSERT_EQUAL(10, match.params[0].value_len);
+
+    TEST_ASSERT_FALSE(uri_template_match("/cards/{id:u32}", "/cards/4294967296", &match)); // Overflow
+    TEST_ASSERT_FALSE(uri_template_match("/cards/{id:u32}", "/cards/12ab", &match));
+    TEST_ASSERT_FALSE(uri_template_match("/cards/{id:u32}", "/cards/", &match));
+    TEST_ASSERT_FALSE(uri_template_match("/cards/{id:u32}", "/cards/12/extra", &match));
+
+    // Also usable on its own, for query parameters
+    TEST_ASSERT_TRUE(uri_template_parse_u32("4294967295", 10, &id));
+    TEST_ASSERT_EQUAL_UINT32(4294967295u, id);
+    TEST_ASSERT_TRUE(uri_template_parse_u32("12&x", 2, &id));
+    TEST_ASSERT_EQUAL_UINT32(12, id);
+    TEST_ASSERT_FALSE(uri_template_parse_u32("", 0, &id));
+    TEST_ASSERT_FALSE(uri_template_parse_u32("-1", 2, &id));
+    TEST_ASSERT_FALSE(uri_template_parse_u32("4294967296", 10, &id));
+    TEST_ASSERT_FALSE(uri_template_match("/cards/{id:u32}", "/card/12", &match));
+    TEST_ASSERT_FALSE(uri_template_match("/cards/{id:i8}", "/cards/12", &match)); // Unknown type
+}
+
+TEST_CASE("URI Template: Several parameters", "[uri_template]")
+{
+    uri_template_match_t match;
+    uint32_t id = 0;
+
+    TEST_ASSERT_TRUE(uri_template_match("/users/{user}/cards/{id:u32}", "/users/alice/cards/7", &match));
+    TEST_ASSERT_EQUAL(2, match.count);
+    const uri_template_param_t *user = uri_template_get(&match, "user");
+    TEST_ASSERT_NOT_NULL(user);
+    TEST_ASSERT_EQUAL(5, user->value_len);
+    TEST_ASSERT_EQUAL_MEMORY("alice", user->value, 5);
+    TEST_ASSERT_TRUE(uri_template_get_u32(&match, "id", &id));
+    TEST_ASSERT_EQUAL_UINT32(7, id);
+    TEST_ASSERT_NULL(uri_template_get(&match, "us"));
+    TEST_ASSERT_FALSE(uri_template_get_u32(&match, "user", &id));
+
+    // Plain paths match exactly
+    TEST_ASSERT_TRUE(uri_template_match("/cards/get", "/cards/get?x=1", NULL));
+    TEST_ASSERT_FALSE(uri_template_match("/cards/get", "/cards/getx", NULL));
+}
+
+TEST_CASE("URI Template: Wildcard pattern", "[uri_template]")
+{
+    char pattern[16];
+
+    TEST_ASSERT_TRUE(uri_template_is_template("/cards/{id:u32}"));
+    TEST_ASSERT_FALSE(uri_template_is_template("/cards/get"));
+    TEST_ASSERT_TRUE(uri_template_wildcard("/cards/{id:u32}", pattern, sizeof(pattern)));
+    TEST_ASSERT_EQUAL_STRING("/cards/*", pattern);
+    TEST_ASSERT_FALSE(uri_template_wildcard("/a/very/long/prefix/{id}", pattern, sizeof(pattern)));
+}
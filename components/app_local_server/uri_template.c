@@ -0,0 +1,138 @@
+/**
+ * @file uri_template.c
+ */
+
+#include <string.h>
+#include "uri_template.h"
+
+bool uri_template_parse_u32(const char *text, size_t len, uint32_t *value)
+{
+    uint32_t result = 0;
+
+    if (len == 0)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++)
+    {
+        if (text[i] < '0' || text[i] > '9')
+        {
+            return false;
+        }
+        uint32_t digit = (uint32_t)(text[i] - '0');
+        if (result > (UINT32_MAX - digit) / 10u)
+        {
+            return false;
+        }
+        result = result * 10u + digit;
+    }
+    *value = result;
+    return true;
+}
+
+bool uri_template_match(const char *tpl, const char *uri, uri_template_match_t *match)
+{
+    uri_template_match_t local;
+    size_t path_len = strcspn(uri, "?#");
+    size_t pos = 0;
+
+    if (match == NULL)
+    {
+        match = &local;
+    }
+    match->count = 0;
+
+    while (*tpl != '\0')
+    {
+        if (*tpl != '{')
+        {
+            if (pos >= path_len || uri[pos] != *tpl)
+            {
+                return false;
+            }
+            tpl++;
+            pos++;
+            continue;
+        }
+
+        // {name} or {name:type}
+        const char *close = strchr(tpl, '}');
+        if (close == NULL || match->count == URI_TEMPLATE_MAX_PARAMS)
+        {
+            return false;
+        }
+        const char *name = tpl + 1;
+        const char *colon = memchr(name, ':', close - name);
+        size_t name_len = (colon != NULL ? colon : close) - name;
+
+        size_t value_len = 0;
+        while (pos + value_len < path_len && uri[pos + value_len] != '/')
+        {
+            value_len++;
+        }
+        if (value_len == 0)
+        {
+            return false;
+        }
+
+        uint32_t number;
+        if (colon != NULL)
+        {
+            size_t type_len = close - colon - 1;
+            if (type_len != 3 || strncmp(colon + 1, "u32", 3) != 0 ||
+                !uri_template_parse_u32(uri + pos, value_len, &number))
+            {
+                return false;
+            }
+        }
+
+        uri_template_param_t *param = &match->params[match->count++];
+        param->name = name;
+        param->name_len = name_len;
+        param->value = uri + pos;
+        param->value_len = value_len;
+        pos += value_len;
+        tpl = close + 1;
+    }
+    return pos == path_len;
+}
+
+bool uri_template_is_template(const char *tpl)
+{
+    return strchr(tpl, '{') != NULL;
+}
+
+bool uri_template_wildcard(const char *tpl, char *dest, size_t dest_len)
+{
+    size_t prefix_len = strcspn(tpl, "{");
+
+    if (prefix_len + 2 > dest_len)
+    {
+        return false;
+    }
+    memcpy(dest, tpl, prefix_len);
+    dest[prefix_len] = '*';
+    dest[prefix_len + 1] = '\0';
+    return true;
+}
+
+const uri_template_param_t *uri_template_get(const uri_template_match_t *match, const char *name)
+{
+    size_t name_len = strlen(name);
+
+    for (size_t i = 0; i < match->count; i++)
+    {
+        if (match->params[i].name_len == name_len && strncmp(match->params[i].name, name, name_len) == 0)
+        {
+            return &match->params[i];
+        }
+    }
+    return NULL;
+}
+
+bool uri_template_get_u32(const uri_template_match_t *match, const char *name, uint32_t *value)
+{
+    const uri_template_param_t *param = uri_template_get(match, name);
+
+    return (param != NULL) && uri_template_parse_u32(param->value, param->value_len, value);
+}
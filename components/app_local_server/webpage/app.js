@@ -3,6 +3,7 @@
  */
 var seconds = null;
 var otaTimerVar = null;
+var otaProgressInterval = null;
 var wifiConnectInterval = null;
 
 /**
@@ -42,22 +43,23 @@ function getFileInfo() {
  * Handles the firmware update.
  */
 function updateFirmware() {
-  // Form Data
-  var formData = new FormData();
   var fileSelect = document.getElementById("selected_file");
 
   if (fileSelect.files && fileSelect.files.length == 1) {
     var file = fileSelect.files[0];
-    formData.set("file", file, file.name);
     document.getElementById("ota_update_status").innerHTML = "Uploading " + file.name + ", Firmware Update in Progress...";
 
-    // Http Request
-    var request = new XMLHttpRequest();
-
-    request.upload.addEventListener("progress", updateProgress);
-    request.open('POST', "/OTAupdate");
-    request.responseType = "blob";
-    request.send(formData);
+    // The device checks the digest before switching to the new image. Browsers
+    // only offer crypto.subtle on secure origins, elsewhere it is left out.
+    if (window.crypto && window.crypto.subtle) {
+      file.arrayBuffer()
+        .then(function (buffer) { return window.crypto.subtle.digest("SHA-256", buffer); })
+        .then(function (digest) { sendFirmware(file, toHex(digest)); })
+        .catch(function () { sendFirmware(file, null); });
+    }
+    else {
+      sendFirmware(file, null);
+    }
   }
   else {
     window.alert('Select A File First')
@@ -65,15 +67,51 @@ function updateFirmware() {
 }
 
 /**
- * Progress on transfers from the server to the client (downloads).
+ * Converts an ArrayBuffer to a lowercase hex string.
+ */
+function toHex(buffer) {
+  return Array.prototype.map.call(new Uint8Array(buffer), function (b) {
+    return ("0" + b.toString(16)).slice(-2);
+  }).join("");
+}
+
+/**
+ * Posts the firmware file and polls the device for progress until it is done.
  */
-function updateProgress(oEvent) {
-  if (oEvent.lengthComputable) {
-    getUpdateStatus();
+function sendFirmware(file, sha256) {
+  // Form Data
+  var formData = new FormData();
+  formData.set("file", file, file.name);
+
+  // Http Request
+  var request = new XMLHttpRequest();
+  request.open('POST', "/OTAupdate");
+  if (sha256) {
+    request.setRequestHeader("X-OTA-SHA256", sha256);
   }
-  else {
-    window.alert('total size is unknown')
+  request.responseType = "blob";
+  request.addEventListener("loadend", getUpdateStatus);
+  request.send(formData);
+
+  clearInterval(otaProgressInterval);
+  otaProgressInterval = setInterval(getUpdateStatus, 1000);
+}
+
+/**
+ * Shows the upload progress reported by the device.
+ */
+function showUpdateProgress(response) {
+  var kib = function (bytes) { return (bytes / 1024).toFixed(0) + " KB"; };
+  var text = "Received " + kib(response.ota_received) + " of " + kib(response.ota_total) +
+    ", written " + kib(response.ota_written) + ", " + kib(response.ota_rate) + "/s";
+
+  if (response.ota_active) {
+    text += ", about " + response.ota_eta + " s left";
+  }
+  if (response.ota_sha256 == "verified") {
+    text += ", SHA-256 verified";
   }
+  document.getElementById("ota_update_status").innerHTML = text;
 }
 
 /**
@@ -82,26 +120,38 @@ function updateProgress(oEvent) {
 function getUpdateStatus() {
   var xhr = new XMLHttpRequest();
   var requestURL = "/OTAstatus";
-  xhr.open('POST', requestURL, false);
-  xhr.send('ota_update_status');
-
-  if (xhr.readyState == 4 && xhr.status == 200) {
+  xhr.open('POST', requestURL, true);
+  xhr.onload = function () {
+    if (xhr.status != 200) {
+      return;
+    }
     var response = JSON.parse(xhr.responseText);
 
     document.getElementById("latest_firmware").innerHTML = response.compile_date + " - " + response.compile_time
 
+    if (response.ota_active) {
+      showUpdateProgress(response);
+      return;
+    }
+
     // If flashing was complete it will return a 1, else -1
     // A return of 0 is just for information on the Latest Firmware request
     if (response.ota_update_status == 1) {
-      // Set the countdown timer time
-      seconds = 10;
-      // Start the countdown timer
-      otaRebootTimer();
+      clearInterval(otaProgressInterval);
+      if (seconds === null) {
+        // Set the countdown timer time
+        seconds = 10;
+        // Start the countdown timer
+        otaRebootTimer();
+      }
     }
     else if (response.ota_update_status == -1) {
-      document.getElementById("ota_update_status").innerHTML = "!!! Upload Error !!!";
+      clearInterval(otaProgressInterval);
+      document.getElementById("ota_update_status").innerHTML =
+        (response.ota_sha256 == "mismatch") ? "!!! Upload Error: SHA-256 mismatch !!!" : "!!! Upload Error !!!";
     }
-  }
+  };
+  xhr.send('ota_update_status');
 }
 
 /**
@@ -269,6 +319,20 @@ function disconnectWiFi() {
   setTimeout("location.reload(true)", 2000);
 }
 
+// Tells the device this client is done with the portal, the phone or laptop
+// then closes its sign-in window on the next connectivity check
+function portalDone() {
+  $.ajax({
+    url: '/captive/accept',
+    dataType: 'json',
+    method: 'POST',
+    cache: false,
+    success: function () {
+      $("#portal_done_status").text("You can close this window");
+    }
+  });
+}
+
 // Sets the interval for displaying local time
 function startLocalTimeInterval() {
   // call function getLocalTime every 10 seconds
@@ -12,6 +12,10 @@ let searchState = {
     filteredCards: []
 };
 
+// Live badge activity
+const LIVE_EVENTS_MAX = 20;
+let liveEventSource = null;
+
 // Admin card protection
 const ADMIN_CARD_ID = 305419896; // 0x12345678 in decimal
 const ADMIN_CARD_HEX = "0x12345678";
@@ -21,8 +25,38 @@ $(document).ready(function() {
     loadCardCount();
     loadDefaultCards(); // Load only default cards initially
     initializeSearch(); // Initialize search functionality
+    startLiveEvents(); // Subscribe to live badge decisions
 });
 
+// Subscribe to the server-sent badge decision stream
+function startLiveEvents() {
+    if (!window.EventSource) {
+        $('#live_status').text('Not supported by this browser');
+        return;
+    }
+
+    liveEventSource = new EventSource('/events');
+
+    liveEventSource.onopen = function() {
+        $('#live_status').text('Live');
+    };
+
+    liveEventSource.onerror = function() {
+        // EventSource reconnects by itself using the server supplied retry delay
+        $('#live_status').text('Reconnecting...');
+    };
+
+    liveEventSource.addEventListener('badge', function(e) {
+        const event = JSON.parse(e.data);
+        const time = event.timestamp ? new Date(event.timestamp * 1000).toLocaleTimeString() : '';
+        const color = event.decision === 'granted' ? '#155724' : '#721c24';
+        const hex = `0x${event.id.toString(16).toUpperCase().padStart(8, '0')}`;
+
+        $('#live_events').prepend(`<li style="color: ${color};">${time} ${hex} - ${event.decision}</li>`);
+        $('#live_events li').slice(LIVE_EVENTS_MAX).remove();
+    });
+}
+
 // Utility function to format card ID for display (hex primary, decimal secondary)
 function formatCardId(decimalId) {
     const hex = `0x${decimalId.toString(16).toUpperCase().padStart(8, '0')}`;
@@ -266,7 +300,7 @@ function removeCard() {
     
     // Send request
     $.ajax({
-        url: `/cards/remove?id=${cardId}`,
+        url: `/cards/${cardId}`,
         type: 'DELETE',
         success: function(response, textStatus, xhr) {
             console.log('Remove card response:', response, 'Status:', xhr.status);
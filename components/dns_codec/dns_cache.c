@@ -0,0 +1,258 @@
+/**
+ * @file dns_cache.c
+ *
+ * Entries are whole responses up to the end of their authority section, so
+ * a hit needs no encoding: the copy only gets the query's id, RD flag and
+ * question bytes (a resolver may randomise the case of the name) and aged
+ * TTLs. The additional section is dropped when storing, it may hold an OPT
+ * record the next client did not ask for.
+ */
+
+#include <string.h>
+#include <ctype.h>
+#include "dns_codec.h"
+#include "dns_cache.h"
+
+#define DNS_CACHE_RR_FIXED_LEN (10u) // Type, class, TTL and data length after the name
+#define DNS_CACHE_SOA_MINIMUM_LEN (4u) // Last field of the SOA data, the negative caching TTL
+
+static inline uint32_t dns_cache_get32(const uint8_t *p)
+{
+    return ((uint32_t)dns_codec_get16(p) << 16) | dns_codec_get16(p + 2);
+}
+
+static inline void dns_cache_put32(uint8_t *p, uint32_t value)
+{
+    dns_codec_put16(p, (uint16_t)(value >> 16));
+    dns_codec_put16(p + 2, (uint16_t)value);
+}
+
+void dns_cache_init(dns_cache_t *cache, dns_cache_entry_t *entries, size_t count)
+{
+    cache->entries = entries;
+    cache->count = count;
+    memset(&cache->stats, 0, sizeof(cache->stats));
+    dns_cache_flush(cache);
+}
+
+void dns_cache_flush(dns_cache_t *cache)
+{
+    for (size_t i = 0; i < cache->count; i++)
+    {
+        cache->entries[i].expires_us = 0;
+    }
+}
+
+/*
+ * Finds the fixed part of a resource record
+ * @param msg start of the message
+ * @param len length of the message
+ * @param offset offset of the record's name
+ * @return offset of the record's type field, 0 if the record runs past the message
+ */
+static size_t dns_cache_record(const uint8_t *msg, size_t len, size_t offset)
+{
+    size_t fixed = dns_codec_skip_name(msg, len, offset);
+
+    if (fixed == 0 || fixed + DNS_CACHE_RR_FIXED_LEN > len ||
+        fixed + DNS_CACHE_RR_FIXED_LEN + dns_codec_get16(&msg[fixed + 8]) > len)
+    {
+        return 0;
+    }
+    return fixed;
+}
+
+/*
+ * Offset of the record after the one whose fixed part starts at fixed
+ */
+static inline size_t dns_cache_record_next(const uint8_t *msg, size_t fixed)
+{
+    return fixed + DNS_CACHE_RR_FIXED_LEN + dns_codec_get16(&msg[fixed + 8]);
+}
+
+/*
+ * Compares the questions of two messages, both checked with dns_codec_parse_question
+ * @return true for the same name (ignoring case), type and class
+ */
+static bool dns_cache_same_question(const uint8_t *a, size_t a_end, const uint8_t *b, size_t b_end)
+{
+    if (a_end != b_end)
+    {
+        return false;
+    }
+    // Label lengths are below 64 and not changed by tolower
+    for (size_t i = DNS_CODEC_HEADER_LEN; i < a_end; i++)
+    {
+        if (tolower(a[i]) != tolower(b[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+int dns_cache_lookup(dns_cache_t *cache, const uint8_t *query, size_t len, uint8_t *reply, size_t reply_size,
+                     int64_t now_us)
+{
+    dns_codec_question_t question;
+
+    if (!dns_codec_parse_question(query, len, &question))
+    {
+        return 0;
+    }
+
+    for (size_t i = 0; i < cache->count; i++)
+    {
+        dns_cache_entry_t *entry = &cache->entries[i];
+        if (entry->expires_us == 0)
+        {
+            continue;
+        }
+        if (entry->expires_us <= now_us)
+        {
+            entry->expires_us = 0;
+            continue;
+        }
+        if (question.end > entry->len || !dns_cache_same_question(entry->response, question.end, query, question.end))
+        {
+            continue;
+        }
+        if (entry->len > reply_size)
+        {
+            break;
+        }
+
+        // The query's id, RD flag and question, the stored header and records
+        uint16_t id = dns_codec_get16(query);
+        uint8_t rd = query[2] & 0x01u;
+        if (reply != query)
+        {
+            memcpy(&reply[DNS_CODEC_HEADER_LEN], &query[DNS_CODEC_HEADER_LEN], question.end - DNS_CODEC_HEADER_LEN);
+        }
+        memcpy(reply, entry->response, DNS_CODEC_HEADER_LEN);
+        memcpy(&reply[question.end], &entry->response[question.end], entry->len - question.end);
+        dns_codec_put16(reply, id);
+        reply[2] = (uint8_t)((reply[2] & 0xFEu) | rd);
+
+        // Stored responses were checked, every record is complete
+        uint32_t age_s = (uint32_t)((now_us - entry->stored_us) / 1000000);
+        uint32_t records = (uint32_t)dns_codec_get16(&reply[6]) + dns_codec_get16(&reply[8]);
+        size_t offset = question.end;
+        for (uint32_t r = 0; r < records; r++)
+        {
+            size_t fixed = dns_cache_record(reply, entry->len, offset);
+            uint32_t ttl = dns_cache_get32(&reply[fixed + 4]);
+            dns_cache_put32(&reply[fixed + 4], (ttl > age_s) ? ttl - age_s : 0);
+            offset = dns_cache_record_next(reply, fixed);
+        }
+
+        entry->used_us = now_us;
+        cache->stats.hits++;
+        return (int)entry->len;
+    }
+    cache->stats.misses++;
+    return 0;
+}
+
+/*
+ * How long a response may be kept
+ * @param response upstream response, its question checked
+ * @param len length of response
+ * @param question_end offset after the question
+ * @param end receives the offset after the authority section
+ * @return TTL in seconds, 0 if it cannot be cached
+ */
+static uint32_t dns_cache_response_ttl(const uint8_t *response, size_t len, size_t question_end, size_t *end)
+{
+    uint8_t rcode = response[3] & 0x0Fu;
+    uint16_t an_count = dns_codec_get16(&response[6]);
+    uint32_t records = (uint32_t)an_count + dns_codec_get16(&response[8]);
+    uint32_t ttl_min = UINT32_MAX;
+    uint32_t soa_ttl = 0;
+    size_t offset = question_end;
+
+    for (uint32_t r = 0; r < records; r++)
+    {
+        size_t fixed = dns_cache_record(response, len, offset);
+        if (fixed == 0)
+        {
+            return 0;
+        }
+        uint16_t type = dns_codec_get16(&response[fixed]);
+        uint32_t ttl = dns_cache_get32(&response[fixed + 4]);
+        uint16_t data_len = dns_codec_get16(&response[fixed + 8]);
+        if (type == DNS_CODEC_TYPE_OPT)
+        {
+            // Not a record, only allowed in the additional section anyway
+            return 0;
+        }
+        if (type == DNS_CODEC_TYPE_SOA && r >= an_count && data_len >= DNS_CACHE_SOA_MINIMUM_LEN)
+        {
+            // RFC 2308: negative answers live for the smaller of the SOA's TTL and minimum
+            uint32_t minimum = dns_cache_get32(&response[fixed + DNS_CACHE_RR_FIXED_LEN + data_len - 4]);
+            soa_ttl = (ttl < minimum) ? ttl : minimum;
+        }
+        ttl_min = (ttl < ttl_min) ? ttl : ttl_min;
+        offset = dns_cache_record_next(response, fixed);
+    }
+    *end = offset;
+
+    if (rcode == DNS_CODEC_RCODE_NXDOMAIN || (rcode == DNS_CODEC_RCODE_NOERROR && an_count == 0))
+    {
+        ttl_min = soa_ttl;
+    }
+    else if (rcode != DNS_CODEC_RCODE_NOERROR)
+    {
+        return 0;
+    }
+    return (ttl_min > DNS_CACHE_MAX_TTL_S) ? DNS_CACHE_MAX_TTL_S : ttl_min;
+}
+
+bool dns_cache_store(dns_cache_t *cache, const uint8_t *response, size_t len, int64_t now_us)
+{
+    dns_codec_question_t question;
+    size_t end = 0;
+    uint32_t ttl_s = 0;
+
+    // A response to a standard query, complete and with one question
+    if (dns_codec_parse_question(response, len, &question) && (response[2] & 0xFAu) == 0x80u &&
+        dns_codec_get16(&response[4]) == 1)
+    {
+        ttl_s = dns_cache_response_ttl(response, len, question.end, &end);
+    }
+    if (ttl_s == 0 || end > DNS_CACHE_RESPONSE_LEN || cache->count == 0)
+    {
+        cache->stats.uncacheable++;
+        return false;
+    }
+
+    // The same question, else a free or expired entry, else the least recently used
+    dns_cache_entry_t *slot = NULL;
+    for (size_t i = 0; i < cache->count; i++)
+    {
+        dns_cache_entry_t *entry = &cache->entries[i];
+        bool live = entry->expires_us > now_us;
+        if (live && dns_cache_same_question(entry->response, question.end, response, question.end))
+        {
+            slot = entry;
+            break;
+        }
+        if (slot == NULL || (slot->expires_us > now_us && (!live || entry->used_us < slot->used_us)))
+        {
+            slot = entry;
+        }
+    }
+    if (slot->expires_us > now_us && !dns_cache_same_question(slot->response, question.end, response, question.end))
+    {
+        cache->stats.evicted++;
+    }
+
+    memcpy(slot->response, response, end);
+    dns_codec_put16(&slot->response[10], 0); // Additional section dropped
+    slot->len = (uint16_t)end;
+    slot->stored_us = now_us;
+    slot->expires_us = now_us + (int64_t)ttl_s * 1000000;
+    slot->used_us = now_us;
+    cache->stats.stored++;
+    return true;
+}
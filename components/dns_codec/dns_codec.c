@@ -0,0 +1,299 @@
+/**
+ * @file dns_codec.c
+ *
+ * Header and record fields are read and written byte by byte in network
+ * order, so the packets need no alignment and nothing depends on the
+ * endianness of the chip.
+ */
+
+#include <string.h>
+#include <ctype.h>
+#include "esp_log.h"
+#include "dns_codec.h"
+
+#define DNS_CODEC_QUESTION_FIXED_LEN (4u) // Type and class after the name
+#define DNS_CODEC_FLAGS_OPCODE (0x78u)    // In the first flags byte
+#define DNS_CODEC_FLAGS_QR (0x80u)
+#define DNS_CODEC_FLAGS_TC (0x02u)
+#define DNS_CODEC_FLAGS_RD (0x01u)
+#define DNS_CODEC_FLAGS_RA (0x80u)        // In the second flags byte, with the RCODE
+#define DNS_CODEC_RECORD_FIXED_LEN (10u)  // Type, class, TTL and data length after the name
+#define DNS_CODEC_EXTENDED_RCODE_BADVERS (1u) // RCODE 16 in the OPT record
+#define DNS_CODEC_LABEL_POINTER (0xC0u)
+
+static const char *TAG = "dns_codec";
+
+void dns_codec_template_init(dns_codec_answer_template_t *tpl, uint32_t addr, uint32_t ttl_s)
+{
+    uint8_t *record = tpl->record;
+
+    dns_codec_put16(&record[0], 0xC000 | DNS_CODEC_HEADER_LEN); // Patched per question
+    dns_codec_put16(&record[2], DNS_CODEC_TYPE_A);
+    dns_codec_put16(&record[4], DNS_CODEC_CLASS_IN);
+    dns_codec_put16(&record[6], (uint16_t)(ttl_s >> 16));
+    dns_codec_put16(&record[8], (uint16_t)ttl_s);
+    dns_codec_put16(&record[10], sizeof(addr));
+    memcpy(&record[12], &addr, sizeof(addr)); // Already in network order
+    tpl->addr = addr;
+
+    // SOA owned by the first question, with its name as primary server and mailbox
+    uint8_t *soa = tpl->soa;
+    // Serial, refresh, retry, expire and minimum, the last one is what resolvers use
+    static const uint32_t timers[] = {1, 3600, 600, 86400, DNS_CODEC_NEGATIVE_TTL_S};
+    dns_codec_put16(&soa[0], 0xC000 | DNS_CODEC_HEADER_LEN);
+    dns_codec_put16(&soa[2], DNS_CODEC_TYPE_SOA);
+    dns_codec_put16(&soa[4], DNS_CODEC_CLASS_IN);
+    dns_codec_put16(&soa[6], 0);
+    dns_codec_put16(&soa[8], DNS_CODEC_NEGATIVE_TTL_S);
+    dns_codec_put16(&soa[10], DNS_CODEC_SOA_LEN - 12);
+    dns_codec_put16(&soa[12], 0xC000 | DNS_CODEC_HEADER_LEN);
+    dns_codec_put16(&soa[14], 0xC000 | DNS_CODEC_HEADER_LEN);
+    for (size_t i = 0; i < sizeof(timers) / sizeof(timers[0]); i++)
+    {
+        dns_codec_put16(&soa[16 + 4 * i], (uint16_t)(timers[i] >> 16));
+        dns_codec_put16(&soa[18 + 4 * i], (uint16_t)timers[i]);
+    }
+}
+
+size_t dns_codec_skip_name(const uint8_t *packet, size_t len, size_t offset)
+{
+    while (offset < len)
+    {
+        uint8_t label = packet[offset];
+        if (label == 0)
+        {
+            return offset + 1;
+        }
+        if ((label & DNS_CODEC_LABEL_POINTER) == DNS_CODEC_LABEL_POINTER)
+        {
+            // A compression pointer ends the name
+            return (offset + 2 <= len) ? offset + 2 : 0;
+        }
+        if ((label & DNS_CODEC_LABEL_POINTER) != 0)
+        {
+            return 0;
+        }
+        offset += 1 + label;
+    }
+    return 0;
+}
+
+bool dns_codec_parse_edns(const uint8_t *packet, size_t len, size_t offset, dns_codec_edns_t *edns)
+{
+    uint32_t first_additional = (uint32_t)dns_codec_get16(&packet[6]) + dns_codec_get16(&packet[8]);
+    uint32_t records = first_additional + dns_codec_get16(&packet[10]);
+
+    memset(edns, 0, sizeof(*edns));
+    for (uint32_t r = 0; r < records; r++)
+    {
+        size_t fixed = dns_codec_skip_name(packet, len, offset);
+        if (fixed == 0 || fixed + DNS_CODEC_RECORD_FIXED_LEN > len)
+        {
+            return false;
+        }
+        size_t next = fixed + DNS_CODEC_RECORD_FIXED_LEN + dns_codec_get16(&packet[fixed + 8]);
+        if (next > len)
+        {
+            return false;
+        }
+        if (r >= first_additional && dns_codec_get16(&packet[fixed]) == DNS_CODEC_TYPE_OPT)
+        {
+            // RFC 6891: owned by the root, at most one per message
+            if (edns->present || packet[offset] != 0)
+            {
+                return false;
+            }
+            edns->present = true;
+            edns->offset = fixed;
+            edns->udp_size = dns_codec_get16(&packet[fixed + 2]);
+            edns->version = packet[fixed + 5];
+            edns->dnssec_ok = (packet[fixed + 6] & 0x80u) != 0;
+        }
+        offset = next;
+    }
+    return true;
+}
+
+/*
+ * Appends an OPT record advertising DNS_CODEC_EDNS_UDP_SIZE
+ * @param record destination, DNS_CODEC_OPT_LEN bytes
+ * @param extended_rcode upper eight bits of the reply's RCODE
+ */
+static void dns_codec_put_opt(uint8_t *record, uint8_t extended_rcode)
+{
+    memset(record, 0, DNS_CODEC_OPT_LEN);
+    dns_codec_put16(&record[1], DNS_CODEC_TYPE_OPT);
+    dns_codec_put16(&record[3], DNS_CODEC_EDNS_UDP_SIZE);
+    record[5] = extended_rcode;
+}
+
+int dns_codec_build_reply(const uint8_t *query, size_t len, uint8_t *reply, size_t reply_size,
+                          const dns_codec_answer_template_t *tpl)
+{
+    if (len < DNS_CODEC_HEADER_LEN)
+    {
+        return -1;
+    }
+    // Not a standard query
+    if ((query[2] & DNS_CODEC_FLAGS_OPCODE) != 0)
+    {
+        return 0;
+    }
+
+    uint16_t qd_count = dns_codec_get16(&query[4]);
+    uint16_t an_count = 0;
+    size_t offset = DNS_CODEC_HEADER_LEN;
+    for (uint16_t i = 0; i < qd_count; i++)
+    {
+        size_t name_end = dns_codec_skip_name(query, len, offset);
+        if (name_end == 0 || name_end + DNS_CODEC_QUESTION_FIXED_LEN > len || offset > 0x3FFF)
+        {
+            ESP_LOGD(TAG, "Question %u at offset %u is malformed", (unsigned)i, (unsigned)offset);
+            return -1;
+        }
+        an_count += dns_codec_get16(&query[name_end]) == DNS_CODEC_TYPE_A &&
+                    dns_codec_get16(&query[name_end + 2]) == DNS_CODEC_CLASS_IN;
+        offset = name_end + DNS_CODEC_QUESTION_FIXED_LEN;
+    }
+    size_t question_end = offset;
+
+    dns_codec_edns_t edns;
+    if (qd_count == 0 || !dns_codec_parse_edns(query, len, question_end, &edns))
+    {
+        return -1;
+    }
+    // RFC 6891: an EDNS version we do not speak gets BADVERS and nothing else
+    bool bad_version = edns.present && edns.version != 0;
+    if (bad_version)
+    {
+        an_count = 0;
+    }
+    uint16_t ns_count = (an_count == 0 && !bad_version) ? 1 : 0;
+    size_t opt_len = edns.present ? DNS_CODEC_OPT_LEN : 0;
+    size_t reply_len = question_end + (size_t)an_count * DNS_CODEC_ANSWER_LEN + ns_count * DNS_CODEC_SOA_LEN + opt_len;
+
+    // Larger than the client takes (or than the buffer): the questions with TC
+    // set, the client asks again over TCP or with a larger EDNS0 payload
+    size_t limit = dns_codec_udp_limit(&edns);
+    bool truncated = reply_len > limit || reply_len > reply_size;
+    if (truncated)
+    {
+        an_count = 0;
+        ns_count = 0;
+        reply_len = question_end + opt_len;
+        if (reply_len > reply_size)
+        {
+            return -1;
+        }
+    }
+
+    // Header and questions, anything the query had after them is left out
+    if (reply != query)
+    {
+        memcpy(reply, query, question_end);
+    }
+    reply[2] = (uint8_t)((reply[2] & (DNS_CODEC_FLAGS_OPCODE | DNS_CODEC_FLAGS_RD)) | DNS_CODEC_FLAGS_QR |
+                         (truncated ? DNS_CODEC_FLAGS_TC : 0));
+    reply[3] = DNS_CODEC_FLAGS_RA;
+    dns_codec_put16(&reply[6], an_count);
+    dns_codec_put16(&reply[8], ns_count);
+    dns_codec_put16(&reply[10], edns.present ? 1 : 0);
+
+    uint8_t *record = reply + question_end;
+    offset = DNS_CODEC_HEADER_LEN;
+    for (uint16_t i = 0; i < qd_count && an_count > 0; i++)
+    {
+        size_t name_end = dns_codec_skip_name(query, len, offset);
+        if (dns_codec_get16(&query[name_end]) == DNS_CODEC_TYPE_A &&
+            dns_codec_get16(&query[name_end + 2]) == DNS_CODEC_CLASS_IN)
+        {
+            memcpy(record, tpl->record, DNS_CODEC_ANSWER_LEN);
+            dns_codec_put16(&record[0], (uint16_t)(0xC000 | offset));
+            record += DNS_CODEC_ANSWER_LEN;
+        }
+        offset = name_end + DNS_CODEC_QUESTION_FIXED_LEN;
+    }
+    if (ns_count > 0)
+    {
+        // NODATA: the name exists (it has an A record), only not with this type,
+        // so AAAA, HTTPS and the like fail at once instead of after a timeout
+        memcpy(record, tpl->soa, DNS_CODEC_SOA_LEN);
+        record += DNS_CODEC_SOA_LEN;
+    }
+    if (edns.present)
+    {
+        dns_codec_put_opt(record, bad_version ? DNS_CODEC_EXTENDED_RCODE_BADVERS : 0);
+    }
+    return (int)reply_len;
+}
+
+bool dns_codec_parse_question(const uint8_t *packet, size_t len, dns_codec_question_t *question)
+{
+    if (len < DNS_CODEC_HEADER_LEN || dns_codec_get16(&packet[4]) == 0)
+    {
+        return false;
+    }
+    size_t name_end = dns_codec_skip_name(packet, len, DNS_CODEC_HEADER_LEN);
+    if (name_end == 0 || name_end + DNS_CODEC_QUESTION_FIXED_LEN > len)
+    {
+        return false;
+    }
+    question->name_offset = DNS_CODEC_HEADER_LEN;
+    question->end = name_end + DNS_CODEC_QUESTION_FIXED_LEN;
+    question->type = dns_codec_get16(&packet[name_end]);
+    question->class = dns_codec_get16(&packet[name_end + 2]);
+    return true;
+}
+
+bool dns_codec_name_equals(const uint8_t *packet, size_t len, size_t offset, const char *name)
+{
+    const char *start = name;
+
+    while (offset < len)
+    {
+        uint8_t label = packet[offset++];
+        if (label == 0)
+        {
+            return *name == '\0';
+        }
+        if ((label & DNS_CODEC_LABEL_POINTER) != 0 || offset + label > len)
+        {
+            return false;
+        }
+        // Labels after the first one follow a dot
+        if (name != start && *name++ != '.')
+        {
+            return false;
+        }
+        for (uint8_t i = 0; i < label; i++, name++)
+        {
+            if (*name == '\0' || tolower(packet[offset + i]) != tolower((unsigned char)*name))
+            {
+                return false;
+            }
+        }
+        offset += label;
+    }
+    return false;
+}
+
+int dns_codec_build_error(const uint8_t *query, size_t len, uint8_t *reply, size_t reply_size, uint8_t rcode)
+{
+    dns_codec_question_t question;
+
+    if (!dns_codec_parse_question(query, len, &question) || question.end > reply_size)
+    {
+        return -1;
+    }
+    if (reply != query)
+    {
+        memcpy(reply, query, question.end);
+    }
+    reply[2] = (uint8_t)((reply[2] & (DNS_CODEC_FLAGS_OPCODE | DNS_CODEC_FLAGS_RD)) | DNS_CODEC_FLAGS_QR);
+    reply[3] = (uint8_t)(DNS_CODEC_FLAGS_RA | (rcode & 0x0Fu));
+    dns_codec_put16(&reply[4], 1);
+    dns_codec_put16(&reply[6], 0);
+    dns_codec_put16(&reply[8], 0);
+    dns_codec_put16(&reply[10], 0);
+    return (int)question.end;
+}
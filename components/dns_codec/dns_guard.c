@@ -0,0 +1,188 @@
+/**
+ * @file dns_guard.c
+ *
+ * Same bucket arithmetic as rate_limit.c, per second instead of per minute
+ * and with the table scan extended by the overflow rule. The name hash reads
+ * the labels in place, no name is copied or lowered into a buffer.
+ */
+
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include "dns_codec.h"
+#include "dns_guard.h"
+
+#define DNS_GUARD_BURST_MAX (UINT32_MAX / DNS_GUARD_TOKEN_SCALE)
+#define DNS_GUARD_NAME_BITS (64u)
+#define DNS_GUARD_FNV_OFFSET (2166136261u)
+#define DNS_GUARD_FNV_PRIME (16777619u)
+
+void dns_guard_init(dns_guard_t *guard, const dns_guard_config_t *config)
+{
+    memset(guard, 0, sizeof(*guard));
+    guard->config = *config;
+    if (guard->config.burst == 0)
+    {
+        guard->config.burst = 1;
+    }
+    else if (guard->config.burst > DNS_GUARD_BURST_MAX)
+    {
+        guard->config.burst = DNS_GUARD_BURST_MAX;
+    }
+}
+
+/*
+ * Hashes the first question's name, ignoring case
+ * @return FNV-1a of the label bytes, the offset basis if there is no name
+ */
+static uint32_t dns_guard_name_hash(const uint8_t *query, size_t len)
+{
+    uint32_t hash = DNS_GUARD_FNV_OFFSET;
+    size_t end = dns_codec_skip_name(query, len, DNS_CODEC_HEADER_LEN);
+
+    for (size_t i = DNS_CODEC_HEADER_LEN; i < end; i++)
+    {
+        hash = (hash ^ (uint8_t)tolower(query[i])) * DNS_GUARD_FNV_PRIME;
+    }
+    return hash;
+}
+
+/*
+ * Linear counting over the name bitmap
+ * @return estimated number of different names behind the set bits
+ */
+static uint32_t dns_guard_estimate(uint64_t names)
+{
+    uint32_t zeros = DNS_GUARD_NAME_BITS - (uint32_t)__builtin_popcountll(names);
+
+    // A full bitmap only says "many", report what one empty bit would give
+    zeros = (zeros == 0) ? 1 : zeros;
+    return (uint32_t)lroundf(-(float)DNS_GUARD_NAME_BITS * logf((float)zeros / DNS_GUARD_NAME_BITS));
+}
+
+/*
+ * Finds the source's entry, starting a full bucket for a new source, or the
+ * shared bucket if every entry is in use and active
+ */
+static dns_guard_client_t *dns_guard_find(dns_guard_t *guard, uint32_t addr, int64_t now_us)
+{
+    dns_guard_client_t *victim = NULL;
+
+    for (size_t i = 0; i < DNS_GUARD_TABLE_SIZE; i++)
+    {
+        dns_guard_client_t *entry = &guard->entries[i];
+        if (!entry->used)
+        {
+            if (victim == NULL || victim->used)
+            {
+                victim = entry;
+            }
+        }
+        else if (entry->addr == addr)
+        {
+            return entry;
+        }
+        else if (victim == NULL || (victim->used && entry->updated_us < victim->updated_us))
+        {
+            victim = entry;
+        }
+    }
+
+    if (victim->used)
+    {
+        if (now_us - victim->updated_us < DNS_GUARD_IDLE_US)
+        {
+            guard->overflow++;
+            if (!guard->shared.used)
+            {
+                guard->shared.used = true;
+                guard->shared.tokens = guard->config.burst * DNS_GUARD_TOKEN_SCALE;
+                guard->shared.updated_us = now_us;
+                guard->shared.window_us = now_us;
+            }
+            return &guard->shared;
+        }
+        guard->evicted++;
+    }
+    memset(victim, 0, sizeof(*victim));
+    victim->used = true;
+    victim->addr = addr;
+    victim->tokens = guard->config.burst * DNS_GUARD_TOKEN_SCALE;
+    victim->updated_us = now_us;
+    victim->window_us = now_us;
+    return victim;
+}
+
+bool dns_guard_admit(dns_guard_t *guard, uint32_t addr, const uint8_t *query, size_t len, int64_t now_us)
+{
+    dns_guard_client_t *client = dns_guard_find(guard, addr, now_us);
+
+    if (now_us - client->window_us >= DNS_GUARD_WINDOW_US)
+    {
+        client->last_names = (uint16_t)dns_guard_estimate(client->names);
+        client->names = 0;
+        client->window_us = now_us;
+    }
+    client->names |= 1ull << (dns_guard_name_hash(query, len) % DNS_GUARD_NAME_BITS);
+    client->queries++;
+
+    if (guard->config.per_second == 0)
+    {
+        client->updated_us = now_us;
+        return true;
+    }
+
+    // Thousandths of a query per microsecond is per_second / 1000
+    uint32_t capacity = guard->config.burst * DNS_GUARD_TOKEN_SCALE;
+    if (now_us > client->updated_us)
+    {
+        uint64_t refill = (uint64_t)(now_us - client->updated_us) * guard->config.per_second / 1000u;
+        client->tokens = (refill >= capacity - client->tokens) ? capacity : client->tokens + (uint32_t)refill;
+    }
+    client->updated_us = now_us;
+
+    if (client->tokens >= DNS_GUARD_TOKEN_SCALE)
+    {
+        client->tokens -= DNS_GUARD_TOKEN_SCALE;
+        return true;
+    }
+    client->refused++;
+    guard->refused++;
+    return false;
+}
+
+uint32_t dns_guard_distinct_names(const dns_guard_client_t *client)
+{
+    uint32_t current = dns_guard_estimate(client->names);
+    return (current > client->last_names) ? current : client->last_names;
+}
+
+size_t dns_guard_top(const dns_guard_t *guard, dns_guard_client_t *top, size_t max)
+{
+    size_t count = 0;
+
+    // Insertion into the short result, the shared bucket competes like a client
+    for (size_t i = 0; i <= DNS_GUARD_TABLE_SIZE; i++)
+    {
+        const dns_guard_client_t *entry = (i < DNS_GUARD_TABLE_SIZE) ? &guard->entries[i] : &guard->shared;
+        if (!entry->used || max == 0)
+        {
+            continue;
+        }
+        size_t at = count;
+        while (at > 0 && top[at - 1].queries < entry->queries)
+        {
+            if (at < max)
+            {
+                top[at] = top[at - 1];
+            }
+            at--;
+        }
+        if (at < max)
+        {
+            top[at] = *entry;
+            count += (count < max);
+        }
+    }
+    return count;
+}
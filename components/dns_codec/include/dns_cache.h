@@ -0,0 +1,86 @@
+/**
+ * @file dns_cache.h
+ *
+ * Fixed-size cache of upstream DNS responses for the forwarding mode of the
+ * captive DNS server. Entries are keyed by their question (name without
+ * regard to case, type and class) and kept for the smallest TTL of their
+ * records, at most DNS_CACHE_MAX_TTL_S. Negative answers (NXDOMAIN, or no
+ * records) are kept for the TTL their SOA record allows and not at all
+ * without one. A hit is the stored response with the query's id and question
+ * and every TTL reduced by the time it spent in the cache. When the table is
+ * full the least recently used entry is replaced. Not thread-safe, the cache
+ * belongs to the DNS task.
+ */
+#ifndef DNS_CACHE_H
+#define DNS_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define DNS_CACHE_RESPONSE_LEN (256u) // Largest response kept, without its additional section
+#define DNS_CACHE_MAX_TTL_S (3600u)
+
+typedef struct dns_cache_entry
+{
+    int64_t stored_us;
+    int64_t expires_us; // 0 for a free entry
+    int64_t used_us;    // Last store or hit, the LRU order
+    uint16_t len;
+    uint8_t response[DNS_CACHE_RESPONSE_LEN];
+} dns_cache_entry_t;
+
+typedef struct dns_cache_stats
+{
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t stored;
+    uint32_t uncacheable; // Responses with a TTL of 0, errors, truncated or too large
+    uint32_t evicted;     // Live entries replaced because the table was full
+} dns_cache_stats_t;
+
+typedef struct dns_cache
+{
+    dns_cache_entry_t *entries;
+    size_t count;
+    dns_cache_stats_t stats;
+} dns_cache_t;
+
+/**
+ * @brief Empties a cache and resets its counters
+ * @param cache cache to set up
+ * @param entries storage owned by the caller
+ * @param count number of entries
+ */
+void dns_cache_init(dns_cache_t *cache, dns_cache_entry_t *entries, size_t count);
+
+/**
+ * @brief Answers a query from the cache
+ * @param cache cache
+ * @param query received datagram
+ * @param len length of query
+ * @param reply destination, either query itself (answered in place) or not overlapping it
+ * @param reply_size capacity of reply
+ * @param now_us current time
+ * @return reply length, 0 if the question is not cached (or the reply does not fit)
+ */
+int dns_cache_lookup(dns_cache_t *cache, const uint8_t *query, size_t len, uint8_t *reply, size_t reply_size,
+                     int64_t now_us);
+
+/**
+ * @brief Keeps an upstream response, replacing an entry with the same question
+ * @param cache cache
+ * @param response datagram from the upstream resolver
+ * @param len length of response
+ * @param now_us current time
+ * @return true if it was stored, false if it cannot be cached
+ */
+bool dns_cache_store(dns_cache_t *cache, const uint8_t *response, size_t len, int64_t now_us);
+
+/**
+ * @brief Drops every entry, e.g. when the upstream link changed
+ * @param cache cache
+ */
+void dns_cache_flush(dns_cache_t *cache);
+
+#endif // DNS_CACHE_H
@@ -0,0 +1,165 @@
+/**
+ * @file dns_codec.h
+ *
+ * Replies of the captive DNS server, built without any lookup per packet.
+ * The A record every answer consists of is prepared once per address in a
+ * template; a reply is the query's header and questions with the QR flag,
+ * followed by a copy of the template per A question with its name pointer
+ * filled in. Questions of any other type get a NODATA reply: no answers and
+ * the template's SOA record, so the client caches the absence for a few
+ * seconds instead of retrying. A query with an EDNS0 OPT record gets one back.
+ * Packets are handled as bytes in network order, nothing is byte swapped in
+ * place and no buffer is cleared beyond the bytes written.
+ */
+#ifndef DNS_CODEC_H
+#define DNS_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define DNS_CODEC_HEADER_LEN (12u)
+#define DNS_CODEC_ANSWER_LEN (16u) // Name pointer, type, class, TTL, length and an IPv4 address
+#define DNS_CODEC_SOA_LEN (36u)    // The NODATA authority record, names as pointers
+#define DNS_CODEC_OPT_LEN (11u)    // EDNS0 OPT record without options
+#define DNS_CODEC_UDP_MIN_SIZE (512u)   // Every client takes replies this large (RFC 1035)
+#define DNS_CODEC_EDNS_UDP_SIZE (512u)  // Advertised in replies, the query buffer of the DNS server
+#define DNS_CODEC_NEGATIVE_TTL_S (10u)  // How long a client may cache NODATA
+#define DNS_CODEC_TYPE_A (1u)
+#define DNS_CODEC_TYPE_SOA (6u)
+#define DNS_CODEC_TYPE_AAAA (28u)
+#define DNS_CODEC_TYPE_OPT (41u)
+#define DNS_CODEC_TYPE_SVCB (64u)
+#define DNS_CODEC_TYPE_HTTPS (65u)
+#define DNS_CODEC_CLASS_IN (1u)
+#define DNS_CODEC_RCODE_NOERROR (0u)
+#define DNS_CODEC_RCODE_SERVFAIL (2u)
+#define DNS_CODEC_RCODE_NXDOMAIN (3u)
+
+// An A record ready to be copied behind a reply
+typedef struct dns_codec_answer_template
+{
+    uint8_t record[DNS_CODEC_ANSWER_LEN];
+    uint8_t soa[DNS_CODEC_SOA_LEN]; // Authority record of NODATA replies
+    uint32_t addr;                  // Address in the record, network order
+} dns_codec_answer_template_t;
+
+// The first question of a message
+typedef struct dns_codec_question
+{
+    size_t name_offset; // Offset of the name, DNS_CODEC_HEADER_LEN
+    size_t end;         // Offset after the class, where the answers start
+    uint16_t type;
+    uint16_t class;
+} dns_codec_question_t;
+
+// The EDNS0 OPT record of a message
+typedef struct dns_codec_edns
+{
+    bool present;
+    size_t offset;     // Offset of the OPT record's type field, to rewrite the payload size
+    uint16_t udp_size; // Largest reply the sender takes over UDP
+    uint8_t version;
+    bool dnssec_ok;
+} dns_codec_edns_t;
+
+static inline uint16_t dns_codec_get16(const uint8_t *p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline void dns_codec_put16(uint8_t *p, uint16_t value)
+{
+    p[0] = (uint8_t)(value >> 8);
+    p[1] = (uint8_t)value;
+}
+
+/**
+ * @brief Largest UDP reply a client takes, negotiated with EDNS0
+ * @param edns OPT record of its query
+ * @return the advertised payload size, but at least DNS_CODEC_UDP_MIN_SIZE
+ */
+static inline size_t dns_codec_udp_limit(const dns_codec_edns_t *edns)
+{
+    return (edns->present && edns->udp_size > DNS_CODEC_UDP_MIN_SIZE) ? edns->udp_size : DNS_CODEC_UDP_MIN_SIZE;
+}
+
+/**
+ * @brief Steps over an encoded name without copying it
+ * @param packet start of the message
+ * @param len length of the message
+ * @param offset offset of the name
+ * @return offset of the first byte after the name, 0 if it runs past the end
+ * of the message or uses a reserved label type. A compression pointer ends the name.
+ */
+size_t dns_codec_skip_name(const uint8_t *packet, size_t len, size_t offset);
+
+/**
+ * @brief Reads the first question of a message
+ * @param packet start of the message
+ * @param len length of the message
+ * @param question destination
+ * @return false if the message has no complete question
+ */
+bool dns_codec_parse_question(const uint8_t *packet, size_t len, dns_codec_question_t *question);
+
+/**
+ * @brief Compares an uncompressed name with a dotted one, ignoring ASCII case
+ * @param packet start of the message
+ * @param len length of the message
+ * @param offset offset of the name
+ * @param name e.g. "captive.apple.com", without the final dot
+ * @return true if both are the same name
+ */
+bool dns_codec_name_equals(const uint8_t *packet, size_t len, size_t offset, const char *name);
+
+/**
+ * @brief Builds an answerless reply to the first question of a query, e.g.
+ * SERVFAIL when the upstream resolver cannot be asked
+ * @param query received datagram
+ * @param len length of query
+ * @param reply destination, either query itself (built in place) or not overlapping it
+ * @param reply_size capacity of reply
+ * @param rcode DNS_CODEC_RCODE_*
+ * @return reply length, -1 if the query has no complete question or the reply does not fit
+ */
+int dns_codec_build_error(const uint8_t *query, size_t len, uint8_t *reply, size_t reply_size, uint8_t rcode);
+
+/**
+ * @brief Finds the OPT record among the records after the questions
+ * @param packet start of the message
+ * @param len length of the message
+ * @param offset offset after the last question
+ * @param edns receives the OPT fields, present is false without one
+ * @return false if a record runs past the message or the OPT record is invalid
+ */
+bool dns_codec_parse_edns(const uint8_t *packet, size_t len, size_t offset, dns_codec_edns_t *edns);
+
+/**
+ * @brief Prepares the A record for an address
+ * @param tpl template to fill
+ * @param addr IPv4 address in network order, as in esp_ip4_addr_t
+ * @param ttl_s time to live of the answers in seconds
+ */
+void dns_codec_template_init(dns_codec_answer_template_t *tpl, uint32_t addr, uint32_t ttl_s);
+
+/**
+ * @brief Builds the reply to a query: its header and questions with the QR
+ * and RA flags set, the template record for every IN A question, the SOA
+ * record if there is none (NODATA) and an OPT record if the query had one. A
+ * query with an EDNS version other than 0 gets BADVERS without answers. A
+ * reply larger than the client's UDP limit (dns_codec_udp_limit) or than
+ * reply_size keeps only the questions and gets the TC flag.
+ * @param query received datagram
+ * @param len length of query
+ * @param reply destination, either query itself (built in place, the buffer
+ * the datagram was received into) or not overlapping it
+ * @param reply_size capacity of reply
+ * @param tpl record of the answers
+ * @return reply length, 0 for anything else than a standard query, -1 if the
+ * query is malformed or not even its questions fit
+ */
+int dns_codec_build_reply(const uint8_t *query, size_t len, uint8_t *reply, size_t reply_size,
+                          const dns_codec_answer_template_t *tpl);
+
+#endif // DNS_CODEC_H
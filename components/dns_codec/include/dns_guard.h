@@ -0,0 +1,92 @@
+/**
+ * @file dns_guard.h
+ *
+ * Per-source admission for the captive DNS server. A fixed table tracks the
+ * clients that sent queries: a token bucket that decides whether the next
+ * query is answered, the number of queries and refusals, and how many
+ * different names the client asked for in the current window (a 64 bit
+ * bitmap of name hashes, linear counting). A phone asks for a dozen names,
+ * a random-subdomain flood for a new one every query.
+ *
+ * When the table is full a new source replaces the least recently seen one,
+ * unless every entry was seen in the last DNS_GUARD_IDLE_US: then the new
+ * source is charged to a shared overflow bucket, so a flood from many
+ * (spoofed) addresses cannot evict the clients that are still active and
+ * gets one bucket in total. Not thread-safe, the guard belongs to the DNS task.
+ */
+#ifndef DNS_GUARD_H
+#define DNS_GUARD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define DNS_GUARD_TABLE_SIZE (16u)
+#define DNS_GUARD_TOKEN_SCALE (1000u)      // Tokens are kept in thousandths of a query
+#define DNS_GUARD_WINDOW_US (10000000ll)   // Name diversity is counted per window
+#define DNS_GUARD_IDLE_US (1000000ll)      // A source seen more recently is not evicted
+
+typedef struct dns_guard_config
+{
+    uint32_t per_second; // Refill rate in queries per second, 0 answers everything
+    uint32_t burst;      // Bucket size, queries answered back to back
+} dns_guard_config_t;
+
+typedef struct dns_guard_client
+{
+    uint32_t addr;       // IPv4 address in network order, 0 for the overflow bucket
+    uint32_t tokens;     // In DNS_GUARD_TOKEN_SCALE units
+    int64_t updated_us;  // Last query, both the refill and the LRU time
+    int64_t window_us;   // Start of the current name window
+    uint64_t names;      // Name hashes seen in the window, one bit each
+    uint16_t last_names; // Estimate of the previous window
+    uint32_t queries;    // Since the client got its entry
+    uint32_t refused;
+    bool used;
+} dns_guard_client_t;
+
+typedef struct dns_guard
+{
+    dns_guard_config_t config;
+    uint32_t refused;   // Queries not answered, all clients
+    uint32_t evicted;   // Clients dropped from the full table
+    uint32_t overflow;  // Queries charged to the shared bucket
+    dns_guard_client_t entries[DNS_GUARD_TABLE_SIZE];
+    dns_guard_client_t shared; // For sources without an entry
+} dns_guard_t;
+
+/**
+ * @brief Sets the limits and forgets all clients
+ * @param guard guard state
+ * @param config rate and burst, burst is kept at 1 or more
+ */
+void dns_guard_init(dns_guard_t *guard, const dns_guard_config_t *config);
+
+/**
+ * @brief Accounts a query to its source and takes a token
+ * @param guard guard state
+ * @param addr source address, network order
+ * @param query received datagram, its first name is hashed for the diversity count
+ * @param len length of query
+ * @param now_us current time in microseconds
+ * @return true if the query is to be answered, false to drop it
+ */
+bool dns_guard_admit(dns_guard_t *guard, uint32_t addr, const uint8_t *query, size_t len, int64_t now_us);
+
+/**
+ * @brief Estimates how many different names a client asked for
+ * @param client entry of the client
+ * @return the larger of the current and the previous window's count
+ */
+uint32_t dns_guard_distinct_names(const dns_guard_client_t *client);
+
+/**
+ * @brief Copies the clients with the most queries, the busiest first
+ * @param guard guard state
+ * @param top destination
+ * @param max capacity of top
+ * @return number of clients copied
+ */
+size_t dns_guard_top(const dns_guard_t *guard, dns_guard_client_t *top, size_t max);
+
+#endif // DNS_GUARD_H
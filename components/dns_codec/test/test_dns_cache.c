@@ -0,0 +1,159 @@
+#include <string.h>
+#include "unity.h"
+#include "dns_codec.h"
+#include "dns_cache.h"
+
+#define TEST_SECOND_US (1000000ll)
+
+static dns_cache_entry_t test_entries[2];
+static dns_cache_t test_cache;
+
+/*
+ * Writes a query for name (one label per '.') with a type
+ */
+static size_t test_query(uint8_t *msg, uint16_t id, const char *name, uint16_t type)
+{
+    size_t len = DNS_CODEC_HEADER_LEN;
+
+    memset(msg, 0, DNS_CODEC_HEADER_LEN);
+    dns_codec_put16(&msg[0], id);
+    msg[2] = 0x01; // RD
+    msg[5] = 1;
+    while (*name != '\0')
+    {
+        const char *dot = strchr(name, '.');
+        size_t label = (dot != NULL) ? (size_t)(dot - name) : strlen(name);
+        msg[len++] = (uint8_t)label;
+        memcpy(&msg[len], name, label);
+        len += label;
+        name += label + (dot != NULL);
+    }
+    msg[len++] = 0;
+    dns_codec_put16(&msg[len], type);
+    dns_codec_put16(&msg[len + 2], DNS_CODEC_CLASS_IN);
+    return len + 4;
+}
+
+/*
+ * Turns a query into a response with one A record, or with an SOA record in
+ * the authority section for rcode NXDOMAIN, plus an OPT record
+ */
+static size_t test_response(uint8_t *msg, size_t len, uint8_t rcode, uint32_t ttl)
+{
+    static const uint8_t soa_data[] = {0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 2, 0, 0, 0, 3, 0, 0, 0, 4, 0, 0, 0, 60};
+    static const uint8_t opt[] = {0, 0, 41, 0x04, 0xD0, 0, 0, 0, 0, 0, 0};
+
+    msg[2] = 0x81;
+    msg[3] = 0x80 | rcode;
+    uint8_t *rr = &msg[len];
+    rr[0] = 0xC0;
+    rr[1] = DNS_CODEC_HEADER_LEN;
+    dns_codec_put16(&rr[2], (rcode == DNS_CODEC_RCODE_NOERROR) ? DNS_CODEC_TYPE_A : DNS_CODEC_TYPE_SOA);
+    dns_codec_put16(&rr[4], DNS_CODEC_CLASS_IN);
+    dns_codec_put16(&rr[6], (uint16_t)(ttl >> 16));
+    dns_codec_put16(&rr[8], (uint16_t)ttl);
+    if (rcode == DNS_CODEC_RCODE_NOERROR)
+    {
+        dns_codec_put16(&rr[10], 4);
+        memcpy(&rr[12], "\x5d\xb8\xd8\x22", 4);
+        len += 16;
+        msg[7] = 1;
+    }
+    else
+    {
+        dns_codec_put16(&rr[10], sizeof(soa_data));
+        memcpy(&rr[12], soa_data, sizeof(soa_data));
+        len += 12 + sizeof(soa_data);
+        msg[9] = 1;
+    }
+    memcpy(&msg[len], opt, sizeof(opt));
+    msg[11] = 1;
+    return len + sizeof(opt);
+}
+
+TEST_CASE("DNS Cache: Hit with the client's id and case, TTLs aged, then expired", "[dns_codec]")
+{
+    uint8_t query[64], response[128], reply[128];
+
+    dns_cache_init(&test_cache, test_entries, 2);
+    size_t query_len = test_query(query, 0x1111, "example.com", DNS_CODEC_TYPE_A);
+    TEST_ASSERT_EQUAL(0, dns_cache_lookup(&test_cache, query, query_len, reply, sizeof(reply), 0));
+
+    memcpy(response, query, query_len);
+    size_t response_len = test_response(response, query_len, DNS_CODEC_RCODE_NOERROR, 120);
+    TEST_ASSERT_TRUE(dns_cache_store(&test_cache, response, response_len, 0));
+
+    // Another client, another id and case, 100 s later
+    query_len = test_query(query, 0x2222, "ExAmPle.COM", DNS_CODEC_TYPE_A);
+    query[2] = 0x00;
+    int len = dns_cache_lookup(&test_cache, query, query_len, reply, sizeof(reply), 100 * TEST_SECOND_US + 5);
+    TEST_ASSERT_EQUAL(query_len + 16, len); // Without the OPT record
+    TEST_ASSERT_EQUAL_HEX8(0x22, reply[1]);
+    TEST_ASSERT_EQUAL_HEX8(0x80, reply[2]);
+    TEST_ASSERT_EQUAL_HEX8(0, reply[11]);
+    TEST_ASSERT_EQUAL_MEMORY(query + DNS_CODEC_HEADER_LEN, reply + DNS_CODEC_HEADER_LEN, query_len - DNS_CODEC_HEADER_LEN);
+    TEST_ASSERT_EQUAL(20, reply[query_len + 9]);
+
+    // Answered in the buffer the query arrived in
+    memcpy(reply, query, query_len);
+    TEST_ASSERT_EQUAL(len, dns_cache_lookup(&test_cache, reply, query_len, reply, sizeof(reply), 100 * TEST_SECOND_US + 5));
+    TEST_ASSERT_EQUAL_HEX8(0x22, reply[1]);
+    TEST_ASSERT_EQUAL_MEMORY(query + DNS_CODEC_HEADER_LEN, reply + DNS_CODEC_HEADER_LEN, query_len - DNS_CODEC_HEADER_LEN);
+    TEST_ASSERT_EQUAL(20, reply[query_len + 9]);
+
+    // Other type, then past the TTL
+    query_len = test_query(query, 0x3333, "example.com", 28);
+    TEST_ASSERT_EQUAL(0, dns_cache_lookup(&test_cache, query, query_len, reply, sizeof(reply), TEST_SECOND_US));
+    query_len = test_query(query, 0x3333, "example.com", DNS_CODEC_TYPE_A);
+    TEST_ASSERT_EQUAL(0, dns_cache_lookup(&test_cache, query, query_len, reply, sizeof(reply), 120 * TEST_SECOND_US));
+    TEST_ASSERT_EQUAL(2, test_cache.stats.hits);
+    TEST_ASSERT_EQUAL(3, test_cache.stats.misses);
+}
+
+TEST_CASE("DNS Cache: Negative answers, errors and eviction", "[dns_codec]")
+{
+    uint8_t query[64], response[128], reply[128];
+
+    dns_cache_init(&test_cache, test_entries, 2);
+
+    // NXDOMAIN lives for the SOA minimum (60 s) rather than the SOA's TTL
+    size_t query_len = test_query(query, 1, "nothing.example", DNS_CODEC_TYPE_A);
+    memcpy(response, query, query_len);
+    size_t response_len = test_response(response, query_len, DNS_CODEC_RCODE_NXDOMAIN, 900);
+    TEST_ASSERT_TRUE(dns_cache_store(&test_cache, response, response_len, 0));
+    TEST_ASSERT_GREATER_THAN(0, dns_cache_lookup(&test_cache, query, query_len, reply, sizeof(reply), 59 * TEST_SECOND_US));
+    TEST_ASSERT_EQUAL_HEX8(0x83, reply[3]);
+    TEST_ASSERT_EQUAL(0, dns_cache_lookup(&test_cache, query, query_len, reply, sizeof(reply), 60 * TEST_SECOND_US));
+
+    // SERVFAIL, truncated and zero TTL answers are not kept
+    response[3] = 0x82;
+    TEST_ASSERT_FALSE(dns_cache_store(&test_cache, response, response_len, 0));
+    memcpy(response, query, query_len);
+    response_len = test_response(response, query_len, DNS_CODEC_RCODE_NOERROR, 0);
+    TEST_ASSERT_FALSE(dns_cache_store(&test_cache, response, response_len, 0));
+    response_len = test_response(response, query_len, DNS_CODEC_RCODE_NOERROR, 30);
+    response[2] |= 0x02;
+    TEST_ASSERT_FALSE(dns_cache_store(&test_cache, response, response_len, 0));
+    TEST_ASSERT_EQUAL(3, test_cache.stats.uncacheable);
+
+    // A third name replaces the least recently used of two
+    const char *names[] = {"a.example", "b.example", "c.example"};
+    for (int i = 0; i < 3; i++)
+    {
+        query_len = test_query(query, 1, names[i], DNS_CODEC_TYPE_A);
+        memcpy(response, query, query_len);
+        response_len = test_response(response, query_len, DNS_CODEC_RCODE_NOERROR, 300);
+        TEST_ASSERT_TRUE(dns_cache_store(&test_cache, response, response_len, (100 + i) * TEST_SECOND_US));
+        if (i == 1)
+        {
+            // a.example is used again, b.example is the one to go
+            query_len = test_query(query, 1, names[0], DNS_CODEC_TYPE_A);
+            TEST_ASSERT_GREATER_THAN(0, dns_cache_lookup(&test_cache, query, query_len, reply, sizeof(reply), 101 * TEST_SECOND_US + 1));
+        }
+    }
+    query_len = test_query(query, 1, names[1], DNS_CODEC_TYPE_A);
+    TEST_ASSERT_EQUAL(0, dns_cache_lookup(&test_cache, query, query_len, reply, sizeof(reply), 103 * TEST_SECOND_US));
+    query_len = test_query(query, 1, names[0], DNS_CODEC_TYPE_A);
+    TEST_ASSERT_GREATER_THAN(0, dns_cache_lookup(&test_cache, query, query_len, reply, sizeof(reply), 103 * TEST_SECOND_US));
+    TEST_ASSERT_EQUAL(1, test_cache.stats.evicted);
+}
@@ -0,0 +1,225 @@
+#include <string.h>
+#include "unity.h"
+#include "dns_codec.h"
+
+#define TEST_AP_ADDR (0x0104A8C0u) // 192.168.4.1 in network order
+
+// Query 0x1234 with RD set: connectivitycheck.gstatic.com A IN
+static const uint8_t test_query_a[] = {
+    0x12, 0x34, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    17, 'c', 'o', 'n', 'n', 'e', 'c', 't', 'i', 'v', 'i', 't', 'y', 'c', 'h', 'e', 'c', 'k',
+    7, 'g', 's', 't', 'a', 't', 'i', 'c', 3, 'c', 'o', 'm', 0,
+    0x00, 0x01, 0x00, 0x01};
+
+TEST_CASE("DNS Codec: A question answered from the template", "[dns_codec]")
+{
+    dns_codec_answer_template_t tpl;
+    uint8_t reply[64];
+
+    dns_codec_template_init(&tpl, TEST_AP_ADDR, 300);
+    int len = dns_codec_build_reply(test_query_a, sizeof(test_query_a), reply, sizeof(reply), &tpl);
+    TEST_ASSERT_EQUAL(sizeof(test_query_a) + DNS_CODEC_ANSWER_LEN, len);
+
+    // Same id and question, QR set, one answer
+    TEST_ASSERT_EQUAL_HEX8(0x12, reply[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x81, reply[2]);
+    TEST_ASSERT_EQUAL_HEX8(0x01, reply[7]);
+    TEST_ASSERT_EQUAL_MEMORY(test_query_a + 12, reply + 12, sizeof(test_query_a) - 12);
+
+    const uint8_t answer[] = {0xC0, 0x0C, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x01, 0x2C, 0x00, 0x04, 192, 168, 4, 1};
+    TEST_ASSERT_EQUAL_MEMORY(answer, reply + sizeof(test_query_a), sizeof(answer));
+
+    // A new address only changes the record
+    dns_codec_template_init(&tpl, 0x0101A8C0u, 300);
+    TEST_ASSERT_EQUAL(len, dns_codec_build_reply(test_query_a, sizeof(test_query_a), reply, sizeof(reply), &tpl));
+    TEST_ASSERT_EQUAL_HEX8(1, reply[len - 2]);
+}
+
+TEST_CASE("DNS Codec: Other types get NODATA, opcodes and flags", "[dns_codec]")
+{
+    dns_codec_answer_template_t tpl;
+    uint8_t query[sizeof(test_query_a)];
+    uint8_t reply[128];
+
+    dns_codec_template_init(&tpl, TEST_AP_ADDR, 300);
+
+    // AAAA and HTTPS: no answer, an SOA with the short negative TTL in the authority section
+    const uint8_t types[] = {DNS_CODEC_TYPE_AAAA, DNS_CODEC_TYPE_HTTPS};
+    for (size_t t = 0; t < sizeof(types); t++)
+    {
+        memcpy(query, test_query_a, sizeof(query));
+        query[sizeof(query) - 3] = types[t];
+        int len = dns_codec_build_reply(query, sizeof(query), reply, sizeof(reply), &tpl);
+        TEST_ASSERT_EQUAL(sizeof(query) + DNS_CODEC_SOA_LEN, len);
+        TEST_ASSERT_EQUAL_HEX8(0x80, reply[3]); // NOERROR, recursion available
+        TEST_ASSERT_EQUAL_HEX8(0, reply[7]);
+        TEST_ASSERT_EQUAL_HEX8(1, reply[9]);
+        TEST_ASSERT_EQUAL_HEX8(0, reply[11]);
+        const uint8_t soa[] = {0xC0, 0x0C, 0x00, 0x06, 0x00, 0x01, 0x00, 0x00, 0x00, DNS_CODEC_NEGATIVE_TTL_S, 0x00, 24};
+        TEST_ASSERT_EQUAL_MEMORY(soa, reply + sizeof(query), sizeof(soa));
+        TEST_ASSERT_EQUAL_HEX8(DNS_CODEC_NEGATIVE_TTL_S, reply[len - 1]);
+    }
+
+    // A in another class than IN is NODATA as well
+    memcpy(query, test_query_a, sizeof(query));
+    query[sizeof(query) - 1] = 3;
+    TEST_ASSERT_EQUAL(sizeof(query) + DNS_CODEC_SOA_LEN, dns_codec_build_reply(query, sizeof(query), reply, sizeof(reply), &tpl));
+
+    // AD and CD in the second flags byte do not make it a non-standard query, nor are they echoed
+    memcpy(query, test_query_a, sizeof(query));
+    query[3] = 0x30;
+    TEST_ASSERT_EQUAL(sizeof(query) + DNS_CODEC_ANSWER_LEN, dns_codec_build_reply(query, sizeof(query), reply, sizeof(reply), &tpl));
+    TEST_ASSERT_EQUAL_HEX8(0x80, reply[3]);
+
+    // STATUS opcode is ignored
+    query[2] = 0x10;
+    TEST_ASSERT_EQUAL(0, dns_codec_build_reply(query, sizeof(query), reply, sizeof(reply), &tpl));
+}
+
+TEST_CASE("DNS Codec: EDNS0 queries get an OPT record back", "[dns_codec]")
+{
+    dns_codec_answer_template_t tpl;
+    dns_codec_edns_t edns;
+    uint8_t query[sizeof(test_query_a) + DNS_CODEC_OPT_LEN];
+    uint8_t reply[128];
+
+    // 1232 byte payload, DO set, as systemd-resolved and Apple's resolver send it
+    const uint8_t opt[] = {0x00, 0x00, 0x29, 0x04, 0xD0, 0x00, 0x00, 0x80, 0x00, 0x00, 0x00};
+    memcpy(query, test_query_a, sizeof(test_query_a));
+    memcpy(query + sizeof(test_query_a), opt, sizeof(opt));
+    query[11] = 1;
+
+    TEST_ASSERT_TRUE(dns_codec_parse_edns(query, sizeof(query), sizeof(test_query_a), &edns));
+    TEST_ASSERT_TRUE(edns.present);
+    TEST_ASSERT_EQUAL(1232, edns.udp_size);
+    TEST_ASSERT_TRUE(edns.dnssec_ok);
+
+    // The answer goes between the question and the OPT record, not after the query's
+    dns_codec_template_init(&tpl, TEST_AP_ADDR, 300);
+    int len = dns_codec_build_reply(query, sizeof(query), reply, sizeof(reply), &tpl);
+    TEST_ASSERT_EQUAL(sizeof(query) + DNS_CODEC_ANSWER_LEN, len);
+    TEST_ASSERT_EQUAL_HEX8(1, reply[7]);
+    TEST_ASSERT_EQUAL_HEX8(1, reply[11]);
+    TEST_ASSERT_EQUAL_HEX8(0xC0, reply[sizeof(test_query_a)]);
+    const uint8_t reply_opt[] = {0x00, 0x00, 0x29, DNS_CODEC_EDNS_UDP_SIZE >> 8, DNS_CODEC_EDNS_UDP_SIZE & 0xFF,
+                                 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    TEST_ASSERT_EQUAL_MEMORY(reply_opt, reply + len - DNS_CODEC_OPT_LEN, DNS_CODEC_OPT_LEN);
+
+    // Version 1 gets BADVERS (extended RCODE 1) and no answer
+    query[sizeof(test_query_a) + 6] = 1;
+    len = dns_codec_build_reply(query, sizeof(query), reply, sizeof(reply), &tpl);
+    TEST_ASSERT_EQUAL(sizeof(query), len);
+    TEST_ASSERT_EQUAL_HEX8(0, reply[7]);
+    TEST_ASSERT_EQUAL_HEX8(0, reply[9]);
+    TEST_ASSERT_EQUAL_HEX8(1, reply[len - 6]);
+
+    // An OPT record cut short, or two of them, make the query malformed
+    TEST_ASSERT_EQUAL(-1, dns_codec_build_reply(query, sizeof(query) - 1, reply, sizeof(reply), &tpl));
+    TEST_ASSERT_FALSE(dns_codec_parse_edns(query, sizeof(query) - 1, sizeof(test_query_a), &edns));
+    uint8_t twice[sizeof(query) + DNS_CODEC_OPT_LEN];
+    memcpy(twice, query, sizeof(query));
+    memcpy(twice + sizeof(query), opt, sizeof(opt));
+    twice[11] = 2;
+    TEST_ASSERT_FALSE(dns_codec_parse_edns(twice, sizeof(twice), sizeof(test_query_a), &edns));
+}
+
+TEST_CASE("DNS Codec: Replies in place and within the client's UDP limit", "[dns_codec]")
+{
+    dns_codec_answer_template_t tpl;
+    static uint8_t query[1024], reply[1024];
+
+    dns_codec_template_init(&tpl, TEST_AP_ADDR, 300);
+
+    // Built in the receive buffer, the same bytes as into a separate one
+    memcpy(query, test_query_a, sizeof(test_query_a));
+    int len = dns_codec_build_reply(query, sizeof(test_query_a), reply, DNS_CODEC_UDP_MIN_SIZE, &tpl);
+    TEST_ASSERT_EQUAL(len, dns_codec_build_reply(query, sizeof(test_query_a), query, DNS_CODEC_UDP_MIN_SIZE, &tpl));
+    TEST_ASSERT_EQUAL_MEMORY(reply, query, len);
+
+    // 30 A questions, the later ones pointing at the first: 480 bytes of answers
+    const uint8_t again[] = {0xC0, 0x0C, 0x00, 0x01, 0x00, 0x01};
+    size_t query_len = sizeof(test_query_a);
+    memcpy(query, test_query_a, sizeof(test_query_a));
+    for (int i = 1; i < 30; i++, query_len += sizeof(again))
+    {
+        memcpy(query + query_len, again, sizeof(again));
+    }
+    query[5] = 30;
+
+    // Without EDNS0 only 512 bytes: the questions with TC set
+    len = dns_codec_build_reply(query, query_len, reply, sizeof(reply), &tpl);
+    TEST_ASSERT_EQUAL(query_len, len);
+    TEST_ASSERT_EQUAL_HEX8(0x83, reply[2]);
+    TEST_ASSERT_EQUAL_HEX8(0, reply[7]);
+    TEST_ASSERT_EQUAL_HEX8(0, reply[9]);
+
+    // A client taking 1232 bytes gets them all, unless the buffer is smaller
+    const uint8_t opt[] = {0x00, 0x00, 0x29, 0x04, 0xD0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    memcpy(query + query_len, opt, sizeof(opt));
+    query[11] = 1;
+    query_len += sizeof(opt);
+    len = dns_codec_build_reply(query, query_len, reply, sizeof(reply), &tpl);
+    TEST_ASSERT_EQUAL(query_len + 30 * DNS_CODEC_ANSWER_LEN, len);
+    TEST_ASSERT_EQUAL_HEX8(0x81, reply[2]);
+    TEST_ASSERT_EQUAL_HEX8(30, reply[7]);
+    TEST_ASSERT_EQUAL(query_len, dns_codec_build_reply(query, query_len, query, DNS_CODEC_UDP_MIN_SIZE, &tpl));
+    TEST_ASSERT_EQUAL_HEX8(0x83, query[2]);
+    TEST_ASSERT_EQUAL_HEX8(1, query[11]);
+}
+
+TEST_CASE("DNS Codec: Malformed queries", "[dns_codec]")
+{
+    dns_codec_answer_template_t tpl;
+    uint8_t query[sizeof(test_query_a)];
+    uint8_t reply[64];
+
+    dns_codec_template_init(&tpl, TEST_AP_ADDR, 300);
+
+    // Short header, truncated question, question count beyond the datagram
+    TEST_ASSERT_EQUAL(-1, dns_codec_build_reply(test_query_a, 11, reply, sizeof(reply), &tpl));
+    TEST_ASSERT_EQUAL(-1, dns_codec_build_reply(test_query_a, sizeof(test_query_a) - 2, reply, sizeof(reply), &tpl));
+    memcpy(query, test_query_a, sizeof(query));
+    query[5] = 2;
+    TEST_ASSERT_EQUAL(-1, dns_codec_build_reply(query, sizeof(query), reply, sizeof(reply), &tpl));
+
+    // A label running past the end, and a reply without room for the question
+    memcpy(query, test_query_a, sizeof(query));
+    query[12] = 60;
+    TEST_ASSERT_EQUAL(-1, dns_codec_build_reply(query, sizeof(query), reply, sizeof(reply), &tpl));
+    TEST_ASSERT_EQUAL(-1, dns_codec_build_reply(test_query_a, sizeof(test_query_a), reply, sizeof(test_query_a) - 1, &tpl));
+
+    // A compressed name pointing back at the first question is fine
+    uint8_t two[sizeof(test_query_a) + 6];
+    memcpy(two, test_query_a, sizeof(test_query_a));
+    two[5] = 2;
+    const uint8_t second[] = {0xC0, 0x0C, 0x00, 0x01, 0x00, 0x01};
+    memcpy(two + sizeof(test_query_a), second, sizeof(second));
+    uint8_t big[128];
+    int len = dns_codec_build_reply(two, sizeof(two), big, sizeof(big), &tpl);
+    TEST_ASSERT_EQUAL(sizeof(two) + 2 * DNS_CODEC_ANSWER_LEN, len);
+    TEST_ASSERT_EQUAL_HEX8(sizeof(test_query_a), big[len - DNS_CODEC_ANSWER_LEN + 1]);
+}
+
+TEST_CASE("DNS Codec: Question, name comparison and error replies", "[dns_codec]")
+{
+    dns_codec_question_t question;
+    uint8_t reply[64];
+
+    TEST_ASSERT_TRUE(dns_codec_parse_question(test_query_a, sizeof(test_query_a), &question));
+    TEST_ASSERT_EQUAL(sizeof(test_query_a), question.end);
+    TEST_ASSERT_EQUAL(DNS_CODEC_TYPE_A, question.type);
+
+    TEST_ASSERT_TRUE(dns_codec_name_equals(test_query_a, sizeof(test_query_a), 12, "connectivitycheck.gstatic.com"));
+    TEST_ASSERT_TRUE(dns_codec_name_equals(test_query_a, sizeof(test_query_a), 12, "ConnectivityCheck.GStatic.com"));
+    TEST_ASSERT_FALSE(dns_codec_name_equals(test_query_a, sizeof(test_query_a), 12, "connectivitycheck.gstatic.co"));
+    TEST_ASSERT_FALSE(dns_codec_name_equals(test_query_a, sizeof(test_query_a), 12, "connectivitycheck.gstatic.com.au"));
+    TEST_ASSERT_FALSE(dns_codec_name_equals(test_query_a, sizeof(test_query_a), 12, "gstatic.com"));
+
+    // Header and question only, counts fixed up
+    int len = dns_codec_build_error(test_query_a, sizeof(test_query_a), reply, sizeof(reply), DNS_CODEC_RCODE_SERVFAIL);
+    TEST_ASSERT_EQUAL(sizeof(test_query_a), len);
+    TEST_ASSERT_EQUAL_HEX8(0x81, reply[2]);
+    TEST_ASSERT_EQUAL_HEX8(0x82, reply[3]);
+    TEST_ASSERT_EQUAL_HEX8(0, reply[7]);
+    TEST_ASSERT_EQUAL(-1, dns_codec_build_error(test_query_a, 20, reply, sizeof(reply), DNS_CODEC_RCODE_SERVFAIL));
+}
@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "dns_codec.h"
+#include "dns_guard.h"
+
+#define TEST_CLIENT_A (0x0204A8C0u) // 192.168.4.2 in network order
+#define TEST_CLIENT_B (0x0304A8C0u)
+
+static dns_guard_t test_guard;
+
+/*
+ * Writes an A query for a one-label name under example.com
+ */
+static size_t test_query(uint8_t *msg, const char *label)
+{
+    size_t len = DNS_CODEC_HEADER_LEN;
+    size_t label_len = strlen(label);
+
+    memset(msg, 0, DNS_CODEC_HEADER_LEN);
+    msg[5] = 1;
+    msg[len++] = (uint8_t)label_len;
+    memcpy(&msg[len], label, label_len);
+    len += label_len;
+    memcpy(&msg[len], "\x07" "example" "\x03" "com", 13);
+    len += 13;
+    msg[len++] = 0;
+    dns_codec_put16(&msg[len], DNS_CODEC_TYPE_A);
+    dns_codec_put16(&msg[len + 2], DNS_CODEC_CLASS_IN);
+    return len + 4;
+}
+
+TEST_CASE("DNS Guard: Burst, refusal and refill per source", "[dns_codec]")
+{
+    const dns_guard_config_t config = {.per_second = 10, .burst = 5};
+    uint8_t query[64];
+    size_t len = test_query(query, "www");
+    int64_t now_us = 1000000;
+
+    dns_guard_init(&test_guard, &config);
+    for (int i = 0; i < 5; i++)
+    {
+        TEST_ASSERT_TRUE(dns_guard_admit(&test_guard, TEST_CLIENT_A, query, len, now_us));
+    }
+    TEST_ASSERT_FALSE(dns_guard_admit(&test_guard, TEST_CLIENT_A, query, len, now_us));
+
+    // Another source has its own bucket
+    TEST_ASSERT_TRUE(dns_guard_admit(&test_guard, TEST_CLIENT_B, query, len, now_us));
+
+    // 10 per second: 50 ms is not enough for a token, 100 ms is
+    TEST_ASSERT_FALSE(dns_guard_admit(&test_guard, TEST_CLIENT_A, query, len, now_us + 50000));
+    TEST_ASSERT_TRUE(dns_guard_admit(&test_guard, TEST_CLIENT_A, query, len, now_us + 100000));
+    TEST_ASSERT_EQUAL_UINT32(2, test_guard.refused);
+
+    dns_guard_client_t top[2];
+    TEST_ASSERT_EQUAL(2, dns_guard_top(&test_guard, top, 2));
+    TEST_ASSERT_EQUAL_HEX32(TEST_CLIENT_A, top[0].addr);
+    TEST_ASSERT_EQUAL_UINT32(8, top[0].queries);
+    TEST_ASSERT_EQUAL_UINT32(2, top[0].refused);
+    TEST_ASSERT_EQUAL_HEX32(TEST_CLIENT_B, top[1].addr);
+
+    // A rate of 0 answers everything and still counts
+    const dns_guard_config_t off = {.per_second = 0, .burst = 1};
+    dns_guard_init(&test_guard, &off);
+    for (int i = 0; i < 100; i++)
+    {
+        TEST_ASSERT_TRUE(dns_guard_admit(&test_guard, TEST_CLIENT_A, query, len, now_us));
+    }
+    TEST_ASSERT_EQUAL(1, dns_guard_top(&test_guard, top, 2));
+    TEST_ASSERT_EQUAL_UINT32(100, top[0].queries);
+}
+
+TEST_CASE("DNS Guard: Name diversity, eviction and the shared bucket", "[dns_codec]")
+{
+    const dns_guard_config_t config = {.per_second = 1000, .burst = 1000};
+    dns_guard_client_t top[1];
+    uint8_t query[64];
+    char label[16];
+    int64_t now_us = 1000000;
+
+    dns_guard_init(&test_guard, &config);
+
+    // The same name over and over is one name, random labels are many
+    size_t len = test_query(query, "CAPTIVE");
+    for (int i = 0; i < 50; i++)
+    {
+        dns_guard_admit(&test_guard, TEST_CLIENT_A, query, len, now_us);
+    }
+    len = test_query(query, "captive");
+    dns_guard_admit(&test_guard, TEST_CLIENT_A, query, len, now_us);
+    for (int i = 0; i < 40; i++)
+    {
+        snprintf(label, sizeof(label), "x%08x", (unsigned)(i * 2654435761u));
+        len = test_query(query, label);
+        dns_guard_admit(&test_guard, TEST_CLIENT_B, query, len, now_us);
+    }
+    for (size_t i = 0; i < DNS_GUARD_TABLE_SIZE; i++)
+    {
+        if (test_guard.entries[i].addr == TEST_CLIENT_A)
+        {
+            TEST_ASSERT_EQUAL_UINT32(1, dns_guard_distinct_names(&test_guard.entries[i]));
+        }
+        else if (test_guard.entries[i].addr == TEST_CLIENT_B)
+        {
+            TEST_ASSERT_UINT32_WITHIN(12, 40, dns_guard_distinct_names(&test_guard.entries[i]));
+        }
+    }
+
+    // The previous window's count is kept for a window
+    now_us += DNS_GUARD_WINDOW_US;
+    dns_guard_admit(&test_guard, TEST_CLIENT_A, query, len, now_us);
+    dns_guard_admit(&test_guard, TEST_CLIENT_B, query, len, now_us);
+    TEST_ASSERT_EQUAL(1, dns_guard_top(&test_guard, top, 1));
+    TEST_ASSERT_EQUAL_HEX32(TEST_CLIENT_A, top[0].addr);
+    for (size_t i = 0; i < DNS_GUARD_TABLE_SIZE; i++)
+    {
+        if (test_guard.entries[i].addr == TEST_CLIENT_B)
+        {
+            TEST_ASSERT_GREATER_THAN(20, dns_guard_distinct_names(&test_guard.entries[i]));
+        }
+    }
+
+    // A full table of active sources: new ones share a bucket instead of evicting
+    for (uint32_t i = 0; i < DNS_GUARD_TABLE_SIZE + 4; i++)
+    {
+        dns_guard_admit(&test_guard, 0x0A000000u + i, query, len, now_us);
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, test_guard.evicted);
+    TEST_ASSERT_EQUAL_UINT32(6, test_guard.overflow);
+    TEST_ASSERT_TRUE(test_guard.shared.used);
+
+    // Once the oldest entries are idle they make room
+    now_us += DNS_GUARD_IDLE_US;
+    dns_guard_admit(&test_guard, 0x0B000000u, query, len, now_us);
+    TEST_ASSERT_EQUAL_UINT32(1, test_guard.evicted);
+}
@@ -0,0 +1,140 @@
+/**
+ * @file metrics.h
+ *
+ * Lock-free counters and fixed-bucket latency histograms, rendered in the
+ * Prometheus text exposition format. Recording a value is one or two atomic
+ * additions, all formatting work happens when the metrics are scraped.
+ */
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include "esp_err.h"
+
+#define METRICS_LATENCY_BUCKET_COUNT (12u) // Finite buckets, +Inf comes on top
+#define METRICS_WRITER_BUFFER_SIZE (512u)  // Output is flushed in pieces of at most this size
+
+// Upper bounds of the latency buckets in microseconds, 0.5 ms to 2.5 s
+extern const uint32_t metrics_latency_bounds_us[METRICS_LATENCY_BUCKET_COUNT];
+
+typedef struct metrics_counter
+{
+    atomic_uint value;
+} metrics_counter_t;
+
+typedef struct metrics_histogram
+{
+    atomic_uint buckets[METRICS_LATENCY_BUCKET_COUNT + 1]; // Per bucket, not cumulative
+    _Atomic uint64_t sum_us;
+} metrics_histogram_t;
+
+// Count and sum only, for durations that do not fit the latency buckets
+typedef struct metrics_summary
+{
+    atomic_uint count;
+    _Atomic uint64_t sum_us;
+} metrics_summary_t;
+
+/*
+ * Receives rendered output
+ * @return ESP_OK to continue, any other value stops rendering
+ */
+typedef esp_err_t (*metrics_flush_t)(const char *data, size_t len, void *ctx);
+
+typedef struct metrics_writer
+{
+    metrics_flush_t flush;
+    void *ctx;
+    esp_err_t error; // First flush error, later output is dropped
+    size_t len;
+    char buffer[METRICS_WRITER_BUFFER_SIZE];
+} metrics_writer_t;
+
+/**
+ * @brief Adds to a counter
+ * @param counter counter to increment
+ * @param value amount to add
+ */
+static inline void metrics_counter_add(metrics_counter_t *counter, uint32_t value)
+{
+    atomic_fetch_add_explicit(&counter->value, value, memory_order_relaxed);
+}
+
+static inline uint32_t metrics_counter_get(metrics_counter_t *counter)
+{
+    return atomic_load_explicit(&counter->value, memory_order_relaxed);
+}
+
+/**
+ * @brief Records one latency sample
+ * @param histogram histogram to update
+ * @param us observed latency in microseconds
+ */
+void metrics_histogram_observe(metrics_histogram_t *histogram, uint32_t us);
+
+/**
+ * @brief Records one duration
+ * @param summary summary to update
+ * @param us observed duration in microseconds
+ */
+static inline void metrics_summary_observe(metrics_summary_t *summary, uint64_t us)
+{
+    atomic_fetch_add_explicit(&summary->sum_us, us, memory_order_relaxed);
+    atomic_fetch_add_explicit(&summary->count, 1, memory_order_relaxed);
+}
+
+/**
+ * @brief Prepares a writer, nothing is sent until the buffer fills up
+ * @param writer writer state, about 0.5 KB
+ * @param flush output callback, e.g. a wrapper around httpd_resp_send_chunk
+ * @param ctx handed to flush
+ */
+void metrics_writer_init(metrics_writer_t *writer, metrics_flush_t flush, void *ctx);
+
+/**
+ * @brief Writes the HELP and TYPE lines of a metric family
+ * @param writer writer state
+ * @param name metric name
+ * @param type "counter", "gauge" or "histogram"
+ * @param help one line description
+ */
+void metrics_write_family(metrics_writer_t *writer, const char *name, const char *type, const char *help);
+
+/**
+ * @brief Writes one sample line
+ * @param writer writer state
+ * @param name metric name
+ * @param labels label list without braces, e.g. "route=\"/\"", or NULL
+ * @param value sample value
+ */
+void metrics_write_sample(metrics_writer_t *writer, const char *name, const char *labels, uint64_t value);
+
+/**
+ * @brief Writes the bucket, sum and count lines of a latency histogram, in seconds
+ * @param writer writer state
+ * @param name metric name without the _bucket/_sum/_count suffix
+ * @param labels label list without braces, or NULL
+ * @param histogram histogram to render
+ */
+void metrics_write_histogram(metrics_writer_t *writer, const char *name, const char *labels,
+                             metrics_histogram_t *histogram);
+
+/**
+ * @brief Writes the sum (in seconds) and count lines of a summary
+ * @param writer writer state
+ * @param name metric name without the _sum/_count suffix
+ * @param labels label list without braces, or NULL
+ * @param summary summary to render
+ */
+void metrics_write_summary(metrics_writer_t *writer, const char *name, const char *labels, metrics_summary_t *summary);
+
+/**
+ * @brief Flushes what is left in the buffer
+ * @param writer writer state
+ * @return ESP_OK, or the first error returned by the flush callback
+ */
+esp_err_t metrics_writer_finish(metrics_writer_t *writer);
+
+#endif // METRICS_H
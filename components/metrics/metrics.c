@@ -0,0 +1,150 @@
+/**
+ * @file metrics.c
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include "esp_log.h"
+#include "metrics.h"
+
+static const char *TAG = "metrics";
+
+const uint32_t metrics_latency_bounds_us[METRICS_LATENCY_BUCKET_COUNT] = {
+    500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000};
+
+void metrics_histogram_observe(metrics_histogram_t *histogram, uint32_t us)
+{
+    size_t bucket = 0;
+
+    while (bucket < METRICS_LATENCY_BUCKET_COUNT && us > metrics_latency_bounds_us[bucket])
+    {
+        bucket++;
+    }
+    atomic_fetch_add_explicit(&histogram->buckets[bucket], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->sum_us, us, memory_order_relaxed);
+}
+
+void metrics_writer_init(metrics_writer_t *writer, metrics_flush_t flush, void *ctx)
+{
+    writer->flush = flush;
+    writer->ctx = ctx;
+    writer->error = ESP_OK;
+    writer->len = 0;
+}
+
+/*
+ * Hands the buffered output to the flush callback
+ */
+static void metrics_writer_flush(metrics_writer_t *writer)
+{
+    if (writer->len > 0 && writer->error == ESP_OK)
+    {
+        writer->error = writer->flush(writer->buffer, writer->len, writer->ctx);
+        if (writer->error != ESP_OK)
+        {
+            ESP_LOGW(TAG, "Output aborted: %s", esp_err_to_name(writer->error));
+        }
+    }
+    writer->len = 0;
+}
+
+/*
+ * Appends one formatted line, flushing first if it does not fit anymore
+ */
+static void metrics_writer_printf(metrics_writer_t *writer, const char *format, ...)
+{
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        size_t space = sizeof(writer->buffer) - writer->len;
+        va_list args;
+        va_start(args, format);
+        int len = vsnprintf(writer->buffer + writer->len, space, format, args);
+        va_end(args);
+
+        if (len >= 0 && (size_t)len < space)
+        {
+            writer->len += len;
+            return;
+        }
+        // Lines are far shorter than the buffer, so one flush always makes room
+        metrics_writer_flush(writer);
+    }
+    ESP_LOGW(TAG, "Line dropped, longer than %u bytes", (unsigned)METRICS_WRITER_BUFFER_SIZE);
+}
+
+void metrics_write_family(metrics_writer_t *writer, const char *name, const char *type, const char *help)
+{
+    metrics_writer_printf(writer, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+void metrics_write_sample(metrics_writer_t *writer, const char *name, const char *labels, uint64_t value)
+{
+    if (labels != NULL)
+    {
+        metrics_writer_printf(writer, "%s{%s} %llu\n", name, labels, (unsigned long long)value);
+    }
+    else
+    {
+        metrics_writer_printf(writer, "%s %llu\n", name, (unsigned long long)value);
+    }
+}
+
+/*
+ * Writes the _sum line in seconds and the _count line shared by histograms and summaries
+ * @param labels label list without braces, "" for none
+ */
+static void metrics_write_sum_count(metrics_writer_t *writer, const char *name, const char *labels,
+                                    uint64_t sum_us, uint64_t count)
+{
+    const char *open = (*labels != '\0') ? "{" : "";
+    const char *close = (*labels != '\0') ? "}" : "";
+
+    metrics_writer_printf(writer, "%s_sum%s%s%s %llu.%06llu\n", name, open, labels, close,
+                          (unsigned long long)(sum_us / 1000000u), (unsigned long long)(sum_us % 1000000u));
+    metrics_writer_printf(writer, "%s_count%s%s%s %llu\n", name, open, labels, close, (unsigned long long)count);
+}
+
+void metrics_write_histogram(metrics_writer_t *writer, const char *name, const char *labels,
+                             metrics_histogram_t *histogram)
+{
+    const char *separator = (labels != NULL) ? "," : "";
+    uint64_t cumulative = 0;
+
+    labels = (labels != NULL) ? labels : "";
+
+    // Buckets are read one by one while requests may still be recorded, the
+    // count is derived from the same reads so that it matches the +Inf bucket
+    for (size_t i = 0; i <= METRICS_LATENCY_BUCKET_COUNT; i++)
+    {
+        cumulative += atomic_load_explicit(&histogram->buckets[i], memory_order_relaxed);
+        if (i < METRICS_LATENCY_BUCKET_COUNT)
+        {
+            metrics_writer_printf(writer, "%s_bucket{%s%sle=\"%g\"} %llu\n", name, labels, separator,
+                                  metrics_latency_bounds_us[i] / 1e6, (unsigned long long)cumulative);
+        }
+        else
+        {
+            metrics_writer_printf(writer, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name, labels, separator,
+                                  (unsigned long long)cumulative);
+        }
+    }
+
+    metrics_write_sum_count(writer, name, labels, atomic_load_explicit(&histogram->sum_us, memory_order_relaxed),
+                            cumulative);
+}
+
+void metrics_write_summary(metrics_writer_t *writer, const char *name, const char *labels, metrics_summary_t *summary)
+{
+    // Count first: an observation landing in between shows up in the sum only on the next scrape
+    uint64_t count = atomic_load_explicit(&summary->count, memory_order_relaxed);
+    uint64_t sum_us = atomic_load_explicit(&summary->sum_us, memory_order_relaxed);
+
+    metrics_write_sum_count(writer, name, (labels != NULL) ? labels : "", sum_us, count);
+}
+
+esp_err_t metrics_writer_finish(metrics_writer_t *writer)
+{
+    metrics_writer_flush(writer);
+    return writer->error;
+}
@@ -0,0 +1,121 @@
+#include "unity.h"
+#include "esp_log.h"
+#include "metrics.h"
+#include <string.h>
+
+static char test_out[4096];
+static size_t test_out_len = 0;
+static size_t test_flushes = 0;
+
+static esp_err_t test_flush(const char *data, size_t len, void *ctx)
+{
+    TEST_ASSERT_LESS_OR_EQUAL(sizeof(test_out) - 1, test_out_len + len);
+    memcpy(test_out + test_out_len, data, len);
+    test_out_len += len;
+    test_out[test_out_len] = '\0';
+    test_flushes++;
+    return ESP_OK;
+}
+
+static esp_err_t test_flush_fail(const char *data, size_t len, void *ctx)
+{
+    test_flushes++;
+    return ESP_ERR_INVALID_STATE;
+}
+
+static void test_reset(void)
+{
+    test_out_len = 0;
+    test_out[0] = '\0';
+    test_flushes = 0;
+}
+
+TEST_CASE("Metrics: Histogram buckets by upper bound", "[metrics]")
+{
+    metrics_histogram_t histogram = {0};
+
+    metrics_histogram_observe(&histogram, 0);
+    metrics_histogram_observe(&histogram, 500);     // Bounds are inclusive
+    metrics_histogram_observe(&histogram, 501);
+    metrics_histogram_observe(&histogram, 2500000);
+    metrics_histogram_observe(&histogram, 9000000); // Beyond the last bound
+
+    TEST_ASSERT_EQUAL(2, histogram.buckets[0]);
+    TEST_ASSERT_EQUAL(1, histogram.buckets[1]);
+    TEST_ASSERT_EQUAL(1, histogram.buckets[METRICS_LATENCY_BUCKET_COUNT - 1]);
+    TEST_ASSERT_EQUAL(1, histogram.buckets[METRICS_LATENCY_BUCKET_COUNT]);
+    TEST_ASSERT_EQUAL(11501001, histogram.sum_us);
+}
+
+TEST_CASE("Metrics: Prometheus text format", "[metrics]")
+{
+    metrics_writer_t writer;
+    metrics_histogram_t histogram = {0};
+    metrics_counter_t counter = {0};
+
+    metrics_counter_add(&counter, 3);
+    metrics_histogram_observe(&histogram, 700);
+    metrics_histogram_observe(&histogram, 1500000);
+
+    test_reset();
+    metrics_writer_init(&writer, test_flush, NULL);
+    metrics_write_family(&writer, "demo_total", "counter", "Demo counter");
+    metrics_write_sample(&writer, "demo_total", NULL, metrics_counter_get(&counter));
+    metrics_write_sample(&writer, "demo_total", "kind=\"a\"", 7);
+    metrics_write_histogram(&writer, "demo_seconds", "route=\"/x\"", &histogram);
+    metrics_write_histogram(&writer, "plain_seconds", NULL, &histogram);
+    TEST_ASSERT_EQUAL(ESP_OK, metrics_writer_finish(&writer));
+
+    TEST_ASSERT_NOT_NULL(strstr(test_out, "# HELP demo_total Demo counter\n# TYPE demo_total counter\n"));
+    TEST_ASSERT_NOT_NULL(strstr(test_out, "\ndemo_total 3\n"));
+    TEST_ASSERT_NOT_NULL(strstr(test_out, "\ndemo_total{kind=\"a\"} 7\n"));
+    TEST_ASSERT_NOT_NULL(strstr(test_out, "\ndemo_seconds_bucket{route=\"/x\",le=\"0.0005\"} 0\n"));
+    TEST_ASSERT_NOT_NULL(strstr(test_out, "\ndemo_seconds_bucket{route=\"/x\",le=\"0.001\"} 1\n"));
+    TEST_ASSERT_NOT_NULL(strstr(test_out, "\ndemo_seconds_bucket{route=\"/x\",le=\"1\"} 1\n"));
+    TEST_ASSERT_NOT_NULL(strstr(test_out, "\ndemo_seconds_bucket{route=\"/x\",le=\"2.5\"} 2\n"));
+    TEST_ASSERT_NOT_NULL(strstr(test_out, "\ndemo_seconds_bucket{route=\"/x\",le=\"+Inf\"} 2\n"));
+    TEST_ASSERT_NOT_NULL(strstr(test_out, "\ndemo_seconds_sum{route=\"/x\"} 1.500700\n"));
+    TEST_ASSERT_NOT_NULL(strstr(test_out, "\ndemo_seconds_count{route=\"/x\"} 2\n"));
+    TEST_ASSERT_NOT_NULL(strstr(test_out, "\nplain_seconds_bucket{le=\"+Inf\"} 2\n"));
+    TEST_ASSERT_NOT_NULL(strstr(test_out, "\nplain_seconds_sum 1.500700\n"));
+
+    // Output larger than the buffer arrives in several pieces, lines intact
+    TEST_ASSERT_GREATER_THAN(METRICS_WRITER_BUFFER_SIZE, test_out_len);
+    TEST_ASSERT_GREATER_THAN(1, test_flushes);
+}
+
+TEST_CASE("Metrics: Summaries keep count and sum", "[metrics]")
+{
+    metrics_writer_t writer;
+    metrics_summary_t summary = {0};
+
+    metrics_summary_observe(&summary, 4200000);
+    metrics_summary_observe(&summary, 12000001); // Well beyond the histogram buckets
+
+    test_reset();
+    metrics_writer_init(&writer, test_flush, NULL);
+    metrics_write_summary(&writer, "join_seconds", "os=\"a\"", &summary);
+    metrics_write_summary(&writer, "plain_seconds", NULL, &summary);
+    TEST_ASSERT_EQUAL(ESP_OK, metrics_writer_finish(&writer));
+
+    TEST_ASSERT_EQUAL_STRING("join_seconds_sum{os=\"a\"} 16.200001\n"
+                             "join_seconds_count{os=\"a\"} 2\n"
+                             "plain_seconds_sum 16.200001\n"
+                             "plain_seconds_count 2\n",
+                             test_out);
+}
+
+TEST_CASE("Metrics: Flush errors stop the output", "[metrics]")
+{
+    metrics_writer_t writer;
+    metrics_histogram_t histogram = {0};
+
+    test_reset();
+    metrics_writer_init(&writer, test_flush_fail, NULL);
+    for (int i = 0; i < 4; i++)
+    {
+        metrics_write_histogram(&writer, "demo_seconds", NULL, &histogram);
+    }
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, metrics_writer_finish(&writer));
+    TEST_ASSERT_EQUAL(1, test_flushes);
+}
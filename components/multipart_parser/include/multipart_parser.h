@@ -0,0 +1,81 @@
+/**
+ * @file multipart_parser.h
+ */
+#ifndef MULTIPART_PARSER_H
+#define MULTIPART_PARSER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#define MULTIPART_PARSER_MAX_BOUNDARY_LEN (70u)  // RFC 2046 limit
+#define MULTIPART_PARSER_MAX_HEADER_LEN (1024u)  // Longest accepted part header block
+#define MULTIPART_PARSER_HEADER_KEEP_LEN (256u)  // Part header bytes kept to look for filename=
+
+/*
+ * Receives the content of file parts, in order and without any framing
+ * @return ESP_OK to continue, anything else aborts parsing with that error
+ */
+typedef esp_err_t (*multipart_parser_data_cb_t)(const char *data, size_t len, void *ctx);
+
+typedef enum multipart_parser_state
+{
+    MULTIPART_PARSER_PREAMBLE = 0, // Before the first delimiter
+    MULTIPART_PARSER_DELIMITER,    // After a delimiter, waiting for CRLF or "--"
+    MULTIPART_PARSER_HEADERS,      // Part headers, up to the blank line
+    MULTIPART_PARSER_DATA,         // Part content
+    MULTIPART_PARSER_EPILOGUE,     // After the closing delimiter
+    MULTIPART_PARSER_ERROR,
+} multipart_parser_state_e;
+
+typedef struct multipart_parser
+{
+    char delimiter[MULTIPART_PARSER_MAX_BOUNDARY_LEN + 4]; // "\r\n--" + boundary
+    uint8_t delimiter_len;
+    uint8_t match;    // Delimiter bytes matched so far, possibly in an earlier chunk
+    uint8_t tail;     // Bytes seen after a delimiter ("--" or CRLF)
+    uint8_t blank;    // Progress through the CRLF CRLF ending the part headers
+    multipart_parser_state_e state;
+    bool is_file;     // Current part carries a filename
+    uint16_t header_len;
+    char header[MULTIPART_PARSER_HEADER_KEEP_LEN];
+    uint16_t file_parts;
+    size_t file_bytes;
+    multipart_parser_data_cb_t on_data;
+    void *ctx;
+} multipart_parser_t;
+
+/**
+ * @brief Prepares a parser for one request body
+ * @param parser parser state
+ * @param content_type value of the Content-Type header, must be
+ * multipart/form-data with a boundary parameter
+ * @param on_data consumer of the file part content
+ * @param ctx opaque pointer handed back to on_data
+ * @return ESP_OK, ESP_ERR_INVALID_ARG if the content type is not usable
+ */
+esp_err_t multipart_parser_init(multipart_parser_t *parser, const char *content_type,
+                                multipart_parser_data_cb_t on_data, void *ctx);
+
+/**
+ * @brief Feeds the next chunk of the body, chunks may split the delimiter or
+ * the headers at any byte
+ * @param parser parser state
+ * @param data chunk, not NUL terminated
+ * @param len length of data
+ * @return ESP_OK, ESP_ERR_INVALID_RESPONSE on malformed input, or the error
+ * returned by on_data
+ */
+esp_err_t multipart_parser_feed(multipart_parser_t *parser, const char *data, size_t len);
+
+/**
+ * @brief Checks that the body ended with the closing delimiter
+ * @param parser parser state
+ * @return ESP_OK if complete and at least one file part was seen,
+ * ESP_ERR_INVALID_SIZE if the body was cut short, ESP_ERR_NOT_FOUND if no
+ * file part was present
+ */
+esp_err_t multipart_parser_finish(const multipart_parser_t *parser);
+
+#endif // MULTIPART_PARSER_H
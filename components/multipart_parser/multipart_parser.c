@@ -0,0 +1,316 @@
+/**
+ * @file multipart_parser.c
+ *
+ * Incremental multipart/form-data parser. The body can be fed in chunks of
+ * any size: a delimiter split over two chunks is tracked by the number of
+ * bytes matched so far, and because the matched bytes are by definition a
+ * prefix of the delimiter they never need to be buffered. Content is handed
+ * to the callback straight from the caller's chunk.
+ */
+
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include "esp_log.h"
+#include "multipart_parser.h"
+
+static const char *TAG = "multipart_parser";
+
+static const char multipart_blank_line[] = "\r\n\r\n";
+
+/*
+ * Case-insensitive search for needle in a NUL terminated haystack
+ */
+static const char *multipart_parser_find(const char *haystack, const char *needle)
+{
+    size_t needle_len = strlen(needle);
+
+    for (; *haystack != '\0'; haystack++)
+    {
+        if (strncasecmp(haystack, needle, needle_len) == 0)
+        {
+            return haystack;
+        }
+    }
+    return NULL;
+}
+
+static esp_err_t multipart_parser_fail(multipart_parser_t *parser, const char *reason)
+{
+    ESP_LOGE(TAG, "Malformed body: %s", reason);
+    parser->state = MULTIPART_PARSER_ERROR;
+    return ESP_ERR_INVALID_RESPONSE;
+}
+
+/*
+ * Hands content to the callback when it belongs to a file part
+ */
+static esp_err_t multipart_parser_emit(multipart_parser_t *parser, const char *data, size_t len)
+{
+    if (len == 0 || parser->state != MULTIPART_PARSER_DATA || !parser->is_file)
+    {
+        return ESP_OK;
+    }
+    parser->file_bytes += len;
+    return parser->on_data(data, len, parser->ctx);
+}
+
+/*
+ * Scans preamble or part content for the delimiter
+ * @param pos index of the next byte to consume, advanced by this call
+ * @return ESP_OK, or the error returned by the data callback
+ */
+static esp_err_t multipart_parser_scan(multipart_parser_t *parser, const char *data, size_t len, size_t *pos)
+{
+    size_t i = *pos;
+    size_t run = i;         // Start of the content not yet handed out
+    size_t match_start = i; // Where the in-chunk part of the current match begins
+    uint8_t carry = parser->match; // Matched bytes which arrived in earlier chunks
+    esp_err_t error;
+
+    while (i < len)
+    {
+        if (parser->match == 0)
+        {
+            // Every delimiter starts with CR, skip straight to the next one
+            const char *cr = memchr(data + i, '\r', len - i);
+            if (cr == NULL)
+            {
+                i = len;
+                break;
+            }
+            i = cr - data;
+            match_start = i;
+            parser->match = 1;
+            i++;
+            continue;
+        }
+
+        if (data[i] == parser->delimiter[parser->match])
+        {
+            parser->match++;
+            i++;
+            if (parser->match == parser->delimiter_len)
+            {
+                // The content ends where the delimiter started
+                error = multipart_parser_emit(parser, data + run, match_start - run);
+                parser->match = 0;
+                parser->state = MULTIPART_PARSER_DELIMITER;
+                parser->tail = 0;
+                *pos = i;
+                return error;
+            }
+            continue;
+        }
+
+        // Mismatch: the bytes held back were content after all. The boundary
+        // cannot contain CR, so no later match can start inside them.
+        if (carry > 0)
+        {
+            error = multipart_parser_emit(parser, parser->delimiter, carry);
+            if (error != ESP_OK)
+            {
+                return error;
+            }
+            carry = 0;
+        }
+        parser->match = 0;
+    }
+
+    // Hold back a partial match at the end of the chunk, it may continue in the next one
+    size_t end = len;
+    if (parser->match > 0)
+    {
+        end = (carry > 0) ? run : match_start;
+    }
+    *pos = len;
+    return multipart_parser_emit(parser, data + run, end - run);
+}
+
+/*
+ * Consumes one byte of the part headers
+ */
+static esp_err_t multipart_parser_header_byte(multipart_parser_t *parser, char c)
+{
+    if (++parser->header_len > MULTIPART_PARSER_MAX_HEADER_LEN)
+    {
+        return multipart_parser_fail(parser, "part headers too long");
+    }
+    if (parser->header_len < MULTIPART_PARSER_HEADER_KEEP_LEN)
+    {
+        parser->header[parser->header_len - 1] = c;
+    }
+
+    if (c == multipart_blank_line[parser->blank])
+    {
+        parser->blank++;
+    }
+    else
+    {
+        parser->blank = (c == '\r') ? 1 : 0;
+    }
+
+    if (parser->blank == sizeof(multipart_blank_line) - 1)
+    {
+        size_t kept = parser->header_len < MULTIPART_PARSER_HEADER_KEEP_LEN ? parser->header_len : MULTIPART_PARSER_HEADER_KEEP_LEN - 1;
+        parser->header[kept] = '\0';
+        parser->is_file = (multipart_parser_find(parser->header, "filename=") != NULL);
+        if (parser->is_file)
+        {
+            parser->file_parts++;
+        }
+        parser->state = MULTIPART_PARSER_DATA;
+        parser->match = 0;
+    }
+    return ESP_OK;
+}
+
+/*
+ * Consumes one byte following a delimiter: "--" closes the body, optional
+ * whitespace and CRLF start the next part
+ */
+static esp_err_t multipart_parser_delimiter_byte(multipart_parser_t *parser, char c)
+{
+    switch (parser->tail)
+    {
+    case 0:
+        if (c == '-')
+        {
+            parser->tail = 1;
+        }
+        else if (c == '\r')
+        {
+            parser->tail = 2;
+        }
+        else if (c != ' ' && c != '\t')
+        {
+            return multipart_parser_fail(parser, "unexpected data after delimiter");
+        }
+        break;
+    case 1:
+        if (c != '-')
+        {
+            return multipart_parser_fail(parser, "incomplete closing delimiter");
+        }
+        parser->state = MULTIPART_PARSER_EPILOGUE;
+        break;
+    default:
+        if (c != '\n')
+        {
+            return multipart_parser_fail(parser, "missing LF after delimiter");
+        }
+        // The CRLF just consumed counts towards the blank line, so a part
+        // without headers is a single further CRLF
+        parser->state = MULTIPART_PARSER_HEADERS;
+        parser->blank = 2;
+        parser->header_len = 0;
+        parser->is_file = false;
+        break;
+    }
+    return ESP_OK;
+}
+
+esp_err_t multipart_parser_init(multipart_parser_t *parser, const char *content_type,
+                                multipart_parser_data_cb_t on_data, void *ctx)
+{
+    static const char form_data[] = "multipart/form-data";
+
+    if (parser == NULL || content_type == NULL || on_data == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(parser, 0, sizeof(*parser));
+
+    if (strncasecmp(content_type, form_data, sizeof(form_data) - 1) != 0)
+    {
+        ESP_LOGE(TAG, "Not multipart/form-data: %s", content_type);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const char *boundary = multipart_parser_find(content_type, "boundary=");
+    if (boundary == NULL)
+    {
+        ESP_LOGE(TAG, "No boundary in content type");
+        return ESP_ERR_INVALID_ARG;
+    }
+    boundary += strlen("boundary=");
+
+    size_t boundary_len = 0;
+    if (*boundary == '"')
+    {
+        boundary++;
+        const char *quote = strchr(boundary, '"');
+        boundary_len = (quote != NULL) ? (size_t)(quote - boundary) : 0;
+    }
+    else
+    {
+        while (boundary[boundary_len] != '\0' && boundary[boundary_len] != ';' &&
+               !isspace((unsigned char)boundary[boundary_len]))
+        {
+            boundary_len++;
+        }
+    }
+
+    if (boundary_len == 0 || boundary_len > MULTIPART_PARSER_MAX_BOUNDARY_LEN ||
+        memchr(boundary, '\r', boundary_len) != NULL || memchr(boundary, '\n', boundary_len) != NULL)
+    {
+        ESP_LOGE(TAG, "Invalid boundary length %u", (unsigned)boundary_len);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memcpy(parser->delimiter, "\r\n--", 4);
+    memcpy(parser->delimiter + 4, boundary, boundary_len);
+    parser->delimiter_len = (uint8_t)(boundary_len + 4);
+
+    // The first delimiter may open the body without a preceding CRLF, so
+    // behave as if that CRLF had already been matched
+    parser->state = MULTIPART_PARSER_PREAMBLE;
+    parser->match = 2;
+    parser->on_data = on_data;
+    parser->ctx = ctx;
+    return ESP_OK;
+}
+
+esp_err_t multipart_parser_feed(multipart_parser_t *parser, const char *data, size_t len)
+{
+    size_t pos = 0;
+    esp_err_t error = ESP_OK;
+
+    while (pos < len && error == ESP_OK)
+    {
+        switch (parser->state)
+        {
+        case MULTIPART_PARSER_PREAMBLE:
+        case MULTIPART_PARSER_DATA:
+            error = multipart_parser_scan(parser, data, len, &pos);
+            break;
+        case MULTIPART_PARSER_DELIMITER:
+            error = multipart_parser_delimiter_byte(parser, data[pos++]);
+            break;
+        case MULTIPART_PARSER_HEADERS:
+            error = multipart_parser_header_byte(parser, data[pos++]);
+            break;
+        case MULTIPART_PARSER_EPILOGUE:
+            // Anything after the closing delimiter is ignored
+            return ESP_OK;
+        default:
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+    }
+
+    return error;
+}
+
+esp_err_t multipart_parser_finish(const multipart_parser_t *parser)
+{
+    if (parser->state != MULTIPART_PARSER_EPILOGUE)
+    {
+        ESP_LOGE(TAG, "Body ended before the closing delimiter");
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (parser->file_parts == 0)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,107 @@
+#include "unity.h"
+#include "esp_log.h"
+#include "multipart_parser.h"
+#include <string.h>
+
+#define TEST_CONTENT_TYPE "multipart/form-data; boundary=----WebKitFormBoundaryX3bY"
+
+static const char test_body[] =
+    "------WebKitFormBoundaryX3bY\r\n"
+    "Content-Disposition: form-data; name=\"note\"\r\n"
+    "\r\n"
+    "not a file\r\n"
+    "------WebKitFormBoundaryX3bY\r\n"
+    "Content-Disposition: form-data; name=\"file\"; filename=\"fw.bin\"\r\n"
+    "Content-Type: application/octet-stream\r\n"
+    "\r\n"
+    "\xe9\x01\r\n--\r\n----WebKitFormBoundaryX3\r\r\n\x00tail"
+    "\r\n------WebKitFormBoundaryX3bY--\r\n";
+
+static const char test_file[] = "\xe9\x01\r\n--\r\n----WebKitFormBoundaryX3\r\r\n\x00tail";
+
+static char test_out[256];
+static size_t test_out_len = 0;
+
+static esp_err_t test_collect(const char *data, size_t len, void *ctx)
+{
+    TEST_ASSERT_LESS_OR_EQUAL(sizeof(test_out), test_out_len + len);
+    memcpy(test_out + test_out_len, data, len);
+    test_out_len += len;
+    return ESP_OK;
+}
+
+static esp_err_t test_reject(const char *data, size_t len, void *ctx)
+{
+    return ESP_ERR_NO_MEM;
+}
+
+/*
+ * Parses the body split into chunks of chunk_len bytes
+ */
+static esp_err_t test_parse_chunked(const char *body, size_t body_len, size_t chunk_len, multipart_parser_t *parser)
+{
+    test_out_len = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, multipart_parser_init(parser, TEST_CONTENT_TYPE, test_collect, NULL));
+
+    for (size_t pos = 0; pos < body_len; pos += chunk_len)
+    {
+        size_t len = (body_len - pos < chunk_len) ? body_len - pos : chunk_len;
+        esp_err_t error = multipart_parser_feed(parser, body + pos, len);
+        if (error != ESP_OK)
+        {
+            return error;
+        }
+    }
+    return multipart_parser_finish(parser);
+}
+
+TEST_CASE("Multipart Parser: Boundary from content type", "[multipart_parser]")
+{
+    multipart_parser_t parser;
+
+    TEST_ASSERT_EQUAL(ESP_OK, multipart_parser_init(&parser, "multipart/form-data; boundary=\"a b\"; charset=utf-8", test_collect, NULL));
+    TEST_ASSERT_EQUAL(7, parser.delimiter_len);
+    TEST_ASSERT_EQUAL_MEMORY("\r\n--a b", parser.delimiter, 7);
+
+    TEST_ASSERT_EQUAL(ESP_OK, multipart_parser_init(&parser, "Multipart/Form-Data;BOUNDARY=xyz", test_collect, NULL));
+    TEST_ASSERT_EQUAL_MEMORY("\r\n--xyz", parser.delimiter, 7);
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, multipart_parser_init(&parser, "application/json", test_collect, NULL));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, multipart_parser_init(&parser, "multipart/form-data", test_collect, NULL));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, multipart_parser_init(&parser, "multipart/form-data; boundary=", test_collect, NULL));
+}
+
+TEST_CASE("Multipart Parser: File content at every chunk size", "[multipart_parser]")
+{
+    multipart_parser_t parser;
+
+    // Splitting at every possible offset exercises delimiters across chunk edges
+    for (size_t chunk_len = 1; chunk_len <= sizeof(test_body); chunk_len++)
+    {
+        TEST_ASSERT_EQUAL(ESP_OK, test_parse_chunked(test_body, sizeof(test_body) - 1, chunk_len, &parser));
+        TEST_ASSERT_EQUAL(sizeof(test_file) - 1, test_out_len);
+        TEST_ASSERT_EQUAL_MEMORY(test_file, test_out, test_out_len);
+        TEST_ASSERT_EQUAL(1, parser.file_parts);
+    }
+}
+
+TEST_CASE("Multipart Parser: Truncated and malformed bodies", "[multipart_parser]")
+{
+    multipart_parser_t parser;
+
+    // Cut inside the closing delimiter
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, test_parse_chunked(test_body, sizeof(test_body) - 6, 64, &parser));
+
+    // No file part
+    static const char no_file[] =
+        "------WebKitFormBoundaryX3bY\r\n\r\nvalue\r\n------WebKitFormBoundaryX3bY--";
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, test_parse_chunked(no_file, sizeof(no_file) - 1, 64, &parser));
+
+    // Garbage after a delimiter
+    static const char garbage[] = "------WebKitFormBoundaryX3bYzz\r\n\r\n";
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_RESPONSE, test_parse_chunked(garbage, sizeof(garbage) - 1, 64, &parser));
+
+    // Callback errors abort parsing
+    TEST_ASSERT_EQUAL(ESP_OK, multipart_parser_init(&parser, TEST_CONTENT_TYPE, test_reject, NULL));
+    TEST_ASSERT_EQUAL(ESP_ERR_NO_MEM, multipart_parser_feed(&parser, test_body, sizeof(test_body) - 1));
+}
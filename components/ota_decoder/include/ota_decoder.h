@@ -0,0 +1,111 @@
+/**
+ * @file ota_decoder.h
+ *
+ * Streaming decoder for packed OTA images produced by tools/ota_pack.py.
+ *
+ * Packed image layout (little endian):
+ *   0  "OTAZ" magic
+ *   4  u8  format version (1)
+ *   5  u8  flags, bit 0 set for a delta against the running image
+ *   6  u8  window bits (12, 4 KB history)
+ *   7  u8  reserved
+ *   8  u32 size of the decoded image
+ *   12 u32 reserved
+ *   16 u8[32] SHA-256 digest of the base image (delta only)
+ *   48 operations until the decoded size is reached:
+ *      0x00-0x7F  literal, (op + 1) bytes follow
+ *      0x80-0xBF  match, (op & 0x3F) + 3 bytes from u16 distance back in the output
+ *      0xC0       copy, u32 length bytes from u32 offset in the base image
+ *
+ * Anything not starting with the magic is passed through unchanged, so plain
+ * .bin uploads keep working.
+ */
+#ifndef OTA_DECODER_H
+#define OTA_DECODER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#define OTA_DECODER_HEADER_LEN (48u)
+#define OTA_DECODER_WINDOW_BITS (12u)
+#define OTA_DECODER_WINDOW_SIZE (1u << OTA_DECODER_WINDOW_BITS)
+#define OTA_DECODER_DIGEST_LEN (32u)
+#define OTA_DECODER_FLAG_DELTA (0x01u)
+
+/*
+ * Receives decoded image bytes in order
+ * @return ESP_OK to continue, anything else aborts decoding with that error
+ */
+typedef esp_err_t (*ota_decoder_write_t)(const char *data, size_t len, void *ctx);
+
+/*
+ * Reads from the base (running) image for delta copies
+ * @return ESP_OK or the read error
+ */
+typedef esp_err_t (*ota_decoder_read_base_t)(size_t offset, void *dest, size_t len, void *ctx);
+
+typedef enum ota_decoder_mode
+{
+    OTA_DECODER_MODE_UNKNOWN = 0, // Header not seen yet
+    OTA_DECODER_MODE_PLAIN,       // Not packed, passed through
+    OTA_DECODER_MODE_COMPRESSED,
+    OTA_DECODER_MODE_DELTA,
+} ota_decoder_mode_e;
+
+typedef struct ota_decoder_config
+{
+    ota_decoder_write_t write;
+    ota_decoder_read_base_t read_base; // NULL disables delta images
+    const uint8_t *base_digest;        // SHA-256 of the running image, NULL disables delta images
+    size_t base_size;                  // Readable size of the base image
+    void *ctx;                         // Handed to write and read_base
+} ota_decoder_config_t;
+
+typedef struct ota_decoder
+{
+    ota_decoder_config_t config;
+    ota_decoder_mode_e mode;
+    uint8_t state;
+    uint8_t header[OTA_DECODER_HEADER_LEN];
+    uint8_t header_len;
+    uint8_t op[9];      // Operation being assembled
+    uint8_t op_len;
+    uint8_t op_need;
+    uint32_t literal_left;
+    size_t image_size;  // Decoded size announced by the header
+    size_t produced;    // Decoded bytes so far
+    size_t consumed;    // Packed bytes fed so far
+    size_t flushed;     // Window position up to which output was written
+    char window[OTA_DECODER_WINDOW_SIZE];
+} ota_decoder_t;
+
+/**
+ * @brief Prepares a decoder for one upload
+ * @param decoder decoder state, about 4.2 KB mostly for the history window
+ * @param config output and base image callbacks
+ * @return ESP_OK, ESP_ERR_INVALID_ARG if write is missing
+ */
+esp_err_t ota_decoder_init(ota_decoder_t *decoder, const ota_decoder_config_t *config);
+
+/**
+ * @brief Decodes the next chunk of the upload
+ * @param decoder decoder state
+ * @param data packed (or plain) image bytes, chunks may split anywhere
+ * @param len length of data
+ * @return ESP_OK, ESP_ERR_INVALID_VERSION for an unknown format or a delta
+ * against another base image, ESP_ERR_INVALID_RESPONSE on a corrupt stream,
+ * or the error returned by a callback
+ */
+esp_err_t ota_decoder_feed(ota_decoder_t *decoder, const char *data, size_t len);
+
+/**
+ * @brief Flushes pending output and checks the stream was complete
+ * @param decoder decoder state
+ * @return ESP_OK, ESP_ERR_INVALID_SIZE if the upload ended early, or the
+ * error returned by the write callback
+ */
+esp_err_t ota_decoder_finish(ota_decoder_t *decoder);
+
+#endif // OTA_DECODER_H
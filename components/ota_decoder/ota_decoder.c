@@ -0,0 +1,391 @@
+/**
+ * @file ota_decoder.c
+ *
+ * Decodes packed OTA images while they are received. Decoded bytes are
+ * staged in the 4 KB history window that back-references read from and are
+ * written out whenever the window is about to be overwritten, so RAM use does
+ * not depend on the image size. Delta copies are read from the base image
+ * straight into the window.
+ */
+
+#include <string.h>
+#include "esp_log.h"
+#include "ota_decoder.h"
+
+#define OTA_DECODER_VERSION (1u)
+#define OTA_DECODER_OP_LITERAL_MAX (0x7Fu)
+#define OTA_DECODER_OP_MATCH_MAX (0xBFu)
+#define OTA_DECODER_OP_COPY (0xC0u)
+#define OTA_DECODER_MATCH_MIN_LEN (3u)
+
+typedef enum
+{
+    OTA_DECODER_STATE_HEADER = 0,
+    OTA_DECODER_STATE_PLAIN,
+    OTA_DECODER_STATE_OP,
+    OTA_DECODER_STATE_LITERAL,
+    OTA_DECODER_STATE_DONE,
+    OTA_DECODER_STATE_ERROR,
+} ota_decoder_state_e;
+
+static const char *TAG = "ota_decoder";
+
+static const uint8_t ota_decoder_magic[4] = {'O', 'T', 'A', 'Z'};
+
+static uint32_t ota_decoder_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static esp_err_t ota_decoder_fail(ota_decoder_t *decoder, esp_err_t error, const char *reason)
+{
+    ESP_LOGE(TAG, "%s at packed offset %u", reason, (unsigned)decoder->consumed);
+    decoder->state = OTA_DECODER_STATE_ERROR;
+    return error;
+}
+
+/*
+ * Writes out everything produced since the last flush, in at most two
+ * contiguous pieces of the window
+ */
+static esp_err_t ota_decoder_flush(ota_decoder_t *decoder)
+{
+    while (decoder->flushed < decoder->produced)
+    {
+        size_t start = decoder->flushed % OTA_DECODER_WINDOW_SIZE;
+        size_t len = decoder->produced - decoder->flushed;
+        if (start + len > OTA_DECODER_WINDOW_SIZE)
+        {
+            len = OTA_DECODER_WINDOW_SIZE - start;
+        }
+
+        esp_err_t error = decoder->config.write(decoder->window + start, len, decoder->config.ctx);
+        if (error != ESP_OK)
+        {
+            decoder->state = OTA_DECODER_STATE_ERROR;
+            return error;
+        }
+        decoder->flushed += len;
+    }
+    return ESP_OK;
+}
+
+/*
+ * Number of bytes that can be produced into the window at once without
+ * wrapping or overwriting data which was not flushed yet
+ */
+static size_t ota_decoder_room(ota_decoder_t *decoder)
+{
+    size_t to_end = OTA_DECODER_WINDOW_SIZE - (decoder->produced % OTA_DECODER_WINDOW_SIZE);
+    size_t unflushed_room = OTA_DECODER_WINDOW_SIZE - (decoder->produced - decoder->flushed);
+    return (to_end < unflushed_room) ? to_end : unflushed_room;
+}
+
+static esp_err_t ota_decoder_put(ota_decoder_t *decoder, const char *src, size_t len)
+{
+    while (len > 0)
+    {
+        size_t room = ota_decoder_room(decoder);
+        if (room == 0)
+        {
+            esp_err_t error = ota_decoder_flush(decoder);
+            if (error != ESP_OK)
+            {
+                return error;
+            }
+            continue;
+        }
+
+        size_t n = (len < room) ? len : room;
+        memcpy(decoder->window + (decoder->produced % OTA_DECODER_WINDOW_SIZE), src, n);
+        decoder->produced += n;
+        src += n;
+        len -= n;
+    }
+    return ESP_OK;
+}
+
+/*
+ * Repeats len bytes found distance bytes back in the output, the ranges may
+ * overlap so runs are expanded byte by byte
+ */
+static esp_err_t ota_decoder_match(ota_decoder_t *decoder, size_t distance, size_t len)
+{
+    if (distance == 0 || distance > decoder->produced || distance > OTA_DECODER_WINDOW_SIZE)
+    {
+        return ota_decoder_fail(decoder, ESP_ERR_INVALID_RESPONSE, "Match outside the window");
+    }
+
+    while (len > 0)
+    {
+        size_t room = ota_decoder_room(decoder);
+        if (room == 0)
+        {
+            esp_err_t error = ota_decoder_flush(decoder);
+            if (error != ESP_OK)
+            {
+                return error;
+            }
+            continue;
+        }
+
+        size_t n = (len < room) ? len : room;
+        for (size_t i = 0; i < n; i++)
+        {
+            size_t dest = decoder->produced % OTA_DECODER_WINDOW_SIZE;
+            decoder->window[dest] = decoder->window[(decoder->produced - distance) % OTA_DECODER_WINDOW_SIZE];
+            decoder->produced++;
+        }
+        len -= n;
+    }
+    return ESP_OK;
+}
+
+/*
+ * Copies a range of the base image into the output
+ */
+static esp_err_t ota_decoder_copy(ota_decoder_t *decoder, size_t offset, size_t len)
+{
+    if (decoder->mode != OTA_DECODER_MODE_DELTA || offset > decoder->config.base_size ||
+        len > decoder->config.base_size - offset)
+    {
+        return ota_decoder_fail(decoder, ESP_ERR_INVALID_RESPONSE, "Copy outside the base image");
+    }
+
+    while (len > 0)
+    {
+        size_t room = ota_decoder_room(decoder);
+        if (room == 0)
+        {
+            esp_err_t error = ota_decoder_flush(decoder);
+            if (error != ESP_OK)
+            {
+                return error;
+            }
+            continue;
+        }
+
+        size_t n = (len < room) ? len : room;
+        esp_err_t error = decoder->config.read_base(offset, decoder->window + (decoder->produced % OTA_DECODER_WINDOW_SIZE),
+                                                    n, decoder->config.ctx);
+        if (error != ESP_OK)
+        {
+            decoder->state = OTA_DECODER_STATE_ERROR;
+            return error;
+        }
+        decoder->produced += n;
+        offset += n;
+        len -= n;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t ota_decoder_parse_header(ota_decoder_t *decoder)
+{
+    const uint8_t *header = decoder->header;
+    uint8_t flags = header[5];
+
+    if (header[4] != OTA_DECODER_VERSION || header[6] > OTA_DECODER_WINDOW_BITS)
+    {
+        return ota_decoder_fail(decoder, ESP_ERR_INVALID_VERSION, "Unsupported packed image format");
+    }
+
+    decoder->image_size = ota_decoder_u32(header + 8);
+    if (decoder->image_size == 0)
+    {
+        return ota_decoder_fail(decoder, ESP_ERR_INVALID_RESPONSE, "Empty packed image");
+    }
+
+    decoder->mode = OTA_DECODER_MODE_COMPRESSED;
+    if (flags & OTA_DECODER_FLAG_DELTA)
+    {
+        // A delta only makes sense against the exact image it was built from
+        if (decoder->config.read_base == NULL || decoder->config.base_digest == NULL ||
+            memcmp(decoder->config.base_digest, header + 16, OTA_DECODER_DIGEST_LEN) != 0)
+        {
+            return ota_decoder_fail(decoder, ESP_ERR_INVALID_VERSION, "Delta built for another base image");
+        }
+        decoder->mode = OTA_DECODER_MODE_DELTA;
+    }
+
+    ESP_LOGI(TAG, "%s image, %u bytes decoded",
+             (decoder->mode == OTA_DECODER_MODE_DELTA) ? "Delta" : "Compressed", (unsigned)decoder->image_size);
+    decoder->state = OTA_DECODER_STATE_OP;
+    return ESP_OK;
+}
+
+/*
+ * Runs the operation assembled in decoder->op
+ */
+static esp_err_t ota_decoder_execute(ota_decoder_t *decoder)
+{
+    uint8_t op = decoder->op[0];
+    size_t len;
+    esp_err_t error = ESP_OK;
+
+    decoder->op_len = 0;
+    if (op <= OTA_DECODER_OP_LITERAL_MAX)
+    {
+        decoder->literal_left = op + 1u;
+        if (decoder->produced + decoder->literal_left > decoder->image_size)
+        {
+            return ota_decoder_fail(decoder, ESP_ERR_INVALID_RESPONSE, "Literal past the image end");
+        }
+        decoder->state = OTA_DECODER_STATE_LITERAL;
+        return ESP_OK;
+    }
+
+    if (op <= OTA_DECODER_OP_MATCH_MAX)
+    {
+        len = (op & 0x3Fu) + OTA_DECODER_MATCH_MIN_LEN;
+        if (decoder->produced + len > decoder->image_size)
+        {
+            return ota_decoder_fail(decoder, ESP_ERR_INVALID_RESPONSE, "Match past the image end");
+        }
+        error = ota_decoder_match(decoder, decoder->op[1] | ((size_t)decoder->op[2] << 8), len);
+    }
+    else
+    {
+        len = ota_decoder_u32(decoder->op + 5);
+        if (len > decoder->image_size - decoder->produced)
+        {
+            return ota_decoder_fail(decoder, ESP_ERR_INVALID_RESPONSE, "Copy past the image end");
+        }
+        error = ota_decoder_copy(decoder, ota_decoder_u32(decoder->op + 1), len);
+    }
+
+    if (error == ESP_OK && decoder->produced == decoder->image_size)
+    {
+        decoder->state = OTA_DECODER_STATE_DONE;
+    }
+    return error;
+}
+
+esp_err_t ota_decoder_init(ota_decoder_t *decoder, const ota_decoder_config_t *config)
+{
+    if (decoder == NULL || config == NULL || config->write == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(decoder, 0, offsetof(ota_decoder_t, window));
+    decoder->config = *config;
+    decoder->state = OTA_DECODER_STATE_HEADER;
+    decoder->mode = OTA_DECODER_MODE_UNKNOWN;
+    return ESP_OK;
+}
+
+esp_err_t ota_decoder_feed(ota_decoder_t *decoder, const char *data, size_t len)
+{
+    size_t pos = 0;
+    esp_err_t error = ESP_OK;
+
+    while (pos < len && error == ESP_OK)
+    {
+        switch (decoder->state)
+        {
+        case OTA_DECODER_STATE_HEADER:
+        {
+            // Stop after the magic to decide between packed and plain images
+            size_t want = (decoder->header_len < sizeof(ota_decoder_magic)) ? sizeof(ota_decoder_magic) : OTA_DECODER_HEADER_LEN;
+            size_t n = want - decoder->header_len;
+            n = (n < len - pos) ? n : len - pos;
+            memcpy(decoder->header + decoder->header_len, data + pos, n);
+            decoder->header_len += n;
+            decoder->consumed += n;
+            pos += n;
+
+            if (decoder->header_len == sizeof(ota_decoder_magic) &&
+                memcmp(decoder->header, ota_decoder_magic, sizeof(ota_decoder_magic)) != 0)
+            {
+                decoder->mode = OTA_DECODER_MODE_PLAIN;
+                decoder->state = OTA_DECODER_STATE_PLAIN;
+                decoder->produced = decoder->header_len;
+                error = decoder->config.write((const char *)decoder->header, decoder->header_len, decoder->config.ctx);
+            }
+            else if (decoder->header_len == OTA_DECODER_HEADER_LEN)
+            {
+                error = ota_decoder_parse_header(decoder);
+            }
+            break;
+        }
+        case OTA_DECODER_STATE_PLAIN:
+            decoder->produced += len - pos;
+            decoder->consumed += len - pos;
+            error = decoder->config.write(data + pos, len - pos, decoder->config.ctx);
+            pos = len;
+            break;
+        case OTA_DECODER_STATE_OP:
+        {
+            uint8_t byte = (uint8_t)data[pos++];
+            decoder->consumed++;
+            if (decoder->op_len == 0)
+            {
+                // Opcode, then distance (match) or offset and length (copy)
+                if (byte <= OTA_DECODER_OP_LITERAL_MAX)
+                {
+                    decoder->op_need = 1;
+                }
+                else if (byte <= OTA_DECODER_OP_MATCH_MAX)
+                {
+                    decoder->op_need = 3;
+                }
+                else if (byte == OTA_DECODER_OP_COPY)
+                {
+                    decoder->op_need = 9;
+                }
+                else
+                {
+                    return ota_decoder_fail(decoder, ESP_ERR_INVALID_RESPONSE, "Unknown operation");
+                }
+            }
+            decoder->op[decoder->op_len++] = byte;
+            if (decoder->op_len == decoder->op_need)
+            {
+                error = ota_decoder_execute(decoder);
+            }
+            break;
+        }
+        case OTA_DECODER_STATE_LITERAL:
+        {
+            size_t n = (decoder->literal_left < len - pos) ? decoder->literal_left : len - pos;
+            error = ota_decoder_put(decoder, data + pos, n);
+            decoder->literal_left -= n;
+            decoder->consumed += n;
+            pos += n;
+            if (decoder->literal_left == 0)
+            {
+                decoder->state = (decoder->produced == decoder->image_size) ? OTA_DECODER_STATE_DONE : OTA_DECODER_STATE_OP;
+            }
+            break;
+        }
+        case OTA_DECODER_STATE_DONE:
+            return ota_decoder_fail(decoder, ESP_ERR_INVALID_RESPONSE, "Data after the end of the image");
+        default:
+            return ESP_ERR_INVALID_STATE;
+        }
+    }
+
+    if (error != ESP_OK)
+    {
+        decoder->state = OTA_DECODER_STATE_ERROR;
+    }
+    return error;
+}
+
+esp_err_t ota_decoder_finish(ota_decoder_t *decoder)
+{
+    switch (decoder->state)
+    {
+    case OTA_DECODER_STATE_PLAIN:
+        return ESP_OK;
+    case OTA_DECODER_STATE_DONE:
+        return ota_decoder_flush(decoder);
+    case OTA_DECODER_STATE_ERROR:
+        return ESP_ERR_INVALID_STATE;
+    default:
+        ESP_LOGE(TAG, "Upload ended after %u of %u decoded bytes",
+                 (unsigned)decoder->produced, (unsigned)decoder->image_size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+}
@@ -0,0 +1,147 @@
+#include "unity.h"
+#include "esp_log.h"
+#include "ota_decoder.h"
+#include <string.h>
+
+#define TEST_OUT_SIZE (3 * OTA_DECODER_WINDOW_SIZE)
+
+static char test_out[TEST_OUT_SIZE];
+static size_t test_out_len = 0;
+static const char test_base[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+static const uint8_t test_base_digest[OTA_DECODER_DIGEST_LEN] = {0xAA, 0x55};
+
+static esp_err_t test_write(const char *data, size_t len, void *ctx)
+{
+    TEST_ASSERT_LESS_OR_EQUAL(sizeof(test_out), test_out_len + len);
+    memcpy(test_out + test_out_len, data, len);
+    test_out_len += len;
+    return ESP_OK;
+}
+
+static esp_err_t test_read_base(size_t offset, void *dest, size_t len, void *ctx)
+{
+    memcpy(dest, test_base + offset, len);
+    return ESP_OK;
+}
+
+static const ota_decoder_config_t test_config = {
+    .write = test_write,
+    .read_base = test_read_base,
+    .base_digest = test_base_digest,
+    .base_size = sizeof(test_base) - 1,
+    .ctx = NULL};
+
+/*
+ * Writes a packed image header into stream
+ * @return header length
+ */
+static size_t test_header(uint8_t *stream, uint8_t flags, uint32_t image_size, const uint8_t *digest)
+{
+    memset(stream, 0, OTA_DECODER_HEADER_LEN);
+    memcpy(stream, "OTAZ", 4);
+    stream[4] = 1;
+    stream[5] = flags;
+    stream[6] = OTA_DECODER_WINDOW_BITS;
+    stream[8] = image_size & 0xFF;
+    stream[9] = (image_size >> 8) & 0xFF;
+    stream[10] = (image_size >> 16) & 0xFF;
+    if (digest != NULL)
+    {
+        memcpy(stream + 16, digest, OTA_DECODER_DIGEST_LEN);
+    }
+    return OTA_DECODER_HEADER_LEN;
+}
+
+/*
+ * Decodes stream split into chunks of chunk_len bytes
+ */
+static esp_err_t test_decode(ota_decoder_t *decoder, const uint8_t *stream, size_t len, size_t chunk_len)
+{
+    test_out_len = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, ota_decoder_init(decoder, &test_config));
+
+    for (size_t pos = 0; pos < len; pos += chunk_len)
+    {
+        size_t n = (len - pos < chunk_len) ? len - pos : chunk_len;
+        esp_err_t error = ota_decoder_feed(decoder, (const char *)stream + pos, n);
+        if (error != ESP_OK)
+        {
+            return error;
+        }
+    }
+    return ota_decoder_finish(decoder);
+}
+
+static ota_decoder_t test_decoder;
+
+TEST_CASE("OTA Decoder: Plain images pass through", "[ota_decoder]")
+{
+    static const uint8_t plain[] = {0xE9, 0x05, 0x02, 0x20, 0x00, 0x01};
+
+    TEST_ASSERT_EQUAL(ESP_OK, test_decode(&test_decoder, plain, sizeof(plain), 1));
+    TEST_ASSERT_EQUAL(OTA_DECODER_MODE_PLAIN, test_decoder.mode);
+    TEST_ASSERT_EQUAL(sizeof(plain), test_out_len);
+    TEST_ASSERT_EQUAL_MEMORY(plain, test_out, sizeof(plain));
+}
+
+TEST_CASE("OTA Decoder: Literals and overlapping matches across the window", "[ota_decoder]")
+{
+    static uint8_t stream[OTA_DECODER_HEADER_LEN + 512];
+    size_t image_size = 2 + 100 * 66; // Wraps the history window
+    size_t len = test_header(stream, 0, image_size, NULL);
+
+    // "ab" then runs of 66 bytes copied from 2 back
+    stream[len++] = 0x01;
+    stream[len++] = 'a';
+    stream[len++] = 'b';
+    for (int i = 0; i < 100; i++)
+    {
+        stream[len++] = 0xBF;
+        stream[len++] = 0x02;
+        stream[len++] = 0x00;
+    }
+
+    for (size_t chunk_len = 1; chunk_len <= 7; chunk_len += 3)
+    {
+        TEST_ASSERT_EQUAL(ESP_OK, test_decode(&test_decoder, stream, len, chunk_len));
+        TEST_ASSERT_EQUAL(OTA_DECODER_MODE_COMPRESSED, test_decoder.mode);
+        TEST_ASSERT_EQUAL(image_size, test_out_len);
+        for (size_t i = 0; i < image_size; i++)
+        {
+            TEST_ASSERT_EQUAL(i % 2 ? 'b' : 'a', test_out[i]);
+        }
+    }
+
+    // Cut short
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, test_decode(&test_decoder, stream, len - 3, 16));
+}
+
+TEST_CASE("OTA Decoder: Delta copies from the base image", "[ota_decoder]")
+{
+    uint8_t stream[OTA_DECODER_HEADER_LEN + 32];
+    size_t len = test_header(stream, OTA_DECODER_FLAG_DELTA, 13, test_base_digest);
+
+    // base[10..16) + "XY" + base[30..35)
+    static const uint8_t ops[] = {
+        0xC0, 10, 0, 0, 0, 6, 0, 0, 0,
+        0x01, 'X', 'Y',
+        0xC0, 30, 0, 0, 0, 5, 0, 0, 0};
+    memcpy(stream + len, ops, sizeof(ops));
+    len += sizeof(ops);
+
+    TEST_ASSERT_EQUAL(ESP_OK, test_decode(&test_decoder, stream, len, 5));
+    TEST_ASSERT_EQUAL(OTA_DECODER_MODE_DELTA, test_decoder.mode);
+    TEST_ASSERT_EQUAL(13, test_out_len);
+    TEST_ASSERT_EQUAL_MEMORY("abcdefXYuvwxy", test_out, 13);
+
+    // A delta for another base image is refused before anything is written
+    static const uint8_t other_digest[OTA_DECODER_DIGEST_LEN] = {0x01};
+    test_header(stream, OTA_DECODER_FLAG_DELTA, 13, other_digest);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_VERSION, test_decode(&test_decoder, stream, len, 64));
+    TEST_ASSERT_EQUAL(0, test_out_len);
+
+    // Copies past the end of the base image are rejected
+    test_header(stream, OTA_DECODER_FLAG_DELTA, 13, test_base_digest);
+    stream[OTA_DECODER_HEADER_LEN + 1] = 34;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_RESPONSE, test_decode(&test_decoder, stream, len, 64));
+}
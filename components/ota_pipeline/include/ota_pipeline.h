@@ -0,0 +1,56 @@
+/**
+ * @file ota_pipeline.h
+ */
+#ifndef OTA_PIPELINE_H
+#define OTA_PIPELINE_H
+
+#include <stddef.h>
+#include "esp_err.h"
+
+#define OTA_PIPELINE_BUFFER_COUNT (3u)    // Blocks in flight between receiver and writer
+#define OTA_PIPELINE_BUFFER_SIZE (4096u)  // One flash sector per block
+
+/*
+ * Destination of the pipeline, called on the writer task for every block
+ * @return ESP_OK, any other value stops further writes and is reported back
+ */
+typedef esp_err_t (*ota_pipeline_write_t)(const void *data, size_t len, void *ctx);
+
+typedef struct ota_pipeline_sink
+{
+    ota_pipeline_write_t write;
+    void *ctx;
+} ota_pipeline_sink_t;
+
+/**
+ * @brief Allocates the block ring and starts the flash writer task
+ * @param sink destination of the data, e.g. a wrapper around esp_ota_write
+ * @return ESP_OK, ESP_ERR_INVALID_STATE if a pipeline is already running,
+ * ESP_ERR_NO_MEM if the ring or the task could not be created
+ */
+esp_err_t ota_pipeline_start(const ota_pipeline_sink_t *sink);
+
+/**
+ * @brief Takes a free block to receive into, waiting for the writer if all
+ * blocks are in flight
+ * @param len receives the block size (OTA_PIPELINE_BUFFER_SIZE)
+ * @return block to fill, NULL if the writer did not release one in time
+ */
+char *ota_pipeline_acquire(size_t *len);
+
+/**
+ * @brief Hands a filled block to the writer task and returns immediately
+ * @param block block obtained from ota_pipeline_acquire
+ * @param len number of valid bytes, 0 simply returns the block
+ * @return ESP_OK, or the first error reported by the sink so far
+ */
+esp_err_t ota_pipeline_submit(char *block, size_t len);
+
+/**
+ * @brief Waits until every submitted block is written, stops the writer task
+ * and releases the ring. Must be called once for every successful start.
+ * @return ESP_OK, or the first error reported by the sink
+ */
+esp_err_t ota_pipeline_finish(void);
+
+#endif // OTA_PIPELINE_H
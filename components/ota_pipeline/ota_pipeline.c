@@ -0,0 +1,173 @@
+/**
+ * @file ota_pipeline.c
+ *
+ * Overlaps network receive and flash writes during a firmware upload. The
+ * HTTP handler fills blocks from a small ring while a dedicated task writes
+ * the previously filled blocks, so sector erase/program time is hidden behind
+ * the next recv instead of adding to it.
+ */
+
+#include <stdlib.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "ota_pipeline.h"
+
+#define OTA_PIPELINE_TASK_STACK_SIZE (3072u)
+#define OTA_PIPELINE_TASK_PRIORITY (5u)
+#define OTA_PIPELINE_ACQUIRE_TIMEOUT_MS (10 * 1000) // Longest wait for the writer to free a block
+
+typedef struct
+{
+    char *data; // NULL asks the writer task to stop
+    size_t len;
+} ota_pipeline_block_t;
+
+static const char *TAG = "ota_pipeline";
+
+static char *ota_pipeline_pool = NULL;
+static QueueHandle_t ota_pipeline_free_q = NULL;
+static QueueHandle_t ota_pipeline_full_q = NULL;
+static SemaphoreHandle_t ota_pipeline_done = NULL;
+static ota_pipeline_sink_t ota_pipeline_sink;
+static atomic_int ota_pipeline_error = ESP_OK;
+
+/*
+ * Writer task, writes blocks in submission order and recycles them
+ * @param arg unused
+ */
+static void ota_pipeline_writer_task(void *arg)
+{
+    ota_pipeline_block_t block;
+
+    while (xQueueReceive(ota_pipeline_full_q, &block, portMAX_DELAY) == pdTRUE)
+    {
+        if (block.data == NULL)
+        {
+            break;
+        }
+
+        // After the first failure blocks are only recycled so the receiver never stalls
+        if (block.len > 0 && atomic_load(&ota_pipeline_error) == ESP_OK)
+        {
+            esp_err_t error = ota_pipeline_sink.write(block.data, block.len, ota_pipeline_sink.ctx);
+            if (error != ESP_OK)
+            {
+                ESP_LOGE(TAG, "Write of %u bytes failed: %s", (unsigned)block.len, esp_err_to_name(error));
+                atomic_store(&ota_pipeline_error, error);
+            }
+        }
+        xQueueSend(ota_pipeline_free_q, &block.data, portMAX_DELAY);
+    }
+
+    xSemaphoreGive(ota_pipeline_done);
+    vTaskDelete(NULL);
+}
+
+static void ota_pipeline_release(void)
+{
+    if (ota_pipeline_free_q != NULL)
+    {
+        vQueueDelete(ota_pipeline_free_q);
+        ota_pipeline_free_q = NULL;
+    }
+    if (ota_pipeline_full_q != NULL)
+    {
+        vQueueDelete(ota_pipeline_full_q);
+        ota_pipeline_full_q = NULL;
+    }
+    if (ota_pipeline_done != NULL)
+    {
+        vSemaphoreDelete(ota_pipeline_done);
+        ota_pipeline_done = NULL;
+    }
+    free(ota_pipeline_pool);
+    ota_pipeline_pool = NULL;
+}
+
+esp_err_t ota_pipeline_start(const ota_pipeline_sink_t *sink)
+{
+    if (sink == NULL || sink->write == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (ota_pipeline_pool != NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // The ring is only needed during an upload, so it is not kept around
+    ota_pipeline_pool = malloc(OTA_PIPELINE_BUFFER_COUNT * OTA_PIPELINE_BUFFER_SIZE);
+    ota_pipeline_free_q = xQueueCreate(OTA_PIPELINE_BUFFER_COUNT, sizeof(char *));
+    ota_pipeline_full_q = xQueueCreate(OTA_PIPELINE_BUFFER_COUNT + 1, sizeof(ota_pipeline_block_t));
+    ota_pipeline_done = xSemaphoreCreateBinary();
+    if (ota_pipeline_pool == NULL || ota_pipeline_free_q == NULL ||
+        ota_pipeline_full_q == NULL || ota_pipeline_done == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to allocate the block ring");
+        ota_pipeline_release();
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (size_t i = 0; i < OTA_PIPELINE_BUFFER_COUNT; i++)
+    {
+        char *block = ota_pipeline_pool + i * OTA_PIPELINE_BUFFER_SIZE;
+        xQueueSend(ota_pipeline_free_q, &block, 0);
+    }
+
+    ota_pipeline_sink = *sink;
+    atomic_store(&ota_pipeline_error, ESP_OK);
+
+    if (xTaskCreate(ota_pipeline_writer_task, "ota_writer", OTA_PIPELINE_TASK_STACK_SIZE,
+                    NULL, OTA_PIPELINE_TASK_PRIORITY, NULL) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed to create the writer task");
+        ota_pipeline_release();
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+char *ota_pipeline_acquire(size_t *len)
+{
+    char *block = NULL;
+
+    if (ota_pipeline_free_q == NULL ||
+        xQueueReceive(ota_pipeline_free_q, &block, pdMS_TO_TICKS(OTA_PIPELINE_ACQUIRE_TIMEOUT_MS)) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "No free block, writer stalled");
+        return NULL;
+    }
+
+    *len = OTA_PIPELINE_BUFFER_SIZE;
+    return block;
+}
+
+esp_err_t ota_pipeline_submit(char *block, size_t len)
+{
+    ota_pipeline_block_t item = {.data = block, .len = len};
+
+    // Never blocks: the full queue has room for every block plus the stop marker
+    xQueueSend(ota_pipeline_full_q, &item, portMAX_DELAY);
+    return (esp_err_t)atomic_load(&ota_pipeline_error);
+}
+
+esp_err_t ota_pipeline_finish(void)
+{
+    ota_pipeline_block_t stop = {.data = NULL, .len = 0};
+
+    if (ota_pipeline_pool == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xQueueSend(ota_pipeline_full_q, &stop, portMAX_DELAY);
+    xSemaphoreTake(ota_pipeline_done, portMAX_DELAY);
+    ota_pipeline_release();
+
+    return (esp_err_t)atomic_load(&ota_pipeline_error);
+}
@@ -0,0 +1,122 @@
+#include "unity.h"
+#include "esp_log.h"
+#include "ota_pipeline.h"
+#include <string.h>
+
+#define TEST_IMAGE_SIZE (5 * OTA_PIPELINE_BUFFER_SIZE + 123)
+
+static uint8_t test_flash[TEST_IMAGE_SIZE];
+static size_t test_flash_used = 0;
+static uint32_t test_write_calls = 0;
+static uint32_t test_fail_on_call = 0; // 0 never fails
+
+static esp_err_t test_sink_write(const void *data, size_t len, void *ctx)
+{
+    test_write_calls++;
+    if (test_write_calls == test_fail_on_call)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (test_flash_used + len > sizeof(test_flash))
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(test_flash + test_flash_used, data, len);
+    test_flash_used += len;
+    return ESP_OK;
+}
+
+static void test_reset_sink(uint32_t fail_on_call)
+{
+    memset(test_flash, 0, sizeof(test_flash));
+    test_flash_used = 0;
+    test_write_calls = 0;
+    test_fail_on_call = fail_on_call;
+}
+
+static uint8_t test_pattern(size_t offset)
+{
+    return (uint8_t)((offset * 7u) ^ (offset >> 8));
+}
+
+/*
+ * Pushes TEST_IMAGE_SIZE bytes of the test pattern through the pipeline
+ * @return first error returned by ota_pipeline_submit
+ */
+static esp_err_t test_push_image(void)
+{
+    esp_err_t result = ESP_OK;
+    size_t offset = 0;
+
+    while (offset < TEST_IMAGE_SIZE)
+    {
+        size_t len = 0;
+        char *block = ota_pipeline_acquire(&len);
+        TEST_ASSERT_NOT_NULL(block);
+        TEST_ASSERT_EQUAL(OTA_PIPELINE_BUFFER_SIZE, len);
+
+        size_t fill = (TEST_IMAGE_SIZE - offset < len) ? TEST_IMAGE_SIZE - offset : len;
+        for (size_t i = 0; i < fill; i++)
+        {
+            block[i] = (char)test_pattern(offset + i);
+        }
+        offset += fill;
+
+        esp_err_t error = ota_pipeline_submit(block, fill);
+        if (result == ESP_OK)
+        {
+            result = error;
+        }
+    }
+    return result;
+}
+
+static const ota_pipeline_sink_t test_sink = {.write = test_sink_write, .ctx = NULL};
+
+TEST_CASE("OTA Pipeline: Writes blocks in order", "[ota_pipeline]")
+{
+    test_reset_sink(0);
+
+    TEST_ASSERT_EQUAL(ESP_OK, ota_pipeline_start(&test_sink));
+    TEST_ASSERT_EQUAL(ESP_OK, test_push_image());
+    TEST_ASSERT_EQUAL(ESP_OK, ota_pipeline_finish());
+
+    TEST_ASSERT_EQUAL(TEST_IMAGE_SIZE, test_flash_used);
+    TEST_ASSERT_EQUAL_UINT32(6, test_write_calls);
+    for (size_t i = 0; i < TEST_IMAGE_SIZE; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT8(test_pattern(i), test_flash[i]);
+    }
+}
+
+TEST_CASE("OTA Pipeline: Propagates write errors", "[ota_pipeline]")
+{
+    test_reset_sink(2);
+
+    TEST_ASSERT_EQUAL(ESP_OK, ota_pipeline_start(&test_sink));
+    test_push_image();
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, ota_pipeline_finish());
+
+    // Nothing is written after the failing block
+    TEST_ASSERT_EQUAL_UINT32(2, test_write_calls);
+    TEST_ASSERT_EQUAL(OTA_PIPELINE_BUFFER_SIZE, test_flash_used);
+}
+
+TEST_CASE("OTA Pipeline: Single instance", "[ota_pipeline]")
+{
+    test_reset_sink(0);
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, ota_pipeline_start(NULL));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, ota_pipeline_finish());
+
+    TEST_ASSERT_EQUAL(ESP_OK, ota_pipeline_start(&test_sink));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, ota_pipeline_start(&test_sink));
+
+    // An empty block is handed back without reaching the sink
+    size_t len = 0;
+    char *block = ota_pipeline_acquire(&len);
+    TEST_ASSERT_NOT_NULL(block);
+    TEST_ASSERT_EQUAL(ESP_OK, ota_pipeline_submit(block, 0));
+    TEST_ASSERT_EQUAL(ESP_OK, ota_pipeline_finish());
+    TEST_ASSERT_EQUAL_UINT32(0, test_write_calls);
+}
@@ -0,0 +1,57 @@
+/**
+ * @file rate_limit.h
+ *
+ * Per-client token buckets. A limiter holds a fixed table of clients, when a
+ * new client arrives and the table is full the least recently seen one is
+ * evicted. The caller passes the time in. The limiter has no locking of its
+ * own: callers on more than one task serialise rate_limit_take, the HTTP and
+ * HTTPS server tasks share a mutex for it.
+ */
+#ifndef RATE_LIMIT_H
+#define RATE_LIMIT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define RATE_LIMIT_TABLE_SIZE (16u)        // Clients tracked per limiter, above the server's socket limit
+#define RATE_LIMIT_TOKEN_SCALE (1000000u) // Tokens are kept in millionths of a request
+
+typedef struct rate_limit_config
+{
+    uint32_t per_minute; // Refill rate in requests per minute, 0 disables the limiter
+    uint32_t burst;      // Bucket size, requests accepted back to back
+} rate_limit_config_t;
+
+typedef struct rate_limit_entry
+{
+    uint32_t client;    // Client address
+    uint32_t tokens;    // In RATE_LIMIT_TOKEN_SCALE units
+    int64_t updated_us; // Last request, both the refill and the LRU time
+    bool used;
+} rate_limit_entry_t;
+
+typedef struct rate_limit
+{
+    rate_limit_config_t config;
+    uint32_t evictions; // Clients dropped from a full table
+    rate_limit_entry_t entries[RATE_LIMIT_TABLE_SIZE];
+} rate_limit_t;
+
+/**
+ * @brief Sets the limits and forgets all clients
+ * @param limit limiter state
+ * @param config rate and burst, burst is kept between 1 and 4294
+ */
+void rate_limit_init(rate_limit_t *limit, const rate_limit_config_t *config);
+
+/**
+ * @brief Takes one token from the client's bucket
+ * @param limit limiter state
+ * @param client client key, e.g. the IPv4 address
+ * @param now_us current time in microseconds
+ * @param retry_after_s if the request is refused, seconds until a token is available; may be NULL
+ * @return true if the request may proceed
+ */
+bool rate_limit_take(rate_limit_t *limit, uint32_t client, int64_t now_us, uint32_t *retry_after_s);
+
+#endif // RATE_LIMIT_H
@@ -0,0 +1,99 @@
+/**
+ * @file rate_limit.c
+ *
+ * The table is small enough that a linear scan is cheaper than any index: one
+ * pass finds the client, a free slot or the eviction candidate.
+ */
+
+#include <string.h>
+#include "rate_limit.h"
+
+#define RATE_LIMIT_BURST_MAX (UINT32_MAX / RATE_LIMIT_TOKEN_SCALE)
+
+void rate_limit_init(rate_limit_t *limit, const rate_limit_config_t *config)
+{
+    memset(limit, 0, sizeof(*limit));
+    limit->config = *config;
+    if (limit->config.burst == 0)
+    {
+        limit->config.burst = 1;
+    }
+    else if (limit->config.burst > RATE_LIMIT_BURST_MAX)
+    {
+        limit->config.burst = RATE_LIMIT_BURST_MAX;
+    }
+}
+
+/*
+ * Finds the client's entry, starting a full bucket for a new client
+ * @param limit limiter state
+ * @param client client key
+ * @param now_us current time
+ * @return the client's entry
+ */
+static rate_limit_entry_t *rate_limit_find(rate_limit_t *limit, uint32_t client, int64_t now_us)
+{
+    rate_limit_entry_t *victim = NULL;
+
+    for (size_t i = 0; i < RATE_LIMIT_TABLE_SIZE; i++)
+    {
+        rate_limit_entry_t *entry = &limit->entries[i];
+        if (!entry->used)
+        {
+            if (victim == NULL || victim->used)
+            {
+                victim = entry;
+            }
+        }
+        else if (entry->client == client)
+        {
+            return entry;
+        }
+        else if (victim == NULL || (victim->used && entry->updated_us < victim->updated_us))
+        {
+            victim = entry;
+        }
+    }
+
+    if (victim->used)
+    {
+        limit->evictions++;
+    }
+    victim->used = true;
+    victim->client = client;
+    victim->tokens = limit->config.burst * RATE_LIMIT_TOKEN_SCALE;
+    victim->updated_us = now_us;
+    return victim;
+}
+
+bool rate_limit_take(rate_limit_t *limit, uint32_t client, int64_t now_us, uint32_t *retry_after_s)
+{
+    if (limit->config.per_minute == 0)
+    {
+        return true;
+    }
+
+    rate_limit_entry_t *entry = rate_limit_find(limit, client, now_us);
+    uint32_t capacity = limit->config.burst * RATE_LIMIT_TOKEN_SCALE;
+
+    // Millionths of a request per microsecond is per_minute / 60
+    if (now_us > entry->updated_us)
+    {
+        uint64_t refill = (uint64_t)(now_us - entry->updated_us) * limit->config.per_minute / 60u;
+        entry->tokens = (refill >= capacity - entry->tokens) ? capacity : entry->tokens + (uint32_t)refill;
+    }
+    entry->updated_us = now_us;
+
+    if (entry->tokens >= RATE_LIMIT_TOKEN_SCALE)
+    {
+        entry->tokens -= RATE_LIMIT_TOKEN_SCALE;
+        return true;
+    }
+
+    if (retry_after_s != NULL)
+    {
+        uint64_t wait_us = (uint64_t)(RATE_LIMIT_TOKEN_SCALE - entry->tokens) * 60u / limit->config.per_minute;
+        *retry_after_s = (uint32_t)((wait_us + 999999u) / 1000000u);
+    }
+    return false;
+}
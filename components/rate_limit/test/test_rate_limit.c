@@ -0,0 +1,82 @@
+#include "unity.h"
+#include "rate_limit.h"
+
+#define TEST_CLIENT_A (0x0104A8C0) // 192.168.4.1 in network order
+#define TEST_CLIENT_B (0x0204A8C0)
+
+static rate_limit_t test_limit;
+
+TEST_CASE("Rate Limit: Burst, refusal and refill", "[rate_limit]")
+{
+    const rate_limit_config_t config = {.per_minute = 60, .burst = 3};
+    uint32_t retry_after_s = 0;
+    int64_t now_us = 1000000;
+
+    rate_limit_init(&test_limit, &config);
+    for (int i = 0; i < 3; i++)
+    {
+        TEST_ASSERT_TRUE(rate_limit_take(&test_limit, TEST_CLIENT_A, now_us, &retry_after_s));
+    }
+    TEST_ASSERT_FALSE(rate_limit_take(&test_limit, TEST_CLIENT_A, now_us, &retry_after_s));
+    TEST_ASSERT_EQUAL_UINT32(1, retry_after_s);
+
+    // 1 per second: half a second is not enough, the rest of the second is
+    now_us += 500000;
+    TEST_ASSERT_FALSE(rate_limit_take(&test_limit, TEST_CLIENT_A, now_us, &retry_after_s));
+    TEST_ASSERT_EQUAL_UINT32(1, retry_after_s);
+    now_us += 500000;
+    TEST_ASSERT_TRUE(rate_limit_take(&test_limit, TEST_CLIENT_A, now_us, NULL));
+
+    // Refill stops at the burst size
+    now_us += 60 * 1000000ll;
+    for (int i = 0; i < 3; i++)
+    {
+        TEST_ASSERT_TRUE(rate_limit_take(&test_limit, TEST_CLIENT_A, now_us, NULL));
+    }
+    TEST_ASSERT_FALSE(rate_limit_take(&test_limit, TEST_CLIENT_A, now_us, NULL));
+
+    // Slow rates give a longer wait
+    const rate_limit_config_t slow = {.per_minute = 6, .burst = 1};
+    rate_limit_init(&test_limit, &slow);
+    TEST_ASSERT_TRUE(rate_limit_take(&test_limit, TEST_CLIENT_A, now_us, NULL));
+    TEST_ASSERT_FALSE(rate_limit_take(&test_limit, TEST_CLIENT_A, now_us, &retry_after_s));
+    TEST_ASSERT_EQUAL_UINT32(10, retry_after_s);
+}
+
+TEST_CASE("Rate Limit: Clients have separate buckets and the oldest is evicted", "[rate_limit]")
+{
+    const rate_limit_config_t config = {.per_minute = 60, .burst = 1};
+    int64_t now_us = 1000;
+
+    rate_limit_init(&test_limit, &config);
+    TEST_ASSERT_TRUE(rate_limit_take(&test_limit, TEST_CLIENT_A, now_us, NULL));
+    TEST_ASSERT_TRUE(rate_limit_take(&test_limit, TEST_CLIENT_B, now_us, NULL));
+    TEST_ASSERT_FALSE(rate_limit_take(&test_limit, TEST_CLIENT_A, now_us, NULL));
+    TEST_ASSERT_FALSE(rate_limit_take(&test_limit, TEST_CLIENT_B, now_us, NULL));
+
+    // Fill the table with other clients, A was seen last of the two so B goes first
+    now_us++;
+    TEST_ASSERT_FALSE(rate_limit_take(&test_limit, TEST_CLIENT_A, now_us, NULL));
+    for (uint32_t client = 1; client <= RATE_LIMIT_TABLE_SIZE - 1; client++)
+    {
+        TEST_ASSERT_TRUE(rate_limit_take(&test_limit, client, ++now_us, NULL));
+    }
+    TEST_ASSERT_EQUAL_UINT32(1, test_limit.evictions);
+    TEST_ASSERT_FALSE(rate_limit_take(&test_limit, TEST_CLIENT_A, now_us, NULL));
+
+    // An evicted client comes back with a full bucket
+    TEST_ASSERT_TRUE(rate_limit_take(&test_limit, TEST_CLIENT_B, now_us, NULL));
+    TEST_ASSERT_EQUAL_UINT32(2, test_limit.evictions);
+}
+
+TEST_CASE("Rate Limit: A zero rate disables the limiter", "[rate_limit]")
+{
+    const rate_limit_config_t config = {.per_minute = 0, .burst = 0};
+
+    rate_limit_init(&test_limit, &config);
+    for (int i = 0; i < 100; i++)
+    {
+        TEST_ASSERT_TRUE(rate_limit_take(&test_limit, TEST_CLIENT_A, 0, NULL));
+    }
+    TEST_ASSERT_FALSE(test_limit.entries[0].used);
+}
@@ -20,6 +20,12 @@ typedef struct
     uint32_t timestamp; // Timestamp of the last access
 } rfid_card_t;
 
+// Access decision hook, called after every rfid_manager_check_card() with the
+// card that was presented and the decision (ESP_OK granted, ESP_ERR_NOT_FOUND
+// unknown, ESP_ERR_INVALID_STATE inactive, anything else an error).
+// Runs on the caller's task after rfid_mutex has been released, so it must not block.
+typedef void (*rfid_manager_check_cb_t)(uint32_t card_id, esp_err_t result);
+
 // Initialization
 esp_err_t rfid_manager_init(void);
 esp_err_t rfid_manager_load_defaults(void);
@@ -28,6 +34,13 @@ esp_err_t rfid_manager_load_defaults(void);
 esp_err_t rfid_manager_add_card(uint32_t card_id, const char *name);
 esp_err_t rfid_manager_remove_card(uint32_t card_id);
 esp_err_t rfid_manager_check_card(uint32_t card_id);
+// Copies one card, ESP_ERR_NOT_FOUND if it is not in the database
+esp_err_t rfid_manager_get_card(uint32_t card_id, rfid_card_t *card);
+// Changes the name (NULL keeps it) and/or the active flag (-1 keeps it) of a
+// card. ESP_ERR_NOT_FOUND for unknown cards, ESP_ERR_NOT_SUPPORTED when
+// deactivating the admin card.
+esp_err_t rfid_manager_update_card(uint32_t card_id, const char *name, int active);
+void rfid_manager_set_check_callback(rfid_manager_check_cb_t callback);
 
 // Database Operations
 uint16_t rfid_manager_get_card_count(void);
@@ -39,6 +52,10 @@ esp_err_t rfid_manager_load_from_file(void);
 esp_err_t rfid_manager_format_database(void);
 esp_err_t rfid_manager_reset_to_defaults(void);
 bool rfid_manager_is_database_valid(void);
+// Changes whenever the card set may have changed (add, remove, format, save), so
+// responses built from the database can be cached until it moves. Starts at 1
+// on every boot; not persisted.
+uint32_t rfid_manager_get_version(void);
 esp_err_t rfid_manager_get_card_list_json(char *buffer, size_t buffer_len);
 
 #endif // RFID_MANAGER_H
@@ -2,6 +2,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
+#include <stdatomic.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "freertos/task.h"
@@ -16,6 +17,9 @@
 
 static const char *TAG = "rfid_manager";
 static SemaphoreHandle_t rfid_mutex = NULL;
+static rfid_manager_check_cb_t rfid_check_cb = NULL;
+// Bumped before every write to the database files, see rfid_manager_get_version()
+static atomic_uint rfid_db_version = 1;
 
 // RFID database header
 typedef struct
@@ -65,6 +69,7 @@ esp_err_t rfid_manager_init(void)
     {
         ESP_LOGI(TAG, "RFID database not found, creating new database");
         rfid_database_t db = {0, 200, 0}; // Initialize with 0 cards, max 200 cards
+        atomic_fetch_add(&rfid_db_version, 1);
         if (!spiffs_storage_write_file(RFID_DB_PATH, (const char *)&db, sizeof(db), false, true))
         {
             ESP_LOGE(TAG, "Failed to create RFID database");
@@ -93,6 +98,7 @@ esp_err_t rfid_manager_load_defaults(void)
     {
         // Create a new database file with default values
         rfid_database_t db = {0, 200, 0}; // Initialize with 0 cards, max 200 cards
+        atomic_fetch_add(&rfid_db_version, 1);
         if (!spiffs_storage_write_file(RFID_DB_PATH, (const char *)&db, sizeof(db), false, true))
         {
             ESP_LOGE(TAG, "Failed to create RFID database");
@@ -188,6 +194,7 @@ esp_err_t rfid_manager_add_card(uint32_t card_id, const char *name)
 
         // Write the updated database back to file
         db.card_count++;
+        atomic_fetch_add(&rfid_db_version, 1);
         if (!spiffs_storage_write_file(RFID_DB_PATH, (const char *)&db, sizeof(db), false, true))
         {
             ESP_LOGE(TAG, "Failed to update RFID database");
@@ -300,6 +307,7 @@ esp_err_t rfid_manager_remove_card(uint32_t card_id)
     }
 
     // Write the updated database back to file
+    atomic_fetch_add(&rfid_db_version, 1);
     if (!spiffs_storage_write_file(RFID_DB_PATH, (const char *)&db, sizeof(db), false, true))
     {
         ESP_LOGE(TAG, "Failed to update RFID database");
@@ -338,7 +346,139 @@ esp_err_t rfid_manager_remove_card(uint32_t card_id)
     return ESP_OK;
 }
 
-esp_err_t rfid_manager_check_card(uint32_t card_id)
+/*
+ * Loads the database header and all cards, the caller holds rfid_mutex
+ * @param db receives the header
+ * @param cards receives a malloc'd array of db->card_count cards (NULL if
+ * there are none), to be freed by the caller
+ * @return ESP_OK, ESP_ERR_NO_MEM, or ESP_FAIL if a file could not be read
+ */
+static esp_err_t rfid_manager_read_cards(rfid_database_t *db, rfid_card_t **cards)
+{
+    *cards = NULL;
+    if (!spiffs_storage_read_file(RFID_DB_PATH, (char *)db, sizeof(*db)))
+    {
+        ESP_LOGE(TAG, "Failed to read RFID database");
+        return ESP_FAIL;
+    }
+    if (db->card_count == 0)
+    {
+        return ESP_OK;
+    }
+
+    *cards = (rfid_card_t *)malloc(db->card_count * sizeof(rfid_card_t));
+    if (*cards == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to allocate memory for cards");
+        return ESP_ERR_NO_MEM;
+    }
+    if (!spiffs_storage_read_file(RFID_CARDS_PATH, (char *)*cards, db->card_count * sizeof(rfid_card_t)))
+    {
+        ESP_LOGE(TAG, "Failed to read RFID cards");
+        free(*cards);
+        *cards = NULL;
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t rfid_manager_get_card(uint32_t card_id, rfid_card_t *card)
+{
+    rfid_database_t db;
+    rfid_card_t *cards = NULL;
+
+    if (card == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (xSemaphoreTake(rfid_mutex, portMAX_DELAY) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Failed to take rfid_mutex");
+        return ESP_FAIL;
+    }
+
+    esp_err_t result = rfid_manager_read_cards(&db, &cards);
+    if (result == ESP_OK)
+    {
+        result = ESP_ERR_NOT_FOUND;
+        for (uint16_t i = 0; i < db.card_count; i++)
+        {
+            if (cards[i].card_id == card_id)
+            {
+                *card = cards[i];
+                result = ESP_OK;
+                break;
+            }
+        }
+    }
+
+    free(cards);
+    xSemaphoreGive(rfid_mutex);
+    return result;
+}
+
+esp_err_t rfid_manager_update_card(uint32_t card_id, const char *name, int active)
+{
+    rfid_database_t db;
+    rfid_card_t *cards = NULL;
+
+    ESP_LOGI(TAG, "Updating RFID card: %lu", (unsigned long)card_id);
+
+    // The admin card must stay usable
+    if (card_id == ADMIN_CARD_ID && active == 0)
+    {
+        ESP_LOGW(TAG, "Attempted to deactivate protected admin card: %lu", (unsigned long)card_id);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (xSemaphoreTake(rfid_mutex, portMAX_DELAY) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Failed to take rfid_mutex");
+        return ESP_FAIL;
+    }
+
+    esp_err_t result = rfid_manager_read_cards(&db, &cards);
+    rfid_card_t *card = NULL;
+    for (uint16_t i = 0; result == ESP_OK && i < db.card_count; i++)
+    {
+        if (cards[i].card_id == card_id)
+        {
+            card = &cards[i];
+            break;
+        }
+    }
+    if (result == ESP_OK && card == NULL)
+    {
+        ESP_LOGW(TAG, "Card not found: %lu", (unsigned long)card_id);
+        result = ESP_ERR_NOT_FOUND;
+    }
+
+    if (result == ESP_OK)
+    {
+        if (name != NULL)
+        {
+            strncpy(card->name, name, sizeof(card->name) - 1);
+            card->name[sizeof(card->name) - 1] = '\0'; // Ensure null termination
+        }
+        if (active >= 0)
+        {
+            card->active = (active != 0) ? 1 : 0;
+        }
+
+        // Only the cards file changes, the header stays as it is
+        atomic_fetch_add(&rfid_db_version, 1);
+        if (!spiffs_storage_write_file(RFID_CARDS_PATH, (const char *)cards, db.card_count * sizeof(rfid_card_t), false, true))
+        {
+            ESP_LOGE(TAG, "Failed to write updated RFID cards");
+            result = ESP_FAIL;
+        }
+    }
+
+    free(cards);
+    xSemaphoreGive(rfid_mutex);
+    return result;
+}
+
+static esp_err_t rfid_manager_lookup_card(uint32_t card_id)
 {
     ESP_LOGI(TAG, "Checking RFID card: %lu", (unsigned long)card_id);
 
@@ -416,6 +556,30 @@ esp_err_t rfid_manager_check_card(uint32_t card_id)
     return result;
 }
 
+esp_err_t rfid_manager_check_card(uint32_t card_id)
+{
+    esp_err_t result = rfid_manager_lookup_card(card_id);
+
+    // Report the decision outside of rfid_mutex so listeners never stall the database
+    rfid_manager_check_cb_t callback = rfid_check_cb;
+    if (callback != NULL)
+    {
+        callback(card_id, result);
+    }
+
+    return result;
+}
+
+uint32_t rfid_manager_get_version(void)
+{
+    return atomic_load(&rfid_db_version);
+}
+
+void rfid_manager_set_check_callback(rfid_manager_check_cb_t callback)
+{
+    rfid_check_cb = callback;
+}
+
 uint16_t rfid_manager_get_card_count(void)
 {
     ESP_LOGI(TAG, "Getting RFID card count");
@@ -524,6 +688,7 @@ esp_err_t rfid_manager_save_to_file(void)
     }
 
     // Write the database back to file
+    atomic_fetch_add(&rfid_db_version, 1);
     if (!spiffs_storage_write_file(RFID_DB_PATH, (const char *)&db, sizeof(db), false, true))
     {
         ESP_LOGE(TAG, "Failed to write RFID database");
@@ -601,6 +766,7 @@ esp_err_t rfid_manager_format_database(void)
     rfid_database_t db = {0, 200, 0}; // Initialize with 0 cards, max 200 cards
 
     // Write the new database to file
+    atomic_fetch_add(&rfid_db_version, 1);
     if (!spiffs_storage_write_file(RFID_DB_PATH, (const char *)&db, sizeof(db), false, true))
     {
         ESP_LOGE(TAG, "Failed to write new RFID database");
@@ -118,6 +118,55 @@ TEST_CASE("RFID Manager: Get Card Count", "[rfid_manager]")
     TEST_ASSERT_EQUAL_UINT16(2, count);
 }
 
+TEST_CASE("RFID Manager: Version changes on every modification", "[rfid_manager]")
+{
+    TEST_ASSERT_EQUAL(ESP_OK, rfid_manager_init());
+    rfid_manager_format_database();
+
+    uint32_t version = rfid_manager_get_version();
+    TEST_ASSERT_EQUAL_UINT16(0, rfid_manager_get_card_count());
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, rfid_manager_check_card(TEST_CARD_ID_2));
+    TEST_ASSERT_EQUAL_UINT32(version, rfid_manager_get_version()); // Reads leave it alone
+
+    TEST_ASSERT_EQUAL(ESP_OK, rfid_manager_add_card(TEST_CARD_ID_2, TEST_CARD_NAME_2));
+    TEST_ASSERT_NOT_EQUAL(version, rfid_manager_get_version());
+
+    version = rfid_manager_get_version();
+    TEST_ASSERT_EQUAL(ESP_OK, rfid_manager_remove_card(TEST_CARD_ID_2));
+    TEST_ASSERT_NOT_EQUAL(version, rfid_manager_get_version());
+
+    version = rfid_manager_get_version();
+    TEST_ASSERT_EQUAL(ESP_OK, rfid_manager_reset_to_defaults());
+    TEST_ASSERT_NOT_EQUAL(version, rfid_manager_get_version());
+}
+
+TEST_CASE("RFID Manager: Get and update a card", "[rfid_manager]")
+{
+    rfid_card_t card;
+
+    TEST_ASSERT_EQUAL(ESP_OK, rfid_manager_init());
+    rfid_manager_format_database();
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, rfid_manager_get_card(TEST_CARD_ID_2, &card));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, rfid_manager_update_card(TEST_CARD_ID_2, "Nobody", -1));
+
+    TEST_ASSERT_EQUAL(ESP_OK, rfid_manager_add_card(TEST_CARD_ID_2, TEST_CARD_NAME_2));
+    TEST_ASSERT_EQUAL(ESP_OK, rfid_manager_get_card(TEST_CARD_ID_2, &card));
+    TEST_ASSERT_EQUAL_STRING(TEST_CARD_NAME_2, card.name);
+    TEST_ASSERT_EQUAL(1, card.active);
+
+    uint32_t version = rfid_manager_get_version();
+    TEST_ASSERT_EQUAL(ESP_OK, rfid_manager_update_card(TEST_CARD_ID_2, NULL, 0));
+    TEST_ASSERT_NOT_EQUAL(version, rfid_manager_get_version());
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, rfid_manager_check_card(TEST_CARD_ID_2));
+
+    TEST_ASSERT_EQUAL(ESP_OK, rfid_manager_update_card(TEST_CARD_ID_2, "A name longer than the thirty-one bytes kept", -1));
+    TEST_ASSERT_EQUAL(ESP_OK, rfid_manager_get_card(TEST_CARD_ID_2, &card));
+    TEST_ASSERT_EQUAL(31, strlen(card.name));
+    TEST_ASSERT_EQUAL(0, card.active);
+
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_SUPPORTED, rfid_manager_update_card(TEST_CARD_ID_1, NULL, 0));
+}
+
 TEST_CASE("RFID Manager: Load Defaults", "[rfid_manager]")
 {
     TEST_ASSERT_EQUAL(ESP_OK, rfid_manager_init());
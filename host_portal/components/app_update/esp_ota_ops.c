@@ -0,0 +1,47 @@
+#include "esp_ota_ops.h"
+
+const esp_partition_t *esp_ota_get_running_partition(void)
+{
+    return esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, NULL);
+}
+
+const esp_partition_t *esp_ota_get_boot_partition(void)
+{
+    return esp_ota_get_running_partition();
+}
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from)
+{
+    return NULL;
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp_ota_handle_t *out_handle)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+// Only built for the device in esp_partition, app_local_server asks for it to accept delta images
+esp_err_t esp_partition_get_sha256(const esp_partition_t *partition, uint8_t *sha_256)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
@@ -0,0 +1,34 @@
+#ifndef SPIFFS_STORAGE_H
+#define SPIFFS_STORAGE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "esp_err.h"
+#include "esp_log.h"
+
+/**
+ * Host build: "/spiffs/<name>" paths are mapped to SPIFFS_STORAGE_HOST_DIR
+ * in the working directory, the database persists between runs like on the
+ * device.
+ */
+#define SPIFFS_STORAGE_HOST_DIR "spiffs"
+
+bool spiffs_storage_init(void);
+bool spiffs_storage_is_initialized(void);
+void spiffs_storage_test(void);
+void spiffs_storage_deinit(void);
+
+bool spiffs_storage_file_exists(const char *filename);
+int32_t spiffs_storage_get_file_size(const char *filename);
+bool spiffs_storage_delete_file(const char *filename);
+bool spiffs_storage_rename_file(const char *old_filename, const char *new_filename);
+bool spiffs_storage_write_file(const char *filename, const char *data, size_t data_size,
+                               bool append, bool is_binary);
+bool spiffs_storage_read_file(const char *filename, char *buffer, size_t buffer_size);
+bool spiffs_storage_read_file_line(const char *filename, char *buffer, size_t buffer_size);
+bool spiffs_storage_create_file(const char *filename);
+bool spiffs_storage_list_files(void);
+
+#endif // SPIFFS_STORAGE_H
@@ -0,0 +1,218 @@
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <dirent.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "spiffs_storage.h"
+
+#define TAG "SPIFFS_STORAGE"
+
+#define SPIFFS_STORAGE_MOUNT_POINT "/spiffs"
+#define SPIFFS_STORAGE_PATH_LEN (128)
+
+static bool spiffs_initialized = false;
+// SPIFFS_STORAGE_WRITE_DELAY_MS from the environment, stands in for flash erase time
+static uint32_t spiffs_write_delay_ms = 0;
+
+/*
+ * Maps a device path to the host directory
+ * @param filename path below /spiffs
+ * @param path buffer of SPIFFS_STORAGE_PATH_LEN bytes for the host path
+ * @return path
+ */
+static const char *spiffs_storage_host_path(const char *filename, char *path)
+{
+    size_t mount_len = strlen(SPIFFS_STORAGE_MOUNT_POINT);
+
+    if (strncmp(filename, SPIFFS_STORAGE_MOUNT_POINT, mount_len) == 0)
+    {
+        snprintf(path, SPIFFS_STORAGE_PATH_LEN, "%s%s", SPIFFS_STORAGE_HOST_DIR, filename + mount_len);
+    }
+    else
+    {
+        snprintf(path, SPIFFS_STORAGE_PATH_LEN, "%s", filename);
+    }
+    return path;
+}
+
+bool spiffs_storage_init(void)
+{
+    if (spiffs_initialized)
+    {
+        return true;
+    }
+
+    if (mkdir(SPIFFS_STORAGE_HOST_DIR, 0755) != 0 && access(SPIFFS_STORAGE_HOST_DIR, W_OK) != 0)
+    {
+        ESP_LOGE(TAG, "Cannot use directory '%s'", SPIFFS_STORAGE_HOST_DIR);
+        return false;
+    }
+
+    const char *delay = getenv("SPIFFS_STORAGE_WRITE_DELAY_MS");
+    spiffs_write_delay_ms = (delay != NULL) ? strtoul(delay, NULL, 10) : 0;
+
+    ESP_LOGI(TAG, "Files are stored in '%s', %lu ms per write", SPIFFS_STORAGE_HOST_DIR,
+             (unsigned long)spiffs_write_delay_ms);
+    spiffs_initialized = true;
+    return true;
+}
+
+bool spiffs_storage_is_initialized(void)
+{
+    return spiffs_initialized;
+}
+
+void spiffs_storage_test(void)
+{
+}
+
+void spiffs_storage_deinit(void)
+{
+    spiffs_initialized = false;
+}
+
+bool spiffs_storage_create_file(const char *filename)
+{
+    char path[SPIFFS_STORAGE_PATH_LEN];
+    FILE *f = fopen(spiffs_storage_host_path(filename, path), "w");
+    if (f == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to create file: %s", filename);
+        return false;
+    }
+    fclose(f);
+    return true;
+}
+
+bool spiffs_storage_list_files(void)
+{
+    DIR *dir = opendir(SPIFFS_STORAGE_HOST_DIR);
+    if (dir == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to open directory");
+        return false;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        ESP_LOGI(TAG, "Found file: %s", entry->d_name);
+    }
+    closedir(dir);
+    return true;
+}
+
+bool spiffs_storage_file_exists(const char *filename)
+{
+    char path[SPIFFS_STORAGE_PATH_LEN];
+    struct stat st;
+    return stat(spiffs_storage_host_path(filename, path), &st) == 0;
+}
+
+int32_t spiffs_storage_get_file_size(const char *filename)
+{
+    char path[SPIFFS_STORAGE_PATH_LEN];
+    struct stat st;
+    if (stat(spiffs_storage_host_path(filename, path), &st) != 0)
+    {
+        ESP_LOGE(TAG, "File does not exist: %s", filename);
+        return -1;
+    }
+    return (int32_t)st.st_size;
+}
+
+bool spiffs_storage_delete_file(const char *filename)
+{
+    char path[SPIFFS_STORAGE_PATH_LEN];
+    if (unlink(spiffs_storage_host_path(filename, path)) != 0)
+    {
+        ESP_LOGE(TAG, "Failed to delete file: %s", filename);
+        return false;
+    }
+    return true;
+}
+
+bool spiffs_storage_rename_file(const char *old_filename, const char *new_filename)
+{
+    char old_path[SPIFFS_STORAGE_PATH_LEN];
+    char new_path[SPIFFS_STORAGE_PATH_LEN];
+    struct stat st;
+
+    spiffs_storage_host_path(old_filename, old_path);
+    spiffs_storage_host_path(new_filename, new_path);
+    // Same rules as the device: the destination must not exist
+    if (stat(old_path, &st) != 0 || stat(new_path, &st) == 0 || rename(old_path, new_path) != 0)
+    {
+        ESP_LOGE(TAG, "Failed to rename file: %s -> %s", old_filename, new_filename);
+        return false;
+    }
+    return true;
+}
+
+bool spiffs_storage_write_file(const char *filename, const char *data, size_t data_size, bool append, bool is_binary)
+{
+    if (!filename || !data || data_size == 0)
+    {
+        ESP_LOGE(TAG, "Invalid arguments to spiffs_storage_write_file");
+        return false;
+    }
+
+    char path[SPIFFS_STORAGE_PATH_LEN];
+    FILE *f = fopen(spiffs_storage_host_path(filename, path), append ? "ab" : "wb");
+    if (!f)
+    {
+        ESP_LOGE(TAG, "Failed to open file: %s", filename);
+        return false;
+    }
+
+    bool result = is_binary ? (fwrite(data, 1, data_size, f) == data_size) : (fprintf(f, "%s", data) >= 0);
+    fclose(f);
+    if (spiffs_write_delay_ms > 0)
+    {
+        // Blocks the calling task like a flash write on the device, other tasks keep running
+        vTaskDelay(pdMS_TO_TICKS(spiffs_write_delay_ms));
+    }
+    if (!result)
+    {
+        ESP_LOGE(TAG, "Write failed to file: %s", filename);
+    }
+    return result;
+}
+
+bool spiffs_storage_read_file(const char *filename, char *buffer, size_t buffer_size)
+{
+    if (!filename || !buffer || buffer_size == 0)
+    {
+        ESP_LOGE(TAG, "Invalid arguments to spiffs_storage_read_file");
+        return false;
+    }
+
+    char path[SPIFFS_STORAGE_PATH_LEN];
+    FILE *f = fopen(spiffs_storage_host_path(filename, path), "rb");
+    if (f == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to open file for reading: %s", filename);
+        return false;
+    }
+
+    // Partial reads are accepted, as on the device
+    fread(buffer, 1, buffer_size, f);
+    fclose(f);
+    return true;
+}
+
+bool spiffs_storage_read_file_line(const char *filename, char *buffer, size_t buffer_size)
+{
+    char path[SPIFFS_STORAGE_PATH_LEN];
+    FILE *f = fopen(spiffs_storage_host_path(filename, path), "r");
+    if (f == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to open file for reading: %s", filename);
+        return false;
+    }
+
+    bool result = (fgets(buffer, buffer_size, f) != NULL);
+    fclose(f);
+    return result;
+}
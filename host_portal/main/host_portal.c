@@ -0,0 +1,36 @@
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_event.h"
+#include "esp_log.h"
+#include "esp_netif.h"
+#include "nvs_storage.h"
+#include "spiffs_storage.h"
+#include "rfid_manager.h"
+#include "app_local_server.h"
+
+static const char *TAG = "host_portal";
+
+void app_main(void)
+{
+    // Same start up as main/main.c without the Wi-Fi part
+    nvs_storage_init();
+    spiffs_storage_init();
+    rfid_manager_init();
+    rfid_manager_load_defaults();
+
+    ESP_ERROR_CHECK(esp_netif_init());
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+
+    app_local_server_init();
+    app_local_server_start();
+
+    ESP_LOGW(TAG, "Portal listening on port %d, try: tools/portal_loadgen.py --host 127.0.0.1 --port %d",
+             CONFIG_APP_LOCAL_SERVER_PORT, CONFIG_APP_LOCAL_SERVER_PORT);
+
+    while (1)
+    {
+        app_local_server_process();
+        vTaskDelay(1000 / portTICK_PERIOD_MS);
+    }
+}
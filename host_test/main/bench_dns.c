@@ -0,0 +1,598 @@
+/**
+ * @file bench_dns.c
+ *
+ * Reply rate of the captive DNS server for the queries phones and laptops
+ * send right after joining the AP. The previous reply path is kept here for
+ * comparison: the 256 byte reply buffer cleared per query, every name copied
+ * out as text, and the AP address looked up per A question. In ESP-IDF 5.x
+ * that lookup (esp_netif_get_handle_from_ifkey) runs on the tcpip task, which
+ * the stand-in task below models with the same queue and semaphore round trip.
+ *
+ * The forwarding mode is measured against a stand-in resolver on a virtual
+ * clock: clients ask for names with Zipf popularity, the resolver answers
+ * after a fixed round trip with the TTL of the name, and every response goes
+ * through dns_cache as on the device. Hit rate and latency are given per
+ * cache size; a hit costs the measured lookup time, a miss the round trip.
+ *
+ * bench_dns_fuzz mutates well-formed queries (with EDNS0, several questions,
+ * compression) and checks every reply dns_codec builds in place: it is the
+ * same as one built into a separate buffer, fits the buffer and the client's
+ * UDP limit, and its section counts match the records it holds. The same
+ * inputs go through dns_cache as upstream responses and as queries.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "dns_codec.h"
+#include "dns_cache.h"
+#include "host_bench.h"
+
+#define BENCH_DNS_QUERIES (20000u)
+#define BENCH_DNS_REPLY_LEN (256u) // DNS_MAX_LEN of dns_server.c
+#define BENCH_DNS_TTL_S (300u)
+#define BENCH_DNS_AP_ADDR (0x0104A8C0u) // 192.168.4.1 in network order
+
+#define BENCH_DNS_FWD_NAMES (400u)
+#define BENCH_DNS_FWD_QUERIES (20000u)
+#define BENCH_DNS_FWD_INTERVAL_US (25000) // 40 queries/s from all clients together
+#define BENCH_DNS_FWD_RTT_US (20000)      // Upstream round trip, shorter than the interval
+#define BENCH_DNS_FWD_NXDOMAIN_EVERY (10u) // Every tenth name does not exist
+
+#define BENCH_DNS_FUZZ_CASES (500000u)
+#define BENCH_DNS_FUZZ_BUFFER (512u) // DNS_MAX_LEN of dns_server.c
+
+typedef enum
+{
+    BENCH_DNS_LEGACY = 0, // Cleared buffer, copied names, address looked up on the tcpip task
+    BENCH_DNS_LEGACY_DIRECT, // The same with the lookup as a plain read, to separate both costs
+    BENCH_DNS_TEMPLATE,      // dns_codec with the address cached
+} bench_dns_mode_e;
+
+static const char *const bench_dns_mode_names[] = {
+    "dns: per query netif lookup",
+    "dns: per query, no IPC",
+    "dns: answer template",
+};
+
+// A lookup handed to the stand-in tcpip task
+typedef struct
+{
+    uint32_t *addr;
+    SemaphoreHandle_t done;
+} bench_dns_ipc_t;
+
+static QueueHandle_t bench_dns_tcpip_queue = NULL;
+
+/*
+ * Stand-in for the tcpip task: answers address lookups, one at a time
+ */
+static void bench_dns_tcpip_task(void *arg)
+{
+    bench_dns_ipc_t ipc;
+
+    while (xQueueReceive(bench_dns_tcpip_queue, &ipc, portMAX_DELAY) == pdTRUE)
+    {
+        *ipc.addr = BENCH_DNS_AP_ADDR;
+        xSemaphoreGive(ipc.done);
+    }
+}
+
+/*
+ * Encodes a query for one question
+ * @param query destination, at least 12 + strlen(name) + 6 bytes
+ * @param id query id
+ * @param name dotted name
+ * @param type question type
+ * @return query length
+ */
+static size_t bench_dns_make_query(uint8_t *query, uint16_t id, const char *name, uint16_t type)
+{
+    size_t len = DNS_CODEC_HEADER_LEN;
+
+    memset(query, 0, DNS_CODEC_HEADER_LEN);
+    query[0] = (uint8_t)(id >> 8);
+    query[1] = (uint8_t)id;
+    query[2] = 0x01; // RD
+    query[5] = 1;
+    while (*name != '\0')
+    {
+        const char *dot = strchr(name, '.');
+        size_t label = (dot != NULL) ? (size_t)(dot - name) : strlen(name);
+        query[len++] = (uint8_t)label;
+        memcpy(&query[len], name, label);
+        len += label;
+        name += label + (dot != NULL);
+    }
+    query[len++] = 0;
+    query[len++] = (uint8_t)(type >> 8);
+    query[len++] = (uint8_t)type;
+    query[len++] = 0;
+    query[len++] = DNS_CODEC_CLASS_IN;
+    return len;
+}
+
+/*
+ * The reply path dns_server.c had before dns_codec, minus its logging
+ * @param ipc lookup round trip, NULL to read the address directly
+ * @return reply length, -1 if the query is malformed
+ */
+static int bench_dns_legacy_reply(const uint8_t *req, size_t req_len, uint8_t *reply, bench_dns_ipc_t *ipc)
+{
+    char name[128];
+
+    memset(reply, 0, BENCH_DNS_REPLY_LEN);
+    memcpy(reply, req, req_len);
+    reply[2] |= 0x80;
+    uint16_t qd_count = (uint16_t)((reply[4] << 8) | reply[5]);
+    reply[6] = reply[4];
+    reply[7] = reply[5];
+
+    size_t reply_len = req_len + qd_count * DNS_CODEC_ANSWER_LEN;
+    if (reply_len > BENCH_DNS_REPLY_LEN)
+    {
+        return -1;
+    }
+
+    uint8_t *answer = reply + req_len;
+    size_t offset = DNS_CODEC_HEADER_LEN;
+    for (uint16_t i = 0; i < qd_count; i++)
+    {
+        // Name copied out as dotted text, as parse_dns_name did
+        size_t name_len = 0;
+        while (reply[offset] != 0)
+        {
+            size_t label = reply[offset];
+            if (name_len + label + 1 > sizeof(name))
+            {
+                return -1;
+            }
+            memcpy(&name[name_len], &reply[offset + 1], label);
+            name_len += label;
+            name[name_len++] = '.';
+            offset += label + 1;
+        }
+        name[name_len - 1] = '\0';
+        size_t question = offset + 1;
+
+        if (reply[question] == 0 && reply[question + 1] == DNS_CODEC_TYPE_A)
+        {
+            uint32_t addr = BENCH_DNS_AP_ADDR;
+            if (ipc != NULL)
+            {
+                ipc->addr = &addr;
+                xQueueSend(bench_dns_tcpip_queue, ipc, portMAX_DELAY);
+                xSemaphoreTake(ipc->done, portMAX_DELAY);
+            }
+            answer[0] = 0xC0;
+            answer[1] = DNS_CODEC_HEADER_LEN;
+            answer[3] = DNS_CODEC_TYPE_A;
+            answer[4] = reply[question + 2];
+            answer[5] = reply[question + 3];
+            answer[8] = BENCH_DNS_TTL_S >> 8;
+            answer[9] = BENCH_DNS_TTL_S & 0xFF;
+            answer[11] = sizeof(addr);
+            memcpy(&answer[12], &addr, sizeof(addr));
+        }
+        answer += DNS_CODEC_ANSWER_LEN;
+        offset = question + 4;
+    }
+    return (int)reply_len;
+}
+
+static void bench_dns_run(bench_dns_mode_e mode, uint8_t queries[][64], const size_t *lengths, size_t count,
+                          bench_dns_ipc_t *ipc)
+{
+    dns_codec_answer_template_t tpl;
+    uint8_t reply[BENCH_DNS_REPLY_LEN];
+    uint64_t bytes = 0;
+    int len = 0;
+
+    dns_codec_template_init(&tpl, BENCH_DNS_AP_ADDR, BENCH_DNS_TTL_S);
+    int64_t start_us = host_bench_now_us();
+    for (uint32_t i = 0; i < BENCH_DNS_QUERIES && len >= 0; i++)
+    {
+        size_t q = i % count;
+        switch (mode)
+        {
+        case BENCH_DNS_LEGACY:
+            len = bench_dns_legacy_reply(queries[q], lengths[q], reply, ipc);
+            break;
+        case BENCH_DNS_LEGACY_DIRECT:
+            len = bench_dns_legacy_reply(queries[q], lengths[q], reply, NULL);
+            break;
+        default:
+            len = dns_codec_build_reply(queries[q], lengths[q], reply, sizeof(reply), &tpl);
+            break;
+        }
+        bytes += (uint64_t)len;
+    }
+    int64_t elapsed_us = host_bench_now_us() - start_us;
+
+    if (len <= 0)
+    {
+        printf("%-32s FAILED\n", bench_dns_mode_names[mode]);
+        return;
+    }
+    printf("%-32s %10.0f queries/s %6.2f us/query %6u bytes/reply\n", bench_dns_mode_names[mode],
+           (double)BENCH_DNS_QUERIES * 1000000.0 / (double)(elapsed_us > 0 ? elapsed_us : 1),
+           (double)elapsed_us / BENCH_DNS_QUERIES, (unsigned)(bytes / BENCH_DNS_QUERIES));
+}
+
+void bench_dns(void)
+{
+    // What Android, Apple and Windows ask right after joining, the AAAA one gets NODATA
+    static const struct
+    {
+        const char *name;
+        uint16_t type;
+    } probes[] = {
+        {"connectivitycheck.gstatic.com", DNS_CODEC_TYPE_A},
+        {"connectivitycheck.gstatic.com", 28},
+        {"captive.apple.com", DNS_CODEC_TYPE_A},
+        {"www.msftconnecttest.com", DNS_CODEC_TYPE_A},
+    };
+    static uint8_t queries[sizeof(probes) / sizeof(probes[0])][64];
+    size_t lengths[sizeof(probes) / sizeof(probes[0])];
+    bench_dns_ipc_t ipc = {0};
+
+    for (size_t i = 0; i < sizeof(probes) / sizeof(probes[0]); i++)
+    {
+        lengths[i] = bench_dns_make_query(queries[i], (uint16_t)(0x1000 + i), probes[i].name, probes[i].type);
+    }
+
+    bench_dns_tcpip_queue = xQueueCreate(1, sizeof(bench_dns_ipc_t));
+    ipc.done = xSemaphoreCreateBinary();
+    if (bench_dns_tcpip_queue == NULL || ipc.done == NULL ||
+        xTaskCreate(bench_dns_tcpip_task, "bench_tcpip", 4096, NULL, configMAX_PRIORITIES - 1, NULL) != pdPASS)
+    {
+        printf("dns: failed to start the tcpip stand-in\n");
+        return;
+    }
+
+    bench_dns_run(BENCH_DNS_LEGACY, queries, lengths, sizeof(probes) / sizeof(probes[0]), &ipc);
+    bench_dns_run(BENCH_DNS_LEGACY_DIRECT, queries, lengths, sizeof(probes) / sizeof(probes[0]), &ipc);
+    bench_dns_run(BENCH_DNS_TEMPLATE, queries, lengths, sizeof(probes) / sizeof(probes[0]), &ipc);
+}
+
+/*
+ * Deterministic xorshift so every run asks the same sequence
+ */
+static uint32_t bench_dns_random(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+/*
+ * Answer of the stand-in resolver: one A record, or NXDOMAIN with an SOA
+ * @param msg query, turned into the response in place (at least len + 64 bytes)
+ * @param len query length
+ * @param name_index popularity rank of the name, picks its TTL
+ * @return response length
+ */
+static size_t bench_dns_upstream_answer(uint8_t *msg, size_t len, uint32_t name_index)
+{
+    static const uint32_t ttls[] = {30, 60, 300, 3600};
+    static const uint8_t soa_data[] = {0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0x0E, 0x10, 0, 0, 0x03, 0x84, 0, 0x09, 0x3A, 0x80,
+                                       0, 0, 0, 60};
+    bool nxdomain = (name_index % BENCH_DNS_FWD_NXDOMAIN_EVERY) == BENCH_DNS_FWD_NXDOMAIN_EVERY - 1;
+    uint32_t ttl = nxdomain ? 900 : ttls[name_index % (sizeof(ttls) / sizeof(ttls[0]))];
+    uint8_t *rr = &msg[len];
+
+    msg[2] = 0x81;
+    msg[3] = nxdomain ? (0x80 | DNS_CODEC_RCODE_NXDOMAIN) : 0x80;
+    rr[0] = 0xC0;
+    rr[1] = DNS_CODEC_HEADER_LEN;
+    dns_codec_put16(&rr[2], nxdomain ? DNS_CODEC_TYPE_SOA : DNS_CODEC_TYPE_A);
+    dns_codec_put16(&rr[4], DNS_CODEC_CLASS_IN);
+    dns_codec_put16(&rr[6], (uint16_t)(ttl >> 16));
+    dns_codec_put16(&rr[8], (uint16_t)ttl);
+    if (nxdomain)
+    {
+        dns_codec_put16(&rr[10], sizeof(soa_data));
+        memcpy(&rr[12], soa_data, sizeof(soa_data));
+        msg[9] = 1;
+        return len + 12 + sizeof(soa_data);
+    }
+    dns_codec_put16(&rr[10], 4);
+    memcpy(&rr[12], &name_index, 4);
+    msg[7] = 1;
+    return len + 16;
+}
+
+static int bench_dns_compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Runs the client workload through a cache of the given size (0 forwards everything)
+ * @param cdf cumulative Zipf weights of the names
+ * @param latencies scratch space for BENCH_DNS_FWD_QUERIES samples
+ */
+static void bench_dns_forward_run(size_t entries, const double *cdf, uint32_t *latencies)
+{
+    static dns_cache_entry_t storage[64];
+    dns_cache_t cache;
+    uint8_t query[128], response[128], reply[DNS_CACHE_RESPONSE_LEN];
+    char name[32];
+    uint32_t seed = 0x2545F491u;
+    int64_t lookup_us = 0;
+    double total_us = 0;
+
+    dns_cache_init(&cache, storage, entries);
+    for (uint32_t i = 0; i < BENCH_DNS_FWD_QUERIES; i++)
+    {
+        int64_t now_us = (int64_t)i * BENCH_DNS_FWD_INTERVAL_US;
+        double u = (double)bench_dns_random(&seed) / (double)UINT32_MAX;
+        uint32_t lo = 0, hi = BENCH_DNS_FWD_NAMES - 1;
+        while (lo < hi)
+        {
+            uint32_t mid = (lo + hi) / 2;
+            if (cdf[mid] < u)
+            {
+                lo = mid + 1;
+            }
+            else
+            {
+                hi = mid;
+            }
+        }
+        snprintf(name, sizeof(name), "host%u.example.net", (unsigned)lo);
+        size_t len = bench_dns_make_query(query, (uint16_t)i, name, DNS_CODEC_TYPE_A);
+
+        int64_t start_us = host_bench_now_us();
+        int hit = dns_cache_lookup(&cache, query, len, reply, sizeof(reply), now_us);
+        int64_t spent_us = host_bench_now_us() - start_us;
+        lookup_us += spent_us;
+
+        if (hit > 0)
+        {
+            latencies[i] = (uint32_t)spent_us;
+        }
+        else
+        {
+            // Answered before the next client asks, so the cache never sees the future
+            memcpy(response, query, len);
+            size_t response_len = bench_dns_upstream_answer(response, len, lo);
+            dns_cache_store(&cache, response, response_len, now_us + BENCH_DNS_FWD_RTT_US);
+            latencies[i] = (uint32_t)(BENCH_DNS_FWD_RTT_US + spent_us);
+        }
+        total_us += latencies[i];
+    }
+
+    qsort(latencies, BENCH_DNS_FWD_QUERIES, sizeof(latencies[0]), bench_dns_compare_u32);
+    char label[40];
+    snprintf(label, sizeof(label), "dns forward: cache %u", (unsigned)entries);
+    printf("%-32s %6.1f %% hits %8.0f us mean %6u us p50 %6u us p99 %5.2f us/lookup %4u evicted\n", label,
+           100.0 * cache.stats.hits / BENCH_DNS_FWD_QUERIES, total_us / BENCH_DNS_FWD_QUERIES,
+           (unsigned)latencies[BENCH_DNS_FWD_QUERIES / 2], (unsigned)latencies[BENCH_DNS_FWD_QUERIES * 99 / 100],
+           (double)lookup_us / BENCH_DNS_FWD_QUERIES, (unsigned)cache.stats.evicted);
+}
+
+void bench_dns_forward(void)
+{
+    static const size_t sizes[] = {0, 4, 16, 64};
+    static double cdf[BENCH_DNS_FWD_NAMES];
+    static uint32_t latencies[BENCH_DNS_FWD_QUERIES];
+    double sum = 0;
+
+    // Zipf with s = 1: the k-th most popular name is asked 1/k as often as the first
+    for (uint32_t k = 0; k < BENCH_DNS_FWD_NAMES; k++)
+    {
+        sum += 1.0 / (k + 1);
+        cdf[k] = sum;
+    }
+    for (uint32_t k = 0; k < BENCH_DNS_FWD_NAMES; k++)
+    {
+        cdf[k] /= sum;
+    }
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        bench_dns_forward_run(sizes[i], cdf, latencies);
+    }
+}
+
+/*
+ * Walks a reply the way a client parses it
+ * @return true if the questions and counted records end exactly at len, with
+ * QR set and at most one OPT record, in the additional section
+ */
+static bool bench_dns_reply_valid(const uint8_t *reply, size_t len)
+{
+    dns_codec_edns_t edns;
+    size_t offset = DNS_CODEC_HEADER_LEN;
+
+    if (len < DNS_CODEC_HEADER_LEN || (reply[2] & 0x80) == 0)
+    {
+        return false;
+    }
+    for (uint16_t i = 0; i < dns_codec_get16(&reply[4]); i++)
+    {
+        offset = dns_codec_skip_name(reply, len, offset);
+        if (offset == 0 || offset + 4 > len)
+        {
+            return false;
+        }
+        offset += 4;
+    }
+    if (!dns_codec_parse_edns(reply, len, offset, &edns))
+    {
+        return false;
+    }
+    // parse_edns checked every record fits, step over them once more for the end
+    uint32_t records = (uint32_t)dns_codec_get16(&reply[6]) + dns_codec_get16(&reply[8]) + dns_codec_get16(&reply[10]);
+    for (uint32_t r = 0; r < records; r++)
+    {
+        offset = dns_codec_skip_name(reply, len, offset);
+        if (dns_codec_get16(&reply[offset]) == DNS_CODEC_TYPE_OPT && r < records - dns_codec_get16(&reply[10]))
+        {
+            return false;
+        }
+        offset += 10 + dns_codec_get16(&reply[offset + 8]);
+    }
+    return offset == len;
+}
+
+/*
+ * Changes a seed the way a broken or hostile client might
+ * @return new length
+ */
+static size_t bench_dns_mutate(uint8_t *msg, size_t len, size_t capacity, uint32_t *seed)
+{
+    static const uint8_t interesting[] = {0x00, 0x01, 0x29, 0x3F, 0x40, 0x7F, 0x80, 0xC0, 0xC1, 0xFF};
+    uint32_t edits = 1 + bench_dns_random(seed) % 4;
+
+    for (uint32_t e = 0; e < edits && len > 0; e++)
+    {
+        uint32_t r = bench_dns_random(seed);
+        size_t at = (r >> 8) % len;
+        switch (r % 6)
+        {
+        case 0: // Bit flip
+            msg[at] ^= (uint8_t)(1u << ((r >> 4) & 7));
+            break;
+        case 1: // Value that means something to a parser
+            msg[at] = interesting[(r >> 4) % sizeof(interesting)];
+            break;
+        case 2: // Cut short
+            len = at;
+            break;
+        case 3: // Random bytes appended
+            while (len < capacity && (bench_dns_random(seed) & 7) != 0)
+            {
+                msg[len++] = (uint8_t)bench_dns_random(seed);
+            }
+            break;
+        case 4: // Section count
+            if (len >= DNS_CODEC_HEADER_LEN)
+            {
+                dns_codec_put16(&msg[4 + 2 * ((r >> 4) % 4)], (uint16_t)((r >> 16) % 40));
+            }
+            break;
+        default: // Somewhere in the OPT record at the end, e.g. its payload size
+            if (len >= 2 + at % 10)
+            {
+                dns_codec_put16(&msg[len - 2 - at % 10], (uint16_t)(r >> 16));
+            }
+            break;
+        }
+    }
+    return len;
+}
+
+void bench_dns_fuzz(void)
+{
+    static const struct
+    {
+        const char *name;
+        uint16_t type;
+        uint16_t udp_size; // 0 without EDNS0
+        uint8_t questions;
+    } seeds[] = {
+        {"connectivitycheck.gstatic.com", DNS_CODEC_TYPE_A, 0, 1},
+        {"captive.apple.com", DNS_CODEC_TYPE_HTTPS, 1232, 1},
+        {"www.msftconnecttest.com", DNS_CODEC_TYPE_AAAA, 0, 1},
+        {"detectportal.firefox.com", DNS_CODEC_TYPE_A, 4096, 1},
+        {"connectivity-check.ubuntu.com", DNS_CODEC_TYPE_A, 1232, 32},
+        {"a.b.c.d.e.f.g.h.i.j.k.l.m.n.o.p.q.r.s.t.u.v.w.x.y.z.example.com", DNS_CODEC_TYPE_SVCB, 512, 3},
+    };
+    static dns_cache_entry_t entries[8];
+    static uint8_t query[1024], copy[1024], reply[1024];
+    dns_codec_answer_template_t tpl;
+    dns_cache_t cache;
+    uint32_t seed = 0x9E3779B9u;
+    uint32_t answered = 0, truncated = 0, rejected = 0, ignored = 0, failures = 0;
+
+    dns_codec_template_init(&tpl, BENCH_DNS_AP_ADDR, BENCH_DNS_TTL_S);
+    dns_cache_init(&cache, entries, sizeof(entries) / sizeof(entries[0]));
+    int64_t start_us = host_bench_now_us();
+    for (uint32_t i = 0; i < BENCH_DNS_FUZZ_CASES; i++)
+    {
+        // Seed: the name, then compressed copies of the question, then the OPT record
+        size_t s = i % (sizeof(seeds) / sizeof(seeds[0]));
+        size_t len = bench_dns_make_query(query, (uint16_t)i, seeds[s].name, seeds[s].type);
+        for (uint8_t q = 1; q < seeds[s].questions; q++)
+        {
+            const uint8_t again[] = {0xC0, 0x0C, 0x00, 0x01, 0x00, 0x01};
+            memcpy(&query[len], again, sizeof(again));
+            len += sizeof(again);
+        }
+        query[5] = seeds[s].questions;
+        if (seeds[s].udp_size != 0)
+        {
+            const uint8_t opt[] = {0x00, 0x00, 0x29, (uint8_t)(seeds[s].udp_size >> 8), (uint8_t)seeds[s].udp_size,
+                                   0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+            memcpy(&query[len], opt, sizeof(opt));
+            len += sizeof(opt);
+            query[11] = 1;
+        }
+        if (i >= sizeof(seeds) / sizeof(seeds[0]))
+        {
+            len = bench_dns_mutate(query, len, BENCH_DNS_FUZZ_BUFFER, &seed);
+        }
+
+        // Into a separate buffer, then in place as dns_server.c does it
+        memcpy(copy, query, len);
+        int separate = dns_codec_build_reply(query, len, reply, BENCH_DNS_FUZZ_BUFFER, &tpl);
+        int in_place = dns_codec_build_reply(copy, len, copy, BENCH_DNS_FUZZ_BUFFER, &tpl);
+        bool ok = separate == in_place && (separate <= 0 || memcmp(reply, copy, (size_t)separate) == 0);
+        if (separate > 0)
+        {
+            dns_codec_edns_t edns;
+            dns_codec_question_t question;
+            dns_codec_parse_question(query, len, &question);
+            size_t limit = BENCH_DNS_FUZZ_BUFFER;
+            for (uint16_t q = 1; q < dns_codec_get16(&query[4]); q++)
+            {
+                question.end = dns_codec_skip_name(query, len, question.end) + 4;
+            }
+            if (dns_codec_parse_edns(query, len, question.end, &edns) && dns_codec_udp_limit(&edns) < limit)
+            {
+                limit = dns_codec_udp_limit(&edns);
+            }
+            ok = ok && bench_dns_reply_valid(reply, (size_t)separate) &&
+                 ((size_t)separate <= limit || dns_codec_get16(&reply[6]) + dns_codec_get16(&reply[8]) == 0);
+            answered++;
+            truncated += (reply[2] & 0x02) != 0;
+        }
+        else if (separate < 0)
+        {
+            rejected++;
+        }
+        else
+        {
+            ignored++;
+        }
+
+        // The cache takes the same bytes as an upstream response and as a query
+        query[2] |= 0x80;
+        dns_cache_store(&cache, query, len, (int64_t)i * 1000);
+        query[2] &= 0x7F;
+        int hit = dns_cache_lookup(&cache, query, len, query, BENCH_DNS_FUZZ_BUFFER, (int64_t)i * 1000);
+        ok = ok && hit <= (int)BENCH_DNS_FUZZ_BUFFER && (hit == 0 || bench_dns_reply_valid(query, (size_t)hit));
+
+        if (!ok && failures++ == 0)
+        {
+            printf("dns fuzz: case %u failed, reply %d in place %d\n", (unsigned)i, separate, in_place);
+        }
+    }
+    int64_t elapsed_us = host_bench_now_us() - start_us;
+
+    printf("%-32s %10.0f cases/s %u answered (%u TC), %u malformed, %u ignored, %u cache hits, %u failures\n",
+           "dns fuzz: reply in place", (double)BENCH_DNS_FUZZ_CASES * 1000000.0 / (double)(elapsed_us > 0 ? elapsed_us : 1),
+           (unsigned)answered, (unsigned)truncated, (unsigned)rejected, (unsigned)ignored, (unsigned)cache.stats.hits,
+           (unsigned)failures);
+}
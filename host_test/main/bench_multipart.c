@@ -0,0 +1,147 @@
+/**
+ * @file bench_multipart.c
+ *
+ * Throughput of multipart_parser on an OTA sized body fed in TCP segment
+ * sized chunks. The adversarial payload is made of delimiter prefixes so
+ * every byte goes through the slow matching path instead of memchr.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_err.h"
+#include "multipart_parser.h"
+#include "host_bench.h"
+
+#define BENCH_MULTIPART_FILE_SIZE (1024u * 1024u)
+#define BENCH_MULTIPART_CHUNK_SIZE (1436u) // TCP MSS over WiFi
+#define BENCH_MULTIPART_ROUNDS (20u)
+#define BENCH_MULTIPART_BOUNDARY "----WebKitFormBoundary7MA4YWxkTrZu0gW"
+
+static const char bench_multipart_head[] =
+    "--" BENCH_MULTIPART_BOUNDARY "\r\n"
+    "Content-Disposition: form-data; name=\"file\"; filename=\"firmware.bin\"\r\n"
+    "Content-Type: application/octet-stream\r\n"
+    "\r\n";
+
+static const char bench_multipart_tail[] = "\r\n--" BENCH_MULTIPART_BOUNDARY "--\r\n";
+
+typedef struct
+{
+    size_t bytes;
+    uint32_t checksum;
+} bench_multipart_sink_t;
+
+static esp_err_t bench_multipart_data(const char *data, size_t len, void *ctx)
+{
+    bench_multipart_sink_t *sink = (bench_multipart_sink_t *)ctx;
+
+    sink->bytes += len;
+    for (size_t i = 0; i < len; i++)
+    {
+        sink->checksum = sink->checksum * 31u + (uint8_t)data[i];
+    }
+    return ESP_OK;
+}
+
+static uint32_t bench_multipart_checksum(const char *data, size_t len)
+{
+    bench_multipart_sink_t sink = {0};
+    bench_multipart_data(data, len, &sink);
+    return sink.checksum;
+}
+
+/*
+ * Builds head + file + tail into one buffer
+ * @return body, owned by the caller
+ */
+static char *bench_multipart_body(const char *file, size_t *body_len)
+{
+    size_t head_len = sizeof(bench_multipart_head) - 1;
+    size_t tail_len = sizeof(bench_multipart_tail) - 1;
+    char *body = malloc(head_len + BENCH_MULTIPART_FILE_SIZE + tail_len);
+
+    if (body != NULL)
+    {
+        memcpy(body, bench_multipart_head, head_len);
+        memcpy(body + head_len, file, BENCH_MULTIPART_FILE_SIZE);
+        memcpy(body + head_len + BENCH_MULTIPART_FILE_SIZE, bench_multipart_tail, tail_len);
+        *body_len = head_len + BENCH_MULTIPART_FILE_SIZE + tail_len;
+    }
+    return body;
+}
+
+static void bench_multipart_run(const char *name, const char *file)
+{
+    size_t body_len = 0;
+    char *body = bench_multipart_body(file, &body_len);
+    uint32_t expected = bench_multipart_checksum(file, BENCH_MULTIPART_FILE_SIZE);
+    int64_t parse_us = 0;
+
+    if (body == NULL)
+    {
+        printf("%-32s FAILED (no memory)\n", name);
+        return;
+    }
+
+    for (uint32_t round = 0; round < BENCH_MULTIPART_ROUNDS; round++)
+    {
+        multipart_parser_t parser;
+        bench_multipart_sink_t sink = {0};
+        esp_err_t error = multipart_parser_init(&parser, "multipart/form-data; boundary=" BENCH_MULTIPART_BOUNDARY,
+                                                bench_multipart_data, &sink);
+
+        int64_t start = host_bench_now_us();
+        for (size_t pos = 0; (error == ESP_OK) && (pos < body_len); pos += BENCH_MULTIPART_CHUNK_SIZE)
+        {
+            size_t len = (body_len - pos < BENCH_MULTIPART_CHUNK_SIZE) ? body_len - pos : BENCH_MULTIPART_CHUNK_SIZE;
+            error = multipart_parser_feed(&parser, body + pos, len);
+        }
+        if (error == ESP_OK)
+        {
+            error = multipart_parser_finish(&parser);
+        }
+        parse_us += host_bench_now_us() - start;
+
+        if (error != ESP_OK || sink.bytes != BENCH_MULTIPART_FILE_SIZE || sink.checksum != expected)
+        {
+            printf("%-32s FAILED (%s, %u bytes)\n", name, esp_err_to_name(error), (unsigned)sink.bytes);
+            free(body);
+            return;
+        }
+    }
+
+    // The checksum in the sink is part of the measured time, same for every payload
+    host_bench_report(name, (uint64_t)body_len * BENCH_MULTIPART_ROUNDS, parse_us);
+    free(body);
+}
+
+void bench_multipart(void)
+{
+    static const char near_miss[] = "\r\n--" BENCH_MULTIPART_BOUNDARY;
+    char *file = malloc(BENCH_MULTIPART_FILE_SIZE);
+    uint32_t seed = 0x12345678u;
+
+    if (file == NULL)
+    {
+        printf("multipart: no memory\n");
+        return;
+    }
+
+    // Firmware-like content, CR shows up about once every 256 bytes
+    for (size_t i = 0; i < BENCH_MULTIPART_FILE_SIZE; i++)
+    {
+        seed = seed * 1103515245u + 12345u;
+        file[i] = (char)(seed >> 16);
+    }
+    bench_multipart_run("multipart random payload", file);
+
+    // Delimiter minus its last byte, over and over
+    for (size_t i = 0; i < BENCH_MULTIPART_FILE_SIZE; i++)
+    {
+        file[i] = near_miss[i % (sizeof(near_miss) - 2)];
+    }
+    bench_multipart_run("multipart near-miss payload", file);
+
+    free(file);
+}
@@ -0,0 +1,415 @@
+/**
+ * @file bench_ota_decoder.c
+ *
+ * Upload bytes and time-to-flash of the same new image sent as a full .bin,
+ * compressed, and as a delta against the image in the emulated ota_0
+ * partition. Every upload goes through ota_decoder and ota_pipeline into
+ * ota_1 over the shared host_bench network and flash model. The packed
+ * streams come from a small greedy encoder equivalent to tools/ota_pack.py.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "ota_decoder.h"
+#include "ota_pipeline.h"
+#include "host_bench.h"
+
+#define BENCH_DECODER_IMAGE_SIZE (1024u * 1024u)
+#define BENCH_DECODER_SNIPPETS (256u)        // Distinct "functions" the image is built from
+#define BENCH_DECODER_EDIT_STRIDE (64u * 1024u) // One changed region per 64 KB in the new image
+#define BENCH_DECODER_EDIT_LEN (200u)
+#define BENCH_DECODER_HASH_BITS (16u)
+#define BENCH_DECODER_BASE_BLOCK (16u)
+#define BENCH_DECODER_COPY_MIN (24u)
+#define BENCH_DECODER_MATCH_MIN (3u)
+#define BENCH_DECODER_MATCH_MAX (BENCH_DECODER_MATCH_MIN + 0x3Fu)
+#define BENCH_DECODER_LITERAL_MAX (128u)
+
+typedef struct
+{
+    uint8_t *out;
+    size_t len;
+    uint8_t *literals;
+    size_t literal_len;
+} bench_stream_t;
+
+// Upload state shared with the decoder write callback, as in the OTA handler
+typedef struct
+{
+    char *block;
+    size_t block_len;
+    size_t filled;
+    const esp_partition_t *base;
+} bench_upload_t;
+
+static const char *TAG = "bench_ota_decoder";
+
+static const uint8_t bench_base_digest[OTA_DECODER_DIGEST_LEN] = {0x5A, 0xA5, 0x01};
+
+static uint32_t bench_rand_state = 1;
+
+static uint32_t bench_rand(void)
+{
+    bench_rand_state ^= bench_rand_state << 13;
+    bench_rand_state ^= bench_rand_state >> 17;
+    bench_rand_state ^= bench_rand_state << 5;
+    return bench_rand_state;
+}
+
+/*
+ * Fills image with code-like content: a limited set of byte sequences
+ * repeated in random order with varying operands in between
+ */
+static void bench_make_image(uint8_t *image, size_t len)
+{
+    static uint8_t snippets[BENCH_DECODER_SNIPPETS][48];
+
+    for (size_t i = 0; i < sizeof(snippets); i++)
+    {
+        ((uint8_t *)snippets)[i] = (uint8_t)bench_rand();
+    }
+
+    size_t pos = 0;
+    while (pos < len)
+    {
+        const uint8_t *snippet = snippets[bench_rand() % BENCH_DECODER_SNIPPETS];
+        size_t n = 8 + bench_rand() % 40;
+        for (size_t i = 0; i < n && pos < len; i++)
+        {
+            image[pos++] = snippet[i];
+        }
+        for (size_t i = bench_rand() % 4; i > 0 && pos < len; i--)
+        {
+            image[pos++] = (uint8_t)bench_rand();
+        }
+    }
+}
+
+static uint32_t bench_hash(const uint8_t *data, size_t len)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash >> (32u - BENCH_DECODER_HASH_BITS);
+}
+
+static void bench_put32(bench_stream_t *stream, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        stream->out[stream->len++] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static void bench_flush_literals(bench_stream_t *stream)
+{
+    if (stream->literal_len > 0)
+    {
+        stream->out[stream->len++] = (uint8_t)(stream->literal_len - 1);
+        memcpy(stream->out + stream->len, stream->literals, stream->literal_len);
+        stream->len += stream->literal_len;
+        stream->literal_len = 0;
+    }
+}
+
+static void bench_literal(bench_stream_t *stream, uint8_t byte)
+{
+    stream->literals[stream->literal_len++] = byte;
+    if (stream->literal_len == BENCH_DECODER_LITERAL_MAX)
+    {
+        bench_flush_literals(stream);
+    }
+}
+
+/*
+ * Greedy encoder producing the ota_decoder format
+ * @param base image to copy from, NULL for a compressed (non-delta) stream
+ * @return packed stream in out, length in out_len
+ */
+static void bench_encode(const uint8_t *image, size_t len, const uint8_t *base, size_t base_len,
+                         uint8_t *out, size_t *out_len)
+{
+    static uint32_t window_head[1u << BENCH_DECODER_HASH_BITS];
+    static uint32_t base_head[1u << BENCH_DECODER_HASH_BITS];
+    uint8_t literals[BENCH_DECODER_LITERAL_MAX];
+    bench_stream_t stream = {.out = out, .literals = literals};
+
+    memset(out, 0, OTA_DECODER_HEADER_LEN);
+    memcpy(out, "OTAZ", 4);
+    out[4] = 1;
+    out[5] = (base != NULL) ? OTA_DECODER_FLAG_DELTA : 0;
+    out[6] = OTA_DECODER_WINDOW_BITS;
+    stream.len = 8;
+    bench_put32(&stream, (uint32_t)len);
+    if (base != NULL)
+    {
+        memcpy(out + 16, bench_base_digest, OTA_DECODER_DIGEST_LEN);
+    }
+    stream.len = OTA_DECODER_HEADER_LEN;
+
+    // Positions are stored plus one so that zero means empty
+    memset(window_head, 0, sizeof(window_head));
+    memset(base_head, 0, sizeof(base_head));
+    for (size_t pos = 0; base != NULL && pos + BENCH_DECODER_BASE_BLOCK <= base_len; pos += BENCH_DECODER_BASE_BLOCK)
+    {
+        uint32_t *slot = &base_head[bench_hash(base + pos, BENCH_DECODER_BASE_BLOCK)];
+        if (*slot == 0)
+        {
+            *slot = (uint32_t)pos + 1;
+        }
+    }
+
+    size_t pos = 0;
+    while (pos < len)
+    {
+        size_t step = 1;
+
+        if (base != NULL && pos + BENCH_DECODER_BASE_BLOCK <= len)
+        {
+            uint32_t slot = base_head[bench_hash(image + pos, BENCH_DECODER_BASE_BLOCK)];
+            size_t start = slot - 1;
+            size_t run = 0;
+            if (slot != 0)
+            {
+                while (pos + run < len && start + run < base_len && image[pos + run] == base[start + run])
+                {
+                    run++;
+                }
+            }
+            if (run >= BENCH_DECODER_COPY_MIN)
+            {
+                bench_flush_literals(&stream);
+                stream.out[stream.len++] = 0xC0;
+                bench_put32(&stream, (uint32_t)start);
+                bench_put32(&stream, (uint32_t)run);
+                step = run;
+            }
+        }
+
+        if (step == 1 && pos + 4 <= len)
+        {
+            uint32_t slot = window_head[bench_hash(image + pos, 4)];
+            size_t cand = slot - 1;
+            size_t run = 0;
+            if (slot != 0 && pos - cand <= OTA_DECODER_WINDOW_SIZE)
+            {
+                while (run < BENCH_DECODER_MATCH_MAX && pos + run < len && image[cand + run] == image[pos + run])
+                {
+                    run++;
+                }
+            }
+            if (run >= BENCH_DECODER_MATCH_MIN)
+            {
+                bench_flush_literals(&stream);
+                stream.out[stream.len++] = (uint8_t)(0x80 | (run - BENCH_DECODER_MATCH_MIN));
+                stream.out[stream.len++] = (uint8_t)((pos - cand) & 0xFF);
+                stream.out[stream.len++] = (uint8_t)((pos - cand) >> 8);
+                step = run;
+            }
+        }
+
+        if (step == 1)
+        {
+            bench_literal(&stream, image[pos]);
+        }
+        for (size_t i = pos; i < pos + step && i + 4 <= len; i++)
+        {
+            window_head[bench_hash(image + i, 4)] = (uint32_t)i + 1;
+        }
+        pos += step;
+    }
+
+    bench_flush_literals(&stream);
+    *out_len = stream.len;
+}
+
+/*
+ * Decoder output, copied into pipeline blocks like http_server_ota_data_cb
+ */
+static esp_err_t bench_upload_write(const char *data, size_t len, void *ctx)
+{
+    bench_upload_t *upload = (bench_upload_t *)ctx;
+
+    while (len > 0)
+    {
+        if (upload->block == NULL)
+        {
+            upload->block = ota_pipeline_acquire(&upload->block_len);
+            upload->filled = 0;
+            if (upload->block == NULL)
+            {
+                return ESP_ERR_TIMEOUT;
+            }
+        }
+
+        size_t n = (len < upload->block_len - upload->filled) ? len : upload->block_len - upload->filled;
+        memcpy(upload->block + upload->filled, data, n);
+        upload->filled += n;
+        data += n;
+        len -= n;
+
+        if (upload->filled == upload->block_len)
+        {
+            esp_err_t error = ota_pipeline_submit(upload->block, upload->filled);
+            upload->block = NULL;
+            if (error != ESP_OK)
+            {
+                return error;
+            }
+        }
+    }
+    return ESP_OK;
+}
+
+static esp_err_t bench_upload_read_base(size_t offset, void *dest, size_t len, void *ctx)
+{
+    bench_upload_t *upload = (bench_upload_t *)ctx;
+    return esp_partition_read(upload->base, offset, dest, len);
+}
+
+/*
+ * Uploads body over the simulated network through the decoder into target
+ */
+static esp_err_t bench_upload(const char *body, size_t body_len, const esp_partition_t *base,
+                              const esp_partition_t *target, ota_decoder_t *decoder)
+{
+    char buffer[HOST_BENCH_SEGMENT_SIZE];
+    host_bench_net_t net = {.data = body, .len = body_len};
+    host_bench_flash_t flash = {.partition = target};
+    bench_upload_t upload = {.base = base};
+    const ota_decoder_config_t config = {
+        .write = bench_upload_write,
+        .read_base = bench_upload_read_base,
+        .base_digest = bench_base_digest,
+        .base_size = base->size,
+        .ctx = &upload};
+    const ota_pipeline_sink_t sink = {.write = host_bench_flash_write, .ctx = &flash};
+
+    esp_err_t error = ota_decoder_init(decoder, &config);
+    if (error == ESP_OK)
+    {
+        error = ota_pipeline_start(&sink);
+        if (error != ESP_OK)
+        {
+            return error;
+        }
+    }
+
+    size_t len;
+    while ((error == ESP_OK) && (len = host_bench_net_recv(&net, buffer, sizeof(buffer))) > 0)
+    {
+        error = ota_decoder_feed(decoder, buffer, len);
+    }
+    if (error == ESP_OK)
+    {
+        error = ota_decoder_finish(decoder);
+    }
+    if (upload.block != NULL)
+    {
+        esp_err_t submit_error = ota_pipeline_submit(upload.block, (error == ESP_OK) ? upload.filled : 0);
+        error = (error == ESP_OK) ? submit_error : error;
+    }
+
+    esp_err_t write_error = ota_pipeline_finish();
+    return (error == ESP_OK) ? write_error : error;
+}
+
+static bool bench_verify(const esp_partition_t *partition, const uint8_t *image, size_t len)
+{
+    uint8_t chunk[256];
+
+    for (size_t offset = 0; offset < len; offset += sizeof(chunk))
+    {
+        size_t n = (len - offset < sizeof(chunk)) ? len - offset : sizeof(chunk);
+        if (esp_partition_read(partition, offset, chunk, n) != ESP_OK || memcmp(chunk, image + offset, n) != 0)
+        {
+            ESP_LOGE(TAG, "Mismatch in block at offset %u", (unsigned)offset);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void bench_run(const char *name, const uint8_t *body, size_t body_len, const uint8_t *image,
+                      const esp_partition_t *base, const esp_partition_t *target, ota_decoder_t *decoder)
+{
+    int64_t start = host_bench_now_us();
+    esp_err_t error = bench_upload((const char *)body, body_len, base, target, decoder);
+    int64_t elapsed = host_bench_now_us() - start;
+
+    if (error != ESP_OK || !bench_verify(target, image, BENCH_DECODER_IMAGE_SIZE))
+    {
+        printf("%-32s FAILED (%s)\n", name, esp_err_to_name(error));
+        return;
+    }
+    host_bench_report(name, body_len, elapsed);
+}
+
+/*
+ * Runs the three uploads of new_image with old_image as the running image
+ */
+static void bench_compare(uint8_t *old_image, uint8_t *new_image, uint8_t *packed, ota_decoder_t *decoder,
+                          const esp_partition_t *base, const esp_partition_t *target)
+{
+    // The running image, and a new build where some regions changed
+    bench_make_image(old_image, BENCH_DECODER_IMAGE_SIZE);
+    memcpy(new_image, old_image, BENCH_DECODER_IMAGE_SIZE);
+    for (size_t pos = BENCH_DECODER_EDIT_STRIDE / 2; pos < BENCH_DECODER_IMAGE_SIZE; pos += BENCH_DECODER_EDIT_STRIDE)
+    {
+        bench_make_image(new_image + pos, BENCH_DECODER_EDIT_LEN);
+    }
+    if (esp_partition_erase_range(base, 0, base->size) != ESP_OK ||
+        esp_partition_write(base, 0, old_image, BENCH_DECODER_IMAGE_SIZE) != ESP_OK)
+    {
+        printf("ota decoder: writing the base image failed\n");
+        return;
+    }
+
+    size_t packed_len = 0;
+    bench_run("ota full image", new_image, BENCH_DECODER_IMAGE_SIZE, new_image, base, target, decoder);
+
+    bench_encode(new_image, BENCH_DECODER_IMAGE_SIZE, NULL, 0, packed, &packed_len);
+    bench_run("ota compressed image", packed, packed_len, new_image, base, target, decoder);
+
+    bench_encode(new_image, BENCH_DECODER_IMAGE_SIZE, old_image, BENCH_DECODER_IMAGE_SIZE, packed, &packed_len);
+    bench_run("ota delta image", packed, packed_len, new_image, base, target, decoder);
+}
+
+void bench_ota_decoder(void)
+{
+    const esp_partition_t *base = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, NULL);
+    const esp_partition_t *target = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_1, NULL);
+    if (base == NULL || target == NULL)
+    {
+        printf("ota decoder: emulated app partitions not found\n");
+        return;
+    }
+
+    // Worst case packed size: one length byte per 128 literals
+    size_t packed_max = OTA_DECODER_HEADER_LEN + BENCH_DECODER_IMAGE_SIZE + BENCH_DECODER_IMAGE_SIZE / 64;
+    uint8_t *old_image = malloc(BENCH_DECODER_IMAGE_SIZE);
+    uint8_t *new_image = malloc(BENCH_DECODER_IMAGE_SIZE);
+    uint8_t *packed = malloc(packed_max);
+    ota_decoder_t *decoder = malloc(sizeof(ota_decoder_t));
+
+    if (old_image != NULL && new_image != NULL && packed != NULL && decoder != NULL)
+    {
+        bench_compare(old_image, new_image, packed, decoder, base, target);
+    }
+    else
+    {
+        printf("ota decoder: out of memory\n");
+    }
+
+    free(decoder);
+    free(packed);
+    free(new_image);
+    free(old_image);
+}
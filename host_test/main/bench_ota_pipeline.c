@@ -0,0 +1,135 @@
+/**
+ * @file bench_ota_pipeline.c
+ *
+ * Time-to-flash of a firmware upload into the emulated ota_0 partition,
+ * comparing the former inline receive/write loop with ota_pipeline. Network
+ * and flash costs come from the shared host_bench model.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "ota_pipeline.h"
+#include "host_bench.h"
+
+#define BENCH_OTA_IMAGE_SIZE (512u * 1024u)   // Uploaded image
+#define BENCH_OTA_INLINE_BUFFER_SIZE (1024u) // Stack buffer of the old handler
+
+static const char *TAG = "bench_ota";
+
+static char *bench_ota_image = NULL;
+
+static esp_err_t bench_ota_inline(host_bench_flash_t *flash)
+{
+    char buffer[BENCH_OTA_INLINE_BUFFER_SIZE];
+    host_bench_net_t net = {.data = bench_ota_image, .len = BENCH_OTA_IMAGE_SIZE};
+    size_t len;
+
+    while ((len = host_bench_net_recv(&net, buffer, sizeof(buffer))) > 0)
+    {
+        esp_err_t error = host_bench_flash_write(buffer, len, flash);
+        if (error != ESP_OK)
+        {
+            return error;
+        }
+    }
+    return ESP_OK;
+}
+
+static esp_err_t bench_ota_pipelined(host_bench_flash_t *flash)
+{
+    host_bench_net_t net = {.data = bench_ota_image, .len = BENCH_OTA_IMAGE_SIZE};
+    const ota_pipeline_sink_t sink = {.write = host_bench_flash_write, .ctx = flash};
+    esp_err_t error = ota_pipeline_start(&sink);
+
+    while ((error == ESP_OK) && (net.sent < BENCH_OTA_IMAGE_SIZE))
+    {
+        size_t block_len = 0;
+        size_t filled = 0;
+        char *block = ota_pipeline_acquire(&block_len);
+        if (block == NULL)
+        {
+            error = ESP_ERR_TIMEOUT;
+            break;
+        }
+        while (filled < block_len && net.sent < BENCH_OTA_IMAGE_SIZE)
+        {
+            filled += host_bench_net_recv(&net, block + filled, block_len - filled);
+        }
+        error = ota_pipeline_submit(block, filled);
+    }
+
+    esp_err_t write_error = ota_pipeline_finish();
+    return (error == ESP_OK) ? write_error : error;
+}
+
+/*
+ * Reads the partition back and compares it with the uploaded pattern
+ */
+static bool bench_ota_verify(const esp_partition_t *partition)
+{
+    char chunk[256];
+
+    for (size_t offset = 0; offset < BENCH_OTA_IMAGE_SIZE; offset += sizeof(chunk))
+    {
+        if (esp_partition_read(partition, offset, chunk, sizeof(chunk)) != ESP_OK)
+        {
+            return false;
+        }
+        if (memcmp(chunk, bench_ota_image + offset, sizeof(chunk)) != 0)
+        {
+            ESP_LOGE(TAG, "Mismatch in block at offset %u", (unsigned)offset);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void bench_ota_run(const char *name, const esp_partition_t *partition,
+                          esp_err_t (*upload)(host_bench_flash_t *flash))
+{
+    host_bench_flash_t flash = {.partition = partition};
+
+    int64_t start = host_bench_now_us();
+    esp_err_t error = upload(&flash);
+    int64_t elapsed = host_bench_now_us() - start;
+
+    if (error != ESP_OK || !bench_ota_verify(partition))
+    {
+        printf("%-32s FAILED (%s)\n", name, esp_err_to_name(error));
+        return;
+    }
+    host_bench_report(name, BENCH_OTA_IMAGE_SIZE, elapsed);
+}
+
+void bench_ota_pipeline(void)
+{
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_APP,
+                                                                ESP_PARTITION_SUBTYPE_APP_OTA_0, NULL);
+    if (partition == NULL)
+    {
+        printf("ota: emulated ota_0 partition not found\n");
+        return;
+    }
+
+    bench_ota_image = malloc(BENCH_OTA_IMAGE_SIZE);
+    if (bench_ota_image == NULL)
+    {
+        printf("ota: out of memory\n");
+        return;
+    }
+    for (size_t i = 0; i < BENCH_OTA_IMAGE_SIZE; i++)
+    {
+        bench_ota_image[i] = (char)((i * 7u) ^ (i >> 8));
+    }
+
+    bench_ota_run("ota inline 1 KB writes", partition, bench_ota_inline);
+    bench_ota_run("ota pipeline 4 KB x3", partition, bench_ota_pipelined);
+
+    free(bench_ota_image);
+    bench_ota_image = NULL;
+}
@@ -0,0 +1,84 @@
+/**
+ * @file host_bench.c
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "host_bench.h"
+
+#define HOST_BENCH_TICK_US (1000000u / configTICK_RATE_HZ)
+
+int64_t host_bench_now_us(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+void host_bench_delay(host_bench_delay_t *delay, uint32_t us)
+{
+    delay->debt_us += us;
+    if (delay->debt_us >= HOST_BENCH_TICK_US)
+    {
+        TickType_t ticks = delay->debt_us / HOST_BENCH_TICK_US;
+        delay->debt_us -= ticks * HOST_BENCH_TICK_US;
+        vTaskDelay(ticks);
+    }
+}
+
+size_t host_bench_net_recv(host_bench_net_t *net, char *buffer, size_t len)
+{
+    if (net->sent >= net->len)
+    {
+        return 0;
+    }
+    if (net->segment_left == 0)
+    {
+        host_bench_delay(&net->delay, HOST_BENCH_SEGMENT_US);
+        net->segment_left = HOST_BENCH_SEGMENT_SIZE;
+    }
+
+    size_t n = len;
+    n = (n < net->segment_left) ? n : net->segment_left;
+    n = (n < net->len - net->sent) ? n : net->len - net->sent;
+    memcpy(buffer, net->data + net->sent, n);
+    net->sent += n;
+    net->segment_left -= n;
+    return n;
+}
+
+esp_err_t host_bench_flash_write(const void *data, size_t len, void *ctx)
+{
+    host_bench_flash_t *flash = (host_bench_flash_t *)ctx;
+
+    while (flash->erased < flash->offset + len)
+    {
+        esp_err_t error = esp_partition_erase_range(flash->partition, flash->erased, HOST_BENCH_SECTOR_SIZE);
+        if (error != ESP_OK)
+        {
+            return error;
+        }
+        host_bench_delay(&flash->delay, HOST_BENCH_SECTOR_ERASE_US);
+        flash->erased += HOST_BENCH_SECTOR_SIZE;
+    }
+
+    esp_err_t error = esp_partition_write(flash->partition, flash->offset, data, len);
+    if (error != ESP_OK)
+    {
+        return error;
+    }
+    host_bench_delay(&flash->delay, (uint32_t)(len * HOST_BENCH_PROGRAM_NS_PER_BYTE / 1000u));
+    flash->offset += len;
+    return ESP_OK;
+}
+
+void host_bench_report(const char *name, uint64_t bytes, int64_t elapsed_us)
+{
+    double ms = (double)elapsed_us / 1000.0;
+    double kib_s = (elapsed_us > 0) ? ((double)bytes / 1024.0) / ((double)elapsed_us / 1e6) : 0.0;
+
+    printf("%-32s %10llu bytes %10.1f ms %10.1f KiB/s\n", name, (unsigned long long)bytes, ms, kib_s);
+}
@@ -0,0 +1,95 @@
+/**
+ * @file host_bench.h
+ *
+ * Helpers shared by the host benchmarks. Latencies of the real hardware
+ * (network segments, flash erase/program) are modelled with vTaskDelay so that
+ * work done by different tasks overlaps the same way it does on the device.
+ */
+#ifndef HOST_BENCH_H
+#define HOST_BENCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_partition.h"
+
+// Browser upload over the SoftAP with the default lwIP TCP window (~60 KB/s)
+#define HOST_BENCH_SEGMENT_SIZE (1436u) // TCP MSS over WiFi
+#define HOST_BENCH_SEGMENT_US (24000u)
+
+// Typical SPI NOR flash on ESP32 modules
+#define HOST_BENCH_SECTOR_SIZE (4096u)
+#define HOST_BENCH_SECTOR_ERASE_US (45000u)
+#define HOST_BENCH_PROGRAM_NS_PER_BYTE (2700u) // 256 B page program
+
+typedef struct host_bench_delay
+{
+    uint32_t debt_us; // Simulated time not yet slept, below one tick
+} host_bench_delay_t;
+
+typedef struct host_bench_net
+{
+    const char *data; // Request body the client uploads
+    size_t len;
+    size_t sent;
+    size_t segment_left; // Bytes of the current segment not yet consumed
+    host_bench_delay_t delay;
+} host_bench_net_t;
+
+typedef struct host_bench_flash
+{
+    const esp_partition_t *partition;
+    size_t offset;
+    size_t erased;
+    host_bench_delay_t delay;
+} host_bench_flash_t;
+
+/**
+ * @brief Monotonic wall clock in microseconds
+ */
+int64_t host_bench_now_us(void);
+
+/**
+ * @brief Charges us microseconds of simulated latency to the calling task.
+ * Sub-tick amounts are accumulated and slept once they reach a full tick.
+ * @param delay accumulator owned by the caller
+ * @param us latency to add
+ */
+void host_bench_delay(host_bench_delay_t *delay, uint32_t us);
+
+/**
+ * @brief Simulated httpd_req_recv, returns at most the rest of the current
+ * segment and pays the segment latency whenever a new one has to arrive
+ * @param net upload state, data/len set by the caller
+ * @param buffer destination
+ * @param len size of buffer
+ * @return bytes received, 0 once the whole body was sent
+ */
+size_t host_bench_net_recv(host_bench_net_t *net, char *buffer, size_t len);
+
+/**
+ * @brief Emulated esp_ota_write with OTA_WITH_SEQUENTIAL_WRITES: each sector
+ * is erased right before it is first written. Usable as ota_pipeline sink.
+ * @param data bytes to append
+ * @param len length of data
+ * @param ctx host_bench_flash_t
+ * @return result of the emulated partition erase/write
+ */
+esp_err_t host_bench_flash_write(const void *data, size_t len, void *ctx);
+
+/**
+ * @brief Prints one result line in the common benchmark format
+ * @param name benchmark name
+ * @param bytes payload processed
+ * @param elapsed_us wall time
+ */
+void host_bench_report(const char *name, uint64_t bytes, int64_t elapsed_us);
+
+void bench_ota_pipeline(void);
+void bench_multipart(void);
+void bench_ota_decoder(void);
+void bench_dns(void);
+void bench_dns_forward(void);
+void bench_dns_fuzz(void);
+
+#endif // HOST_BENCH_H
@@ -0,0 +1,25 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "host_bench.h"
+
+static void print_banner(const char *text)
+{
+    printf("\n#### %s #####\n\n", text);
+}
+
+void app_main(void)
+{
+    print_banner("Starting Host Benchmarks");
+
+    bench_ota_pipeline();
+    bench_multipart();
+    bench_ota_decoder();
+    bench_dns();
+    bench_dns_forward();
+    bench_dns_fuzz();
+
+    print_banner("Host Benchmarks Done");
+    // Nothing else runs on the host, end the process instead of idling forever
+    fflush(stdout);
+    exit(0);
+}
@@ -0,0 +1,241 @@
+#!/usr/bin/env python3
+"""Load generator for the captive DNS server (device or host_portal build).
+
+    dns_loadgen.py --host 192.168.4.1
+    dns_loadgen.py --host 127.0.0.1 --port 5353 -c 8 -d 20 --json before.json
+    dns_loadgen.py --host 127.0.0.1 --port 5353 -c 8 -d 20 --compare before.json
+    dns_loadgen.py --host 127.0.0.1 --port 5353 -c 32 --interval 1
+    dns_loadgen.py --host 127.0.0.1 --port 5353 -c 8 --interval 1 --bind 127.0.0.10 --flood 2 --flood-bind 127.0.1.1
+
+Each client is a phone that just joined the AP: it sends the probe queries
+of one round (A and AAAA of every probe name) at once on its own UDP socket,
+waits until all of them are answered or timed out, and starts the next round
+after --interval seconds (0, the default, sends the next round right away).
+A query without a reply before --timeout is lost, a reply with another RCODE
+than NOERROR is an error.
+
+With --flood, that many extra processes send queries as fast as they can
+(random names under one domain, or one name with --flood-names same) while
+the phones run, and the report adds how many flood queries were sent and
+answered per second. The server limits queries per source address, so on the
+host give every phone and flooder its own loopback address with --bind and
+--flood-bind; against the device run the flood from another machine with -c 0.
+"""
+
+import argparse
+import asyncio
+import ipaddress
+import json
+import multiprocessing
+import random
+import socket
+import struct
+import sys
+import time
+
+PROBE_NAMES = ['connectivitycheck.gstatic.com', 'www.google.com', 'clients3.google.com', 'captive.apple.com',
+               'www.apple.com', 'www.msftconnecttest.com', 'dns.msftncsi.com', 'detectportal.firefox.com']
+TYPE_A, TYPE_AAAA = 1, 28
+
+
+def encode_query(query_id, name, qtype):
+    header = struct.pack('!HHHHHH', query_id, 0x0100, 1, 0, 0, 0)  # RD set, one question
+    labels = b''.join(bytes([len(label)]) + label.encode() for label in name.split('.'))
+    return header + labels + b'\0' + struct.pack('!HH', qtype, 1)
+
+
+class Phone(asyncio.DatagramProtocol):
+    def __init__(self):
+        self.pending = {}  # Query id: (send time, future)
+
+    def datagram_received(self, data, addr):
+        if len(data) < 12:
+            return
+        query_id, flags = struct.unpack('!HH', data[:4])
+        entry = self.pending.pop(query_id, None)
+        if entry is not None and not entry[1].done():
+            entry[1].set_result((time.monotonic() - entry[0], flags & 0x000F))
+
+
+class Stats:
+    def __init__(self):
+        self.latencies = []
+        self.lost = 0
+        self.errors = 0
+        self.rounds = 0
+
+    def summary(self, elapsed):
+        lat = sorted(self.latencies)
+        count = len(lat) + self.lost + self.errors
+
+        def pct(p):
+            return lat[min(len(lat) - 1, int(p / 100.0 * len(lat)))] * 1000.0 if lat else 0.0
+
+        return {
+            'queries': count,
+            'answered': len(lat),
+            'lost': self.lost,
+            'errors': self.errors,
+            'loss_rate': (self.lost / count) if count else 0.0,
+            'qps': len(lat) / elapsed if elapsed > 0 else 0.0,
+            'rounds': self.rounds,
+            'p50_ms': pct(50),
+            'p90_ms': pct(90),
+            'p99_ms': pct(99),
+            'max_ms': lat[-1] * 1000.0 if lat else 0.0,
+        }
+
+
+def source_addr(base, index):
+    """Address number index counted from base, None to let the OS pick"""
+    return (str(ipaddress.ip_address(base) + index), 0) if base else None
+
+
+async def phone(args, stats, deadline, seed, index):
+    rng = random.Random(seed)
+    loop = asyncio.get_running_loop()
+    transport, protocol = await loop.create_datagram_endpoint(Phone, remote_addr=(args.host, args.port),
+                                                              local_addr=source_addr(args.bind, index))
+
+    try:
+        while time.monotonic() < deadline:
+            futures = []
+            for name in PROBE_NAMES[:args.names]:
+                for qtype in (TYPE_A, TYPE_AAAA):
+                    query_id = rng.randrange(0x10000)
+                    while query_id in protocol.pending:
+                        query_id = rng.randrange(0x10000)
+                    future = loop.create_future()
+                    protocol.pending[query_id] = (time.monotonic(), future)
+                    futures.append((query_id, future))
+                    transport.sendto(encode_query(query_id, name, qtype))
+
+            done, _ = await asyncio.wait([f for _, f in futures], timeout=args.timeout)
+            for query_id, future in futures:
+                if future in done:
+                    latency, rcode = future.result()
+                    if rcode == 0:
+                        stats.latencies.append(latency)
+                    else:
+                        stats.errors += 1
+                else:
+                    protocol.pending.pop(query_id, None)
+                    stats.lost += 1
+            stats.rounds += 1
+            if args.interval > 0:
+                await asyncio.sleep(min(args.interval, max(0.0, deadline - time.monotonic())))
+    finally:
+        transport.close()
+
+
+def print_table(result, baseline=None):
+    print('%9s %9s %7s %7s %9s %9s %9s %9s %9s' % ('queries', 'answered', 'lost%', 'errors', 'qps', 'p50 ms',
+                                                   'p90 ms', 'p99 ms', 'max ms'))
+    print('%9d %9d %6.2f%% %7d %9.1f %9.2f %9.2f %9.2f %9.2f' % (result['queries'], result['answered'],
+                                                               100.0 * result['loss_rate'], result['errors'],
+                                                               result['qps'], result['p50_ms'], result['p90_ms'],
+                                                               result['p99_ms'], result['max_ms']))
+    if baseline:
+        def delta(key):
+            return '%+.1f%%' % (100.0 * (result[key] - baseline[key]) / baseline[key]) if baseline[key] else 'n/a'
+
+        print('%9s %9s %7s %7s %9s %9s %9s %9s' % ('vs base', '', '', '', delta('qps'), delta('p50_ms'),
+                                                   delta('p90_ms'), delta('p99_ms')))
+
+
+def flooder(args, index, sent, answered):
+    """Sends queries back to back until the duration is over, replies are only counted"""
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    local = source_addr(args.flood_bind, index)
+    if local:
+        sock.bind(local)
+    sock.setblocking(False)
+    rng = random.Random(args.seed + 1000 + index)
+    if args.flood_names == 'same':
+        queries = [encode_query(i, 'www.example.com', TYPE_A) for i in range(256)]
+    else:
+        queries = [encode_query(i, '%08x.example.com' % rng.getrandbits(32), TYPE_A) for i in range(4096)]
+    count = replies = 0
+    deadline = time.monotonic() + args.duration
+    while time.monotonic() < deadline:
+        for query in queries[count % len(queries):][:64]:
+            try:
+                sock.sendto(query, (args.host, args.port))
+                count += 1
+            except (BlockingIOError, InterruptedError):
+                break
+        while True:
+            try:
+                sock.recv(512)
+                replies += 1
+            except (BlockingIOError, InterruptedError):
+                break
+    sock.close()
+    with sent.get_lock():
+        sent.value += count
+    with answered.get_lock():
+        answered.value += replies
+
+
+async def run(args):
+    stats = Stats()
+    sent = multiprocessing.Value('Q', 0)
+    answered = multiprocessing.Value('Q', 0)
+    flooders = [multiprocessing.Process(target=flooder, args=(args, i, sent, answered)) for i in range(args.flood)]
+    for process in flooders:
+        process.start()
+    start = time.monotonic()
+    deadline = start + args.duration
+    await asyncio.gather(*(phone(args, stats, deadline, args.seed + i, i) for i in range(args.concurrency)))
+    elapsed = time.monotonic() - start
+    for process in flooders:
+        process.join()
+    result = stats.summary(elapsed)
+    if args.flood:
+        result['flood_sent_qps'] = sent.value / elapsed
+        result['flood_answered_qps'] = answered.value / elapsed
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--host', default='192.168.4.1')
+    parser.add_argument('--port', type=int, default=53)
+    parser.add_argument('-c', '--concurrency', type=int, default=8, help='phones, each with its own socket')
+    parser.add_argument('--bind', help='source address of the first phone, the next ones count up from it')
+    parser.add_argument('--flood', type=int, default=0, help='flooding processes next to the phones')
+    parser.add_argument('--flood-bind', help='source address of the first flooder, the next ones count up from it')
+    parser.add_argument('--flood-names', choices=('random', 'same'), default='random',
+                        help='random subdomains (default) or one name over and over')
+    parser.add_argument('-d', '--duration', type=float, default=10.0, help='seconds')
+    parser.add_argument('--names', type=int, default=len(PROBE_NAMES), choices=range(1, len(PROBE_NAMES) + 1),
+                        metavar='N', help='probe names per round, two queries each (default %(default)s)')
+    parser.add_argument('--interval', type=float, default=0.0, help='seconds between the rounds of a phone')
+    parser.add_argument('--timeout', type=float, default=1.0, help='per round, seconds')
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('--json', help='write the results to this file')
+    parser.add_argument('--compare', help='results of an earlier run to compare against')
+    args = parser.parse_args()
+
+    result = asyncio.run(run(args))
+
+    baseline = None
+    if args.compare:
+        with open(args.compare) as f:
+            baseline = json.load(f)
+    print('%s:%d, %d phones, %d queries per round, %.0f s' % (args.host, args.port, args.concurrency,
+                                                              2 * args.names, args.duration))
+    print_table(result, baseline)
+    if args.flood:
+        print('flood: %d processes, %.0f queries/s sent, %.0f answered/s' % (args.flood, result['flood_sent_qps'],
+                                                                          result['flood_answered_qps']))
+
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump(result, f, indent=2)
+
+    return 1 if args.concurrency > 0 and result['answered'] == 0 else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
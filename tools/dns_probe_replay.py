@@ -0,0 +1,276 @@
+#!/usr/bin/env python3
+"""Replays the DNS queries operating systems send to detect a captive portal.
+
+    dns_probe_replay.py --host 192.168.4.1
+    dns_probe_replay.py --host 127.0.0.1 --port 5353 --rounds 20 --json before.json
+    dns_probe_replay.py --host 127.0.0.1 --port 5353 --rounds 20 --compare before.json
+    dns_probe_replay.py --host 127.0.0.1 --port 5353 --os ios --os windows -v
+
+Every OS is a list of steps, a step is the queries its resolver sends at once
+(A and AAAA side by side, HTTPS records on Apple systems and Firefox, EDNS0
+where the resolver adds it). The next step starts when every query of the
+current one got a usable reply. Replies are checked the way a stub resolver
+does: the id, the question and every record in the counted sections have to
+match, answers have to be of the asked type, OPT may only appear once in the
+additional section. A reply that fails is dropped and the query is sent again
+after the resolver's retransmit interval, as the client would. The detection
+time of an OS is the time until its last step is done, the DNS part of how
+long a phone takes to show the sign-in page.
+"""
+
+import argparse
+import json
+import random
+import select
+import socket
+import struct
+import sys
+import time
+
+TYPE_A, TYPE_SOA, TYPE_CNAME, TYPE_AAAA, TYPE_OPT, TYPE_HTTPS = 1, 6, 5, 28, 41, 65
+
+# Steps of queries: (name, type, EDNS0 payload size or None, DO bit)
+SEQUENCES = {
+    'android': {
+        'retransmit': 5.0, 'attempts': 2,
+        'steps': [[('connectivitycheck.gstatic.com', TYPE_A, 1232, False),
+                   ('connectivitycheck.gstatic.com', TYPE_AAAA, 1232, False),
+                   ('www.google.com', TYPE_A, 1232, False),
+                   ('www.google.com', TYPE_AAAA, 1232, False)]],
+    },
+    'ios': {
+        'retransmit': 1.0, 'attempts': 4,
+        'steps': [[('captive.apple.com', TYPE_HTTPS, 1232, False),
+                   ('captive.apple.com', TYPE_A, 1232, False),
+                   ('captive.apple.com', TYPE_AAAA, 1232, False)]],
+    },
+    'macos': {
+        'retransmit': 1.0, 'attempts': 4,
+        'steps': [[('captive.apple.com', TYPE_HTTPS, 1232, False),
+                   ('captive.apple.com', TYPE_A, 1232, False),
+                   ('captive.apple.com', TYPE_AAAA, 1232, False)],
+                  [('www.apple.com', TYPE_HTTPS, 1232, False),
+                   ('www.apple.com', TYPE_A, 1232, False),
+                   ('www.apple.com', TYPE_AAAA, 1232, False)]],
+    },
+    'windows': {
+        'retransmit': 1.0, 'attempts': 3,
+        'steps': [[('www.msftconnecttest.com', TYPE_A, None, False),
+                   ('www.msftconnecttest.com', TYPE_AAAA, None, False)],
+                  [('dns.msftncsi.com', TYPE_A, None, False),
+                   ('dns.msftncsi.com', TYPE_AAAA, None, False)]],
+    },
+    'linux': {
+        'retransmit': 5.0, 'attempts': 2,
+        'steps': [[('connectivity-check.ubuntu.com', TYPE_A, 1232, True),
+                   ('connectivity-check.ubuntu.com', TYPE_AAAA, 1232, True)]],
+    },
+    'firefox': {
+        'retransmit': 1.0, 'attempts': 3,
+        'steps': [[('detectportal.firefox.com', TYPE_A, None, False),
+                   ('detectportal.firefox.com', TYPE_AAAA, None, False),
+                   ('detectportal.firefox.com', TYPE_HTTPS, None, False)]],
+    },
+}
+
+
+def encode_query(query_id, name, qtype, edns_size, dnssec_ok):
+    arcount = 1 if edns_size else 0
+    header = struct.pack('!HHHHHH', query_id, 0x0100, 1, 0, 0, arcount)  # RD set, one question
+    labels = b''.join(bytes([len(label)]) + label.encode() for label in name.split('.'))
+    message = header + labels + b'\0' + struct.pack('!HH', qtype, 1)
+    if edns_size:
+        message += b'\0' + struct.pack('!HHIH', TYPE_OPT, edns_size, 0x8000 if dnssec_ok else 0, 0)
+    return message
+
+
+def skip_name(data, offset):
+    """Offset after the name at offset, ValueError if it runs past the end"""
+    while True:
+        if offset >= len(data):
+            raise ValueError('name past the end')
+        label = data[offset]
+        if label == 0:
+            return offset + 1
+        if label & 0xC0 == 0xC0:
+            if offset + 2 > len(data):
+                raise ValueError('pointer past the end')
+            return offset + 2
+        if label & 0xC0:
+            raise ValueError('reserved label type')
+        offset += 1 + label
+
+
+def check_reply(query, reply):
+    """Verdict of a stub resolver on a reply: answer, nodata, nxdomain, error or malformed: <reason>"""
+    try:
+        if len(reply) < 12:
+            raise ValueError('short header')
+        query_id, flags, qdcount, ancount, nscount, arcount = struct.unpack('!HHHHHH', reply[:12])
+        question_end = skip_name(query, 12) + 4
+        if query_id != struct.unpack('!H', query[:2])[0] or not flags & 0x8000 or qdcount != 1:
+            raise ValueError('id, QR or question count')
+        if reply[12:question_end].lower() != query[12:question_end].lower():
+            raise ValueError('question differs')
+        qtype = struct.unpack('!H', query[question_end - 4:question_end - 2])[0]
+
+        offset = question_end
+        opt_seen = False
+        answers = 0
+        for index in range(ancount + nscount + arcount):
+            owner = offset
+            offset = skip_name(reply, offset)
+            if offset + 10 > len(reply):
+                raise ValueError('record %d cut off' % index)
+            rtype, _, _, rdlength = struct.unpack('!HHIH', reply[offset:offset + 10])
+            offset += 10 + rdlength
+            if offset > len(reply):
+                raise ValueError('record %d data past the end' % index)
+            if rtype == TYPE_OPT:
+                if index < ancount + nscount or opt_seen or reply[owner] != 0:
+                    raise ValueError('OPT outside the additional section')
+                opt_seen = True
+            elif index < ancount:
+                if rtype not in (qtype, TYPE_CNAME):
+                    raise ValueError('answer of type %d to a type %d question' % (rtype, qtype))
+                answers += 1
+        if offset != len(reply):
+            raise ValueError('%d bytes after the last record' % (len(reply) - offset))
+    except (ValueError, struct.error) as e:
+        return 'malformed: %s' % e
+
+    rcode = flags & 0x000F
+    if rcode == 3:
+        return 'nxdomain'
+    if rcode != 0:
+        return 'error'
+    return 'answer' if answers else 'nodata'
+
+
+def run_os(args, name, sequence, rng):
+    """One detection: the OS's steps one after another, with its retransmit rules"""
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setblocking(False)
+    retransmit = args.retransmit if args.retransmit else sequence['retransmit']
+    result = {'queries': 0, 'sent': 0, 'malformed': 0, 'verdicts': {}, 'failed': 0}
+    start = time.monotonic()
+    try:
+        for step in sequence['steps']:
+            pending = {}  # Query id: [message, attempts, next retransmit]
+            for qname, qtype, edns_size, dnssec_ok in step:
+                query_id = rng.randrange(0x10000)
+                while query_id in pending:
+                    query_id = rng.randrange(0x10000)
+                message = encode_query(query_id, qname, qtype, edns_size, dnssec_ok)
+                pending[query_id] = [message, 1, time.monotonic() + retransmit]
+                sock.sendto(message, (args.host, args.port))
+                result['queries'] += 1
+                result['sent'] += 1
+
+            while pending:
+                now = time.monotonic()
+                for query_id in list(pending):
+                    entry = pending[query_id]
+                    if entry[2] > now:
+                        continue
+                    if entry[1] >= sequence['attempts']:
+                        del pending[query_id]
+                        result['failed'] += 1
+                        continue
+                    entry[1] += 1
+                    entry[2] = now + retransmit
+                    sock.sendto(entry[0], (args.host, args.port))
+                    result['sent'] += 1
+                if not pending:
+                    break
+                wait = max(0.0, min(entry[2] for entry in pending.values()) - time.monotonic())
+                if not select.select([sock], [], [], wait)[0]:
+                    continue
+                reply = sock.recv(4096)
+                if len(reply) < 2 or struct.unpack('!H', reply[:2])[0] not in pending:
+                    continue
+                query_id = struct.unpack('!H', reply[:2])[0]
+                verdict = check_reply(pending[query_id][0], reply)
+                if verdict.startswith('malformed'):
+                    result['malformed'] += 1
+                    if args.verbose:
+                        print('  %s: %s' % (name, verdict))
+                    continue
+                result['verdicts'][verdict] = result['verdicts'].get(verdict, 0) + 1
+                del pending[query_id]
+    finally:
+        sock.close()
+    result['seconds'] = time.monotonic() - start
+    return result
+
+
+def summarize(runs):
+    times = sorted(run['seconds'] for run in runs)
+
+    def pct(p):
+        return times[min(len(times) - 1, int(p / 100.0 * len(times)))] * 1000.0
+
+    verdicts = {}
+    for run in runs:
+        for verdict, count in run['verdicts'].items():
+            verdicts[verdict] = verdicts.get(verdict, 0) + count
+    return {
+        'rounds': len(runs),
+        'queries': sum(run['queries'] for run in runs),
+        'retransmits': sum(run['sent'] - run['queries'] for run in runs),
+        'malformed': sum(run['malformed'] for run in runs),
+        'failed': sum(run['failed'] for run in runs),
+        'verdicts': verdicts,
+        'p50_ms': pct(50),
+        'max_ms': times[-1] * 1000.0,
+    }
+
+
+def print_table(results, baseline=None):
+    print('%-8s %7s %7s %9s %7s %7s %21s %10s %10s' % ('os', 'rounds', 'queries', 'malformed', 'resent', 'failed',
+                                                       'answer/nodata/nxdom', 'p50 ms', 'max ms'))
+    for name, result in results.items():
+        verdicts = result['verdicts']
+        line = '%-8s %7d %7d %9d %7d %7d %21s %10.1f %10.1f' % (
+            name, result['rounds'], result['queries'], result['malformed'], result['retransmits'], result['failed'],
+            '%d/%d/%d' % (verdicts.get('answer', 0), verdicts.get('nodata', 0), verdicts.get('nxdomain', 0)),
+            result['p50_ms'], result['max_ms'])
+        if baseline and name in baseline and baseline[name]['p50_ms']:
+            line += '  p50 %+.1f%%' % (100.0 * (result['p50_ms'] - baseline[name]['p50_ms']) / baseline[name]['p50_ms'])
+        print(line)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--host', default='192.168.4.1')
+    parser.add_argument('--port', type=int, default=53)
+    parser.add_argument('--os', action='append', choices=sorted(SEQUENCES), help='replay only these (repeatable)')
+    parser.add_argument('--rounds', type=int, default=5, help='detections per OS')
+    parser.add_argument('--retransmit', type=float, help="seconds, instead of each resolver's own interval")
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('-v', '--verbose', action='store_true', help='print why a reply was dropped')
+    parser.add_argument('--json', help='write the results to this file')
+    parser.add_argument('--compare', help='results of an earlier run to compare against')
+    args = parser.parse_args()
+
+    rng = random.Random(args.seed)
+    results = {}
+    for name in args.os or sorted(SEQUENCES):
+        results[name] = summarize([run_os(args, name, SEQUENCES[name], rng) for _ in range(args.rounds)])
+
+    baseline = None
+    if args.compare:
+        with open(args.compare) as f:
+            baseline = json.load(f)
+    print('%s:%d, %d rounds per OS' % (args.host, args.port, args.rounds))
+    print_table(results, baseline)
+
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump(results, f, indent=2)
+
+    return 1 if any(result['failed'] or result['malformed'] for result in results.values()) else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
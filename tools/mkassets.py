@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+"""Packs the web UI for the "assets" partition (see components/app_local_server/include/asset_pack.h).
+
+    mkassets.py components/app_local_server/webpage -o assets.bin
+    mkassets.py components/app_local_server/webpage --no-gzip -o assets.bin
+
+Every file of the directory is stored under "/<name>", gzip compressed when
+that makes it smaller. The device sends those with Content-Encoding: gzip to
+clients that accept it and decompresses them for the others.
+Write the result with parttool.py or upload it to a running device:
+
+    parttool.py write_partition --partition-name assets --input assets.bin
+    curl --data-binary @assets.bin http://192.168.4.1/assets/update
+"""
+
+import argparse
+import gzip
+import os
+import struct
+import sys
+import zlib
+
+MAGIC = b'WPAK'
+VERSION = 1
+HEADER_LEN = 16
+ENTRY_LEN = 80
+PATH_LEN = 32
+TYPE_LEN = 32
+FLAG_GZIP = 0x0001
+PARTITION_SIZE = 0x20000  # partition-rev-1-4mb.csv
+
+CONTENT_TYPES = {
+    '.html': 'text/html',
+    '.css': 'text/css',
+    '.js': 'application/javascript',
+    '.ico': 'image/x-icon',
+    '.png': 'image/png',
+    '.svg': 'image/svg+xml',
+    '.json': 'application/json',
+}
+
+
+def pack(files, use_gzip):
+    """files: list of (path, content type, data), returns the pack image."""
+    offset = HEADER_LEN + len(files) * ENTRY_LEN
+    entries, blobs = b'', b''
+    for path, content_type, data in files:
+        flags = 0
+        if use_gzip:
+            compressed = gzip.compress(data, compresslevel=9, mtime=0)  # Same input, same image
+            if len(compressed) < len(data):
+                data, flags = compressed, FLAG_GZIP
+        # Fields are NUL terminated inside their fixed size
+        entries += struct.pack('<%ds%dsIIIHH' % (PATH_LEN, TYPE_LEN), path.encode(), content_type.encode(),
+                               offset + len(blobs), len(data), zlib.crc32(data), flags, 0)
+        blobs += data
+
+    body = entries + blobs
+    header = MAGIC + struct.pack('<HHII', VERSION, len(files), HEADER_LEN + len(body), zlib.crc32(body))
+    assert len(header) == HEADER_LEN
+    return header + body
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('directory', help='web UI files, e.g. components/app_local_server/webpage')
+    parser.add_argument('-o', '--output', required=True, help='pack image')
+    parser.add_argument('--no-gzip', action='store_true', help='store every file as is')
+    args = parser.parse_args()
+
+    files, raw_len = [], 0
+    for name in sorted(os.listdir(args.directory)):
+        source = os.path.join(args.directory, name)
+        if not os.path.isfile(source):
+            continue
+        path = '/' + name
+        content_type = CONTENT_TYPES.get(os.path.splitext(name)[1], 'application/octet-stream')
+        if len(path) >= PATH_LEN:
+            sys.exit('%s: path longer than %d characters' % (name, PATH_LEN - 1))
+        with open(source, 'rb') as f:
+            data = f.read()
+        raw_len += len(data)
+        files.append((path, content_type, data))
+
+    image = pack(files, not args.no_gzip)
+    if len(image) > PARTITION_SIZE:
+        sys.exit('pack is %d bytes, the partition holds %d' % (len(image), PARTITION_SIZE))
+
+    with open(args.output, 'wb') as f:
+        f.write(image)
+    print('%s: %d files, %d -> %d bytes (%.1f%% of the partition)' % (args.output, len(files), raw_len, len(image),
+                                                                     100.0 * len(image) / PARTITION_SIZE))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,168 @@
+#!/usr/bin/env python3
+"""Packs an app image for the /OTAupdate endpoint (see components/ota_decoder).
+
+    ota_pack.py build/captive_portal.bin -o fw.otaz
+    ota_pack.py build/captive_portal.bin --base old/captive_portal.bin -o fw.otaz
+
+Without --base the image is LZ compressed with a 4 KB window. With --base the
+result is a delta: ranges that also exist in the base image (the one running
+on the device) become copy operations, the rest is compressed as above. The
+device refuses a delta whose base digest does not match its running image.
+"""
+
+import argparse
+import hashlib
+import struct
+import sys
+
+MAGIC = b'OTAZ'
+VERSION = 1
+FLAG_DELTA = 0x01
+WINDOW_BITS = 12
+WINDOW_SIZE = 1 << WINDOW_BITS
+HEADER_LEN = 48
+DIGEST_LEN = 32
+
+LITERAL_MAX = 128        # 0x00-0x7F
+MATCH_MIN = 3            # 0x80-0xBF
+MATCH_MAX = MATCH_MIN + 0x3F
+COPY_OP = 0xC0
+
+HASH_LEN = 4             # Bytes hashed to find window matches
+MAX_CHAIN = 32           # Window candidates examined per position
+BASE_BLOCK = 16          # Base image is indexed every BASE_BLOCK bytes
+COPY_MIN = 24            # Shorter base matches are not worth a 9 byte copy
+
+
+def base_digest(base):
+    """Returns the digest the device reports for its running image.
+
+    ESP-IDF app images end with the SHA-256 of everything before it, and that
+    appended value is what esp_partition_get_sha256() returns for an app
+    partition.
+    """
+    body, appended = base[:-DIGEST_LEN], base[-DIGEST_LEN:]
+    if len(base) <= DIGEST_LEN or hashlib.sha256(body).digest() != appended:
+        sys.exit('base image does not end with its SHA-256 digest')
+    return appended
+
+
+class Writer:
+    def __init__(self):
+        self.out = bytearray()
+        self.literals = bytearray()
+
+    def literal(self, byte):
+        self.literals.append(byte)
+        if len(self.literals) == LITERAL_MAX:
+            self.flush()
+
+    def flush(self):
+        if self.literals:
+            self.out.append(len(self.literals) - 1)
+            self.out += self.literals
+            self.literals = bytearray()
+
+    def match(self, distance, length):
+        self.flush()
+        self.out.append(0x80 | (length - MATCH_MIN))
+        self.out += struct.pack('<H', distance)
+
+    def copy(self, offset, length):
+        self.flush()
+        self.out.append(COPY_OP)
+        self.out += struct.pack('<II', offset, length)
+
+
+def index_base(base):
+    index = {}
+    for pos in range(0, len(base) - BASE_BLOCK + 1, BASE_BLOCK):
+        index.setdefault(base[pos:pos + BASE_BLOCK], pos)
+    return index
+
+
+def encode(image, base=None):
+    writer = Writer()
+    base_index = index_base(base) if base else {}
+    chains = {}
+    pos = 0
+
+    def remember(at):
+        if at + HASH_LEN <= len(image):
+            chains.setdefault(image[at:at + HASH_LEN], []).append(at)
+
+    while pos < len(image):
+        # Long runs shared with the base image first
+        if base_index:
+            start = base_index.get(image[pos:pos + BASE_BLOCK])
+            if start is not None:
+                length = BASE_BLOCK
+                while pos + length < len(image) and start + length < len(base) and \
+                        image[pos + length] == base[start + length]:
+                    length += 1
+                if length >= COPY_MIN:
+                    writer.copy(start, length)
+                    for at in range(pos, pos + length):
+                        remember(at)
+                    pos += length
+                    continue
+
+        best_len, best_dist = 0, 0
+        for cand in reversed(chains.get(image[pos:pos + HASH_LEN], [])[-MAX_CHAIN:]):
+            distance = pos - cand
+            if distance > WINDOW_SIZE:
+                break
+            length = 0
+            while length < MATCH_MAX and pos + length < len(image) and \
+                    image[cand + length] == image[pos + length]:
+                length += 1
+            if length > best_len:
+                best_len, best_dist = length, distance
+                if length == MATCH_MAX:
+                    break
+
+        if best_len >= MATCH_MIN:
+            writer.match(best_dist, best_len)
+            for at in range(pos, pos + best_len):
+                remember(at)
+            pos += best_len
+        else:
+            writer.literal(image[pos])
+            remember(pos)
+            pos += 1
+
+    writer.flush()
+    return bytes(writer.out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('image', help='app image to upload (.bin)')
+    parser.add_argument('--base', help='app image currently running on the device, produces a delta')
+    parser.add_argument('-o', '--output', required=True, help='packed output file')
+    args = parser.parse_args()
+
+    with open(args.image, 'rb') as f:
+        image = f.read()
+
+    flags, digest, base = 0, bytes(DIGEST_LEN), None
+    if args.base:
+        with open(args.base, 'rb') as f:
+            base = f.read()
+        flags, digest = FLAG_DELTA, base_digest(base)
+
+    header = MAGIC + struct.pack('<BBBBII', VERSION, flags, WINDOW_BITS, 0, len(image), 0) + digest
+    assert len(header) == HEADER_LEN
+    packed = header + encode(image, base)
+
+    with open(args.output, 'wb') as f:
+        f.write(packed)
+
+    print('%s: %d -> %d bytes (%.1f%%)%s' % (args.output, len(image), len(packed), 100.0 * len(packed) / len(image),
+                                             ' delta' if base else ''))
+    # Sent as X-OTA-SHA256 the device checks the upload before booting it
+    print('sha256: %s' % hashlib.sha256(packed).hexdigest())
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,292 @@
+#!/usr/bin/env python3
+"""Load generator for the portal HTTP server (device or host_portal build).
+
+    portal_loadgen.py --host 192.168.4.1
+    portal_loadgen.py --host 127.0.0.1 --port 8080 -c 8 -d 20 --mix static=4,check=3,list=1,data=2
+    portal_loadgen.py --host 127.0.0.1 --port 8080 --json after.json --compare before.json
+    portal_loadgen.py --host 127.0.0.1 --port 8080 -c 8 --mix static=8,reset=1
+    portal_loadgen.py --host 127.0.0.1 --port 8080 -c 8 --mix static=1 --gzip
+    portal_loadgen.py --host 127.0.0.1 --port 8080 -c 8 --mix static=1,range=1
+    portal_loadgen.py --host 127.0.0.1 --port 8080 -c 4 --idle 12
+
+Each client keeps one HTTP/1.1 connection open and sends requests back to
+back, picking the next scenario at random with the --mix weights. The server
+closing a connection is not an error, the client reconnects. Any status of
+400 or above, a timeout or a broken connection counts as an error, except
+503: the server refusing slow work while its workers are busy is counted
+separately. With --idle, extra connections load one page and then sit idle
+like phones that opened the portal and went quiet; the report counts how
+often the server closed them to make room and how often it refused them.
+"""
+
+import argparse
+import asyncio
+import json
+import random
+import sys
+import time
+
+STATIC_URIS = ['/', '/app.css', '/app.js', '/jquery-3.3.1.min.js', '/favicon.ico']
+CARD_IDS = ['305419896', '2271560481', '2882400000', '1', '42']  # Defaults plus unknown cards
+DATA_KEYS = 'SSID,Temp,Humidity,FirmwareVersion,WiFiStatus'
+
+
+class Request:
+    def __init__(self, method, uri, body=None, headers=None):
+        self.method, self.uri, self.body, self.headers = method, uri, body, headers or {}
+
+    def encode(self, host, etag=None, gzip=False):
+        body = self.body.encode() if self.body else b''
+        head = '%s %s HTTP/1.1\r\nHost: %s\r\n' % (self.method, self.uri, host)
+        if gzip:
+            head += 'Accept-Encoding: gzip, deflate\r\n'
+        for name, value in self.headers.items():
+            head += '%s: %s\r\n' % (name, value)
+        if etag:
+            head += 'If-None-Match: %s\r\n' % etag
+        if body:
+            head += 'Content-Type: application/json\r\nContent-Length: %d\r\n' % len(body)
+        return (head + '\r\n').encode() + body
+
+
+def scenario_requests(name, rng):
+    if name == 'static':
+        return Request('GET', rng.choice(STATIC_URIS))
+    if name == 'check':
+        # /cards/check is registered as GET and reads a JSON body
+        return Request('GET', '/cards/check', json.dumps({'card_id': rng.choice(CARD_IDS)}))
+    if name == 'list':
+        return Request('GET', '/cards/get')
+    if name == 'data':
+        return Request('POST', '/getData', json.dumps({'key': DATA_KEYS}))
+    if name == 'reset':
+        # Rewrites the card database, a slow request (raise the card write rate limit for this)
+        return Request('POST', '/cards/reset')
+    if name == 'range':
+        # Resumes the jQuery bundle, inside the 32 KB of its gzip copy in the asset pack too
+        return Request('GET', '/jquery-3.3.1.min.js', headers={'Range': 'bytes=%d-' % rng.randrange(30 * 1024)})
+    raise ValueError(name)
+
+
+SCENARIOS = ('static', 'check', 'list', 'data', 'reset', 'range')
+
+
+class Stats:
+    def __init__(self):
+        self.latencies = []
+        self.errors = 0
+        self.bytes = 0
+        self.not_modified = 0
+        self.busy = 0
+
+    def summary(self, elapsed):
+        lat = sorted(self.latencies)
+        count = len(lat) + self.errors + self.busy
+
+        def pct(p):
+            return lat[min(len(lat) - 1, int(p / 100.0 * len(lat)))] * 1000.0 if lat else 0.0
+
+        return {
+            'requests': count,
+            'errors': self.errors,
+            'error_rate': (self.errors / count) if count else 0.0,
+            'rps': count / elapsed if elapsed > 0 else 0.0,
+            'p50_ms': pct(50),
+            'p90_ms': pct(90),
+            'p99_ms': pct(99),
+            'max_ms': lat[-1] * 1000.0 if lat else 0.0,
+            'kib': self.bytes / 1024.0,
+            'not_modified': self.not_modified,
+            'busy': self.busy,
+        }
+
+
+async def read_response(reader):
+    """Returns (status, body length, keep_alive, etag)."""
+    status_line = await reader.readline()
+    if not status_line:
+        raise ConnectionError('connection closed')
+    status = int(status_line.split()[1])
+
+    headers = {}
+    while True:
+        line = await reader.readline()
+        if line in (b'\r\n', b'\n', b''):
+            break
+        name, _, value = line.decode('latin-1').partition(':')
+        headers[name.strip().lower()] = value.strip()
+
+    length = 0
+    if headers.get('transfer-encoding', '').lower() == 'chunked':
+        while True:
+            size = int((await reader.readline()).split(b';')[0], 16)
+            await reader.readexactly(size + 2)
+            length += size
+            if size == 0:
+                break
+    elif 'content-length' in headers:
+        length = int(headers['content-length'])
+        await reader.readexactly(length)
+
+    keep_alive = headers.get('connection', '').lower() != 'close'
+    return status, length, keep_alive, headers.get('etag')
+
+
+async def client(args, weights, stats, deadline, seed):
+    rng = random.Random(seed)
+    reader = writer = None
+    etags = {}  # Per URI, sent back as If-None-Match with --revalidate
+
+    while time.monotonic() < deadline:
+        name = rng.choices(SCENARIOS, weights)[0]
+        request = scenario_requests(name, rng)
+        uri = request.uri
+        request = request.encode(args.host, etags.get(uri) if args.revalidate else None, args.gzip)
+        start = time.monotonic()
+        try:
+            if writer is None:
+                reader, writer = await asyncio.wait_for(asyncio.open_connection(args.host, args.port), args.timeout)
+            writer.write(request)
+            status, length, keep_alive, etag = await asyncio.wait_for(read_response(reader), args.timeout)
+        except (OSError, ConnectionError, asyncio.TimeoutError, asyncio.IncompleteReadError, ValueError, IndexError):
+            stats[name].errors += 1
+            if writer is not None:
+                writer.close()
+            reader = writer = None
+            continue
+
+        stats[name].bytes += length
+        if status == 304:
+            stats[name].not_modified += 1
+        elif etag:
+            etags[uri] = etag
+        if status == 503:
+            stats[name].busy += 1
+        elif status >= 400:
+            stats[name].errors += 1
+        else:
+            stats[name].latencies.append(time.monotonic() - start)
+        if not keep_alive:
+            writer.close()
+            reader = writer = None
+
+    if writer is not None:
+        writer.close()
+
+
+async def idle_client(args, idle, deadline):
+    while time.monotonic() < deadline:
+        try:
+            reader, writer = await asyncio.wait_for(asyncio.open_connection(args.host, args.port), args.timeout)
+            writer.write(Request('GET', '/favicon.ico').encode(args.host))
+            status = (await asyncio.wait_for(read_response(reader), args.timeout))[0]
+        except (OSError, ConnectionError, asyncio.TimeoutError, asyncio.IncompleteReadError, ValueError, IndexError):
+            status, writer = None, None
+        if status != 200:
+            idle['refused'] += 1
+        else:
+            # Until the server closes it or the run ends
+            try:
+                if not await asyncio.wait_for(reader.read(1), max(0.0, deadline - time.monotonic())):
+                    idle['closed'] += 1
+            except (OSError, asyncio.TimeoutError):
+                pass
+        if writer is not None:
+            writer.close()
+        # A phone only comes back with its next connectivity probe
+        await asyncio.sleep(min(1.0, max(0.0, deadline - time.monotonic())))
+
+
+def parse_mix(text):
+    weights = dict.fromkeys(SCENARIOS, 0)
+    for item in text.split(','):
+        name, _, weight = item.partition('=')
+        if name not in weights:
+            sys.exit('unknown scenario %r, expected one of %s' % (name, ', '.join(SCENARIOS)))
+        weights[name] = float(weight or 1)
+    return [weights[name] for name in SCENARIOS]
+
+
+def print_table(results, baseline=None):
+    print('%-8s %9s %7s %8s %9s %9s %9s %9s %6s %6s' % ('scenario', 'requests', 'err%', 'req/s', 'p50 ms', 'p90 ms',
+                                                      'p99 ms', 'max ms', '304s', '503s'))
+    for name, r in results.items():
+        print('%-8s %9d %6.2f%% %8.1f %9.2f %9.2f %9.2f %9.2f %6d %6d' % (name, r['requests'], 100.0 * r['error_rate'],
+                                                                        r['rps'], r['p50_ms'], r['p90_ms'],
+                                                                        r['p99_ms'], r['max_ms'], r['not_modified'],
+                                                                        r.get('busy', 0)))
+        if baseline and name in baseline:
+            b = baseline[name]
+
+            def delta(key):
+                return '%+.1f%%' % (100.0 * (r[key] - b[key]) / b[key]) if b[key] else 'n/a'
+
+            print('%-8s %9s %7s %8s %9s %9s %9s' % ('', 'vs base', '', delta('rps'), delta('p50_ms'), delta('p90_ms'),
+                                                    delta('p99_ms')))
+
+
+async def run(args):
+    weights = parse_mix(args.mix)
+    stats = {name: Stats() for name in SCENARIOS}
+    start = time.monotonic()
+    deadline = start + args.duration
+    idle = {'closed': 0, 'refused': 0}
+    await asyncio.gather(*(client(args, weights, stats, deadline, args.seed + i) for i in range(args.concurrency)),
+                         *(idle_client(args, idle, deadline) for _ in range(args.idle)))
+    elapsed = time.monotonic() - start
+
+    total = Stats()
+    for s in stats.values():
+        total.latencies += s.latencies
+        total.errors += s.errors
+        total.bytes += s.bytes
+        total.not_modified += s.not_modified
+        total.busy += s.busy
+    results = {name: s.summary(elapsed) for name, s in stats.items() if s.latencies or s.errors or s.busy}
+    results['total'] = total.summary(elapsed)
+    if args.idle:
+        results['idle'] = idle
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--host', default='192.168.4.1')
+    parser.add_argument('--port', type=int, default=80)
+    parser.add_argument('-c', '--concurrency', type=int, default=8, help='parallel connections (server allows 13)')
+    parser.add_argument('-d', '--duration', type=float, default=10.0, help='seconds')
+    parser.add_argument('--mix', default='static=4,check=3,list=1,data=2', help='scenario weights')
+    parser.add_argument('--timeout', type=float, default=5.0, help='per request, seconds')
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('--revalidate', action='store_true',
+                        help='send the last ETag of a URI as If-None-Match, like a browser polling it')
+    parser.add_argument('--gzip', action='store_true',
+                        help='send Accept-Encoding: gzip like a browser, the asset pack is sent compressed')
+    parser.add_argument('--idle', type=int, default=0,
+                        help='extra connections that load one file and stay idle, like a burst of captive clients')
+    parser.add_argument('--json', help='write the results to this file')
+    parser.add_argument('--compare', help='results of an earlier run to compare against')
+    args = parser.parse_args()
+
+    results = asyncio.run(run(args))
+
+    baseline = None
+    if args.compare:
+        with open(args.compare) as f:
+            baseline = json.load(f)
+    print('%s:%d, %d clients, %.0f s, mix %s' % (args.host, args.port, args.concurrency, args.duration, args.mix))
+    idle = results.pop('idle', None)
+    print_table(results, baseline)
+    if idle is not None:
+        print('%d idle connections: %d closed by the server, %d refused' % (args.idle, idle['closed'], idle['refused']))
+        results['idle'] = idle
+
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump(results, f, indent=2)
+
+    return 1 if results['total']['requests'] == 0 else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,160 @@
+#!/usr/bin/env python3
+"""Times full against resumed TLS handshakes of the HTTPS listener.
+
+    tls_handshake_bench.py --host 192.168.4.1
+    tls_handshake_bench.py --host 192.168.4.1 -n 50 --json after.json --compare before.json
+    tls_handshake_bench.py --host 192.168.4.1 --tickets
+
+Opens one connection at a time and alternates a full handshake (no session
+offered) with one offering the last session it got, like a browser coming
+back to the page. Only the TLS handshake is timed, from the ClientHello to
+the server's Finished, not the TCP connect. Every connection is closed with
+close_notify, a server may drop sessions of connections that end without
+it. A resumption the server refused (an evicted or expired session) counts
+in "refused", its full handshake still goes into the resumed timings.
+
+TLS 1.2 is used, session ID resumption does not exist in TLS 1.3. Without
+--tickets no session ticket is asked for, so only the server's session ID
+cache can resume the session. The certificate is not verified unless
+--cafile is given.
+"""
+
+import argparse
+import json
+import socket
+import ssl
+import sys
+import time
+
+
+def make_context(args):
+    context = ssl.SSLContext(ssl.PROTOCOL_TLS_CLIENT)
+    context.minimum_version = ssl.TLSVersion.TLSv1_2
+    context.maximum_version = ssl.TLSVersion.TLSv1_2
+    # The device certificate names its address, which the client may reach differently
+    context.check_hostname = False
+    if args.cafile:
+        context.load_verify_locations(args.cafile)
+    else:
+        context.verify_mode = ssl.CERT_NONE
+    if not args.tickets:
+        context.options |= ssl.OP_NO_TICKET
+    return context
+
+
+def handshake(args, context, session=None):
+    """Returns (seconds, session, reused)."""
+    with socket.create_connection((args.host, args.port), timeout=args.timeout) as sock:
+        sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        tls = context.wrap_socket(sock, server_hostname=args.host, session=session, do_handshake_on_connect=False)
+        start = time.perf_counter()
+        tls.do_handshake()
+        elapsed = time.perf_counter() - start
+        result = (elapsed, tls.session, tls.session_reused)
+        try:
+            tls.unwrap()
+        except (OSError, ssl.SSLError):
+            pass
+        return result
+
+
+def summary(latencies, refused=0, errors=0):
+    lat = sorted(latencies)
+
+    def pct(p):
+        return lat[min(len(lat) - 1, int(p / 100.0 * len(lat)))] * 1000.0 if lat else 0.0
+
+    return {
+        'handshakes': len(lat),
+        'errors': errors,
+        'refused': refused,
+        'p50_ms': pct(50),
+        'p90_ms': pct(90),
+        'max_ms': lat[-1] * 1000.0 if lat else 0.0,
+        'mean_ms': 1000.0 * sum(lat) / len(lat) if lat else 0.0,
+    }
+
+
+def run(args):
+    context = make_context(args)
+    full, resumed = [], []
+    errors = {'full': 0, 'resumed': 0}
+    refused = 0
+    session = None
+
+    for _ in range(args.warmup):
+        _, session, _ = handshake(args, context)
+    for _ in range(args.count):
+        try:
+            elapsed, fresh, _ = handshake(args, context)
+            full.append(elapsed)
+            session = session or fresh
+        except (OSError, ssl.SSLError):
+            errors['full'] += 1
+        if session is None:
+            errors['resumed'] += 1
+            continue
+        try:
+            elapsed, fresh, reused = handshake(args, context, session)
+            resumed.append(elapsed)
+            if not reused:
+                # Evicted or expired on the server, offer the new session next time
+                refused += 1
+                session = fresh
+        except (OSError, ssl.SSLError):
+            errors['resumed'] += 1
+    return {'full': summary(full, 0, errors['full']), 'resumed': summary(resumed, refused, errors['resumed'])}
+
+
+def print_table(results, baseline=None):
+    print('%-8s %10s %6s %8s %9s %9s %9s %9s' % ('kind', 'handshakes', 'errors', 'refused', 'p50 ms', 'p90 ms',
+                                               'mean ms', 'max ms'))
+    for name, r in results.items():
+        print('%-8s %10d %6d %8d %9.2f %9.2f %9.2f %9.2f' % (name, r['handshakes'], r['errors'], r['refused'],
+                                                           r['p50_ms'], r['p90_ms'], r['mean_ms'], r['max_ms']))
+        if baseline and name in baseline:
+            b = baseline[name]
+
+            def delta(key):
+                return '%+.1f%%' % (100.0 * (r[key] - b[key]) / b[key]) if b[key] else 'n/a'
+
+            print('%-8s %10s %6s %8s %9s %9s %9s' % ('', 'vs base', '', '', delta('p50_ms'), delta('p90_ms'),
+                                                     delta('mean_ms')))
+    if results['full']['p50_ms'] and results['resumed']['handshakes']:
+        print('resumed p50 is %.0f%% of full, %d of %d resumptions refused' % (
+            100.0 * results['resumed']['p50_ms'] / results['full']['p50_ms'], results['resumed']['refused'],
+            results['resumed']['handshakes']))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--host', default='192.168.4.1')
+    parser.add_argument('--port', type=int, default=443)
+    parser.add_argument('-n', '--count', type=int, default=20, help='handshakes of each kind')
+    parser.add_argument('--warmup', type=int, default=1, help='untimed full handshakes first')
+    parser.add_argument('--timeout', type=float, default=10.0, help='per connection, seconds')
+    parser.add_argument('--tickets', action='store_true', help='accept session tickets, like a browser')
+    parser.add_argument('--cafile', help='verify the server certificate against this file')
+    parser.add_argument('--json', help='write the results to this file')
+    parser.add_argument('--compare', help='results of an earlier run to compare against')
+    args = parser.parse_args()
+
+    results = run(args)
+
+    baseline = None
+    if args.compare:
+        with open(args.compare) as f:
+            baseline = json.load(f)
+    print('%s:%d, %d handshakes of each kind, TLS 1.2, session %s' % (args.host, args.port, args.count,
+                                                                       'tickets' if args.tickets else 'IDs'))
+    print_table(results, baseline)
+
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump(results, f, indent=2)
+
+    return 1 if results['full']['handshakes'] == 0 else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())